@@ -1,19 +1,71 @@
 QT += core gui network
 QT += sql
+QT += concurrent
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 CONFIG += c++17
 
 SOURCES += \
+    chatrepository.cpp \
+    credentialpool.cpp \
+    deliveryqueue.cpp \
+    historycache.cpp \
+    hotrestart.cpp \
+    jsonenvelope.cpp \
     logger.cpp \
     main.cpp \
+    messagebus.cpp \
+    messagelog.cpp \
+    messagesequencer.cpp \
+    outboundqueue.cpp \
+    payloadcompressor.cpp \
+    presencehub.cpp \
+    ratelimiter.cpp \
+    requestarena.cpp \
+    requestschema.cpp \
+    reuseportlistener.cpp \
+    rsakeypool.cpp \
+    securechannel.cpp \
     serverlogic.cpp \
-    serverui.cpp
+    servermetrics.cpp \
+    serverui.cpp \
+    sessionregistry.cpp \
+    sessiontokens.cpp \
+    sqlitechatrepository.cpp \
+    tlslistener.cpp \
+    trafficcapture.cpp \
+    wireprotocol.cpp
 
 HEADERS += \
+    chatrepository.h \
+    credentialpool.h \
+    deliveryqueue.h \
+    historycache.h \
+    hotrestart.h \
+    jsonenvelope.h \
     logger.h \
+    messagebus.h \
+    messagelog.h \
+    messagesequencer.h \
+    outboundqueue.h \
+    payloadcompressor.h \
+    presencehub.h \
+    ratelimiter.h \
+    requestarena.h \
+    requestschema.h \
+    reuseportlistener.h \
+    rsakeypool.h \
+    securechannel.h \
     serverlogic.h \
-    serverui.h
+    servermetrics.h \
+    serverui.h \
+    sessionregistry.h \
+    sessiontokens.h \
+    sqlitechatrepository.h \
+    tlslistener.h \
+    tokenbucket.h \
+    trafficcapture.h \
+    wireprotocol.h
 
 FORMS +=
 
@@ -36,5 +88,13 @@ RESOURCES += \
 }
 INCLUDEPATH += $$PWD/Qt-Secret/src/Qt-RSA
 INCLUDEPATH += $$PWD/QtBigInt/src
+
+# Зашифрованные сессии используют qca (собирается отдельно): qmake CONFIG+=secure_sessions
+secure_sessions {
+    DEFINES += SERVER_HAVE_QCA
+    INCLUDEPATH += $$PWD/qca/include/QtCrypto
+    LIBS += -lqca-qt5
+}
+
 QT += network
 
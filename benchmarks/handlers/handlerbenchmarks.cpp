@@ -0,0 +1,494 @@
+/**
+ * /file handlerbenchmarks.cpp
+ * /brief Набор QBENCHMARK-замеров обработчиков ServerLogic на синтетической базе данных.
+ */
+
+#include "serverlogic.h"
+#include "memorychatrepository.h"
+#include "servermetrics.h"
+
+#include <QtTest>
+#include <QSqlQuery>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QTemporaryDir>
+#include <QLoggingCategory>
+
+/**
+ * /brief Класс SinkSocket.
+ *
+ * Сокет-заглушка, который принимает всё, что в него пишут обработчики, и только
+ * подсчитывает байты. Благодаря этому замеры не зависят от сети и от скорости клиента.
+ */
+class SinkSocket : public QTcpSocket
+{
+public:
+    qint64 sinkBytes = 0; ///< Количество байт, записанных обработчиками.
+
+    /**
+     * /brief Конструктор, открывающий сокет на запись без реального подключения.
+     *
+     * Сокет помечается подключённым, иначе исходящая очередь сервера отбросит ответы.
+     */
+    SinkSocket()
+    {
+        setOpenMode(QIODevice::ReadWrite);
+        setSocketState(QAbstractSocket::ConnectedState);
+    }
+
+protected:
+    /**
+     * /brief Принимает данные, не отправляя их в сеть.
+     * /param data Указатель на данные.
+     * /param len Длина данных.
+     * /return Количество принятых байт.
+     */
+    qint64 writeData(const char *data, qint64 len) override
+    {
+        Q_UNUSED(data);
+        sinkBytes += len;
+        return len;
+    }
+};
+
+/**
+ * /brief Класс HandlerBenchmarks.
+ *
+ * Заполняет временную базу SQLite синтетическими данными (10 000 пользователей, чаты
+ * разного размера вплоть до 100 000 сообщений) и замеряет обработчики ServerLogic
+ * без участия сети.
+ *
+ * Каждый замер выполняется дважды: с хранилищем SQLite и с хранилищем в памяти,
+ * загруженным из той же базы, поэтому видно, какая часть времени приходится на хранилище.
+ */
+class HandlerBenchmarks : public QObject
+{
+    Q_OBJECT
+
+private:
+    static const int userCount = 10000; ///< Количество синтетических пользователей.
+    static const int chatListSize = 200; ///< Количество личных чатов у пользователя user_00000.
+
+    QTemporaryDir tempDir; ///< Каталог с временной базой данных и журналом.
+    ServerLogic *server = nullptr; ///< Проверяемый экземпляр логики сервера.
+    SinkSocket sink; ///< Сокет-заглушка для ответов обработчиков.
+    MemoryChatRepository memoryRepository; ///< Хранилище в памяти с теми же данными.
+    QHash<int, int> chatIdBySize; ///< Идентификаторы чатов по количеству сообщений в них.
+
+    /**
+     * /brief Создаёт схему базы данных, совпадающую с рабочей.
+     */
+    void createSchema();
+
+    /**
+     * /brief Заполняет базу пользователями, чатами и сообщениями.
+     */
+    void seedData();
+
+    /**
+     * /brief Возвращает логин синтетического пользователя по номеру.
+     * /param index Номер пользователя.
+     * /return Логин пользователя.
+     */
+    static QString loginOf(int index)
+    {
+        return QString("user_%1").arg(index, 5, 10, QChar('0'));
+    }
+
+    /**
+     * /brief Заполняет таблицу данных для замеров, зависящих от размера чата.
+     */
+    void chatSizeData();
+
+private slots:
+    void initTestCase_data();
+    void initTestCase();
+    void cleanupTestCase();
+    void init();
+
+    void getChatList();
+    void getChatHistory_data();
+    void getChatHistory();
+    void getChatHistorySegments_data();
+    void getChatHistorySegments();
+    void getChatHistoryCached_data();
+    void getChatHistoryCached();
+    void markMessagesAsRead_data();
+    void markMessagesAsRead();
+    void findUsers();
+    void asyncChatHistory();
+    void encodeAck_data();
+    void encodeAck();
+    void parseRequest();
+    void scanRequest_data();
+    void scanRequest();
+    void sendMessage();
+};
+
+void HandlerBenchmarks::initTestCase_data()
+{
+    QTest::addColumn<QString>("storage");
+    QTest::newRow("sqlite") << "sqlite";
+    QTest::newRow("memory") << "memory";
+}
+
+void HandlerBenchmarks::initTestCase()
+{
+    //Отладочный вывод обработчиков заглушается, чтобы замерялась работа с базой, а не консоль
+    QLoggingCategory::setFilterRules("default.debug=false");
+    QVERIFY(tempDir.isValid());
+    Logger::getInstance()->setLogFile(tempDir.filePath("bench_log.txt"));
+
+    server = new ServerLogic(tempDir.filePath("bench.db"));
+    createSchema();
+    seedData();
+    //Схема создаётся после конструктора, поэтому индексы сообщений добавляются повторным открытием
+    QVERIFY(server->sqliteRepository.open(server->database));
+    QVERIFY2(memoryRepository.load(server->database), qPrintable(memoryRepository.lastError()));
+}
+
+void HandlerBenchmarks::init()
+{
+    QFETCH_GLOBAL(QString, storage);
+    server->useRepository(storage == "memory" ? static_cast<ChatRepository*>(&memoryRepository) : nullptr);
+    //Кэш истории включается только в своём замере, остальные читают хранилище
+    server->historyCache.configure(0, 0);
+}
+
+void HandlerBenchmarks::cleanupTestCase()
+{
+    delete server;
+    server = nullptr;
+}
+
+void HandlerBenchmarks::createSchema()
+{
+    QSqlQuery query(server->database);
+    const QStringList statements = {
+        "CREATE TABLE user_auth (user_id INTEGER PRIMARY KEY AUTOINCREMENT, login TEXT UNIQUE NOT NULL, "
+        "password TEXT NOT NULL, nickname TEXT)",
+        "CREATE TABLE chats (chat_id INTEGER PRIMARY KEY AUTOINCREMENT, chat_name TEXT, chat_type TEXT)",
+        "CREATE TABLE chat_participants (chat_id INTEGER REFERENCES chats(chat_id) ON DELETE CASCADE, "
+        "user_id INTEGER REFERENCES user_auth(user_id), PRIMARY KEY (chat_id, user_id))",
+        "CREATE TABLE messages (message_id INTEGER PRIMARY KEY AUTOINCREMENT, chat_id INTEGER, user_id INTEGER, "
+        "message_text TEXT, timestamp_sent TEXT, client_msg_id TEXT, chat_seq INTEGER)",
+        "CREATE TABLE message_read_status (message_id INTEGER, user_id INTEGER, timestamp_read TEXT, "
+        "PRIMARY KEY (message_id, user_id))"
+    };
+    for (const QString &statement : statements)
+    {
+        QVERIFY2(query.exec(statement), qPrintable(query.lastError().text()));
+    }
+}
+
+void HandlerBenchmarks::seedData()
+{
+    QSqlDatabase &db = server->database;
+    QVERIFY(db.transaction());
+
+    QSqlQuery userQuery(db);
+    userQuery.prepare("INSERT INTO user_auth (user_id, login, password, nickname) VALUES (?, ?, ?, ?)");
+    for (int i = 0; i < userCount; ++i)
+    {
+        userQuery.addBindValue(i + 1);
+        userQuery.addBindValue(loginOf(i));
+        userQuery.addBindValue(QString(128, QChar('a' + i % 26)));
+        userQuery.addBindValue(QString("Nick %1").arg(i));
+        QVERIFY(userQuery.exec());
+    }
+
+    //Личные чаты user_00000 с пользователями 1..chatListSize; размеры первых чатов заданы явно
+    const QList<int> sizedChats = {100, 1000, 10000, 100000};
+    QSqlQuery chatQuery(db);
+    QSqlQuery participantQuery(db);
+    QSqlQuery messageQuery(db);
+    chatQuery.prepare("INSERT INTO chats (chat_name, chat_type) VALUES (?, 'personal')");
+    participantQuery.prepare("INSERT INTO chat_participants (chat_id, user_id) VALUES (?, ?)");
+    messageQuery.prepare("INSERT INTO messages (chat_id, user_id, message_text, timestamp_sent, chat_seq) VALUES (?, ?, ?, ?, ?)");
+    for (int peer = 1; peer <= chatListSize; ++peer)
+    {
+        chatQuery.addBindValue(loginOf(0) + loginOf(peer));
+        QVERIFY(chatQuery.exec());
+        int chatId = chatQuery.lastInsertId().toInt();
+        for (int userId : {1, peer + 1})
+        {
+            participantQuery.addBindValue(chatId);
+            participantQuery.addBindValue(userId);
+            QVERIFY(participantQuery.exec());
+        }
+
+        int messageCount = peer <= sizedChats.size() ? sizedChats[peer - 1] : 20;
+        chatIdBySize.insert(messageCount, chatId);
+        QDateTime timestamp(QDate(2024, 1, 1), QTime(0, 0));
+        for (int m = 0; m < messageCount; ++m)
+        {
+            messageQuery.addBindValue(chatId);
+            messageQuery.addBindValue(m % 2 == 0 ? 1 : peer + 1);
+            messageQuery.addBindValue(QString("Synthetic message %1 with some typical chat text").arg(m));
+            messageQuery.addBindValue(timestamp.addSecs(m).toString(Qt::ISODate));
+            messageQuery.addBindValue(m + 1);
+            QVERIFY(messageQuery.exec());
+        }
+    }
+
+    QVERIFY(db.commit());
+}
+
+void HandlerBenchmarks::getChatList()
+{
+    LoginRequest request;
+    request.login = loginOf(0);
+    QBENCHMARK
+    {
+        server->handleGetChatList(&sink, request);
+    }
+}
+
+void HandlerBenchmarks::chatSizeData()
+{
+    QTest::addColumn<int>("chatId");
+    for (int size : {100, 1000, 10000, 100000})
+    {
+        QTest::newRow(qPrintable(QString("%1 messages").arg(size))) << chatIdBySize.value(size);
+    }
+}
+
+void HandlerBenchmarks::getChatHistory_data()
+{
+    chatSizeData();
+}
+
+void HandlerBenchmarks::getChatHistory()
+{
+    QFETCH(int, chatId);
+    ChatHistoryRequest request;
+    request.chatId = chatId;
+    request.login = loginOf(0);
+    QBENCHMARK
+    {
+        server->handleGetChatHistory(&sink, request);
+    }
+}
+
+void HandlerBenchmarks::getChatHistorySegments_data()
+{
+    chatSizeData();
+}
+
+void HandlerBenchmarks::getChatHistorySegments()
+{
+    QFETCH(int, chatId);
+    ChatHistoryRequest request;
+    request.chatId = chatId;
+    request.login = loginOf(0);
+    if (server->repository != &server->sqliteRepository)
+    {
+        QSKIP("History segments are filled from the SQLite messages table");
+    }
+    QVERIFY(server->messageLog.open(server->database, tempDir.filePath("segments")));
+    //Первый запрос создаёт сегмент чата из базы данных и в замер не входит
+    server->handleGetChatHistory(&sink, request);
+    QBENCHMARK
+    {
+        server->handleGetChatHistory(&sink, request);
+    }
+    server->messageLog.close();
+}
+
+void HandlerBenchmarks::getChatHistoryCached_data()
+{
+    chatSizeData();
+}
+
+void HandlerBenchmarks::getChatHistoryCached()
+{
+    QFETCH(int, chatId);
+    ChatHistoryRequest request;
+    request.chatId = chatId;
+    request.login = loginOf(0);
+    //Лимит с запасом, чтобы в кэш попала вся история самого большого чата
+    server->historyCache.configure(512 * 1024 * 1024, 200000);
+    //Первый запрос читает историю из хранилища и заполняет кэш
+    server->handleGetChatHistory(&sink, request);
+    QBENCHMARK
+    {
+        server->handleGetChatHistory(&sink, request);
+    }
+    QCOMPARE(ServerMetrics::getInstance()->value("history.cache_chats"), 1.0);
+}
+
+void HandlerBenchmarks::markMessagesAsRead_data()
+{
+    chatSizeData();
+}
+
+void HandlerBenchmarks::markMessagesAsRead()
+{
+    QFETCH(int, chatId);
+    QBENCHMARK
+    {
+        server->markMessagesAsRead(chatId, 1);
+    }
+}
+
+void HandlerBenchmarks::findUsers()
+{
+    FindUsersRequest request;
+    request.searchText = "Nick 12";
+    request.login = loginOf(0);
+    QBENCHMARK
+    {
+        server->handleFindUsers(&sink, request);
+    }
+}
+
+void HandlerBenchmarks::asyncChatHistory()
+{
+    //Одинаковая параллельная нагрузка на хранилище: чтение истории из нескольких потоков пула
+    ChatRepository *repository = server->repository;
+    repository->setAsyncThreads(4);
+    int chatId = chatIdBySize.value(1000);
+    QBENCHMARK
+    {
+        QVector<QFuture<int>> calls;
+        for (int i = 0; i < 16; ++i)
+        {
+            calls.append(repository->async([chatId](ChatRepository &storage)
+            {
+                int count = 0;
+                storage.history(chatId, 0, [&count](const ChatRepository::MessageRecord &) { ++count; });
+                return count;
+            }));
+        }
+        for (QFuture<int> &call : calls)
+        {
+            QVERIFY(call.result() >= 1000);
+        }
+    }
+}
+
+void HandlerBenchmarks::encodeAck_data()
+{
+    QTest::addColumn<bool>("writer");
+    QTest::newRow("qjsonobject") << false;
+    QTest::newRow("responsewriter") << true;
+}
+
+void HandlerBenchmarks::encodeAck()
+{
+    //Сборка подтверждения send_message прежним способом и через буфер подключения
+    QFETCH(bool, writer);
+    QByteArray buffer;
+    buffer.reserve(256);
+    QByteArray expected = WireProtocol::encode(QJsonObject{{"type", "send_message"}, {"status", "success"},
+                                                           {"message_id", 123456}, {"seq", qint64(789)}}, WireEncoding::Json);
+    QBENCHMARK
+    {
+        if (writer)
+        {
+            ResponseWriter response(buffer, WireEncoding::Json, 4);
+            response.field("message_id", 123456).field("seq", qint64(789)).field("status", "success").field("type", "send_message");
+            response.finish();
+        }
+        else
+        {
+            buffer = WireProtocol::encode(QJsonObject{{"type", "send_message"}, {"status", "success"},
+                                                      {"message_id", 123456}, {"seq", qint64(789)}}, WireEncoding::Json);
+        }
+    }
+    QCOMPARE(buffer, expected);
+}
+
+void HandlerBenchmarks::parseRequest()
+{
+    //Проверка и извлечение полей send_message по схеме за один проход
+    QJsonObject json{{"type", "send_message"}, {"chat_id", "42"}, {"user_id", loginOf(0)},
+                     {"message_text", "Benchmark message"}, {"timestamp", "2024-06-01T12:00:00"}};
+    SendMessageRequest request;
+    RequestError error;
+    QBENCHMARK
+    {
+        request = SendMessageRequest();
+        QVERIFY(RequestParser::parse(json, request, error));
+    }
+    QCOMPARE(request.chatId, 42);
+    QCOMPARE(request.userLogin, loginOf(0));
+
+    json.remove("message_text");
+    QVERIFY(!RequestParser::parse(json, request, error));
+    QCOMPARE(QString(error.field), QString("message_text"));
+}
+
+void HandlerBenchmarks::scanRequest_data()
+{
+    QTest::addColumn<bool>("envelope");
+    QTest::addColumn<bool>("arena");
+    QTest::newRow("qjsondocument") << false << false;
+    QTest::newRow("jsonenvelope") << true << false;
+    QTest::newRow("jsonenvelope_arena") << true << true;
+}
+
+void HandlerBenchmarks::scanRequest()
+{
+    //Разбор send_message с многострочным текстом в 1 КБ: прежний путь через QJsonDocument и проход
+    //JsonEnvelope с черновым буфером в куче или в арене запроса
+    QFETCH(bool, envelope);
+    QFETCH(bool, arena);
+    QString text = QString("Benchmark message\n").repeated(57);
+    RequestArena requestArena;
+    QByteArray data = QJsonDocument(QJsonObject{{"type", "send_message"}, {"chat_id", "42"}, {"user_id", loginOf(0)},
+                                                {"message_text", text}, {"timestamp", "2024-06-01T12:00:00"}}).toJson(QJsonDocument::Compact);
+    SendMessageRequest request;
+    RequestError error;
+    QBENCHMARK
+    {
+        if (envelope)
+        {
+            RequestArena::Scope arenaScope(requestArena);
+            JsonEnvelope scanned(arena ? &requestArena : nullptr);
+            QVERIFY(scanned.scan(data));
+            QVERIFY(RequestParser::parse(scanned, request, error));
+        }
+        else
+        {
+            QJsonObject json;
+            QVERIFY(WireProtocol::decode(data, json));
+            QVERIFY(RequestParser::parse(json, request, error));
+        }
+    }
+    QCOMPARE(request.chatId, 42);
+    QCOMPARE(request.messageText, text);
+}
+
+void HandlerBenchmarks::sendMessage()
+{
+    SendMessageRequest request;
+    request.chatId = chatIdBySize.value(1000);
+    request.userLogin = loginOf(0);
+    request.messageText = "Benchmark message";
+    request.timestamp = "2024-06-01T12:00:00";
+    QBENCHMARK
+    {
+        server->handleSendMessage(&sink, request);
+    }
+}
+
+/**
+ * /brief Точка входа набора замеров.
+ *
+ * Если путь вывода не задан аргументами, результаты дополнительно сохраняются
+ * в машиночитаемом виде (handler_benchmarks.xml) для отслеживания регрессий.
+ */
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QStringList args = app.arguments();
+    if (!args.contains("-o"))
+    {
+        args << "-o" << "handler_benchmarks.xml,xml" << "-o" << "-,txt";
+    }
+    HandlerBenchmarks benchmarks;
+    return QTest::qExec(&benchmarks, args);
+}
+
+#include "handlerbenchmarks.moc"
@@ -0,0 +1,84 @@
+QT += core network sql testlib concurrent
+QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = handlerbenchmarks
+
+SERVER_DIR = $$PWD/../..
+INCLUDEPATH += $$SERVER_DIR
+
+SOURCES += \
+    $$SERVER_DIR/chatrepository.cpp \
+    $$SERVER_DIR/credentialpool.cpp \
+    $$SERVER_DIR/deliveryqueue.cpp \
+    $$SERVER_DIR/historycache.cpp \
+    $$SERVER_DIR/hotrestart.cpp \
+    $$SERVER_DIR/jsonenvelope.cpp \
+    $$SERVER_DIR/logger.cpp \
+    $$SERVER_DIR/memorychatrepository.cpp \
+    $$SERVER_DIR/messagebus.cpp \
+    $$SERVER_DIR/messagelog.cpp \
+    $$SERVER_DIR/messagesequencer.cpp \
+    $$SERVER_DIR/outboundqueue.cpp \
+    $$SERVER_DIR/payloadcompressor.cpp \
+    $$SERVER_DIR/presencehub.cpp \
+    $$SERVER_DIR/ratelimiter.cpp \
+    $$SERVER_DIR/requestarena.cpp \
+    $$SERVER_DIR/requestschema.cpp \
+    $$SERVER_DIR/reuseportlistener.cpp \
+    $$SERVER_DIR/rsakeypool.cpp \
+    $$SERVER_DIR/securechannel.cpp \
+    $$SERVER_DIR/serverlogic.cpp \
+    $$SERVER_DIR/servermetrics.cpp \
+    $$SERVER_DIR/sessionregistry.cpp \
+    $$SERVER_DIR/sessiontokens.cpp \
+    $$SERVER_DIR/sqlitechatrepository.cpp \
+    $$SERVER_DIR/tlslistener.cpp \
+    $$SERVER_DIR/trafficcapture.cpp \
+    $$SERVER_DIR/wireprotocol.cpp \
+    handlerbenchmarks.cpp
+
+HEADERS += \
+    $$SERVER_DIR/chatrepository.h \
+    $$SERVER_DIR/credentialpool.h \
+    $$SERVER_DIR/deliveryqueue.h \
+    $$SERVER_DIR/historycache.h \
+    $$SERVER_DIR/hotrestart.h \
+    $$SERVER_DIR/jsonenvelope.h \
+    $$SERVER_DIR/logger.h \
+    $$SERVER_DIR/memorychatrepository.h \
+    $$SERVER_DIR/messagebus.h \
+    $$SERVER_DIR/messagelog.h \
+    $$SERVER_DIR/messagesequencer.h \
+    $$SERVER_DIR/outboundqueue.h \
+    $$SERVER_DIR/payloadcompressor.h \
+    $$SERVER_DIR/presencehub.h \
+    $$SERVER_DIR/ratelimiter.h \
+    $$SERVER_DIR/requestarena.h \
+    $$SERVER_DIR/requestschema.h \
+    $$SERVER_DIR/reuseportlistener.h \
+    $$SERVER_DIR/rsakeypool.h \
+    $$SERVER_DIR/securechannel.h \
+    $$SERVER_DIR/serverlogic.h \
+    $$SERVER_DIR/servermetrics.h \
+    $$SERVER_DIR/sessionregistry.h \
+    $$SERVER_DIR/sessiontokens.h \
+    $$SERVER_DIR/sqlitechatrepository.h \
+    $$SERVER_DIR/tlslistener.h \
+    $$SERVER_DIR/tokenbucket.h \
+    $$SERVER_DIR/trafficcapture.h \
+    $$SERVER_DIR/wireprotocol.h
+
+# Условное подключение GMP.pri
+!exists($$SERVER_DIR/QtBigInt/GMP.pri): {
+    include($$SERVER_DIR/QtBigInt/GMP.pri)
+}
+
+# Условное подключение Qt-Secret.pri
+!exists($$SERVER_DIR/Qt-Secret/src/Qt-Secret.pri): {
+    include($$SERVER_DIR/Qt-Secret/src/Qt-Secret.pri)
+}
+INCLUDEPATH += $$SERVER_DIR/Qt-Secret/src/Qt-RSA
+INCLUDEPATH += $$SERVER_DIR/QtBigInt/src
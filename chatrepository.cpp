@@ -0,0 +1,59 @@
+#include "chatrepository.h"
+
+/**
+ * @brief Конструктор класса ChatRepository.
+ *
+ * Потоки пула не завершаются при простое: реализации могут держать в них собственные
+ * подключения к хранилищу.
+ */
+ChatRepository::ChatRepository()
+{
+    asyncPool.setMaxThreadCount(1);
+    asyncPool.setExpiryTimeout(-1);
+}
+
+/**
+ * @brief Деструктор класса ChatRepository.
+ */
+ChatRepository::~ChatRepository()
+{
+    asyncPool.waitForDone();
+}
+
+/**
+ * @brief Задаёт количество потоков для асинхронных вызовов.
+ *
+ * @param threads Количество потоков.
+ */
+void ChatRepository::setAsyncThreads(int threads)
+{
+    asyncPool.setMaxThreadCount(qMax(1, threads));
+}
+
+/**
+ * @brief Дожидается завершения асинхронных вызовов.
+ */
+void ChatRepository::waitForAsyncCalls()
+{
+    asyncPool.waitForDone();
+}
+
+/**
+ * @brief Запоминает текст ошибки последнего вызова в текущем потоке.
+ *
+ * @param error Текст ошибки.
+ */
+void ChatRepository::setLastError(const QString &error)
+{
+    errors.setLocalData(error);
+}
+
+/**
+ * @brief Возвращает текст ошибки последнего неудачного вызова в текущем потоке.
+ *
+ * @return QString Текст ошибки.
+ */
+QString ChatRepository::lastError() const
+{
+    return errors.hasLocalData() ? errors.localData() : QString();
+}
@@ -0,0 +1,375 @@
+/**
+ * /file chatrepository.h
+ * /brief Определение интерфейса ChatRepository для хранения пользователей, чатов и сообщений.
+ */
+
+#ifndef CHATREPOSITORY_H
+#define CHATREPOSITORY_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QThreadPool>
+#include <QThreadStorage>
+#include <QFuture>
+#include <QtConcurrent/QtConcurrentRun>
+#include <functional>
+#include <utility>
+
+/**
+ * /brief Класс ChatRepository.
+ *
+ * Интерфейс хранилища, через который ServerLogic работает с пользователями, чатами,
+ * участниками, сообщениями и отметками о прочтении, не зная, как они хранятся.
+ * Основная реализация — SqliteChatRepository (таблицы базы сервера), для замеров
+ * и проверок есть MemoryChatRepository.
+ *
+ * Методы вызываются синхронно из потока событий. Любой из них можно выполнить и
+ * асинхронно функцией async(): вызов выполняется в собственном пуле потоков хранилища,
+ * поэтому разные реализации сравниваются под одинаковой параллельной нагрузкой.
+ * Для обращений сразу к нескольким чатам предусмотрены пакетные методы.
+ */
+class ChatRepository
+{
+public:
+    /**
+     * /brief Учётная запись пользователя.
+     */
+    struct UserRecord
+    {
+        int userId = -1; ///< Идентификатор пользователя.
+        QString login; ///< Логин.
+        QString password; ///< Хеш пароля.
+        QString nickname; ///< Отображаемое имя.
+        qint64 tokensRevokedAt = 0; ///< Момент последнего отзыва токенов сессии (секунды с начала эпохи).
+    };
+
+    /**
+     * /brief Элемент списка чатов пользователя.
+     */
+    struct ChatSummary
+    {
+        int chatId = -1; ///< Идентификатор чата.
+        QString title; ///< Имя собеседника (личный чат) или название группы.
+        QString chatType; ///< Тип чата (personal или group).
+        int unreadCount = 0; ///< Количество непрочитанных сообщений.
+    };
+
+    /**
+     * /brief Сообщение чата.
+     */
+    struct MessageRecord
+    {
+        int messageId = -1; ///< Идентификатор сообщения.
+        int chatId = -1; ///< Идентификатор чата.
+        int userId = -1; ///< Идентификатор отправителя.
+        QString senderLogin; ///< Логин отправителя (заполняется при чтении истории).
+        QString text; ///< Текст сообщения.
+        QString timestamp; ///< Время отправки.
+        QString clientMessageId; ///< Идентификатор сообщения клиента (может быть пустым).
+        qint64 seq = 0; ///< Порядковый номер сообщения в чате.
+    };
+
+    using MessageVisitor = std::function<void(const MessageRecord &message)>; ///< Обработчик очередного сообщения истории.
+    using UserVisitor = std::function<void(const UserRecord &user)>; ///< Обработчик очередного найденного пользователя.
+
+private:
+    QThreadPool asyncPool; ///< Пул потоков для асинхронных вызовов.
+    QThreadStorage<QString> errors; ///< Текст последней ошибки в каждом потоке.
+
+protected:
+    /**
+     * /brief Запоминает текст ошибки последнего вызова в текущем потоке.
+     * /param error Текст ошибки.
+     */
+    void setLastError(const QString &error);
+
+    /**
+     * /brief Дожидается завершения асинхронных вызовов.
+     *
+     * Вызывается из деструкторов реализаций, пока их данные ещё не удалены.
+     */
+    void waitForAsyncCalls();
+
+public:
+    /**
+     * /brief Конструктор, создающий пул асинхронных вызовов из одного потока.
+     */
+    ChatRepository();
+
+    /**
+     * /brief Деструктор.
+     */
+    virtual ~ChatRepository();
+
+    ChatRepository(const ChatRepository&) = delete;
+    ChatRepository &operator=(const ChatRepository&) = delete;
+
+    /**
+     * /brief Задаёт количество потоков для асинхронных вызовов.
+     * /param threads Количество потоков.
+     */
+    void setAsyncThreads(int threads);
+
+    /**
+     * /brief Выполняет вызов хранилища в пуле потоков.
+     *
+     * Пример: repository.async([](ChatRepository &r) { return r.userIdByLogin("alice"); }).
+     *
+     * /param call Функция, получающая хранилище.
+     * /return Будущий результат вызова.
+     */
+    template<typename Call>
+    auto async(Call call) -> QFuture<decltype(call(std::declval<ChatRepository&>()))>
+    {
+        return QtConcurrent::run(&asyncPool, [this, call]() { return call(*this); });
+    }
+
+    /**
+     * /brief Возвращает текст ошибки последнего неудачного вызова в текущем потоке.
+     * /return Текст ошибки.
+     */
+    QString lastError() const;
+
+    /**
+     * /brief Возвращает имя реализации хранилища (для журнала и замеров).
+     * /return Имя реализации.
+     */
+    virtual QString engineName() const = 0;
+
+    /**
+     * /brief Проверяет, свободен ли логин.
+     * /param login Логин.
+     * /return Признак свободного логина (false и при ошибке хранилища).
+     */
+    virtual bool isLoginAvailable(const QString &login) = 0;
+
+    /**
+     * /brief Возвращает идентификатор пользователя по логину.
+     * /param login Логин.
+     * /return Идентификатор или -1, если пользователь не найден.
+     */
+    virtual int userIdByLogin(const QString &login) = 0;
+
+    /**
+     * /brief Ищет учётную запись по логину.
+     * /param login Логин.
+     * /param user Найденная учётная запись.
+     * /return Признак того, что пользователь найден.
+     */
+    virtual bool findUser(const QString &login, UserRecord &user) = 0;
+
+    /**
+     * /brief Создаёт пользователя.
+     * /param login Логин.
+     * /param password Хеш пароля.
+     * /param nickname Отображаемое имя.
+     * /return Идентификатор нового пользователя или -1 (в том числе если логин занят).
+     */
+    virtual int createUser(const QString &login, const QString &password, const QString &nickname) = 0;
+
+    /**
+     * /brief Заменяет хеш пароля пользователя.
+     * /param login Логин.
+     * /param password Новый хеш пароля.
+     * /return Признак успешной записи.
+     */
+    virtual bool updatePassword(const QString &login, const QString &password) = 0;
+
+    /**
+     * /brief Заменяет хеш пароля, только если он не изменился с момента чтения.
+     * /param userId Идентификатор пользователя.
+     * /param oldPassword Прочитанный хеш пароля.
+     * /param newPassword Новый хеш пароля.
+     * /return Признак того, что хеш заменён.
+     */
+    virtual bool upgradePassword(int userId, const QString &oldPassword, const QString &newPassword) = 0;
+
+    /**
+     * /brief Меняет логин и хеш пароля пользователя.
+     * /param oldLogin Прежний логин.
+     * /param newLogin Новый логин.
+     * /param password Новый хеш пароля.
+     * /return Признак успешной записи.
+     */
+    virtual bool updateLogin(const QString &oldLogin, const QString &newLogin, const QString &password) = 0;
+
+    /**
+     * /brief Меняет отображаемое имя пользователя.
+     * /param login Логин.
+     * /param nickname Новое имя.
+     * /return Признак успешной записи.
+     */
+    virtual bool updateNickname(const QString &login, const QString &nickname) = 0;
+
+    /**
+     * /brief Отзывает токены сессии пользователя, выданные до указанного момента.
+     * /param userId Идентификатор пользователя.
+     * /param revokedAt Момент отзыва (секунды с начала эпохи).
+     * /return Признак успешной записи.
+     */
+    virtual bool revokeTokens(int userId, qint64 revokedAt) = 0;
+
+    /**
+     * /brief Читает моменты отзыва токенов сессии всех пользователей, у которых они отзывались.
+     * /param revokedAt Моменты отзыва (секунды с начала эпохи) по идентификаторам пользователей.
+     * /return Признак успешного чтения.
+     */
+    virtual bool tokenRevocations(QHash<int, qint64> &revokedAt) = 0;
+
+    /**
+     * /brief Ищет пользователей по части отображаемого имени.
+     * /param nicknamePart Часть имени (без учёта регистра).
+     * /param exceptLogin Логин, исключаемый из результатов.
+     * /param visit Обработчик найденных пользователей (вызывается только при успешном поиске).
+     * /return Признак успешного поиска.
+     */
+    virtual bool findUsers(const QString &nicknamePart, const QString &exceptLogin, const UserVisitor &visit) = 0;
+
+    /**
+     * /brief Ищет чат по одному из названий.
+     * /param names Возможные названия чата.
+     * /return Идентификатор первого найденного чата или -1, если чата нет.
+     */
+    virtual int chatIdByName(const QStringList &names) = 0;
+
+    /**
+     * /brief Создаёт чат без участников.
+     * /param name Название чата.
+     * /param chatType Тип чата (personal или group).
+     * /return Идентификатор нового чата или -1.
+     */
+    virtual int createChat(const QString &name, const QString &chatType) = 0;
+
+    /**
+     * /brief Добавляет в чат пользователей с указанными логинами.
+     *
+     * Несуществующие логины пропускаются.
+     *
+     * /param chatId Идентификатор чата.
+     * /param logins Логины участников.
+     * /return Признак успешной записи.
+     */
+    virtual bool addParticipants(int chatId, const QStringList &logins) = 0;
+
+    /**
+     * /brief Удаляет чат.
+     * /param chatId Идентификатор чата.
+     * /return Признак успешного удаления.
+     */
+    virtual bool deleteChat(int chatId) = 0;
+
+    /**
+     * /brief Возвращает участников чата.
+     * /param chatId Идентификатор чата.
+     * /param userIds Идентификаторы участников.
+     * /return Признак успешного чтения.
+     */
+    virtual bool participants(int chatId, QVector<int> &userIds) = 0;
+
+    /**
+     * /brief Возвращает участников нескольких чатов одним обращением.
+     * /param chatIds Идентификаторы чатов.
+     * /param members Участники по чатам.
+     * /return Признак успешного чтения.
+     */
+    virtual bool participants(const QVector<int> &chatIds, QHash<int, QVector<int>> &members) = 0;
+
+    /**
+     * /brief Возвращает чаты пользователя.
+     * /param userId Идентификатор пользователя.
+     * /param chatIds Идентификаторы чатов.
+     * /return Признак успешного чтения.
+     */
+    virtual bool chatsOf(int userId, QVector<int> &chatIds) = 0;
+
+    /**
+     * /brief Возвращает чаты пользователя вместе с их участниками одним обращением.
+     * /param userId Идентификатор пользователя.
+     * /param members Участники по чатам.
+     * /return Признак успешного чтения.
+     */
+    virtual bool membershipsOf(int userId, QHash<int, QVector<int>> &members) = 0;
+
+    /**
+     * /brief Дописывает личные чаты пользователя в список (название — имя собеседника).
+     * /param login Логин пользователя.
+     * /param chats Список чатов.
+     * /return Признак успешного чтения.
+     */
+    virtual bool personalChats(const QString &login, QVector<ChatSummary> &chats) = 0;
+
+    /**
+     * /brief Дописывает групповые чаты пользователя в список.
+     * /param login Логин пользователя.
+     * /param chats Список чатов.
+     * /return Признак успешного чтения.
+     */
+    virtual bool groupChats(const QString &login, QVector<ChatSummary> &chats) = 0;
+
+    /**
+     * /brief Заполняет количество непрочитанных сообщений для всех чатов списка.
+     *
+     * Чаты, для которых количество прочитать не удалось, удаляются из списка.
+     *
+     * /param login Логин пользователя.
+     * /param chats Список чатов.
+     */
+    virtual void countUnread(const QString &login, QVector<ChatSummary> &chats) = 0;
+
+    /**
+     * /brief Возвращает последний номер сообщения в чате.
+     * /param chatId Идентификатор чата.
+     * /return Номер последнего сообщения (0, если сообщений нет).
+     */
+    virtual qint64 lastSeq(int chatId) = 0;
+
+    /**
+     * /brief Сохраняет сообщение.
+     *
+     * Если номер сообщения не задан (seq <= 0), хранилище присваивает следующий номер
+     * чата в той же операции записи. Повтор идентификатора клиента отклоняется.
+     *
+     * /param message Сообщение; заполняются messageId и seq.
+     * /return Признак успешной записи.
+     */
+    virtual bool insertMessage(MessageRecord &message) = 0;
+
+    /**
+     * /brief Сохраняет несколько сообщений одной операцией записи.
+     * /param messages Сообщения; заполняются messageId и seq.
+     * /return Признак того, что сохранены все сообщения.
+     */
+    virtual bool insertMessages(QVector<MessageRecord> &messages) = 0;
+
+    /**
+     * /brief Ищет сообщение по идентификатору клиента.
+     * /param chatId Идентификатор чата.
+     * /param userId Идентификатор отправителя.
+     * /param clientMessageId Идентификатор сообщения клиента.
+     * /param message Найденное сообщение (messageId и seq).
+     * /return Признак того, что сообщение найдено.
+     */
+    virtual bool findMessage(int chatId, int userId, const QString &clientMessageId, MessageRecord &message) = 0;
+
+    /**
+     * /brief Выдаёт историю чата в порядке отправки.
+     * /param chatId Идентификатор чата.
+     * /param afterSeq Номер, после которого выдаются сообщения (0 — вся история).
+     * /param visit Обработчик сообщений (вызывается только при успешном чтении).
+     * /return Признак успешного чтения.
+     */
+    virtual bool history(int chatId, qint64 afterSeq, const MessageVisitor &visit) = 0;
+
+    /**
+     * /brief Отмечает прочитанными сообщения чата, отправленные другими участниками.
+     * /param chatId Идентификатор чата.
+     * /param userId Идентификатор читателя.
+     * /param messageIds Идентификаторы отмеченных сообщений.
+     * /return Признак успешного чтения сообщений чата.
+     */
+    virtual bool markChatRead(int chatId, int userId, QVector<int> &messageIds) = 0;
+};
+
+#endif // CHATREPOSITORY_H
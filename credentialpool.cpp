@@ -0,0 +1,278 @@
+#include "credentialpool.h"
+#include "servermetrics.h"
+
+#include <QtConcurrent>
+#include <QFutureWatcher>
+#include <QPasswordDigestor>
+#include <QCryptographicHash>
+#include <QRandomGenerator>
+#include <QPointer>
+#include <QVector>
+
+namespace
+{
+const int saltSize = 16; ///< Размер соли в байтах.
+const int keySize = 64; ///< Размер выводимого ключа в байтах.
+
+/**
+ * @brief Вычисляет ключ PBKDF2-HMAC-SHA512.
+ *
+ * @param credential Пароль.
+ * @param salt Соль.
+ * @param iterations Количество итераций.
+ * @return QByteArray Ключ.
+ */
+QByteArray pbkdf2(const QString &credential, const QByteArray &salt, int iterations)
+{
+    return QPasswordDigestor::deriveKeyPbkdf2(QCryptographicHash::Sha512, credential.toUtf8(), salt, iterations, keySize);
+}
+}
+
+/**
+ * @brief Сравнивает массивы за время, не зависящее от места первого расхождения.
+ *
+ * @param a Первый массив.
+ * @param b Второй массив.
+ * @return true Если массивы совпадают.
+ */
+bool CredentialPool::constantTimeEquals(const QByteArray &a, const QByteArray &b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    char diff = 0;
+    for (int i = 0; i < a.size(); ++i)
+    {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
+
+/**
+ * @brief Конструктор класса CredentialPool.
+ *
+ * @param parent Указатель на родительский объект (по умолчанию nullptr).
+ */
+CredentialPool::CredentialPool(QObject *parent) : QObject(parent)
+{
+    pool.setMaxThreadCount(2);
+}
+
+/**
+ * @brief Задаёт параметры пула.
+ *
+ * @param threads Количество потоков.
+ * @param maxPerPeer Предел незавершённых операций для одного IP-адреса.
+ * @param maxQueued Общий предел незавершённых операций.
+ * @param iterations Количество итераций PBKDF2.
+ */
+void CredentialPool::configure(int threads, int maxPerPeer, int maxQueued, int iterations)
+{
+    pool.setMaxThreadCount(qMax(1, threads));
+    this->maxPerPeer = qMax(1, maxPerPeer);
+    this->maxQueued = qMax(1, maxQueued);
+    this->iterations = qMax(1000, iterations);
+}
+
+/**
+ * @brief Ставит операцию в пул с учётом ограничений.
+ *
+ * Счётчики незавершённых операций освобождаются до вызова обработчика, поэтому
+ * обработчик может сразу поставить следующую операцию для того же клиента.
+ *
+ * @param socket Сокет клиента.
+ * @param work Операция, выполняемая в пуле.
+ * @param done Обработчик результата.
+ * @return true Если операция принята.
+ * @return false Если превышен предел для IP-адреса или общий предел.
+ */
+bool CredentialPool::submit(QTcpSocket *socket, std::function<Outcome()> work, Callback done)
+{
+    QString peer = socket->peerAddress().toString();
+    if (inflightTotal >= maxQueued || inflightByPeer.value(peer) >= maxPerPeer)
+    {
+        ServerMetrics::getInstance()->add("auth.rejected");
+        return false;
+    }
+    inflightTotal++;
+    inflightByPeer[peer]++;
+    inflightBySocket[socket]++;
+    ServerMetrics::getInstance()->set("auth.inflight", inflightTotal);
+
+    QPointer<QTcpSocket> guard(socket);
+    QFutureWatcher<Outcome> *watcher = new QFutureWatcher<Outcome>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, guard, socket, peer, done]()
+            {
+                Outcome outcome = watcher->result();
+                watcher->deleteLater();
+
+                inflightTotal--;
+                if (--inflightByPeer[peer] <= 0)
+                {
+                    inflightByPeer.remove(peer);
+                }
+                if (--inflightBySocket[socket] <= 0)
+                {
+                    inflightBySocket.remove(socket);
+                }
+                ServerMetrics::getInstance()->set("auth.inflight", inflightTotal);
+
+                //Клиент мог отключиться, пока вычислялся хеш
+                if (guard && guard->state() == QAbstractSocket::ConnectedState)
+                {
+                    done(outcome);
+                }
+            });
+    watcher->setFuture(QtConcurrent::run(&pool, work));
+    return true;
+}
+
+/**
+ * @brief Вычисляет хеш нового пароля.
+ *
+ * @param socket Сокет клиента.
+ * @param credential Пароль.
+ * @param done Обработчик результата.
+ * @return true Если операция принята.
+ */
+bool CredentialPool::hash(QTcpSocket *socket, const QString &credential, Callback done)
+{
+    int rounds = iterations;
+    return submit(socket, [credential, rounds]()
+                  {
+                      Outcome outcome;
+                      outcome.valid = true;
+                      outcome.newHash = derive(credential, rounds);
+                      return outcome;
+                  }, done);
+}
+
+/**
+ * @brief Проверяет пароль по сохранённому хешу.
+ *
+ * @param socket Сокет клиента.
+ * @param credential Проверяемый пароль.
+ * @param stored Сохранённый хеш.
+ * @param done Обработчик результата.
+ * @param replacement Новый пароль (пусто, если пароль не меняется).
+ * @return true Если операция принята.
+ */
+bool CredentialPool::verify(QTcpSocket *socket, const QString &credential, const QString &stored, Callback done,
+                            const QString &replacement)
+{
+    int rounds = iterations;
+    return submit(socket, [credential, stored, replacement, rounds]()
+                  {
+                      Outcome outcome;
+                      outcome.valid = matches(credential, stored);
+                      if (outcome.valid && !replacement.isEmpty())
+                      {
+                          outcome.newHash = derive(replacement, rounds);
+                      }
+                      else if (outcome.valid && needsUpgrade(stored, rounds))
+                      {
+                          outcome.newHash = derive(credential, rounds);
+                      }
+                      return outcome;
+                  }, done);
+}
+
+/**
+ * @brief Проверяет пароль при смене логина и вычисляет хеш для нового логина.
+ *
+ * @param socket Сокет клиента.
+ * @param password Пароль (хеш, присланный клиентом).
+ * @param oldLogin Текущий логин.
+ * @param newLogin Новый логин.
+ * @param stored Сохранённый хеш.
+ * @param done Обработчик результата.
+ * @return true Если операция принята.
+ */
+bool CredentialPool::verifyLoginChange(QTcpSocket *socket, const QString &password, const QString &oldLogin,
+                                       const QString &newLogin, const QString &stored, Callback done)
+{
+    int rounds = iterations;
+    return submit(socket, [password, oldLogin, newLogin, stored, rounds]()
+                  {
+                      Outcome outcome;
+                      outcome.valid = matches(saltedSha512(password, oldLogin), stored);
+                      if (outcome.valid)
+                      {
+                          outcome.newHash = derive(saltedSha512(password, newLogin), rounds);
+                      }
+                      return outcome;
+                  }, done);
+}
+
+/**
+ * @brief Получает SHA-512 хеш строки с солью.
+ *
+ * @param str Строка для хеширования.
+ * @param salt Соль для хеширования.
+ * @return QString Хеш в шестнадцатеричном виде.
+ */
+QString CredentialPool::saltedSha512(const QString &str, const QString &salt)
+{
+    return QCryptographicHash::hash((str + salt).toUtf8(), QCryptographicHash::Sha512).toHex();
+}
+
+/**
+ * @brief Вычисляет хеш PBKDF2 со случайной солью.
+ *
+ * @param credential Пароль.
+ * @param iterations Количество итераций.
+ * @return QString Хеш в формате "pbkdf2$sha512$<итерации>$<соль>$<ключ>".
+ */
+QString CredentialPool::derive(const QString &credential, int iterations)
+{
+    QVector<quint32> words(saltSize / int(sizeof(quint32)));
+    QRandomGenerator::system()->fillRange(words.data(), words.size());
+    QByteArray salt(reinterpret_cast<const char*>(words.constData()), saltSize);
+
+    return QString("pbkdf2$sha512$%1$%2$%3").arg(iterations)
+        .arg(QString::fromLatin1(salt.toBase64()), QString::fromLatin1(pbkdf2(credential, salt, iterations).toBase64()));
+}
+
+/**
+ * @brief Сравнивает пароль с сохранённым хешем.
+ *
+ * Хеши прежнего формата хранят присланный клиентом SHA-512 и сравниваются напрямую.
+ *
+ * @param credential Пароль.
+ * @param stored Сохранённый хеш.
+ * @return true Если пароль верен.
+ */
+bool CredentialPool::matches(const QString &credential, const QString &stored)
+{
+    if (!stored.startsWith("pbkdf2$"))
+    {
+        return constantTimeEquals(credential.toUtf8(), stored.toUtf8());
+    }
+
+    QStringList parts = stored.split('$');
+    if (parts.size() != 5 || parts[1] != "sha512")
+    {
+        return false;
+    }
+    int rounds = parts[2].toInt();
+    QByteArray salt = QByteArray::fromBase64(parts[3].toLatin1());
+    QByteArray expected = QByteArray::fromBase64(parts[4].toLatin1());
+    return rounds > 0 && constantTimeEquals(pbkdf2(credential, salt, rounds), expected);
+}
+
+/**
+ * @brief Проверяет, нужно ли пересчитать сохранённый хеш.
+ *
+ * @param stored Сохранённый хеш.
+ * @param iterations Текущее количество итераций.
+ * @return true Если хеш прежнего формата или вычислен с меньшим числом итераций.
+ */
+bool CredentialPool::needsUpgrade(const QString &stored, int iterations)
+{
+    if (!stored.startsWith("pbkdf2$"))
+    {
+        return true;
+    }
+    return stored.section('$', 2, 2).toInt() < iterations;
+}
@@ -0,0 +1,170 @@
+/**
+ * /file credentialpool.h
+ * /brief Определение класса CredentialPool для хеширования и проверки паролей вне потока событий.
+ */
+
+#ifndef CREDENTIALPOOL_H
+#define CREDENTIALPOOL_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QThreadPool>
+#include <QHash>
+#include <functional>
+
+/**
+ * /brief Класс CredentialPool.
+ *
+ * Выполняет вычисление PBKDF2-HMAC-SHA512 и проверку паролей в отдельном ограниченном
+ * пуле потоков, чтобы вход и регистрация не задерживали обработку сообщений других
+ * пользователей. Результат возвращается в поток событий через callback; если клиент
+ * отключился до завершения, callback не вызывается.
+ *
+ * Хеш хранится в виде "pbkdf2$sha512$<итерации>$<соль base64>$<ключ base64>".
+ * Прежние хеши (SHA-512, присланный клиентом) по-прежнему принимаются и заменяются
+ * новым форматом после успешного входа.
+ *
+ * Число одновременных операций ограничено как в целом, так и для одного IP-адреса.
+ */
+class CredentialPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * /brief Результат операции с учётными данными.
+     */
+    struct Outcome
+    {
+        bool valid = false; ///< Признак совпадения пароля (для хеширования всегда true).
+        QString newHash; ///< Новый хеш для записи в базу (пусто, если запись не нужна).
+    };
+
+    using Callback = std::function<void(const Outcome &outcome)>; ///< Обработчик результата в потоке событий.
+
+private:
+    QThreadPool pool; ///< Пул потоков для вычисления хешей.
+    QHash<QString, int> inflightByPeer; ///< Количество незавершённых операций по IP-адресам.
+    QHash<QTcpSocket*, int> inflightBySocket; ///< Количество незавершённых операций по подключениям.
+    int inflightTotal = 0; ///< Общее количество незавершённых операций.
+    int maxPerPeer = 4; ///< Предел незавершённых операций для одного IP-адреса.
+    int maxQueued = 256; ///< Общий предел незавершённых операций.
+    int iterations = 100000; ///< Количество итераций PBKDF2 для новых хешей.
+
+    /**
+     * /brief Ставит операцию в пул с учётом ограничений.
+     * /param socket Сокет клиента, запросившего операцию.
+     * /param work Операция, выполняемая в пуле.
+     * /param done Обработчик результата.
+     * /return Признак того, что операция принята (false при превышении ограничений).
+     */
+    bool submit(QTcpSocket *socket, std::function<Outcome()> work, Callback done);
+
+public:
+    /**
+     * /brief Конструктор класса CredentialPool.
+     * /param parent Указатель на родительский объект.
+     */
+    explicit CredentialPool(QObject *parent = nullptr);
+
+    /**
+     * /brief Задаёт параметры пула.
+     * /param threads Количество потоков.
+     * /param maxPerPeer Предел незавершённых операций для одного IP-адреса.
+     * /param maxQueued Общий предел незавершённых операций.
+     * /param iterations Количество итераций PBKDF2.
+     */
+    void configure(int threads, int maxPerPeer, int maxQueued, int iterations);
+
+    /**
+     * /brief Проверяет, ожидает ли подключение результата операции.
+     * /param socket Сокет клиента.
+     * /return Признак незавершённой операции.
+     */
+    bool isBusy(QTcpSocket *socket) const { return inflightBySocket.contains(socket); }
+
+    /**
+     * /brief Вычисляет хеш нового пароля.
+     * /param socket Сокет клиента.
+     * /param credential Пароль (хеш, присланный клиентом).
+     * /param done Обработчик результата (хеш в поле newHash).
+     * /return Признак того, что операция принята.
+     */
+    bool hash(QTcpSocket *socket, const QString &credential, Callback done);
+
+    /**
+     * /brief Проверяет пароль по сохранённому хешу.
+     *
+     * Если пароль верен и задан replacement, в newHash возвращается хеш replacement
+     * (смена пароля или логина). Иначе newHash заполняется, только когда сохранённый хеш
+     * устарел и его следует обновить.
+     *
+     * /param socket Сокет клиента.
+     * /param credential Проверяемый пароль.
+     * /param stored Сохранённый хеш.
+     * /param done Обработчик результата.
+     * /param replacement Новый пароль, хеш которого нужно вычислить при успешной проверке.
+     * /return Признак того, что операция принята.
+     */
+    bool verify(QTcpSocket *socket, const QString &credential, const QString &stored, Callback done,
+                const QString &replacement = QString());
+
+    /**
+     * /brief Проверяет пароль при смене логина и вычисляет хеш для нового логина.
+     *
+     * Пароль солится логином, поэтому проверяется хеш со старым логином, а при успехе
+     * в newHash возвращается хеш с новым. Оба хеша SHA-512 вычисляются в пуле.
+     *
+     * /param socket Сокет клиента.
+     * /param password Пароль (хеш, присланный клиентом).
+     * /param oldLogin Текущий логин.
+     * /param newLogin Новый логин.
+     * /param stored Сохранённый хеш.
+     * /param done Обработчик результата.
+     * /return Признак того, что операция принята.
+     */
+    bool verifyLoginChange(QTcpSocket *socket, const QString &password, const QString &oldLogin,
+                           const QString &newLogin, const QString &stored, Callback done);
+
+    /**
+     * /brief Получает SHA-512 хеш строки с солью.
+     * /param str Строка для хеширования.
+     * /param salt Соль для хеширования.
+     * /return Хеш в шестнадцатеричном виде.
+     */
+    static QString saltedSha512(const QString &str, const QString &salt);
+
+    /**
+     * /brief Вычисляет хеш PBKDF2 со случайной солью.
+     * /param credential Пароль.
+     * /param iterations Количество итераций.
+     * /return Хеш в формате хранения.
+     */
+    static QString derive(const QString &credential, int iterations);
+
+    /**
+     * /brief Сравнивает пароль с сохранённым хешем любого поддерживаемого формата.
+     * /param credential Пароль.
+     * /param stored Сохранённый хеш.
+     * /return Признак совпадения.
+     */
+    static bool matches(const QString &credential, const QString &stored);
+
+    /**
+     * /brief Проверяет, нужно ли пересчитать сохранённый хеш.
+     * /param stored Сохранённый хеш.
+     * /param iterations Текущее количество итераций.
+     * /return Признак устаревшего хеша.
+     */
+    static bool needsUpgrade(const QString &stored, int iterations);
+
+    /**
+     * /brief Сравнивает массивы за время, не зависящее от места первого расхождения.
+     * /param a Первый массив.
+     * /param b Второй массив.
+     * /return Признак совпадения.
+     */
+    static bool constantTimeEquals(const QByteArray &a, const QByteArray &b);
+};
+
+#endif // CREDENTIALPOOL_H
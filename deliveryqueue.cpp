@@ -0,0 +1,245 @@
+#include "deliveryqueue.h"
+#include "servermetrics.h"
+
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QJsonArray>
+#include <QDebug>
+
+/**
+ * @brief Подключает очередь к базе данных и создаёт таблицу при необходимости.
+ *
+ * @param database База данных сервера.
+ * @param maxChatsPerUser Максимальное количество чатов в очереди одного пользователя.
+ * @return true Если таблица готова к работе.
+ */
+bool DeliveryQueue::open(const QSqlDatabase &database, int maxChatsPerUser)
+{
+    this->database = database;
+    this->maxChatsPerUser = qMax(1, maxChatsPerUser);
+
+    QSqlQuery query(this->database);
+    if (!query.exec("CREATE TABLE IF NOT EXISTS pending_deliveries ("
+                    "user_id INTEGER NOT NULL, "
+                    "chat_id INTEGER NOT NULL, "
+                    "first_message_id INTEGER NOT NULL, "
+                    "last_message_id INTEGER NOT NULL, "
+                    "message_count INTEGER NOT NULL, "
+                    "PRIMARY KEY (user_id, chat_id))"))
+    {
+        qCritical() << "Could not create pending_deliveries table:" << query.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Добавляет сообщение в очередь пользователя.
+ *
+ * Повторные сообщения того же чата сворачиваются в существующую строку. Если у пользователя
+ * накопилось больше чатов, чем допускает предел, самые старые записи заменяются
+ * служебной записью о переполнении.
+ *
+ * @param userId Идентификатор получателя.
+ * @param chatId Идентификатор чата.
+ * @param messageId Идентификатор сообщения.
+ */
+void DeliveryQueue::enqueue(int userId, int chatId, int messageId)
+{
+    QSqlQuery query(database);
+    query.prepare("UPDATE pending_deliveries SET last_message_id = :messageId, message_count = message_count + 1 "
+                  "WHERE user_id = :userId AND chat_id = :chatId");
+    query.bindValue(":messageId", messageId);
+    query.bindValue(":userId", userId);
+    query.bindValue(":chatId", chatId);
+    if (!query.exec())
+    {
+        qCritical() << "Could not enqueue pending delivery:" << query.lastError().text();
+        return;
+    }
+    ServerMetrics::getInstance()->add("delivery.enqueued");
+
+    //Новая строка появляется только для нового чата, поэтому предел проверяется лишь в этом случае
+    if (query.numRowsAffected() == 0)
+    {
+        QSqlQuery insertQuery(database);
+        insertQuery.prepare("INSERT INTO pending_deliveries "
+                            "(user_id, chat_id, first_message_id, last_message_id, message_count) "
+                            "VALUES (:userId, :chatId, :firstMessageId, :lastMessageId, 1)");
+        insertQuery.bindValue(":userId", userId);
+        insertQuery.bindValue(":chatId", chatId);
+        insertQuery.bindValue(":firstMessageId", messageId);
+        insertQuery.bindValue(":lastMessageId", messageId);
+        if (!insertQuery.exec())
+        {
+            qCritical() << "Could not enqueue pending delivery:" << insertQuery.lastError().text();
+            return;
+        }
+
+        QSqlQuery countQuery(database);
+        countQuery.prepare("SELECT COUNT(*) FROM pending_deliveries WHERE user_id = :userId AND chat_id != :overflow");
+        countQuery.bindValue(":userId", userId);
+        countQuery.bindValue(":overflow", overflowChatId);
+        if (!countQuery.exec() || !countQuery.next() || countQuery.value(0).toInt() <= maxChatsPerUser)
+        {
+            return;
+        }
+
+        QSqlQuery trimQuery(database);
+        trimQuery.prepare("DELETE FROM pending_deliveries WHERE user_id = :userId AND chat_id IN ("
+                          "SELECT chat_id FROM pending_deliveries WHERE user_id = :ownerId AND chat_id != :overflow "
+                          "ORDER BY last_message_id LIMIT :excess)");
+        trimQuery.bindValue(":userId", userId);
+        trimQuery.bindValue(":ownerId", userId);
+        trimQuery.bindValue(":overflow", overflowChatId);
+        trimQuery.bindValue(":excess", countQuery.value(0).toInt() - maxChatsPerUser);
+        trimQuery.exec();
+
+        QSqlQuery overflowQuery(database);
+        overflowQuery.prepare("INSERT OR IGNORE INTO pending_deliveries "
+                              "(user_id, chat_id, first_message_id, last_message_id, message_count) "
+                              "VALUES (:userId, :overflow, 0, 0, 0)");
+        overflowQuery.bindValue(":userId", userId);
+        overflowQuery.bindValue(":overflow", overflowChatId);
+        overflowQuery.exec();
+        ServerMetrics::getInstance()->add("delivery.overflows");
+    }
+}
+
+/**
+ * @brief Читает очередь пользователя, не удаляя её.
+ *
+ * Кадр имеет вид {"type":"pending_updates","updates":[...],"resync":bool}; каждый элемент
+ * updates содержит chat_id, first_message_id, last_message_id, count и текст, время и
+ * отправителя последнего сообщения. Очередь очищается только методом acknowledge, поэтому
+ * кадр, не дошедший до клиента, будет выдан повторно при следующем входе.
+ *
+ * @param userId Идентификатор пользователя.
+ * @return QJsonObject Кадр pending_updates или пустой объект.
+ */
+QJsonObject DeliveryQueue::pending(int userId)
+{
+    QSqlQuery query(database);
+    query.prepare("SELECT p.chat_id, p.first_message_id, p.last_message_id, p.message_count, "
+                  "m.message_text, m.timestamp_sent, u.login "
+                  "FROM pending_deliveries p "
+                  "LEFT JOIN messages m ON m.message_id = p.last_message_id "
+                  "LEFT JOIN user_auth u ON u.user_id = m.user_id "
+                  "WHERE p.user_id = :userId ORDER BY p.last_message_id");
+    query.bindValue(":userId", userId);
+    if (!query.exec())
+    {
+        qCritical() << "Could not read pending deliveries:" << query.lastError().text();
+        return QJsonObject();
+    }
+
+    QJsonArray updates;
+    bool resync = false;
+    while (query.next())
+    {
+        int chatId = query.value(0).toInt();
+        if (chatId == overflowChatId)
+        {
+            resync = true;
+            continue;
+        }
+        QJsonObject update;
+        update["chat_id"] = QString::number(chatId);
+        update["first_message_id"] = query.value(1).toInt();
+        update["last_message_id"] = query.value(2).toInt();
+        update["count"] = query.value(3).toInt();
+        update["message_text"] = query.value(4).toString();
+        update["timestamp"] = query.value(5).toString();
+        update["user_id"] = query.value(6).toString(); //Логин отправителя, как в chat_update
+        updates.append(update);
+    }
+    if (updates.isEmpty() && !resync)
+    {
+        return QJsonObject();
+    }
+    return QJsonObject{{"type", "pending_updates"}, {"updates", updates}, {"resync", resync}};
+}
+
+/**
+ * @brief Удаляет из очереди пользователя записи, выданные клиенту и подтверждённые им.
+ *
+ * Запись чата удаляется, только если после выдачи в неё не попали новые сообщения. Иначе
+ * из неё вычитаются выданные сообщения, и в очереди остаются лишь пришедшие позже.
+ *
+ * @param userId Идентификатор пользователя.
+ * @param frame Выданный кадр pending_updates.
+ */
+void DeliveryQueue::acknowledge(int userId, const QJsonObject &frame)
+{
+    if (!database.transaction())
+    {
+        qCritical() << "Could not acknowledge pending deliveries:" << database.lastError().text();
+        return;
+    }
+
+    const QJsonArray updates = frame["updates"].toArray();
+    bool ok = true;
+    for (const QJsonValue &value : updates)
+    {
+        QJsonObject update = value.toObject();
+        int chatId = update["chat_id"].toString().toInt();
+        int lastMessageId = update["last_message_id"].toInt();
+
+        QSqlQuery deleteQuery(database);
+        deleteQuery.prepare("DELETE FROM pending_deliveries "
+                            "WHERE user_id = :userId AND chat_id = :chatId AND last_message_id <= :lastMessageId");
+        deleteQuery.bindValue(":userId", userId);
+        deleteQuery.bindValue(":chatId", chatId);
+        deleteQuery.bindValue(":lastMessageId", lastMessageId);
+
+        QSqlQuery trimQuery(database);
+        trimQuery.prepare("UPDATE pending_deliveries SET "
+                          "message_count = MAX(1, message_count - :count), "
+                          "first_message_id = COALESCE((SELECT MIN(message_id) FROM messages "
+                          "WHERE chat_id = :messageChatId AND message_id > :sentMessageId), last_message_id) "
+                          "WHERE user_id = :userId AND chat_id = :chatId AND last_message_id > :lastMessageId");
+        trimQuery.bindValue(":count", update["count"].toInt());
+        trimQuery.bindValue(":messageChatId", chatId);
+        trimQuery.bindValue(":sentMessageId", lastMessageId);
+        trimQuery.bindValue(":userId", userId);
+        trimQuery.bindValue(":chatId", chatId);
+        trimQuery.bindValue(":lastMessageId", lastMessageId);
+
+        if (!deleteQuery.exec() || !trimQuery.exec())
+        {
+            qCritical() << "Could not acknowledge pending deliveries:" << deleteQuery.lastError().text()
+                        << trimQuery.lastError().text();
+            ok = false;
+            break;
+        }
+    }
+
+    if (ok && frame["resync"].toBool())
+    {
+        QSqlQuery overflowQuery(database);
+        overflowQuery.prepare("DELETE FROM pending_deliveries WHERE user_id = :userId AND chat_id = :overflow");
+        overflowQuery.bindValue(":userId", userId);
+        overflowQuery.bindValue(":overflow", overflowChatId);
+        ok = overflowQuery.exec();
+    }
+
+    if (!ok || !database.commit())
+    {
+        database.rollback();
+        return;
+    }
+    ServerMetrics::getInstance()->add("delivery.flushed_chats", updates.size());
+}
+
+/**
+ * @brief Удаляет из очередей все записи чата.
+ *
+ * @param chatId Идентификатор чата.
+ */
+void DeliveryQueue::removeChat(int chatId)
+{
+    QSqlQuery query(database);
+    query.prepare("DELETE FROM pending_deliveries WHERE chat_id = :chatId");
+    query.bindValue(":chatId", chatId);
+    query.exec();
+}
@@ -0,0 +1,72 @@
+/**
+ * /file deliveryqueue.h
+ * /brief Определение класса DeliveryQueue для хранения уведомлений пользователей, находящихся не в сети.
+ */
+
+#ifndef DELIVERYQUEUE_H
+#define DELIVERYQUEUE_H
+
+#include <QSqlDatabase>
+#include <QJsonObject>
+
+/**
+ * /brief Класс DeliveryQueue.
+ *
+ * Хранит в таблице pending_deliveries ссылки на сообщения, которые не удалось доставить
+ * пользователю, пока он был не в сети. Для каждой пары (пользователь, чат) хранится одна
+ * строка: идентификаторы первого и последнего пропущенного сообщения и их количество,
+ * поэтому очередь не растёт с числом сообщений. Число чатов в очереди пользователя
+ * ограничено; при переполнении удаляются самые старые записи, а клиенту при выдаче
+ * сообщается о необходимости полной синхронизации.
+ *
+ * При входе очередь пользователя выдаётся одним кадром pending_updates. Записи удаляются
+ * только после подтверждения кадра клиентом и только в пределах выданного: сообщения,
+ * пришедшие после выдачи, остаются в очереди.
+ */
+class DeliveryQueue
+{
+private:
+    QSqlDatabase database; ///< База данных сервера.
+    int maxChatsPerUser = 200; ///< Максимальное количество чатов в очереди одного пользователя.
+
+public:
+    static const int overflowChatId = -1; ///< Служебная запись о переполнении очереди.
+
+    /**
+     * /brief Подключает очередь к базе данных и создаёт таблицу при необходимости.
+     * /param database База данных сервера.
+     * /param maxChatsPerUser Максимальное количество чатов в очереди одного пользователя.
+     * /return Признак успешной подготовки таблицы.
+     */
+    bool open(const QSqlDatabase &database, int maxChatsPerUser);
+
+    /**
+     * /brief Добавляет сообщение в очередь пользователя.
+     * /param userId Идентификатор получателя.
+     * /param chatId Идентификатор чата.
+     * /param messageId Идентификатор сообщения.
+     */
+    void enqueue(int userId, int chatId, int messageId);
+
+    /**
+     * /brief Читает очередь пользователя, не удаляя её.
+     * /param userId Идентификатор пользователя.
+     * /return Кадр pending_updates или пустой объект, если очередь пуста.
+     */
+    QJsonObject pending(int userId);
+
+    /**
+     * /brief Удаляет из очереди пользователя записи, выданные клиенту и подтверждённые им.
+     * /param userId Идентификатор пользователя.
+     * /param frame Выданный кадр pending_updates.
+     */
+    void acknowledge(int userId, const QJsonObject &frame);
+
+    /**
+     * /brief Удаляет из очередей все записи чата (при удалении чата).
+     * /param chatId Идентификатор чата.
+     */
+    void removeChat(int chatId);
+};
+
+#endif // DELIVERYQUEUE_H
@@ -0,0 +1,335 @@
+#include "historycache.h"
+#include "servermetrics.h"
+
+#include <QBuffer>
+#include <QJsonDocument>
+#include <QCborMap>
+#include <QCborValue>
+#include <algorithm>
+
+/**
+ * @brief Конструктор сборщика.
+ *
+ * @param limit Количество сохраняемых последних сообщений.
+ */
+HistoryCache::Collector::Collector(int limit)
+    : limit(qMax(1, limit))
+{
+}
+
+/**
+ * @brief Добавляет очередное сообщение истории.
+ *
+ * Чтобы длинная история не копилась в памяти целиком, при накоплении двойного лимита
+ * старшая половина отбрасывается.
+ *
+ * @param seq Порядковый номер сообщения в чате.
+ * @param timestamp Время отправки.
+ * @param item Закодированный элемент списка messages.
+ */
+void HistoryCache::Collector::add(qint64 seq, const QString &timestamp, const QByteArray &item)
+{
+    if (!seqs.isEmpty() && seq <= seqs.last())
+    {
+        ordered = false;
+    }
+    seqs.append(seq);
+    items.append(item);
+    lastTimestamp = timestamp;
+    if (items.size() >= 2 * limit)
+    {
+        int dropped = items.size() - limit;
+        droppedUpTo = qMax(droppedUpTo, seqs.at(dropped - 1));
+        seqs.remove(0, dropped);
+        items.remove(0, dropped);
+    }
+}
+
+/**
+ * @brief Конструктор выключенного кэша.
+ */
+HistoryCache::HistoryCache()
+{
+    entries.setMaxCost(0);
+}
+
+/**
+ * @brief Возвращает ответ без сообщений.
+ *
+ * Ответ формируется тем же ListResponseWriter и с тем же заголовком, что и в
+ * ServerLogic::handleGetChatHistory(), поэтому байты ответа из кэша совпадают с
+ * байтами ответа, прочитанного из хранилища.
+ *
+ * @param encoding Кодировка ответа.
+ * @return QByteArray Ответ с пустым списком messages.
+ */
+QByteArray HistoryCache::emptyResponse(WireEncoding encoding)
+{
+    auto build = [](WireEncoding encoding)
+    {
+        QBuffer buffer;
+        buffer.open(QIODevice::WriteOnly);
+        ListResponseWriter writer(&buffer, encoding, QJsonObject{{"type", "get_chat_history"}}, "messages");
+        writer.finish();
+        return buffer.data();
+    };
+    static const QByteArray json = build(WireEncoding::Json);
+    static const QByteArray cbor = build(WireEncoding::Cbor);
+    return encoding == WireEncoding::Cbor ? cbor : json;
+}
+
+/**
+ * @brief Возвращает объём памяти, занимаемый записью.
+ *
+ * @param entry Запись кэша.
+ * @return int Размер в байтах.
+ */
+int HistoryCache::costOf(const Entry &entry)
+{
+    return int(sizeof(Entry)) + entry.response.size()
+           + entry.seqs.size() * int(sizeof(qint64)) + entry.itemOffsets.size() * int(sizeof(int));
+}
+
+/**
+ * @brief Отбрасывает самые старые сообщения записи.
+ *
+ * Записи дают вырасти на четверть сверх лимита, чтобы ответ не пересобирался при
+ * каждом новом сообщении.
+ *
+ * @param entry Запись кэша.
+ */
+void HistoryCache::trim(Entry &entry) const
+{
+    if (entry.seqs.size() <= messageLimit + qMax(1, messageLimit / 4))
+    {
+        return;
+    }
+    int dropped = entry.seqs.size() - messageLimit;
+    int cut = entry.itemOffsets.at(dropped);
+    int shift = cut - entry.prefixSize;
+    entry.droppedUpTo = entry.seqs.at(dropped - 1);
+    //Разделитель перед первым оставшимся элементом JSON лежит до смещения и отрезается вместе с ним
+    entry.response = entry.response.left(entry.prefixSize) + entry.response.mid(cut);
+    entry.seqs.remove(0, dropped);
+    entry.itemOffsets.remove(0, dropped);
+    for (int &offset : entry.itemOffsets)
+    {
+        offset -= shift;
+    }
+}
+
+/**
+ * @brief Задаёт ограничения кэша и очищает его.
+ *
+ * @param maxBytes Наибольший объём кэша в байтах.
+ * @param messagesPerChat Количество хранимых последних сообщений чата (0 выключает кэш).
+ */
+void HistoryCache::configure(int maxBytes, int messagesPerChat)
+{
+    entries.clear();
+    entries.setMaxCost(qMax(0, maxBytes));
+    messageLimit = maxBytes > 0 ? qMax(0, messagesPerChat) : 0;
+    publishMetrics();
+}
+
+/**
+ * @brief Ищет готовый ответ get_chat_history.
+ *
+ * Если выдаются все сообщения записи, возвращается сам общий QByteArray записи;
+ * иначе ответ собирается из заголовка и хвоста записи.
+ *
+ * @param chatId Идентификатор чата.
+ * @param afterSeq Номер, после которого выдаются сообщения (0 — вся история).
+ * @param encoding Кодировка ответа.
+ * @param response Готовый ответ.
+ * @return true Если ответ выдан из кэша.
+ * @return false Если историю нужно читать из хранилища.
+ */
+bool HistoryCache::lookup(int chatId, qint64 afterSeq, WireEncoding encoding, QByteArray &response)
+{
+    if (!isEnabled())
+    {
+        return false;
+    }
+
+    Entry *entry = entries.object(keyOf(chatId, encoding));
+    if (!entry || afterSeq < entry->droppedUpTo)
+    {
+        ++misses;
+        publishMetrics();
+        return false;
+    }
+
+    int first = int(std::upper_bound(entry->seqs.constBegin(), entry->seqs.constEnd(), afterSeq) - entry->seqs.constBegin());
+    if (first == 0)
+    {
+        response = entry->response;
+    }
+    else if (first == entry->seqs.size())
+    {
+        response = entry->response.left(entry->prefixSize) + entry->response.right(suffixSize(encoding));
+    }
+    else
+    {
+        response = entry->response.left(entry->prefixSize) + entry->response.mid(entry->itemOffsets.at(first));
+    }
+    ++hits;
+    publishMetrics();
+    return true;
+}
+
+/**
+ * @brief Сохраняет историю чата, собранную при чтении из хранилища.
+ *
+ * История, номера которой в порядке выдачи не возрастают (например, из-за времени
+ * отправки, заданного клиентом не по порядку), не кэшируется: выдачу после номера
+ * нельзя было бы вырезать из неё одним куском.
+ *
+ * @param chatId Идентификатор чата.
+ * @param encoding Кодировка ответа.
+ * @param collector Собранные сообщения.
+ */
+void HistoryCache::store(int chatId, WireEncoding encoding, const Collector &collector)
+{
+    if (!isEnabled() || !collector.ordered)
+    {
+        return;
+    }
+
+    Entry *entry = new Entry;
+    entry->response = emptyResponse(encoding);
+    entry->response.chop(suffixSize(encoding));
+    entry->prefixSize = entry->response.size();
+    int first = qMax(0, collector.items.size() - messageLimit);
+    entry->droppedUpTo = first > 0 ? qMax(collector.droppedUpTo, collector.seqs.at(first - 1)) : collector.droppedUpTo;
+    entry->seqs = collector.seqs.mid(first);
+    entry->itemOffsets.reserve(entry->seqs.size());
+    for (int i = first; i < collector.items.size(); ++i)
+    {
+        if (encoding == WireEncoding::Json && i > first)
+        {
+            entry->response.append(',');
+        }
+        entry->itemOffsets.append(entry->response.size());
+        entry->response.append(collector.items.at(i));
+    }
+    entry->response.append(emptyResponse(encoding).right(suffixSize(encoding)));
+    entry->lastTimestamp = collector.lastTimestamp;
+    entries.insert(keyOf(chatId, encoding), entry, costOf(*entry));
+    publishMetrics();
+}
+
+/**
+ * @brief Дописывает сообщение в запись кэша.
+ *
+ * Окончание ответа отрезается, к нему дописываются элемент и то же окончание. Сообщение
+ * с меньшим номером или более ранним временем отправки, чем последнее в записи, заняло бы
+ * в истории из хранилища другое место, поэтому запись в этом случае удаляется.
+ *
+ * @param key Ключ записи.
+ * @param encoding Кодировка ответа.
+ * @param seq Порядковый номер сообщения в чате.
+ * @param timestamp Время отправки.
+ * @param item Элемент списка messages в общей модели.
+ */
+void HistoryCache::appendTo(quint64 key, WireEncoding encoding, qint64 seq, const QString &timestamp, const QJsonObject &item)
+{
+    //Запись вынимается из кэша, так как её стоимость меняется
+    Entry *entry = entries.take(key);
+    if (!entry)
+    {
+        return;
+    }
+    qint64 lastSeq = entry->seqs.isEmpty() ? entry->droppedUpTo : entry->seqs.last();
+    if (seq <= lastSeq || timestamp < entry->lastTimestamp)
+    {
+        delete entry;
+        return;
+    }
+
+    QByteArray suffix = entry->response.right(suffixSize(encoding));
+    entry->response.chop(suffix.size());
+    if (encoding == WireEncoding::Json && !entry->seqs.isEmpty())
+    {
+        entry->response.append(',');
+    }
+    entry->itemOffsets.append(entry->response.size());
+    entry->response.append(encodeItem(item, encoding));
+    entry->response.append(suffix);
+    entry->seqs.append(seq);
+    entry->lastTimestamp = timestamp;
+    trim(*entry);
+    entries.insert(key, entry, costOf(*entry));
+}
+
+/**
+ * @brief Дописывает новое сообщение в записи чата.
+ *
+ * @param chatId Идентификатор чата.
+ * @param seq Порядковый номер сообщения в чате.
+ * @param timestamp Время отправки.
+ * @param item Элемент списка messages в общей модели.
+ */
+void HistoryCache::append(int chatId, qint64 seq, const QString &timestamp, const QJsonObject &item)
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+    appendTo(keyOf(chatId, WireEncoding::Json), WireEncoding::Json, seq, timestamp, item);
+    appendTo(keyOf(chatId, WireEncoding::Cbor), WireEncoding::Cbor, seq, timestamp, item);
+    publishMetrics();
+}
+
+/**
+ * @brief Удаляет записи чата.
+ *
+ * @param chatId Идентификатор чата.
+ */
+void HistoryCache::removeChat(int chatId)
+{
+    entries.remove(keyOf(chatId, WireEncoding::Json));
+    entries.remove(keyOf(chatId, WireEncoding::Cbor));
+    publishMetrics();
+}
+
+/**
+ * @brief Удаляет все записи.
+ */
+void HistoryCache::clear()
+{
+    entries.clear();
+    publishMetrics();
+}
+
+/**
+ * @brief Кодирует элемент списка messages.
+ *
+ * @param item Элемент в общей модели.
+ * @param encoding Кодировка ответа.
+ * @return QByteArray Закодированный элемент.
+ */
+QByteArray HistoryCache::encodeItem(const QJsonObject &item, WireEncoding encoding)
+{
+    if (encoding == WireEncoding::Cbor)
+    {
+        return QCborMap::fromJsonObject(item).toCborValue().toCbor();
+    }
+    return QJsonDocument(item).toJson(QJsonDocument::Compact);
+}
+
+/**
+ * @brief Обновляет показатели кэша.
+ *
+ * history.cache_hit_rate — доля запросов истории, выданных из кэша, history.cache_bytes —
+ * занятый записями объём памяти.
+ */
+void HistoryCache::publishMetrics() const
+{
+    ServerMetrics *metrics = ServerMetrics::getInstance();
+    metrics->set("history.cache_hits", hits);
+    metrics->set("history.cache_misses", misses);
+    metrics->set("history.cache_hit_rate", hits + misses > 0 ? double(hits) / double(hits + misses) : 0);
+    metrics->set("history.cache_bytes", entries.totalCost());
+    metrics->set("history.cache_chats", entries.size());
+}
@@ -0,0 +1,220 @@
+/**
+ * /file historycache.h
+ * /brief Определение класса HistoryCache — кэша последних сообщений активных чатов в готовом виде.
+ */
+
+#ifndef HISTORYCACHE_H
+#define HISTORYCACHE_H
+
+#include "wireprotocol.h"
+
+#include <QCache>
+#include <QByteArray>
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+
+/**
+ * /brief Класс HistoryCache.
+ *
+ * Хранит для недавно запрошенных чатов последние сообщения в виде уже закодированного
+ * ответа get_chat_history (отдельно для JSON и CBOR). Повторный запрос истории такого
+ * чата отправляется одной записью общего QByteArray без обращения к хранилищу и без
+ * сборки QJsonObject для каждой строки.
+ *
+ * Кэш вытесняет давно не запрашивавшиеся чаты (LRU) при превышении заданного объёма
+ * в байтах. Для каждого чата хранится не больше заданного числа последних сообщений:
+ * ответ без after_seq выдаётся из кэша, только если в нём вся история чата, а запрос
+ * с after_seq — если в кэше все сообщения после указанного номера.
+ *
+ * Новое сообщение дописывается в готовый ответ на месте, удаление чата и смена логина
+ * (логины отправителей входят в ответ) сбрасывают соответствующие записи. Запросы
+ * обслуживаются в потоке событий, поэтому кэш не защищён блокировкой.
+ */
+class HistoryCache
+{
+public:
+    /**
+     * /brief Собирает последние сообщения чата при чтении истории из хранилища.
+     */
+    class Collector
+    {
+    private:
+        friend class HistoryCache;
+
+        int limit; ///< Количество сохраняемых последних сообщений.
+        QVector<qint64> seqs; ///< Номера собранных сообщений.
+        QVector<QByteArray> items; ///< Закодированные элементы собранных сообщений.
+        QString lastTimestamp; ///< Время отправки последнего сообщения.
+        qint64 droppedUpTo = 0; ///< Наибольший номер отброшенного сообщения.
+        bool ordered = true; ///< Признак возрастания номеров в порядке выдачи.
+
+    public:
+        /**
+         * /brief Конструктор.
+         * /param limit Количество сохраняемых последних сообщений.
+         */
+        explicit Collector(int limit);
+
+        /**
+         * /brief Добавляет очередное сообщение истории.
+         * /param seq Порядковый номер сообщения в чате.
+         * /param timestamp Время отправки.
+         * /param item Закодированный элемент списка messages.
+         */
+        void add(qint64 seq, const QString &timestamp, const QByteArray &item);
+    };
+
+private:
+    /**
+     * /brief Готовый ответ с последними сообщениями чата.
+     */
+    struct Entry
+    {
+        QByteArray response; ///< Ответ get_chat_history целиком.
+        int prefixSize = 0; ///< Размер заголовка ответа до первого элемента.
+        QVector<qint64> seqs; ///< Номера сообщений в ответе.
+        QVector<int> itemOffsets; ///< Смещения элементов в ответе.
+        QString lastTimestamp; ///< Время отправки последнего сообщения.
+        qint64 droppedUpTo = 0; ///< Сообщения с номерами не больше этого в ответ не входят.
+    };
+
+    QCache<quint64, Entry> entries; ///< Ответы по чатам и кодировкам; стоимость — размер в байтах.
+    int messageLimit = 0; ///< Количество хранимых последних сообщений чата (0 — кэш выключен).
+    qint64 hits = 0; ///< Количество запросов, выданных из кэша.
+    qint64 misses = 0; ///< Количество запросов, прочитанных из хранилища.
+
+    /**
+     * /brief Возвращает ключ записи кэша.
+     * /param chatId Идентификатор чата.
+     * /param encoding Кодировка ответа.
+     * /return Ключ записи.
+     */
+    static quint64 keyOf(int chatId, WireEncoding encoding)
+    {
+        return (quint64(quint32(chatId)) << 1) | (encoding == WireEncoding::Cbor ? 1 : 0);
+    }
+
+    /**
+     * /brief Возвращает ответ без сообщений в указанной кодировке.
+     * /param encoding Кодировка ответа.
+     * /return Ответ с пустым списком messages.
+     */
+    static QByteArray emptyResponse(WireEncoding encoding);
+
+    /**
+     * /brief Возвращает размер окончания ответа после последнего элемента.
+     * /param encoding Кодировка ответа.
+     * /return Размер окончания в байтах.
+     */
+    static int suffixSize(WireEncoding encoding) { return encoding == WireEncoding::Cbor ? 1 : 2; }
+
+    /**
+     * /brief Возвращает объём памяти, занимаемый записью.
+     * /param entry Запись кэша.
+     * /return Размер в байтах.
+     */
+    static int costOf(const Entry &entry);
+
+    /**
+     * /brief Отбрасывает самые старые сообщения записи сверх допустимого количества.
+     * /param entry Запись кэша.
+     */
+    void trim(Entry &entry) const;
+
+    /**
+     * /brief Дописывает сообщение в запись кэша.
+     * /param key Ключ записи.
+     * /param encoding Кодировка ответа.
+     * /param seq Порядковый номер сообщения в чате.
+     * /param timestamp Время отправки.
+     * /param item Элемент списка messages в общей модели.
+     */
+    void appendTo(quint64 key, WireEncoding encoding, qint64 seq, const QString &timestamp, const QJsonObject &item);
+
+    /**
+     * /brief Обновляет показатели кэша в ServerMetrics.
+     */
+    void publishMetrics() const;
+
+public:
+    /**
+     * /brief Конструктор выключенного кэша.
+     */
+    HistoryCache();
+
+    /**
+     * /brief Задаёт ограничения кэша и очищает его.
+     * /param maxBytes Наибольший объём кэша в байтах.
+     * /param messagesPerChat Количество хранимых последних сообщений чата (0 выключает кэш).
+     */
+    void configure(int maxBytes, int messagesPerChat);
+
+    /**
+     * /brief Проверяет, включён ли кэш.
+     * /return Признак включённого кэша.
+     */
+    bool isEnabled() const { return messageLimit > 0; }
+
+    /**
+     * /brief Возвращает количество хранимых последних сообщений чата.
+     * /return Количество сообщений.
+     */
+    int messagesPerChat() const { return messageLimit; }
+
+    /**
+     * /brief Проверяет, есть ли в кэше запись чата.
+     * /param chatId Идентификатор чата.
+     * /param encoding Кодировка ответа.
+     * /return Признак наличия записи.
+     */
+    bool contains(int chatId, WireEncoding encoding) const { return entries.contains(keyOf(chatId, encoding)); }
+
+    /**
+     * /brief Ищет готовый ответ get_chat_history.
+     * /param chatId Идентификатор чата.
+     * /param afterSeq Номер, после которого выдаются сообщения (0 — вся история).
+     * /param encoding Кодировка ответа.
+     * /param response Готовый ответ (без копирования, если выдаётся вся запись).
+     * /return Признак того, что ответ выдан из кэша.
+     */
+    bool lookup(int chatId, qint64 afterSeq, WireEncoding encoding, QByteArray &response);
+
+    /**
+     * /brief Сохраняет историю чата, собранную при чтении из хранилища.
+     * /param chatId Идентификатор чата.
+     * /param encoding Кодировка ответа.
+     * /param collector Собранные сообщения.
+     */
+    void store(int chatId, WireEncoding encoding, const Collector &collector);
+
+    /**
+     * /brief Дописывает новое сообщение в записи чата, если они есть.
+     * /param chatId Идентификатор чата.
+     * /param seq Порядковый номер сообщения в чате.
+     * /param timestamp Время отправки.
+     * /param item Элемент списка messages в общей модели.
+     */
+    void append(int chatId, qint64 seq, const QString &timestamp, const QJsonObject &item);
+
+    /**
+     * /brief Удаляет записи чата.
+     * /param chatId Идентификатор чата.
+     */
+    void removeChat(int chatId);
+
+    /**
+     * /brief Удаляет все записи.
+     */
+    void clear();
+
+    /**
+     * /brief Кодирует элемент списка messages так же, как ListResponseWriter::append().
+     * /param item Элемент в общей модели.
+     * /param encoding Кодировка ответа.
+     * /return Закодированный элемент.
+     */
+    static QByteArray encodeItem(const QJsonObject &item, WireEncoding encoding);
+};
+
+#endif // HISTORYCACHE_H
@@ -0,0 +1,407 @@
+#include "hotrestart.h"
+#include "wireprotocol.h"
+#include "logger.h"
+
+#include <QFile>
+#include <QtEndian>
+
+#ifdef Q_OS_UNIX
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace
+{
+const quint32 maxHandoffFrameSize = 64 * 1024 * 1024; ///< Максимальный размер кадра передачи.
+const int handoffTimeoutSec = 10; ///< Тайм-аут ожидания данных канала передачи.
+
+#ifdef Q_OS_UNIX
+#ifdef MSG_NOSIGNAL
+const int sendFlags = MSG_NOSIGNAL; ///< Отправка без SIGPIPE, если новый процесс завершился.
+#else
+const int sendFlags = 0; ///< Флаги отправки.
+#endif
+
+/**
+ * @brief Заполняет адрес Unix-сокета.
+ *
+ * @param path Путь к файлу сокета.
+ * @param address Адрес.
+ * @return true Если путь помещается в адрес.
+ */
+bool fillAddress(const QString &path, sockaddr_un &address)
+{
+    QByteArray encoded = QFile::encodeName(path);
+    if (encoded.size() >= int(sizeof(address.sun_path)))
+    {
+        return false;
+    }
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, encoded.constData(), size_t(encoded.size()));
+    return true;
+}
+
+/**
+ * @brief Ограничивает время ожидания чтения и записи канала.
+ *
+ * @param descriptor Дескриптор канала.
+ */
+void setChannelTimeout(int descriptor)
+{
+    timeval timeout = {};
+    timeout.tv_sec = handoffTimeoutSec;
+    ::setsockopt(descriptor, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ::setsockopt(descriptor, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+/**
+ * @brief Читает из канала ровно size байт.
+ *
+ * @param descriptor Дескриптор канала.
+ * @param data Буфер.
+ * @param size Количество байт.
+ * @return true Если все байты прочитаны.
+ */
+bool readExactly(int descriptor, char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t received = ::recv(descriptor, data, size, 0);
+        if (received < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (received <= 0)
+        {
+            return false;
+        }
+        data += received;
+        size -= size_t(received);
+    }
+    return true;
+}
+#endif
+}
+
+/**
+ * @brief Конструктор класса HotRestart.
+ *
+ * @param parent Указатель на родительский объект (по умолчанию nullptr).
+ */
+HotRestart::HotRestart(QObject *parent) : QObject(parent)
+{
+}
+
+/**
+ * @brief Деструктор класса HotRestart.
+ */
+HotRestart::~HotRestart()
+{
+    close();
+}
+
+/**
+ * @brief Проверяет, поддерживает ли система передачу дескрипторов.
+ *
+ * @return true Если передача доступна.
+ */
+bool HotRestart::isSupported()
+{
+#ifdef Q_OS_UNIX
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Начинает ожидать подключения нового процесса.
+ *
+ * Файл сокета предыдущего процесса заменяется: к этому моменту все сокеты уже приняты.
+ * Доступ к файлу ограничен владельцем.
+ *
+ * @param path Путь к Unix-сокету передачи.
+ * @return true Если сокет передачи открыт.
+ */
+bool HotRestart::listen(const QString &path)
+{
+    close();
+#ifdef Q_OS_UNIX
+    sockaddr_un address;
+    if (!fillAddress(path, address))
+    {
+        return false;
+    }
+    int descriptor = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (descriptor < 0)
+    {
+        return false;
+    }
+    QFile::remove(path);
+    if (::bind(descriptor, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(descriptor, 1) != 0)
+    {
+        ::close(descriptor);
+        return false;
+    }
+    QFile::setPermissions(path, QFile::ReadOwner | QFile::WriteOwner);
+
+    listenDescriptor = descriptor;
+    notifier = new QSocketNotifier(listenDescriptor, QSocketNotifier::Read, this);
+    connect(notifier, &QSocketNotifier::activated, this, &HotRestart::acceptSuccessor);
+    return true;
+#else
+    Q_UNUSED(path)
+    return false;
+#endif
+}
+
+/**
+ * @brief Перестаёт ожидать подключения нового процесса.
+ *
+ * Файл сокета не удаляется: его уже мог занять новый процесс.
+ */
+void HotRestart::close()
+{
+    delete notifier;
+    notifier = nullptr;
+    if (listenDescriptor >= 0)
+    {
+        closeDescriptor(listenDescriptor);
+        listenDescriptor = -1;
+    }
+}
+
+/**
+ * @brief Принимает подключение нового процесса.
+ *
+ * Принимается только один преемник; после этого сокет передачи закрывается.
+ */
+void HotRestart::acceptSuccessor()
+{
+#ifdef Q_OS_UNIX
+    int channel = ::accept(int(listenDescriptor), nullptr, nullptr);
+    if (channel < 0)
+    {
+        return;
+    }
+    close();
+    setChannelTimeout(channel);
+    Logger::getInstance()->logToFile("Hot restart: successor process connected");
+    emit successorConnected(channel);
+#endif
+}
+
+/**
+ * @brief Подключается к работающему серверу для приёма сокетов.
+ *
+ * @param path Путь к Unix-сокету передачи.
+ * @return qintptr Дескриптор канала или -1, если работающего сервера нет.
+ */
+qintptr HotRestart::connectTo(const QString &path)
+{
+#ifdef Q_OS_UNIX
+    sockaddr_un address;
+    if (!fillAddress(path, address))
+    {
+        return -1;
+    }
+    int descriptor = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (descriptor < 0)
+    {
+        return -1;
+    }
+    if (::connect(descriptor, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        ::close(descriptor);
+        return -1;
+    }
+    setChannelTimeout(descriptor);
+    return descriptor;
+#else
+    Q_UNUSED(path)
+    return -1;
+#endif
+}
+
+/**
+ * @brief Отправляет кадр с дескрипторами.
+ *
+ * Дескрипторы прикрепляются к первой части кадра; остаток дописывается обычной отправкой.
+ *
+ * @param channel Дескриптор канала.
+ * @param message Сообщение.
+ * @param descriptors Передаваемые дескрипторы.
+ * @return true Если кадр отправлен целиком.
+ */
+bool HotRestart::sendFrame(qintptr channel, const QJsonObject &message, const QVector<qintptr> &descriptors)
+{
+#ifdef Q_OS_UNIX
+    if (descriptors.size() > maxDescriptorsPerFrame)
+    {
+        return false;
+    }
+    QByteArray payload = WireProtocol::encode(message, WireEncoding::Cbor);
+    QByteArray frame(4, Qt::Uninitialized);
+    qToBigEndian<quint32>(quint32(payload.size()), frame.data());
+    frame.append(payload);
+
+    iovec vector = {};
+    vector.iov_base = frame.data();
+    vector.iov_len = size_t(frame.size());
+    msghdr header = {};
+    header.msg_iov = &vector;
+    header.msg_iovlen = 1;
+
+    QByteArray control;
+    if (!descriptors.isEmpty())
+    {
+        control.fill(0, int(CMSG_SPACE(sizeof(int) * size_t(descriptors.size()))));
+        header.msg_control = control.data();
+        header.msg_controllen = size_t(control.size());
+        cmsghdr *rights = CMSG_FIRSTHDR(&header);
+        rights->cmsg_level = SOL_SOCKET;
+        rights->cmsg_type = SCM_RIGHTS;
+        rights->cmsg_len = CMSG_LEN(sizeof(int) * size_t(descriptors.size()));
+        int *passed = reinterpret_cast<int*>(CMSG_DATA(rights));
+        for (int i = 0; i < descriptors.size(); ++i)
+        {
+            passed[i] = int(descriptors[i]);
+        }
+    }
+
+    ssize_t sent;
+    do
+    {
+        sent = ::sendmsg(int(channel), &header, sendFlags);
+    } while (sent < 0 && errno == EINTR);
+    if (sent <= 0)
+    {
+        return false;
+    }
+
+    const char *rest = frame.constData() + sent;
+    size_t remaining = size_t(frame.size()) - size_t(sent);
+    while (remaining > 0)
+    {
+        ssize_t written = ::send(int(channel), rest, remaining, sendFlags);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            return false;
+        }
+        rest += written;
+        remaining -= size_t(written);
+    }
+    return true;
+#else
+    Q_UNUSED(channel)
+    Q_UNUSED(message)
+    Q_UNUSED(descriptors)
+    return false;
+#endif
+}
+
+/**
+ * @brief Принимает кадр с дескрипторами.
+ *
+ * Дескрипторы приходят вместе с первыми байтами кадра, поэтому длина читается через recvmsg.
+ *
+ * @param channel Дескриптор канала.
+ * @param message Принятое сообщение.
+ * @param descriptors Принятые дескрипторы (владение переходит к вызывающему).
+ * @return true Если кадр принят и разобран.
+ */
+bool HotRestart::receiveFrame(qintptr channel, QJsonObject &message, QVector<qintptr> &descriptors)
+{
+    descriptors.clear();
+#ifdef Q_OS_UNIX
+    char length[4];
+    iovec vector = {};
+    vector.iov_base = length;
+    vector.iov_len = sizeof(length);
+    QByteArray control(int(CMSG_SPACE(sizeof(int) * maxDescriptorsPerFrame)), 0);
+    msghdr header = {};
+    header.msg_iov = &vector;
+    header.msg_iovlen = 1;
+    header.msg_control = control.data();
+    header.msg_controllen = size_t(control.size());
+
+    int flags = 0;
+#ifdef MSG_CMSG_CLOEXEC
+    flags |= MSG_CMSG_CLOEXEC;
+#endif
+    ssize_t received;
+    do
+    {
+        received = ::recvmsg(int(channel), &header, flags);
+    } while (received < 0 && errno == EINTR);
+    if (received <= 0)
+    {
+        return false;
+    }
+
+    for (cmsghdr *rights = CMSG_FIRSTHDR(&header); rights; rights = CMSG_NXTHDR(&header, rights))
+    {
+        if (rights->cmsg_level != SOL_SOCKET || rights->cmsg_type != SCM_RIGHTS)
+        {
+            continue;
+        }
+        int count = int((rights->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        const int *passed = reinterpret_cast<const int*>(CMSG_DATA(rights));
+        for (int i = 0; i < count; ++i)
+        {
+            descriptors.append(passed[i]);
+        }
+    }
+
+    bool valid = !(header.msg_flags & MSG_CTRUNC) &&
+                 readExactly(int(channel), length + received, sizeof(length) - size_t(received));
+    quint32 size = valid ? qFromBigEndian<quint32>(length) : 0;
+    QByteArray payload;
+    if (valid && size <= maxHandoffFrameSize)
+    {
+        payload.resize(int(size));
+        valid = readExactly(int(channel), payload.data(), size) && WireProtocol::decode(payload, message);
+    }
+    else
+    {
+        valid = false;
+    }
+
+    if (!valid)
+    {
+        for (qintptr descriptor : qAsConst(descriptors))
+        {
+            closeDescriptor(descriptor);
+        }
+        descriptors.clear();
+    }
+    return valid;
+#else
+    Q_UNUSED(channel)
+    Q_UNUSED(message)
+    return false;
+#endif
+}
+
+/**
+ * @brief Закрывает дескриптор.
+ *
+ * @param descriptor Дескриптор.
+ */
+void HotRestart::closeDescriptor(qintptr descriptor)
+{
+#ifdef Q_OS_UNIX
+    ::close(int(descriptor));
+#else
+    Q_UNUSED(descriptor)
+#endif
+}
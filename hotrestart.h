@@ -0,0 +1,117 @@
+/**
+ * /file hotrestart.h
+ * /brief Определение класса HotRestart для передачи сокетов новому процессу сервера при перезапуске.
+ */
+
+#ifndef HOTRESTART_H
+#define HOTRESTART_H
+
+#include <QObject>
+#include <QJsonObject>
+#include <QSocketNotifier>
+#include <QVector>
+
+/**
+ * /brief Класс HotRestart.
+ *
+ * Перезапуск без разрыва подключений. Работающий сервер слушает локальный Unix-сокет
+ * передачи; новый процесс при запуске подключается к нему, и старый передаёт через
+ * SCM_RIGHTS слушающие сокеты и подключения клиентов вместе с состоянием их сессий,
+ * после чего дожидается закрытия оставшихся подключений и завершается.
+ *
+ * Обмен идёт кадрами: 4 байта длины (big-endian) и сообщение CBOR; дескрипторы, если есть,
+ * прикрепляются к первому байту кадра. Передача блокирующая, так как выполняется один раз
+ * между двумя локальными процессами; ожидание ограничено тайм-аутом сокета.
+ *
+ * Передача дескрипторов доступна только в Unix-системах; в остальных isSupported()
+ * возвращает false и перезапуск выполняется обычным образом.
+ */
+class HotRestart : public QObject
+{
+    Q_OBJECT
+
+private:
+    qintptr listenDescriptor = -1; ///< Слушающий сокет передачи (-1, если не слушает).
+    QSocketNotifier *notifier = nullptr; ///< Уведомление о подключении нового процесса.
+
+private slots:
+    /**
+     * /brief Принимает подключение нового процесса.
+     */
+    void acceptSuccessor();
+
+public:
+    static const int maxDescriptorsPerFrame = 64; ///< Наибольшее число дескрипторов в одном кадре.
+
+    /**
+     * /brief Конструктор класса HotRestart.
+     * /param parent Указатель на родительский объект.
+     */
+    explicit HotRestart(QObject *parent = nullptr);
+
+    /**
+     * /brief Деструктор, закрывающий сокет передачи.
+     */
+    ~HotRestart() override;
+
+    /**
+     * /brief Проверяет, поддерживает ли система передачу дескрипторов.
+     * /return Признак поддержки.
+     */
+    static bool isSupported();
+
+    /**
+     * /brief Начинает ожидать подключения нового процесса.
+     * /param path Путь к Unix-сокету передачи.
+     * /return Признак успешного запуска.
+     */
+    bool listen(const QString &path);
+
+    /**
+     * /brief Перестаёт ожидать подключения нового процесса (файл сокета не удаляется).
+     */
+    void close();
+
+    /**
+     * /brief Подключается к работающему серверу для приёма сокетов.
+     * /param path Путь к Unix-сокету передачи.
+     * /return Дескриптор канала или -1, если работающего сервера нет.
+     */
+    static qintptr connectTo(const QString &path);
+
+    /**
+     * /brief Отправляет кадр с дескрипторами.
+     * /param channel Дескриптор канала.
+     * /param message Сообщение.
+     * /param descriptors Передаваемые дескрипторы (не больше maxDescriptorsPerFrame).
+     * /return Признак успешной отправки.
+     */
+    static bool sendFrame(qintptr channel, const QJsonObject &message, const QVector<qintptr> &descriptors = {});
+
+    /**
+     * /brief Принимает кадр с дескрипторами.
+     * /param channel Дескриптор канала.
+     * /param message Принятое сообщение.
+     * /param descriptors Принятые дескрипторы.
+     * /return Признак успешного приёма.
+     */
+    static bool receiveFrame(qintptr channel, QJsonObject &message, QVector<qintptr> &descriptors);
+
+    /**
+     * /brief Закрывает дескриптор (канал или не принятый сокет).
+     * /param descriptor Дескриптор.
+     */
+    static void closeDescriptor(qintptr descriptor);
+
+signals:
+    /**
+     * /brief Сигнал о подключении нового процесса.
+     *
+     * Получатель передаёт сокеты функцией sendFrame и закрывает канал closeDescriptor.
+     *
+     * /param channel Дескриптор канала.
+     */
+    void successorConnected(qintptr channel);
+};
+
+#endif // HOTRESTART_H
@@ -0,0 +1,577 @@
+#include "jsonenvelope.h"
+
+#include <QtAlgorithms>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define JSONENVELOPE_HAVE_SSE2
+#endif
+
+namespace
+{
+/**
+ * @brief Возвращает значение шестнадцатеричной цифры.
+ *
+ * @param character Символ.
+ * @return int Значение цифры или -1, если символ не является шестнадцатеричной цифрой.
+ */
+int hexValue(char character)
+{
+    if (character >= '0' && character <= '9')
+    {
+        return character - '0';
+    }
+    if (character >= 'a' && character <= 'f')
+    {
+        return character - 'a' + 10;
+    }
+    if (character >= 'A' && character <= 'F')
+    {
+        return character - 'A' + 10;
+    }
+    return -1;
+}
+
+/**
+ * @brief Проверяет, является ли символ десятичной цифрой.
+ *
+ * @param character Символ.
+ * @return true Если символ — цифра.
+ * @return false В противном случае.
+ */
+bool isDigit(char character)
+{
+    return character >= '0' && character <= '9';
+}
+
+/**
+ * @brief Проверяет, начинается ли буфер с указанного литерала.
+ *
+ * @param position Текущая позиция.
+ * @param end Конец буфера.
+ * @param literal Литерал (true, false или null).
+ * @return true Если литерал найден.
+ * @return false В противном случае.
+ */
+bool startsWith(const char *position, const char *end, const char *literal)
+{
+    size_t size = std::strlen(literal);
+    return size_t(end - position) >= size && std::memcmp(position, literal, size) == 0;
+}
+}
+
+/**
+ * @brief Пропускает пробельные символы JSON.
+ *
+ * @param position Текущая позиция.
+ * @param end Конец буфера.
+ * @return const char* Позиция первого непробельного символа.
+ */
+const char *JsonEnvelope::skipSpace(const char *position, const char *end)
+{
+    while (position < end && (*position == ' ' || *position == '\n' || *position == '\r' || *position == '\t'))
+    {
+        ++position;
+    }
+    return position;
+}
+
+/**
+ * @brief Разбирает строку JSON, начиная с символа после открывающей кавычки.
+ *
+ * Обычные символы пропускаются блоками по 16 байт (SSE2): в блоке ищутся кавычка,
+ * обратная косая черта и управляющие символы, после чего разбор продолжается с
+ * найденного символа. Строка с байтами вне ASCII проверяется на правильность UTF-8
+ * целиком после того, как найден её конец.
+ *
+ * @param position Текущая позиция.
+ * @param end Конец буфера.
+ * @param escaped Признак escape-последовательностей в строке.
+ * @return const char* Позиция закрывающей кавычки или nullptr, если строка ошибочна.
+ */
+const char *JsonEnvelope::scanString(const char *position, const char *end, bool &escaped)
+{
+    const char *start = position;
+    bool nonAscii = false;
+    escaped = false;
+#ifdef JSONENVELOPE_HAVE_SSE2
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i lastControl = _mm_set1_epi8(0x1F);
+#endif
+
+    for (;;)
+    {
+#ifdef JSONENVELOPE_HAVE_SSE2
+        while (end - position >= 16)
+        {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(position));
+            //Байт не больше 0x1F, если минимум из него и 0x1F равен ему самому
+            __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                                           _mm_cmpeq_epi8(_mm_min_epu8(chunk, lastControl), chunk));
+            if (_mm_movemask_epi8(chunk) != 0)
+            {
+                nonAscii = true;
+            }
+            int mask = _mm_movemask_epi8(special);
+            if (mask != 0)
+            {
+                position += qCountTrailingZeroBits(quint32(mask));
+                break;
+            }
+            position += 16;
+        }
+#endif
+        while (position < end)
+        {
+            uchar character = uchar(*position);
+            if (character == '"' || character == '\\' || character < 0x20)
+            {
+                break;
+            }
+            if (character >= 0x80)
+            {
+                nonAscii = true;
+            }
+            ++position;
+        }
+
+        if (position >= end || uchar(*position) < 0x20)
+        {
+            return nullptr;
+        }
+        if (*position == '"')
+        {
+            break;
+        }
+
+        //Escape-последовательность проверяется здесь, раскрывается только в toString()
+        escaped = true;
+        ++position;
+        if (position >= end)
+        {
+            return nullptr;
+        }
+        switch (*position)
+        {
+        case '"':
+        case '\\':
+        case '/':
+        case 'b':
+        case 'f':
+        case 'n':
+        case 'r':
+        case 't':
+            ++position;
+            break;
+        case 'u':
+            if (end - position < 5)
+            {
+                return nullptr;
+            }
+            for (int i = 1; i <= 4; ++i)
+            {
+                if (hexValue(position[i]) < 0)
+                {
+                    return nullptr;
+                }
+            }
+            position += 5;
+            break;
+        default:
+            return nullptr;
+        }
+    }
+
+    if (nonAscii && !isValidUtf8(start, int(position - start)))
+    {
+        return nullptr;
+    }
+    return position;
+}
+
+/**
+ * @brief Разбирает число JSON.
+ *
+ * @param position Текущая позиция.
+ * @param end Конец буфера.
+ * @return const char* Позиция после числа или nullptr, если число ошибочно.
+ */
+const char *JsonEnvelope::scanNumber(const char *position, const char *end)
+{
+    if (position < end && *position == '-')
+    {
+        ++position;
+    }
+    if (position >= end || !isDigit(*position))
+    {
+        return nullptr;
+    }
+    //Ведущие нули не допускаются
+    if (*position == '0')
+    {
+        ++position;
+    }
+    else
+    {
+        while (position < end && isDigit(*position))
+        {
+            ++position;
+        }
+    }
+    if (position < end && *position == '.')
+    {
+        ++position;
+        if (position >= end || !isDigit(*position))
+        {
+            return nullptr;
+        }
+        while (position < end && isDigit(*position))
+        {
+            ++position;
+        }
+    }
+    if (position < end && (*position == 'e' || *position == 'E'))
+    {
+        ++position;
+        if (position < end && (*position == '+' || *position == '-'))
+        {
+            ++position;
+        }
+        if (position >= end || !isDigit(*position))
+        {
+            return nullptr;
+        }
+        while (position < end && isDigit(*position))
+        {
+            ++position;
+        }
+    }
+    return position;
+}
+
+/**
+ * @brief Проверяет, что байты строки составляют правильную последовательность UTF-8.
+ *
+ * Отвергаются избыточно длинные формы, суррогаты и значения больше U+10FFFF, так же
+ * как при разборе через QJsonDocument.
+ *
+ * @param data Начало строки.
+ * @param size Размер строки в байтах.
+ * @return true Если последовательность правильная.
+ * @return false В противном случае.
+ */
+bool JsonEnvelope::isValidUtf8(const char *data, int size)
+{
+    const uchar *position = reinterpret_cast<const uchar *>(data);
+    const uchar *end = position + size;
+    while (position < end)
+    {
+        uchar lead = *position;
+        if (lead < 0x80)
+        {
+            ++position;
+            continue;
+        }
+
+        int length = 0;
+        uchar low = 0x80;  //Допустимый диапазон второго байта
+        uchar high = 0xBF;
+        if (lead >= 0xC2 && lead <= 0xDF)
+        {
+            length = 2;
+        }
+        else if (lead >= 0xE0 && lead <= 0xEF)
+        {
+            length = 3;
+            if (lead == 0xE0)
+            {
+                low = 0xA0;
+            }
+            else if (lead == 0xED)
+            {
+                high = 0x9F;
+            }
+        }
+        else if (lead >= 0xF0 && lead <= 0xF4)
+        {
+            length = 4;
+            if (lead == 0xF0)
+            {
+                low = 0x90;
+            }
+            else if (lead == 0xF4)
+            {
+                high = 0x8F;
+            }
+        }
+        else
+        {
+            return false;
+        }
+
+        if (end - position < length || position[1] < low || position[1] > high)
+        {
+            return false;
+        }
+        for (int i = 2; i < length; ++i)
+        {
+            if ((position[i] & 0xC0) != 0x80)
+            {
+                return false;
+            }
+        }
+        position += length;
+    }
+    return true;
+}
+
+/**
+ * @brief Разбирает запрос.
+ *
+ * @param data Принятые байты.
+ * @return true Если запрос — плоский объект JSON и разобран.
+ * @return false Если запрос нужно разбирать через WireProtocol::decode() (в том числе
+ * запрос в CBOR и ошибочный JSON).
+ */
+bool JsonEnvelope::scan(const QByteArray &data)
+{
+    fields.clear();
+    const char *end = data.constData() + data.size();
+    const char *position = skipSpace(data.constData(), end);
+    if (position >= end || *position != '{')
+    {
+        return false;
+    }
+    position = skipSpace(position + 1, end);
+    if (position < end && *position == '}')
+    {
+        return skipSpace(position + 1, end) == end;
+    }
+
+    for (;;)
+    {
+        if (position >= end || *position != '"' || fields.size() >= maxFields)
+        {
+            return false;
+        }
+
+        Field field;
+        bool escaped = false;
+        const char *keyEnd = scanString(position + 1, end, escaped);
+        if (!keyEnd || escaped)
+        {
+            return false;
+        }
+        for (const char *character = position + 1; character < keyEnd; ++character)
+        {
+            if (uchar(*character) >= 0x80)
+            {
+                return false;
+            }
+        }
+        field.key = QLatin1String(position + 1, int(keyEnd - position - 1));
+        if (find(field.key))
+        {
+            return false;
+        }
+
+        position = skipSpace(keyEnd + 1, end);
+        if (position >= end || *position != ':')
+        {
+            return false;
+        }
+        position = skipSpace(position + 1, end);
+        if (position >= end)
+        {
+            return false;
+        }
+
+        field.value = position;
+        if (*position == '"')
+        {
+            const char *valueEnd = scanString(position + 1, end, field.escaped);
+            if (!valueEnd)
+            {
+                return false;
+            }
+            field.kind = Kind::String;
+            field.value = position + 1;
+            field.size = int(valueEnd - field.value);
+            position = valueEnd + 1;
+        }
+        else if (startsWith(position, end, "true") || startsWith(position, end, "false"))
+        {
+            field.kind = Kind::Bool;
+            field.size = *position == 't' ? 4 : 5;
+            position += field.size;
+        }
+        else if (startsWith(position, end, "null"))
+        {
+            field.kind = Kind::Null;
+            field.size = 4;
+            position += field.size;
+        }
+        else
+        {
+            //Сюда же попадают вложенные объекты и массивы: они разбираются через QJsonDocument
+            const char *valueEnd = scanNumber(position, end);
+            if (!valueEnd)
+            {
+                return false;
+            }
+            field.kind = Kind::Number;
+            field.size = int(valueEnd - position);
+            position = valueEnd;
+        }
+        fields.append(field);
+
+        position = skipSpace(position, end);
+        if (position >= end)
+        {
+            return false;
+        }
+        if (*position == '}')
+        {
+            break;
+        }
+        if (*position != ',')
+        {
+            return false;
+        }
+        position = skipSpace(position + 1, end);
+    }
+    return skipSpace(position + 1, end) == end;
+}
+
+/**
+ * @brief Возвращает поле по ключу.
+ *
+ * @param key Ключ.
+ * @return const Field* Указатель на поле или nullptr, если поля нет.
+ */
+const JsonEnvelope::Field *JsonEnvelope::find(QLatin1String key) const
+{
+    for (const Field &field : fields)
+    {
+        if (field.key == key)
+        {
+            return &field;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Возвращает тип запроса.
+ *
+ * @return QString Значение поля type или пустая строка, как у QJsonValue::toString().
+ */
+QString JsonEnvelope::type() const
+{
+    const Field *field = find(QLatin1String("type"));
+    return field && field->kind == Kind::String ? toString(*field) : QString();
+}
+
+/**
+ * @brief Возвращает значение строкового поля.
+ *
+ * Строка без escape-последовательностей переводится из UTF-8 одним вызовом. Остальные
+ * строки раскрываются в черновой буфер UTF-16 из арены запроса (UTF-8 уже проверен при
+ * разборе) и копируются в QString один раз. Каждый байт строки даёт не больше одного
+ * кода UTF-16 (четырёхбайтовая последовательность — два), поэтому буфера размером
+ * в строку достаточно. \uXXXX даёт один код UTF-16, так что суррогатные пары
+ * собираются сами собой.
+ *
+ * @param field Поле вида Kind::String.
+ * @return QString Строка.
+ */
+QString JsonEnvelope::toString(const Field &field) const
+{
+    if (!field.escaped)
+    {
+        return QString::fromUtf8(field.value, field.size);
+    }
+
+    QVarLengthArray<QChar, 256> local;
+    QChar *buffer = nullptr;
+    if (arena)
+    {
+        buffer = arena->allocateArray<QChar>(field.size);
+    }
+    else
+    {
+        local.resize(field.size);
+        buffer = local.data();
+    }
+
+    int length = 0;
+    const uchar *position = reinterpret_cast<const uchar *>(field.value);
+    const uchar *end = position + field.size;
+    while (position < end)
+    {
+        uchar lead = *position;
+        if (lead == '\\')
+        {
+            uchar code = position[1];
+            position += 2;
+            switch (code)
+            {
+            case 'b':
+                buffer[length++] = QChar(ushort('\b'));
+                break;
+            case 'f':
+                buffer[length++] = QChar(ushort('\f'));
+                break;
+            case 'n':
+                buffer[length++] = QChar(ushort('\n'));
+                break;
+            case 'r':
+                buffer[length++] = QChar(ushort('\r'));
+                break;
+            case 't':
+                buffer[length++] = QChar(ushort('\t'));
+                break;
+            case 'u':
+            {
+                ushort unit = 0;
+                for (int i = 0; i < 4; ++i)
+                {
+                    unit = ushort((unit << 4) | hexValue(char(position[i])));
+                }
+                buffer[length++] = QChar(unit);
+                position += 4;
+                break;
+            }
+            default:
+                //Кавычка, обратная и прямая косая черта
+                buffer[length++] = QChar(ushort(code));
+                break;
+            }
+        }
+        else if (lead < 0x80)
+        {
+            buffer[length++] = QChar(ushort(lead));
+            ++position;
+        }
+        else if (lead < 0xE0)
+        {
+            buffer[length++] = QChar(ushort(((lead & 0x1F) << 6) | (position[1] & 0x3F)));
+            position += 2;
+        }
+        else if (lead < 0xF0)
+        {
+            buffer[length++] = QChar(ushort(((lead & 0x0F) << 12) | ((position[1] & 0x3F) << 6) | (position[2] & 0x3F)));
+            position += 3;
+        }
+        else
+        {
+            uint codePoint = ((lead & 0x07u) << 18) | ((position[1] & 0x3Fu) << 12) | ((position[2] & 0x3Fu) << 6) | (position[3] & 0x3Fu);
+            buffer[length++] = QChar::highSurrogate(codePoint);
+            buffer[length++] = QChar::lowSurrogate(codePoint);
+            position += 4;
+        }
+    }
+    return QString(buffer, length);
+}
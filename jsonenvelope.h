@@ -0,0 +1,135 @@
+/**
+ * /file jsonenvelope.h
+ * /brief Определение класса JsonEnvelope — разбора запроса JSON за один проход без построения QJsonObject.
+ */
+
+#ifndef JSONENVELOPE_H
+#define JSONENVELOPE_H
+
+#include "requestarena.h"
+
+#include <QByteArray>
+#include <QLatin1String>
+#include <QString>
+#include <QVarLengthArray>
+
+/**
+ * /brief Класс JsonEnvelope.
+ *
+ * Разбирает запрос JSON обычного вида — плоский объект, значения которого строки, числа,
+ * true/false или null, — одним проходом по принятому буферу. Для каждого поля запоминаются
+ * только границы ключа и значения в буфере: строки не копируются, пока обработчику не
+ * понадобится их значение, а QJsonDocument и дерево QJsonObject не создаются вовсе.
+ * Поиск конца строки (самая длинная часть запроса send_message — текст сообщения)
+ * выполняется командами SSE2 по 16 байт, если процессор их поддерживает.
+ *
+ * Разбор не удаётся для всего, что выходит за этот вид: вложенных объектов и массивов,
+ * ключей с escape-последовательностями или символами вне ASCII, повторяющихся ключей,
+ * а также для ошибочного JSON. Такой запрос разбирается прежним способом через
+ * WireProtocol::decode(), который и сообщает об ошибках формата.
+ *
+ * Поля ссылаются на данные разобранного буфера, поэтому JsonEnvelope не должен
+ * использоваться после изменения или освобождения буфера. Черновые буферы для строк
+ * с escape-последовательностями берутся из арены запроса, если она задана.
+ */
+class JsonEnvelope
+{
+public:
+    /**
+     * /brief Тип значения поля.
+     */
+    enum class Kind
+    {
+        String, ///< Строка.
+        Number, ///< Число.
+        Bool,   ///< true или false.
+        Null    ///< null.
+    };
+
+    /**
+     * /brief Поле запроса: границы ключа и значения в буфере.
+     */
+    struct Field
+    {
+        QLatin1String key; ///< Ключ (без кавычек).
+        Kind kind = Kind::Null; ///< Тип значения.
+        const char *value = nullptr; ///< Начало значения (у строки — без кавычек).
+        int size = 0; ///< Размер значения в байтах.
+        bool escaped = false; ///< Признак escape-последовательностей в строке.
+    };
+
+private:
+    static const int maxFields = 32; ///< Наибольшее количество полей запроса обычного вида.
+
+    QVarLengthArray<Field, 16> fields; ///< Поля запроса в порядке следования.
+    RequestArena *arena = nullptr; ///< Арена запроса для черновых буферов (может отсутствовать).
+
+    /**
+     * /brief Пропускает пробельные символы JSON.
+     * /param position Текущая позиция.
+     * /param end Конец буфера.
+     * /return Позиция первого непробельного символа.
+     */
+    static const char *skipSpace(const char *position, const char *end);
+
+    /**
+     * /brief Разбирает строку JSON, начиная с символа после открывающей кавычки.
+     * /param position Текущая позиция.
+     * /param end Конец буфера.
+     * /param escaped Признак escape-последовательностей в строке.
+     * /return Позиция закрывающей кавычки или nullptr, если строка ошибочна.
+     */
+    static const char *scanString(const char *position, const char *end, bool &escaped);
+
+    /**
+     * /brief Разбирает число JSON.
+     * /param position Текущая позиция.
+     * /param end Конец буфера.
+     * /return Позиция после числа или nullptr, если число ошибочно.
+     */
+    static const char *scanNumber(const char *position, const char *end);
+
+    /**
+     * /brief Проверяет, что байты строки составляют правильную последовательность UTF-8.
+     * /param data Начало строки.
+     * /param size Размер строки в байтах.
+     * /return Признак правильной последовательности.
+     */
+    static bool isValidUtf8(const char *data, int size);
+
+public:
+    /**
+     * /brief Конструктор.
+     * /param arena Арена запроса для черновых буферов; nullptr — буферы на стеке и в куче.
+     */
+    explicit JsonEnvelope(RequestArena *arena = nullptr) : arena(arena) {}
+
+    /**
+     * /brief Разбирает запрос.
+     * /param data Принятые байты.
+     * /return Признак того, что запрос имеет обычный вид и разобран.
+     */
+    bool scan(const QByteArray &data);
+
+    /**
+     * /brief Возвращает поле по ключу.
+     * /param key Ключ.
+     * /return Указатель на поле или nullptr, если поля нет.
+     */
+    const Field *find(QLatin1String key) const;
+
+    /**
+     * /brief Возвращает тип запроса (поле type).
+     * /return Тип запроса или пустая строка, если поле отсутствует или не является строкой.
+     */
+    QString type() const;
+
+    /**
+     * /brief Возвращает значение строкового поля с раскрытыми escape-последовательностями.
+     * /param field Поле вида Kind::String.
+     * /return Строка.
+     */
+    QString toString(const Field &field) const;
+};
+
+#endif // JSONENVELOPE_H
@@ -7,12 +7,19 @@
 #include "serverlogic.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
+
+#ifdef SERVER_HAVE_QCA
+#include <QtCrypto>
+#endif
 
 /**
  * /brief Главная функция приложения.
  *
  * Эта функция инициализирует приложение, создает экземпляр логики сервера,
- * запускает сервер на указанном порту и отображает графический интерфейс.
+ * запускает сервер на указанном порту (параметр --port, по умолчанию 3000) и отображает
+ * графический интерфейс. Параметр --port позволяет запустить на одной машине несколько
+ * экземпляров, объединённых шиной (см. tools/cluster).
  * Также устанавливает соединение между сигналом закрытия окна и
  * слотом завершения работы сервера, чтобы гарантировать его корректное завершение.
  *
@@ -23,9 +30,18 @@
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv); ///< Инициализация приложения.
+#ifdef SERVER_HAVE_QCA
+    QCA::Initializer cryptoInitializer; ///< Инициализация qca для зашифрованных сессий.
+#endif
+
+    QCommandLineParser parser;
+    QCommandLineOption portOption("port", "Port to listen on.", "port", "3000");
+    parser.addHelpOption();
+    parser.addOption(portOption);
+    parser.process(a);
 
     ServerLogic server; ///< Создание экземпляра логики сервера.
-    int port = 3000; ///< Установка порта, на котором сервер будет слушать входящие соединения.
+    int port = parser.value(portOption).toInt(); ///< Порт, на котором сервер будет слушать входящие соединения.
     server.startServer(port); ///< Запуск сервера на заданном порту.
 
     ServerUI window; ///< Создание экземпляра пользовательского интерфейса сервера.
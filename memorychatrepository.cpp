@@ -0,0 +1,845 @@
+#include "memorychatrepository.h"
+
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QMutexLocker>
+#include <algorithm>
+
+/**
+ * @brief Деструктор класса MemoryChatRepository.
+ */
+MemoryChatRepository::~MemoryChatRepository()
+{
+    waitForAsyncCalls();
+}
+
+/**
+ * @brief Заменяет содержимое хранилища данными из базы SQLite сервера.
+ *
+ * Сообщения каждого чата упорядочиваются по времени отправки, как в истории из базы.
+ *
+ * @param database База данных сервера.
+ * @return true Если все таблицы прочитаны.
+ */
+bool MemoryChatRepository::load(const QSqlDatabase &database)
+{
+    QMutexLocker locker(&mutex);
+    clear();
+
+    QSqlQuery query(database);
+    if (!query.exec("SELECT user_id, login, password, nickname, tokens_revoked_at FROM user_auth ORDER BY user_id"))
+    {
+        setLastError(query.lastError().text());
+        return false;
+    }
+    while (query.next())
+    {
+        UserRecord user;
+        user.userId = query.value(0).toInt();
+        user.login = query.value(1).toString();
+        user.password = query.value(2).toString();
+        user.nickname = query.value(3).toString();
+        user.tokensRevokedAt = query.value(4).toLongLong();
+        users.insert(user.userId, user);
+        userIdsByLogin.insert(user.login, user.userId);
+        nextUserId = qMax(nextUserId, user.userId + 1);
+    }
+
+    if (!query.exec("SELECT chat_id, chat_name, chat_type FROM chats ORDER BY chat_id"))
+    {
+        setLastError(query.lastError().text());
+        return false;
+    }
+    while (query.next())
+    {
+        int chatId = query.value(0).toInt();
+        Chat &chat = chats[chatId];
+        chat.name = query.value(1).toString();
+        chat.chatType = query.value(2).toString();
+        if (!chatIdsByName.contains(chat.name))
+        {
+            chatIdsByName.insert(chat.name, chatId);
+        }
+        nextChatId = qMax(nextChatId, chatId + 1);
+    }
+
+    if (!query.exec("SELECT chat_id, user_id FROM chat_participants"))
+    {
+        setLastError(query.lastError().text());
+        return false;
+    }
+    while (query.next())
+    {
+        addParticipantLocked(query.value(0).toInt(), query.value(1).toInt());
+    }
+
+    if (!query.exec("SELECT message_id, chat_id, user_id, message_text, timestamp_sent, client_msg_id, chat_seq "
+                    "FROM messages ORDER BY chat_id, chat_seq"))
+    {
+        setLastError(query.lastError().text());
+        return false;
+    }
+    while (query.next())
+    {
+        MessageRecord message;
+        message.messageId = query.value(0).toInt();
+        message.chatId = query.value(1).toInt();
+        message.userId = query.value(2).toInt();
+        message.text = query.value(3).toString();
+        message.timestamp = query.value(4).toString();
+        message.clientMessageId = query.value(5).toString();
+        message.seq = query.value(6).toLongLong();
+        messagesByChat[message.chatId].append(message);
+        if (!message.clientMessageId.isEmpty())
+        {
+            messagesByClientId.insert(clientKey(message.chatId, message.userId, message.clientMessageId), message);
+        }
+        qint64 &last = lastSeqs[message.chatId];
+        last = qMax(last, message.seq);
+        nextMessageId = qMax(nextMessageId, message.messageId + 1);
+    }
+
+    if (!query.exec("SELECT message_id, user_id FROM message_read_status"))
+    {
+        setLastError(query.lastError().text());
+        return false;
+    }
+    while (query.next())
+    {
+        markReadLocked(query.value(0).toInt(), query.value(1).toInt());
+    }
+    return true;
+}
+
+/**
+ * @brief Удаляет все данные хранилища.
+ */
+void MemoryChatRepository::clear()
+{
+    QMutexLocker locker(&mutex);
+    users.clear();
+    userIdsByLogin.clear();
+    chats.clear();
+    chatIdsByName.clear();
+    chatsByUser.clear();
+    messagesByChat.clear();
+    messagesByClientId.clear();
+    lastSeqs.clear();
+    readerCounts.clear();
+    readMarks.clear();
+    nextUserId = 1;
+    nextChatId = 1;
+    nextMessageId = 1;
+}
+
+/**
+ * @brief Добавляет участника в чат (без блокировки).
+ *
+ * Участники несуществующих чатов и повторные добавления пропускаются.
+ *
+ * @param chatId Идентификатор чата.
+ * @param userId Идентификатор пользователя.
+ */
+void MemoryChatRepository::addParticipantLocked(int chatId, int userId)
+{
+    auto chat = chats.find(chatId);
+    if (chat == chats.end() || chat->participants.contains(userId))
+    {
+        return;
+    }
+    chat->participants.append(userId);
+    chatsByUser[userId].append(chatId);
+}
+
+/**
+ * @brief Сохраняет сообщение (без блокировки).
+ *
+ * @param message Сообщение.
+ * @return true Если сообщение сохранено.
+ */
+bool MemoryChatRepository::insertMessageLocked(MessageRecord &message)
+{
+    QString key;
+    if (!message.clientMessageId.isEmpty())
+    {
+        key = clientKey(message.chatId, message.userId, message.clientMessageId);
+        if (messagesByClientId.contains(key))
+        {
+            setLastError("Duplicate client_msg_id");
+            return false;
+        }
+    }
+
+    qint64 &last = lastSeqs[message.chatId];
+    if (message.seq <= 0)
+    {
+        message.seq = last + 1;
+    }
+    last = qMax(last, message.seq);
+    message.messageId = nextMessageId++;
+    message.senderLogin.clear();
+    messagesByChat[message.chatId].append(message);
+    if (!key.isEmpty())
+    {
+        messagesByClientId.insert(key, message);
+    }
+    return true;
+}
+
+/**
+ * @brief Ставит отметку о прочтении (без блокировки).
+ *
+ * @param messageId Идентификатор сообщения.
+ * @param userId Идентификатор читателя.
+ * @return true Если отметки ещё не было.
+ */
+bool MemoryChatRepository::markReadLocked(int messageId, int userId)
+{
+    quint64 key = readKey(messageId, userId);
+    if (readMarks.contains(key))
+    {
+        return false;
+    }
+    readMarks.insert(key);
+    ++readerCounts[messageId];
+    return true;
+}
+
+/**
+ * @brief Дописывает чаты пользователя указанного типа в список (без блокировки).
+ *
+ * Для личных чатов название заменяется отображаемым именем каждого другого участника.
+ *
+ * @param login Логин пользователя.
+ * @param chatType Тип чатов.
+ * @param chatList Список чатов.
+ */
+void MemoryChatRepository::appendChatsLocked(const QString &login, const QString &chatType, QVector<ChatSummary> &chatList) const
+{
+    int userId = userIdsByLogin.value(login, -1);
+    bool personal = chatType == "personal";
+    for (int chatId : chatsByUser.value(userId))
+    {
+        auto chat = chats.constFind(chatId);
+        if (chat == chats.constEnd() || chat->chatType != chatType)
+        {
+            continue;
+        }
+        ChatSummary summary;
+        summary.chatId = chatId;
+        summary.chatType = chat->chatType;
+        if (!personal)
+        {
+            summary.title = chat->name;
+            chatList.append(summary);
+            continue;
+        }
+        for (int memberId : chat->participants)
+        {
+            auto member = users.constFind(memberId);
+            if (memberId != userId && member != users.constEnd())
+            {
+                summary.title = member->nickname;
+                chatList.append(summary);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Возвращает имя реализации хранилища.
+ *
+ * @return QString "memory".
+ */
+QString MemoryChatRepository::engineName() const
+{
+    return "memory";
+}
+
+/**
+ * @brief Проверяет, свободен ли логин.
+ *
+ * @param login Логин.
+ * @return true Если логин свободен.
+ */
+bool MemoryChatRepository::isLoginAvailable(const QString &login)
+{
+    QMutexLocker locker(&mutex);
+    return !userIdsByLogin.contains(login);
+}
+
+/**
+ * @brief Возвращает идентификатор пользователя по логину.
+ *
+ * @param login Логин.
+ * @return int Идентификатор или -1.
+ */
+int MemoryChatRepository::userIdByLogin(const QString &login)
+{
+    QMutexLocker locker(&mutex);
+    return userIdsByLogin.value(login, -1);
+}
+
+/**
+ * @brief Ищет учётную запись по логину.
+ *
+ * @param login Логин.
+ * @param user Найденная учётная запись.
+ * @return true Если пользователь найден.
+ */
+bool MemoryChatRepository::findUser(const QString &login, UserRecord &user)
+{
+    QMutexLocker locker(&mutex);
+    auto it = userIdsByLogin.constFind(login);
+    if (it == userIdsByLogin.constEnd())
+    {
+        return false;
+    }
+    user = users.value(*it);
+    return true;
+}
+
+/**
+ * @brief Создаёт пользователя.
+ *
+ * @param login Логин.
+ * @param password Хеш пароля.
+ * @param nickname Отображаемое имя.
+ * @return int Идентификатор нового пользователя или -1.
+ */
+int MemoryChatRepository::createUser(const QString &login, const QString &password, const QString &nickname)
+{
+    QMutexLocker locker(&mutex);
+    if (userIdsByLogin.contains(login))
+    {
+        setLastError("Login already exists");
+        return -1;
+    }
+    UserRecord user;
+    user.userId = nextUserId++;
+    user.login = login;
+    user.password = password;
+    user.nickname = nickname;
+    users.insert(user.userId, user);
+    userIdsByLogin.insert(login, user.userId);
+    return user.userId;
+}
+
+/**
+ * @brief Заменяет хеш пароля пользователя.
+ *
+ * @param login Логин.
+ * @param password Новый хеш пароля.
+ * @return true Всегда (несуществующий логин не изменяет данных).
+ */
+bool MemoryChatRepository::updatePassword(const QString &login, const QString &password)
+{
+    QMutexLocker locker(&mutex);
+    auto it = userIdsByLogin.constFind(login);
+    if (it != userIdsByLogin.constEnd())
+    {
+        users[*it].password = password;
+    }
+    return true;
+}
+
+/**
+ * @brief Заменяет хеш пароля, только если он не изменился с момента чтения.
+ *
+ * @param userId Идентификатор пользователя.
+ * @param oldPassword Прочитанный хеш пароля.
+ * @param newPassword Новый хеш пароля.
+ * @return true Если хеш заменён.
+ */
+bool MemoryChatRepository::upgradePassword(int userId, const QString &oldPassword, const QString &newPassword)
+{
+    QMutexLocker locker(&mutex);
+    auto it = users.find(userId);
+    if (it == users.end() || it->password != oldPassword)
+    {
+        return false;
+    }
+    it->password = newPassword;
+    return true;
+}
+
+/**
+ * @brief Меняет логин и хеш пароля пользователя.
+ *
+ * @param oldLogin Прежний логин.
+ * @param newLogin Новый логин.
+ * @param password Новый хеш пароля.
+ * @return true Если запись выполнена (false, если новый логин занят).
+ */
+bool MemoryChatRepository::updateLogin(const QString &oldLogin, const QString &newLogin, const QString &password)
+{
+    QMutexLocker locker(&mutex);
+    auto it = userIdsByLogin.constFind(oldLogin);
+    if (it == userIdsByLogin.constEnd())
+    {
+        return true;
+    }
+    if (newLogin != oldLogin && userIdsByLogin.contains(newLogin))
+    {
+        setLastError("Login already exists");
+        return false;
+    }
+    int userId = *it;
+    userIdsByLogin.remove(oldLogin);
+    userIdsByLogin.insert(newLogin, userId);
+    UserRecord &user = users[userId];
+    user.login = newLogin;
+    user.password = password;
+    return true;
+}
+
+/**
+ * @brief Меняет отображаемое имя пользователя.
+ *
+ * @param login Логин.
+ * @param nickname Новое имя.
+ * @return true Всегда (несуществующий логин не изменяет данных).
+ */
+bool MemoryChatRepository::updateNickname(const QString &login, const QString &nickname)
+{
+    QMutexLocker locker(&mutex);
+    auto it = userIdsByLogin.constFind(login);
+    if (it != userIdsByLogin.constEnd())
+    {
+        users[*it].nickname = nickname;
+    }
+    return true;
+}
+
+/**
+ * @brief Отзывает токены сессии пользователя, выданные до указанного момента.
+ *
+ * @param userId Идентификатор пользователя.
+ * @param revokedAt Момент отзыва (секунды с начала эпохи).
+ * @return true Всегда (несуществующий пользователь не изменяет данных).
+ */
+bool MemoryChatRepository::revokeTokens(int userId, qint64 revokedAt)
+{
+    QMutexLocker locker(&mutex);
+    auto it = users.find(userId);
+    if (it != users.end())
+    {
+        it->tokensRevokedAt = qMax(it->tokensRevokedAt, revokedAt);
+    }
+    return true;
+}
+
+/**
+ * @brief Читает моменты отзыва токенов сессии.
+ *
+ * @param revokedAt Моменты отзыва по идентификаторам пользователей.
+ * @return true Всегда.
+ */
+bool MemoryChatRepository::tokenRevocations(QHash<int, qint64> &revokedAt)
+{
+    QMutexLocker locker(&mutex);
+    revokedAt.clear();
+    for (const UserRecord &user : qAsConst(users))
+    {
+        if (user.tokensRevokedAt > 0)
+        {
+            revokedAt.insert(user.userId, user.tokensRevokedAt);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Ищет пользователей по части отображаемого имени.
+ *
+ * @param nicknamePart Часть имени.
+ * @param exceptLogin Логин, исключаемый из результатов.
+ * @param visit Обработчик найденных пользователей.
+ * @return true Всегда.
+ */
+bool MemoryChatRepository::findUsers(const QString &nicknamePart, const QString &exceptLogin, const UserVisitor &visit)
+{
+    QMutexLocker locker(&mutex);
+    for (const UserRecord &user : qAsConst(users))
+    {
+        if (user.login != exceptLogin && user.nickname.contains(nicknamePart, Qt::CaseInsensitive))
+        {
+            visit(user);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Ищет чат по одному из названий.
+ *
+ * @param names Возможные названия чата.
+ * @return int Идентификатор первого созданного из найденных чатов или -1.
+ */
+int MemoryChatRepository::chatIdByName(const QStringList &names)
+{
+    QMutexLocker locker(&mutex);
+    int found = -1;
+    for (const QString &name : names)
+    {
+        int chatId = chatIdsByName.value(name, -1);
+        if (chatId >= 0 && (found < 0 || chatId < found))
+        {
+            found = chatId;
+        }
+    }
+    return found;
+}
+
+/**
+ * @brief Создаёт чат без участников.
+ *
+ * @param name Название чата.
+ * @param chatType Тип чата.
+ * @return int Идентификатор нового чата.
+ */
+int MemoryChatRepository::createChat(const QString &name, const QString &chatType)
+{
+    QMutexLocker locker(&mutex);
+    int chatId = nextChatId++;
+    Chat &chat = chats[chatId];
+    chat.name = name;
+    chat.chatType = chatType;
+    if (!chatIdsByName.contains(name))
+    {
+        chatIdsByName.insert(name, chatId);
+    }
+    return chatId;
+}
+
+/**
+ * @brief Добавляет в чат пользователей с указанными логинами.
+ *
+ * @param chatId Идентификатор чата.
+ * @param logins Логины участников.
+ * @return true Всегда.
+ */
+bool MemoryChatRepository::addParticipants(int chatId, const QStringList &logins)
+{
+    QMutexLocker locker(&mutex);
+    for (const QString &login : logins)
+    {
+        auto it = userIdsByLogin.constFind(login);
+        if (it != userIdsByLogin.constEnd())
+        {
+            addParticipantLocked(chatId, *it);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Удаляет чат вместе с участниками и сообщениями.
+ *
+ * @param chatId Идентификатор чата.
+ * @return true Всегда.
+ */
+bool MemoryChatRepository::deleteChat(int chatId)
+{
+    QMutexLocker locker(&mutex);
+    auto chat = chats.find(chatId);
+    if (chat == chats.end())
+    {
+        return true;
+    }
+    for (int userId : qAsConst(chat->participants))
+    {
+        chatsByUser[userId].removeAll(chatId);
+    }
+    if (chatIdsByName.value(chat->name) == chatId)
+    {
+        chatIdsByName.remove(chat->name);
+    }
+    chats.erase(chat);
+
+    const QVector<MessageRecord> messages = messagesByChat.take(chatId);
+    for (const MessageRecord &message : messages)
+    {
+        if (!message.clientMessageId.isEmpty())
+        {
+            messagesByClientId.remove(clientKey(message.chatId, message.userId, message.clientMessageId));
+        }
+        readerCounts.remove(message.messageId);
+    }
+    lastSeqs.remove(chatId);
+    return true;
+}
+
+/**
+ * @brief Возвращает участников чата.
+ *
+ * @param chatId Идентификатор чата.
+ * @param userIds Идентификаторы участников.
+ * @return true Всегда.
+ */
+bool MemoryChatRepository::participants(int chatId, QVector<int> &userIds)
+{
+    QMutexLocker locker(&mutex);
+    userIds += chats.value(chatId).participants;
+    return true;
+}
+
+/**
+ * @brief Возвращает участников нескольких чатов.
+ *
+ * @param chatIds Идентификаторы чатов.
+ * @param members Участники по чатам.
+ * @return true Всегда.
+ */
+bool MemoryChatRepository::participants(const QVector<int> &chatIds, QHash<int, QVector<int>> &members)
+{
+    QMutexLocker locker(&mutex);
+    for (int chatId : chatIds)
+    {
+        auto chat = chats.constFind(chatId);
+        if (chat != chats.constEnd() && !chat->participants.isEmpty())
+        {
+            members[chatId] += chat->participants;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Возвращает чаты пользователя.
+ *
+ * @param userId Идентификатор пользователя.
+ * @param chatIds Идентификаторы чатов.
+ * @return true Всегда.
+ */
+bool MemoryChatRepository::chatsOf(int userId, QVector<int> &chatIds)
+{
+    QMutexLocker locker(&mutex);
+    chatIds += chatsByUser.value(userId);
+    return true;
+}
+
+/**
+ * @brief Возвращает чаты пользователя вместе с их участниками.
+ *
+ * @param userId Идентификатор пользователя.
+ * @param members Участники по чатам.
+ * @return true Всегда.
+ */
+bool MemoryChatRepository::membershipsOf(int userId, QHash<int, QVector<int>> &members)
+{
+    QMutexLocker locker(&mutex);
+    return participants(chatsByUser.value(userId), members);
+}
+
+/**
+ * @brief Дописывает личные чаты пользователя в список.
+ *
+ * @param login Логин пользователя.
+ * @param chatList Список чатов.
+ * @return true Всегда.
+ */
+bool MemoryChatRepository::personalChats(const QString &login, QVector<ChatSummary> &chatList)
+{
+    QMutexLocker locker(&mutex);
+    appendChatsLocked(login, "personal", chatList);
+    return true;
+}
+
+/**
+ * @brief Дописывает групповые чаты пользователя в список.
+ *
+ * @param login Логин пользователя.
+ * @param chatList Список чатов.
+ * @return true Всегда.
+ */
+bool MemoryChatRepository::groupChats(const QString &login, QVector<ChatSummary> &chatList)
+{
+    QMutexLocker locker(&mutex);
+    appendChatsLocked(login, "group", chatList);
+    return true;
+}
+
+/**
+ * @brief Заполняет количество непрочитанных сообщений для всех чатов списка.
+ *
+ * Непрочитанным считается сообщение другого участника без единой отметки о прочтении.
+ *
+ * @param login Логин пользователя.
+ * @param chatList Список чатов.
+ */
+void MemoryChatRepository::countUnread(const QString &login, QVector<ChatSummary> &chatList)
+{
+    QMutexLocker locker(&mutex);
+    int userId = userIdsByLogin.value(login, -1);
+    for (ChatSummary &chat : chatList)
+    {
+        chat.unreadCount = 0;
+        if (userId < 0)
+        {
+            continue;
+        }
+        const QVector<MessageRecord> messages = messagesByChat.value(chat.chatId);
+        for (const MessageRecord &message : messages)
+        {
+            if (message.userId != userId && !readerCounts.contains(message.messageId))
+            {
+                ++chat.unreadCount;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Возвращает последний номер сообщения в чате.
+ *
+ * @param chatId Идентификатор чата.
+ * @return qint64 Номер последнего сообщения.
+ */
+qint64 MemoryChatRepository::lastSeq(int chatId)
+{
+    QMutexLocker locker(&mutex);
+    return lastSeqs.value(chatId, 0);
+}
+
+/**
+ * @brief Сохраняет сообщение.
+ *
+ * @param message Сообщение.
+ * @return true Если сообщение сохранено (false при повторе идентификатора клиента).
+ */
+bool MemoryChatRepository::insertMessage(MessageRecord &message)
+{
+    QMutexLocker locker(&mutex);
+    return insertMessageLocked(message);
+}
+
+/**
+ * @brief Сохраняет несколько сообщений за одну блокировку.
+ *
+ * Повтор идентификатора клиента проверяется до записи, поэтому при ошибке
+ * не сохраняется ни одно сообщение.
+ *
+ * @param messages Сообщения.
+ * @return true Если сохранены все сообщения.
+ */
+bool MemoryChatRepository::insertMessages(QVector<MessageRecord> &messages)
+{
+    QMutexLocker locker(&mutex);
+    QSet<QString> keys;
+    for (const MessageRecord &message : qAsConst(messages))
+    {
+        if (message.clientMessageId.isEmpty())
+        {
+            continue;
+        }
+        QString key = clientKey(message.chatId, message.userId, message.clientMessageId);
+        if (messagesByClientId.contains(key) || keys.contains(key))
+        {
+            setLastError("Duplicate client_msg_id");
+            return false;
+        }
+        keys.insert(key);
+    }
+    for (MessageRecord &message : messages)
+    {
+        insertMessageLocked(message);
+    }
+    return true;
+}
+
+/**
+ * @brief Ищет сообщение по идентификатору клиента.
+ *
+ * @param chatId Идентификатор чата.
+ * @param userId Идентификатор отправителя.
+ * @param clientMessageId Идентификатор сообщения клиента.
+ * @param message Найденное сообщение.
+ * @return true Если сообщение найдено.
+ */
+bool MemoryChatRepository::findMessage(int chatId, int userId, const QString &clientMessageId, MessageRecord &message)
+{
+    QMutexLocker locker(&mutex);
+    auto it = messagesByClientId.constFind(clientKey(chatId, userId, clientMessageId));
+    if (it == messagesByClientId.constEnd())
+    {
+        return false;
+    }
+    message.messageId = it->messageId;
+    message.seq = it->seq;
+    return true;
+}
+
+/**
+ * @brief Выдаёт историю чата в порядке сохранения.
+ *
+ * Логин отправителя подставляется текущий, как при соединении с таблицей user_auth;
+ * сообщения удалённых пользователей пропускаются.
+ *
+ * @param chatId Идентификатор чата.
+ * @param afterSeq Номер, после которого выдаются сообщения (0 — вся история).
+ * @param visit Обработчик сообщений.
+ * @return true Всегда.
+ */
+bool MemoryChatRepository::history(int chatId, qint64 afterSeq, const MessageVisitor &visit)
+{
+    QMutexLocker locker(&mutex);
+    const QVector<MessageRecord> messages = messagesByChat.value(chatId);
+    auto first = messages.constBegin();
+    if (afterSeq > 0)
+    {
+        first = std::find_if(messages.constBegin(), messages.constEnd(),
+                             [afterSeq](const MessageRecord &message) { return message.seq > afterSeq; });
+    }
+
+    MessageRecord entry;
+    int cachedUserId = -1;
+    for (auto it = first; it != messages.constEnd(); ++it)
+    {
+        if (it->seq <= afterSeq && afterSeq > 0)
+        {
+            continue;
+        }
+        if (it->userId != cachedUserId)
+        {
+            auto sender = users.constFind(it->userId);
+            if (sender == users.constEnd())
+            {
+                continue;
+            }
+            cachedUserId = it->userId;
+            entry.senderLogin = sender->login;
+        }
+        entry.messageId = it->messageId;
+        entry.chatId = chatId;
+        entry.userId = it->userId;
+        entry.text = it->text;
+        entry.timestamp = it->timestamp;
+        entry.seq = it->seq;
+        visit(entry);
+    }
+    return true;
+}
+
+/**
+ * @brief Отмечает прочитанными сообщения чата, отправленные другими участниками.
+ *
+ * @param chatId Идентификатор чата.
+ * @param userId Идентификатор читателя.
+ * @param messageIds Идентификаторы отмеченных сообщений.
+ * @return true Всегда.
+ */
+bool MemoryChatRepository::markChatRead(int chatId, int userId, QVector<int> &messageIds)
+{
+    QMutexLocker locker(&mutex);
+    const QVector<MessageRecord> messages = messagesByChat.value(chatId);
+    for (const MessageRecord &message : messages)
+    {
+        if (message.userId != userId)
+        {
+            markReadLocked(message.messageId, userId);
+            messageIds.append(message.messageId);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,159 @@
+/**
+ * /file memorychatrepository.h
+ * /brief Определение класса MemoryChatRepository — хранилища чатов в памяти процесса.
+ */
+
+#ifndef MEMORYCHATREPOSITORY_H
+#define MEMORYCHATREPOSITORY_H
+
+#include "chatrepository.h"
+
+#include <QSqlDatabase>
+#include <QMap>
+#include <QSet>
+#include <QMutex>
+
+/**
+ * /brief Класс MemoryChatRepository.
+ *
+ * Реализация ChatRepository на хеш-таблицах в памяти процесса без записи на диск.
+ * Предназначена для замеров и проверок: показывает, сколько времени обработчиков
+ * приходится на само хранилище, и служит эталоном при сравнении реализаций.
+ * Данные можно загрузить из базы SQLite сервера функцией load().
+ *
+ * Поведение повторяет SqliteChatRepository, в том числе подсчёт непрочитанных
+ * сообщений (сообщение считается прочитанным, если его прочитал любой участник).
+ * История выдаётся в порядке сохранения, поиск пользователей не различает регистр.
+ * Все методы защищены одной блокировкой, поэтому хранилище допускает асинхронные вызовы.
+ */
+class MemoryChatRepository : public ChatRepository
+{
+private:
+    /**
+     * /brief Чат и его участники.
+     */
+    struct Chat
+    {
+        QString name; ///< Название чата.
+        QString chatType; ///< Тип чата.
+        QVector<int> participants; ///< Идентификаторы участников.
+    };
+
+    mutable QRecursiveMutex mutex; ///< Блокировка всех данных хранилища (обработчики истории могут вызывать хранилище).
+    QMap<int, UserRecord> users; ///< Пользователи по идентификаторам (в порядке создания).
+    QHash<QString, int> userIdsByLogin; ///< Идентификаторы пользователей по логинам.
+    QMap<int, Chat> chats; ///< Чаты по идентификаторам (в порядке создания).
+    QHash<QString, int> chatIdsByName; ///< Первый чат с данным названием.
+    QHash<int, QVector<int>> chatsByUser; ///< Чаты по участникам.
+    QHash<int, QVector<MessageRecord>> messagesByChat; ///< Сообщения по чатам в порядке сохранения.
+    QHash<QString, MessageRecord> messagesByClientId; ///< Сообщения по отправителю и идентификатору клиента.
+    QHash<int, qint64> lastSeqs; ///< Последние номера сообщений по чатам.
+    QHash<int, int> readerCounts; ///< Количество отметок о прочтении по сообщениям.
+    QSet<quint64> readMarks; ///< Отметки о прочтении (сообщение, читатель).
+    int nextUserId = 1; ///< Следующий идентификатор пользователя.
+    int nextChatId = 1; ///< Следующий идентификатор чата.
+    int nextMessageId = 1; ///< Следующий идентификатор сообщения.
+
+    /**
+     * /brief Возвращает ключ отметки о прочтении.
+     * /param messageId Идентификатор сообщения.
+     * /param userId Идентификатор читателя.
+     * /return Ключ отметки.
+     */
+    static quint64 readKey(int messageId, int userId)
+    {
+        return (quint64(quint32(messageId)) << 32) | quint32(userId);
+    }
+
+    /**
+     * /brief Возвращает ключ сообщения по чату, отправителю и идентификатору клиента.
+     * /param chatId Идентификатор чата.
+     * /param userId Идентификатор отправителя.
+     * /param clientMessageId Идентификатор сообщения клиента.
+     * /return Ключ сообщения.
+     */
+    static QString clientKey(int chatId, int userId, const QString &clientMessageId)
+    {
+        return QString::number(chatId) + ':' + QString::number(userId) + ':' + clientMessageId;
+    }
+
+    /**
+     * /brief Добавляет участника в чат (без блокировки).
+     * /param chatId Идентификатор чата.
+     * /param userId Идентификатор пользователя.
+     */
+    void addParticipantLocked(int chatId, int userId);
+
+    /**
+     * /brief Сохраняет сообщение (без блокировки).
+     * /param message Сообщение.
+     * /return Признак успешной записи.
+     */
+    bool insertMessageLocked(MessageRecord &message);
+
+    /**
+     * /brief Ставит отметку о прочтении (без блокировки).
+     * /param messageId Идентификатор сообщения.
+     * /param userId Идентификатор читателя.
+     * /return Признак того, что отметки ещё не было.
+     */
+    bool markReadLocked(int messageId, int userId);
+
+    /**
+     * /brief Дописывает чаты пользователя указанного типа в список (без блокировки).
+     * /param login Логин пользователя.
+     * /param chatType Тип чатов.
+     * /param chatList Список чатов.
+     */
+    void appendChatsLocked(const QString &login, const QString &chatType, QVector<ChatSummary> &chatList) const;
+
+public:
+    /**
+     * /brief Деструктор, дожидающийся асинхронных вызовов.
+     */
+    ~MemoryChatRepository() override;
+
+    /**
+     * /brief Заменяет содержимое хранилища данными из базы SQLite сервера.
+     * /param database База данных сервера.
+     * /return Признак успешной загрузки.
+     */
+    bool load(const QSqlDatabase &database);
+
+    /**
+     * /brief Удаляет все данные хранилища.
+     */
+    void clear();
+
+    QString engineName() const override;
+    bool isLoginAvailable(const QString &login) override;
+    int userIdByLogin(const QString &login) override;
+    bool findUser(const QString &login, UserRecord &user) override;
+    int createUser(const QString &login, const QString &password, const QString &nickname) override;
+    bool updatePassword(const QString &login, const QString &password) override;
+    bool upgradePassword(int userId, const QString &oldPassword, const QString &newPassword) override;
+    bool updateLogin(const QString &oldLogin, const QString &newLogin, const QString &password) override;
+    bool updateNickname(const QString &login, const QString &nickname) override;
+    bool revokeTokens(int userId, qint64 revokedAt) override;
+    bool tokenRevocations(QHash<int, qint64> &revokedAt) override;
+    bool findUsers(const QString &nicknamePart, const QString &exceptLogin, const UserVisitor &visit) override;
+    int chatIdByName(const QStringList &names) override;
+    int createChat(const QString &name, const QString &chatType) override;
+    bool addParticipants(int chatId, const QStringList &logins) override;
+    bool deleteChat(int chatId) override;
+    bool participants(int chatId, QVector<int> &userIds) override;
+    bool participants(const QVector<int> &chatIds, QHash<int, QVector<int>> &members) override;
+    bool chatsOf(int userId, QVector<int> &chatIds) override;
+    bool membershipsOf(int userId, QHash<int, QVector<int>> &members) override;
+    bool personalChats(const QString &login, QVector<ChatSummary> &chatList) override;
+    bool groupChats(const QString &login, QVector<ChatSummary> &chatList) override;
+    void countUnread(const QString &login, QVector<ChatSummary> &chatList) override;
+    qint64 lastSeq(int chatId) override;
+    bool insertMessage(MessageRecord &message) override;
+    bool insertMessages(QVector<MessageRecord> &messages) override;
+    bool findMessage(int chatId, int userId, const QString &clientMessageId, MessageRecord &message) override;
+    bool history(int chatId, qint64 afterSeq, const MessageVisitor &visit) override;
+    bool markChatRead(int chatId, int userId, QVector<int> &messageIds) override;
+};
+
+#endif // MEMORYCHATREPOSITORY_H
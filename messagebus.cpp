@@ -0,0 +1,586 @@
+#include "messagebus.h"
+#include "wireprotocol.h"
+#include "logger.h"
+#include "servermetrics.h"
+
+#include <QDir>
+#include <QJsonArray>
+#include <QRandomGenerator>
+#include <QtEndian>
+#include <QDebug>
+
+namespace
+{
+const quint32 maxBusFrameSize = 16 * 1024 * 1024; ///< Максимальный размер кадра шины.
+}
+
+/**
+ * @brief Конструктор класса MessageBus.
+ *
+ * @param parent Указатель на родительский объект (по умолчанию nullptr).
+ */
+MessageBus::MessageBus(QObject *parent) : QObject(parent)
+{
+    reconnectTimer.setSingleShot(true);
+    connect(&reconnectTimer, &QTimer::timeout, this, &MessageBus::connectOrHost);
+}
+
+/**
+ * @brief Деструктор класса MessageBus.
+ */
+MessageBus::~MessageBus()
+{
+    stop();
+}
+
+/**
+ * @brief Запускает шину.
+ *
+ * @param busName Имя локального сокета шины.
+ * @param instanceId Идентификатор этого экземпляра.
+ */
+void MessageBus::start(const QString &busName, const QString &instanceId)
+{
+    this->busName = busName;
+    this->instanceId = instanceId;
+    running = true;
+    connectOrHost();
+}
+
+/**
+ * @brief Останавливает шину.
+ *
+ * Подключённые экземпляры обнаружат закрытие и выберут нового брокера.
+ */
+void MessageBus::stop()
+{
+    running = false;
+    reconnectTimer.stop();
+    if (upstream)
+    {
+        upstream->disconnect(this);
+        upstream->abort();
+        upstream->deleteLater();
+        upstream = nullptr;
+    }
+    if (server)
+    {
+        for (auto it = peers.begin(); it != peers.end(); ++it)
+        {
+            it.key()->disconnect(this);
+            it.key()->abort();
+            it.key()->deleteLater();
+        }
+        peers.clear();
+        server->close();
+        delete server;
+        server = nullptr;
+    }
+    brokerLock.reset();
+    directory.clear();
+    directoryLogins.clear();
+}
+
+/**
+ * @brief Подключается к брокеру или становится брокером.
+ *
+ * Роль брокера закрепляется файлом блокировки: его захватывает ровно один живой процесс,
+ * а блокировка завершившегося процесса считается устаревшей, поэтому имя сокета
+ * не может быть перехвачено у работающего брокера.
+ */
+void MessageBus::connectOrHost()
+{
+    if (!running)
+    {
+        return;
+    }
+
+    brokerLock.reset(new QLockFile(QDir::temp().filePath(busName + ".lock")));
+    brokerLock->setStaleLockTime(0);
+    if (brokerLock->tryLock(0))
+    {
+        QLocalServer::removeServer(busName);
+        server = new QLocalServer(this);
+        server->setSocketOptions(QLocalServer::UserAccessOption);
+        if (server->listen(busName))
+        {
+            connect(server, &QLocalServer::newConnection, this, &MessageBus::onPeerConnected);
+            ServerMetrics::getInstance()->set("cluster.broker", 1);
+            Logger::getInstance()->logToFile(QString("Message bus broker started: %1").arg(server->fullServerName()));
+            return;
+        }
+        qCritical() << "Could not start message bus broker:" << server->errorString();
+        delete server;
+        server = nullptr;
+        brokerLock.reset();
+        reconnectTimer.start(1000);
+        return;
+    }
+    brokerLock.reset();
+
+    upstream = new QLocalSocket(this);
+    connect(upstream, &QLocalSocket::connected, this, &MessageBus::introduce);
+    connect(upstream, &QLocalSocket::disconnected, this, &MessageBus::onUpstreamLost);
+    connect(upstream, &QLocalSocket::errorOccurred, this, &MessageBus::onUpstreamLost);
+    connect(upstream, &QLocalSocket::readyRead, this, [this]()
+            {
+                upstreamBuffer += upstream->readAll();
+                QList<QJsonObject> messages;
+                bool valid = takeFrames(upstreamBuffer, messages);
+                for (const QJsonObject &message : qAsConst(messages))
+                {
+                    dispatch(message);
+                }
+                if (!valid)
+                {
+                    onUpstreamLost();
+                }
+            });
+    ServerMetrics::getInstance()->set("cluster.broker", 0);
+    upstream->connectToServer(busName);
+}
+
+/**
+ * @brief Отправляет брокеру приветствие и сведения о пользователях этого экземпляра.
+ */
+void MessageBus::introduce()
+{
+    QJsonArray users;
+    for (auto it = localUsers.cbegin(); it != localUsers.cend(); ++it)
+    {
+        users.append(QJsonObject{{"user_id", it.key()}, {"login", it.value()}});
+    }
+    upstream->write(frame(QJsonObject{{"kind", "hello"}, {"origin", instanceId}, {"users", users}}));
+    Logger::getInstance()->logToFile(QString("Joined message bus %1 as %2").arg(busName, instanceId));
+}
+
+/**
+ * @brief Обрабатывает потерю подключения к брокеру.
+ *
+ * Сведения о других экземплярах сбрасываются и восстанавливаются из снимка каталога
+ * после повторного подключения. Задержка перед повтором случайна, чтобы экземпляры
+ * не соревновались за роль брокера одновременно.
+ */
+void MessageBus::onUpstreamLost()
+{
+    if (!upstream)
+    {
+        return;
+    }
+    upstream->disconnect(this);
+    upstream->abort();
+    upstream->deleteLater();
+    upstream = nullptr;
+    upstreamBuffer.clear();
+
+    const QList<int> users = directory.keys();
+    directory.clear();
+    for (int userId : users)
+    {
+        emit remotePresenceChanged(userId, directoryLogins.take(userId), false);
+    }
+    ServerMetrics::getInstance()->set("cluster.remote_users", 0);
+
+    if (running)
+    {
+        ServerMetrics::getInstance()->add("cluster.reconnects");
+        reconnectTimer.start(100 + QRandomGenerator::global()->bounded(400));
+    }
+}
+
+/**
+ * @brief Принимает подключения экземпляров.
+ */
+void MessageBus::onPeerConnected()
+{
+    while (server->hasPendingConnections())
+    {
+        QLocalSocket *socket = server->nextPendingConnection();
+        peers.insert(socket, Peer());
+
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket]()
+                {
+                    Peer peer = peers.take(socket);
+                    socket->deleteLater();
+                    if (!peer.instanceId.isEmpty())
+                    {
+                        Logger::getInstance()->logToFile(QString("Instance %1 left message bus").arg(peer.instanceId));
+                        dropInstance(peer.instanceId);
+                        route(QJsonObject{{"kind", "instance_down"}, {"origin", instanceId}, {"instance", peer.instanceId}}, nullptr);
+                    }
+                    ServerMetrics::getInstance()->set("cluster.peers", peers.size());
+                });
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket]()
+                {
+                    auto it = peers.find(socket);
+                    if (it == peers.end())
+                    {
+                        return;
+                    }
+                    it->buffer += socket->readAll();
+                    QList<QJsonObject> messages;
+                    bool valid = takeFrames(it->buffer, messages);
+
+                    for (const QJsonObject &message : qAsConst(messages))
+                    {
+                        if (message["kind"].toString() != "hello")
+                        {
+                            route(message, socket);
+                            continue;
+                        }
+
+                        //Новый экземпляр: его пользователи рассылаются остальным, в ответ — снимок каталога
+                        QString peerId = message["origin"].toString();
+                        peers[socket].instanceId = peerId;
+                        const QJsonArray users = message["users"].toArray();
+                        for (const QJsonValue &user : users)
+                        {
+                            QJsonObject presence = user.toObject();
+                            presence["kind"] = "presence";
+                            presence["origin"] = peerId;
+                            presence["online"] = true;
+                            route(presence, socket);
+                        }
+
+                        QJsonArray entries;
+                        for (auto entry = directory.cbegin(); entry != directory.cend(); ++entry)
+                        {
+                            for (const QString &instance : entry.value())
+                            {
+                                if (instance != peerId)
+                                {
+                                    entries.append(QJsonObject{{"user_id", entry.key()}, {"login", directoryLogins.value(entry.key())},
+                                                               {"instance", instance}});
+                                }
+                            }
+                        }
+                        for (auto local = localUsers.cbegin(); local != localUsers.cend(); ++local)
+                        {
+                            entries.append(QJsonObject{{"user_id", local.key()}, {"login", local.value()}, {"instance", instanceId}});
+                        }
+                        socket->write(frame(QJsonObject{{"kind", "snapshot"}, {"origin", instanceId}, {"entries", entries}}));
+                        Logger::getInstance()->logToFile(QString("Instance %1 joined message bus").arg(peerId));
+                    }
+                    ServerMetrics::getInstance()->set("cluster.peers", peers.size());
+
+                    if (!valid)
+                    {
+                        socket->abort();
+                    }
+                });
+    }
+}
+
+/**
+ * @brief Отправляет сообщение в шину.
+ *
+ * @param message Сообщение.
+ */
+void MessageBus::publish(QJsonObject message)
+{
+    if (!running)
+    {
+        return;
+    }
+    message["origin"] = instanceId;
+    if (server)
+    {
+        route(message, nullptr);
+    }
+    else if (upstream && upstream->state() == QLocalSocket::ConnectedState)
+    {
+        upstream->write(frame(message));
+    }
+    else
+    {
+        ServerMetrics::getInstance()->add("cluster.dropped");
+        return;
+    }
+    ServerMetrics::getInstance()->add("cluster.messages_out");
+}
+
+/**
+ * @brief Пересылает сообщение подключённым экземплярам.
+ *
+ * Сообщение с полем targets доставляется только перечисленным экземплярам.
+ * Брокер применяет чужие сообщения и к себе.
+ *
+ * @param message Сообщение.
+ * @param from Подключение, от которого получено сообщение.
+ */
+void MessageBus::route(const QJsonObject &message, QLocalSocket *from)
+{
+    if (message["origin"].toString() != instanceId)
+    {
+        dispatch(message);
+    }
+
+    bool targeted = message.contains("targets");
+    QJsonArray targets = message["targets"].toArray();
+    QByteArray data;
+    for (auto it = peers.begin(); it != peers.end(); ++it)
+    {
+        if (it.key() == from || it->instanceId.isEmpty() || (targeted && !targets.contains(it->instanceId)))
+        {
+            continue;
+        }
+        if (data.isEmpty())
+        {
+            data = frame(message);
+        }
+        it.key()->write(data);
+    }
+}
+
+/**
+ * @brief Обрабатывает сообщение, адресованное этому экземпляру.
+ *
+ * @param message Сообщение.
+ */
+void MessageBus::dispatch(const QJsonObject &message)
+{
+    ServerMetrics::getInstance()->add("cluster.messages_in");
+    QString kind = message["kind"].toString();
+    if (kind == "presence")
+    {
+        updateDirectory(message["user_id"].toInt(), message["login"].toString(),
+                        message["origin"].toString(), message["online"].toBool());
+    }
+    else if (kind == "snapshot")
+    {
+        const QJsonArray entries = message["entries"].toArray();
+        for (const QJsonValue &value : entries)
+        {
+            QJsonObject entry = value.toObject();
+            updateDirectory(entry["user_id"].toInt(), entry["login"].toString(), entry["instance"].toString(), true);
+        }
+    }
+    else if (kind == "instance_down")
+    {
+        dropInstance(message["instance"].toString());
+    }
+    else if (kind == "push")
+    {
+        if (!message.contains("targets") || message["targets"].toArray().contains(instanceId))
+        {
+            emit pushReceived(message["user_id"].toInt(), message["push"].toObject(), message["collapse"].toString());
+        }
+    }
+    else if (kind == "typing")
+    {
+        emit typingReceived(message["chat_id"].toInt(), message["login"].toString(), message["typing"].toBool());
+    }
+    else if (kind == "chat_changed")
+    {
+        emit chatChanged(message["chat_id"].toInt());
+    }
+    else if (kind == "chat_deleted")
+    {
+        emit chatDeleted(message["chat_id"].toInt());
+    }
+    else if (kind == "tokens_revoked")
+    {
+        emit tokensRevoked(message["user_id"].toInt(), qint64(message["revoked_at"].toDouble()));
+    }
+}
+
+/**
+ * @brief Выделяет из буфера полные кадры шины.
+ *
+ * @param buffer Буфер принятых байтов.
+ * @param messages Разобранные сообщения.
+ * @return false Если встречен некорректный кадр.
+ */
+bool MessageBus::takeFrames(QByteArray &buffer, QList<QJsonObject> &messages)
+{
+    int offset = 0;
+    bool valid = true;
+    while (buffer.size() - offset >= 4)
+    {
+        quint32 length = qFromBigEndian<quint32>(buffer.constData() + offset);
+        if (length > maxBusFrameSize)
+        {
+            valid = false;
+            break;
+        }
+        if (quint32(buffer.size() - offset - 4) < length)
+        {
+            break;
+        }
+        QJsonObject message;
+        if (!WireProtocol::decode(buffer.mid(offset + 4, int(length)), message))
+        {
+            valid = false;
+            break;
+        }
+        messages.append(message);
+        offset += 4 + int(length);
+    }
+    buffer.remove(0, offset);
+    return valid;
+}
+
+/**
+ * @brief Кодирует сообщение в кадр шины.
+ *
+ * @param message Сообщение.
+ * @return QByteArray Кадр с префиксом длины.
+ */
+QByteArray MessageBus::frame(const QJsonObject &message)
+{
+    QByteArray payload = WireProtocol::encode(message, WireEncoding::Cbor);
+    QByteArray data(4, Qt::Uninitialized);
+    qToBigEndian<quint32>(quint32(payload.size()), data.data());
+    return data + payload;
+}
+
+/**
+ * @brief Отмечает пользователя на экземпляре в каталоге присутствия.
+ *
+ * Сигнал remotePresenceChanged испускается только при появлении первой
+ * и исчезновении последней записи пользователя.
+ *
+ * @param userId Идентификатор пользователя.
+ * @param login Логин пользователя.
+ * @param instance Идентификатор экземпляра.
+ * @param online Признак подключения пользователя.
+ */
+void MessageBus::updateDirectory(int userId, const QString &login, const QString &instance, bool online)
+{
+    if (instance == instanceId)
+    {
+        return;
+    }
+
+    auto it = directory.find(userId);
+    if (online)
+    {
+        bool known = it != directory.end();
+        directory[userId].insert(instance);
+        directoryLogins.insert(userId, login);
+        if (!known)
+        {
+            emit remotePresenceChanged(userId, login, true);
+        }
+    }
+    else if (it != directory.end())
+    {
+        it->remove(instance);
+        if (it->isEmpty())
+        {
+            directory.erase(it);
+            emit remotePresenceChanged(userId, directoryLogins.take(userId), false);
+        }
+    }
+    ServerMetrics::getInstance()->set("cluster.remote_users", directory.size());
+}
+
+/**
+ * @brief Удаляет из каталога все записи экземпляра.
+ *
+ * @param instance Идентификатор экземпляра.
+ */
+void MessageBus::dropInstance(const QString &instance)
+{
+    QList<int> users;
+    for (auto it = directory.cbegin(); it != directory.cend(); ++it)
+    {
+        if (it->contains(instance))
+        {
+            users.append(it.key());
+        }
+    }
+    for (int userId : qAsConst(users))
+    {
+        updateDirectory(userId, directoryLogins.value(userId), instance, false);
+    }
+}
+
+/**
+ * @brief Сообщает о подключении пользователя к этому экземпляру.
+ *
+ * @param userId Идентификатор пользователя.
+ * @param login Логин пользователя.
+ */
+void MessageBus::announceOnline(int userId, const QString &login)
+{
+    localUsers.insert(userId, login);
+    publish(QJsonObject{{"kind", "presence"}, {"user_id", userId}, {"login", login}, {"online", true}});
+}
+
+/**
+ * @brief Сообщает об отключении пользователя от этого экземпляра.
+ *
+ * @param userId Идентификатор пользователя.
+ */
+void MessageBus::announceOffline(int userId)
+{
+    QString login = localUsers.take(userId);
+    publish(QJsonObject{{"kind", "presence"}, {"user_id", userId}, {"login", login}, {"online", false}});
+}
+
+/**
+ * @brief Отправляет уведомление пользователю на экземпляры, где у него есть сессии.
+ *
+ * @param userId Идентификатор пользователя.
+ * @param push Уведомление.
+ * @param collapseKey Ключ схлопывания уведомлений.
+ */
+void MessageBus::publishPush(int userId, const QJsonObject &push, const QString &collapseKey)
+{
+    auto it = directory.constFind(userId);
+    if (it == directory.constEnd())
+    {
+        return;
+    }
+    QJsonArray targets;
+    for (const QString &instance : it.value())
+    {
+        targets.append(instance);
+    }
+    publish(QJsonObject{{"kind", "push"}, {"targets", targets}, {"user_id", userId},
+                        {"push", push}, {"collapse", collapseKey}});
+}
+
+/**
+ * @brief Рассылает событие набора текста.
+ *
+ * @param chatId Идентификатор чата.
+ * @param login Логин пользователя.
+ * @param typing Признак набора.
+ */
+void MessageBus::publishTyping(int chatId, const QString &login, bool typing)
+{
+    publish(QJsonObject{{"kind", "typing"}, {"chat_id", chatId}, {"login", login}, {"typing", typing}});
+}
+
+/**
+ * @brief Сообщает об изменении состава чата.
+ *
+ * @param chatId Идентификатор чата.
+ */
+void MessageBus::publishChatChanged(int chatId)
+{
+    publish(QJsonObject{{"kind", "chat_changed"}, {"chat_id", chatId}});
+}
+
+/**
+ * @brief Сообщает об удалении чата.
+ *
+ * @param chatId Идентификатор чата.
+ */
+void MessageBus::publishChatDeleted(int chatId)
+{
+    publish(QJsonObject{{"kind", "chat_deleted"}, {"chat_id", chatId}});
+}
+
+/**
+ * @brief Сообщает об отзыве токенов сессии пользователя.
+ *
+ * @param userId Идентификатор пользователя.
+ * @param revokedAt Момент отзыва.
+ */
+void MessageBus::publishTokensRevoked(int userId, qint64 revokedAt)
+{
+    publish(QJsonObject{{"kind", "tokens_revoked"}, {"user_id", userId}, {"revoked_at", double(revokedAt)}});
+}
@@ -0,0 +1,260 @@
+/**
+ * /file messagebus.h
+ * /brief Определение класса MessageBus для обмена уведомлениями между экземплярами сервера.
+ */
+
+#ifndef MESSAGEBUS_H
+#define MESSAGEBUS_H
+
+#include <QObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QLockFile>
+#include <QHash>
+#include <QSet>
+#include <QTimer>
+#include <QJsonObject>
+#include <memory>
+
+/**
+ * /brief Класс MessageBus.
+ *
+ * Связывает несколько процессов сервера, работающих с общей базой данных, через локальный
+ * сокет (Unix domain socket в Linux, именованный канал в Windows). Первый процесс, захвативший
+ * файл блокировки, становится брокером и принимает подключения остальных; брокер пересылает
+ * сообщения между экземплярами. Если брокер завершается, его место занимает другой процесс.
+ *
+ * Каждый экземпляр хранит копию каталога присутствия: какие пользователи подключены к каким
+ * экземплярам. По нему уведомления для пользователя отправляются только экземплярам, на которых
+ * у него есть сессии, поэтому нагрузка на экземпляр не растёт с их числом.
+ *
+ * Сообщения шины — объекты CBOR с префиксом длины; поле kind задаёт тип сообщения.
+ */
+class MessageBus : public QObject
+{
+    Q_OBJECT
+
+private:
+    /**
+     * /brief Подключение экземпляра к брокеру.
+     */
+    struct Peer
+    {
+        QString instanceId; ///< Идентификатор экземпляра (после hello).
+        QByteArray buffer; ///< Принятые, но ещё не разобранные байты.
+    };
+
+    QString busName; ///< Имя локального сокета шины.
+    QString instanceId; ///< Идентификатор этого экземпляра.
+    std::unique_ptr<QLockFile> brokerLock; ///< Блокировка роли брокера.
+    QLocalServer *server = nullptr; ///< Сервер шины (только у брокера).
+    QLocalSocket *upstream = nullptr; ///< Подключение к брокеру (у остальных экземпляров).
+    QByteArray upstreamBuffer; ///< Принятые от брокера, но ещё не разобранные байты.
+    QHash<QLocalSocket*, Peer> peers; ///< Подключённые экземпляры (только у брокера).
+    QHash<int, QSet<QString>> directory; ///< Каталог присутствия: пользователь -> другие экземпляры.
+    QHash<int, QString> directoryLogins; ///< Логины пользователей каталога.
+    QHash<int, QString> localUsers; ///< Пользователи, подключённые к этому экземпляру.
+    QTimer reconnectTimer; ///< Таймер повторного подключения к шине.
+    bool running = false; ///< Признак запущенной шины.
+
+    /**
+     * /brief Подключается к брокеру или становится брокером.
+     */
+    void connectOrHost();
+
+    /**
+     * /brief Отправляет сообщение в шину.
+     * /param message Сообщение.
+     */
+    void publish(QJsonObject message);
+
+    /**
+     * /brief Пересылает сообщение подключённым экземплярам (только у брокера).
+     * /param message Сообщение.
+     * /param from Подключение, от которого получено сообщение (nullptr для собственных сообщений).
+     */
+    void route(const QJsonObject &message, QLocalSocket *from);
+
+    /**
+     * /brief Обрабатывает сообщение, адресованное этому экземпляру.
+     * /param message Сообщение.
+     */
+    void dispatch(const QJsonObject &message);
+
+    /**
+     * /brief Выделяет из буфера полные кадры шины.
+     * /param buffer Буфер принятых байтов.
+     * /param messages Разобранные сообщения.
+     * /return Признак корректных кадров (false — подключение следует закрыть).
+     */
+    static bool takeFrames(QByteArray &buffer, QList<QJsonObject> &messages);
+
+    /**
+     * /brief Кодирует сообщение в кадр шины.
+     * /param message Сообщение.
+     * /return Кадр с префиксом длины.
+     */
+    static QByteArray frame(const QJsonObject &message);
+
+    /**
+     * /brief Отмечает пользователя на экземпляре в каталоге присутствия.
+     * /param userId Идентификатор пользователя.
+     * /param login Логин пользователя.
+     * /param instance Идентификатор экземпляра.
+     * /param online Признак подключения пользователя.
+     */
+    void updateDirectory(int userId, const QString &login, const QString &instance, bool online);
+
+    /**
+     * /brief Удаляет из каталога все записи экземпляра.
+     * /param instance Идентификатор экземпляра.
+     */
+    void dropInstance(const QString &instance);
+
+    /**
+     * /brief Отправляет брокеру приветствие и сведения о пользователях этого экземпляра.
+     */
+    void introduce();
+
+private slots:
+    /**
+     * /brief Принимает подключение экземпляра (у брокера).
+     */
+    void onPeerConnected();
+
+    /**
+     * /brief Обрабатывает потерю подключения к брокеру.
+     */
+    void onUpstreamLost();
+
+public:
+    /**
+     * /brief Конструктор класса MessageBus.
+     * /param parent Указатель на родительский объект.
+     */
+    explicit MessageBus(QObject *parent = nullptr);
+
+    /**
+     * /brief Деструктор, закрывающий шину.
+     */
+    ~MessageBus() override;
+
+    /**
+     * /brief Запускает шину.
+     * /param busName Имя локального сокета шины.
+     * /param instanceId Идентификатор этого экземпляра.
+     */
+    void start(const QString &busName, const QString &instanceId);
+
+    /**
+     * /brief Останавливает шину.
+     */
+    void stop();
+
+    /**
+     * /brief Проверяет, запущена ли шина.
+     * /return Признак запущенной шины.
+     */
+    bool isRunning() const { return running; }
+
+    /**
+     * /brief Проверяет, подключён ли пользователь к другим экземплярам.
+     * /param userId Идентификатор пользователя.
+     * /return Признак наличия сессий пользователя на других экземплярах.
+     */
+    bool isOnlineElsewhere(int userId) const { return directory.contains(userId); }
+
+    /**
+     * /brief Сообщает о подключении пользователя к этому экземпляру.
+     * /param userId Идентификатор пользователя.
+     * /param login Логин пользователя.
+     */
+    void announceOnline(int userId, const QString &login);
+
+    /**
+     * /brief Сообщает об отключении пользователя от этого экземпляра.
+     * /param userId Идентификатор пользователя.
+     */
+    void announceOffline(int userId);
+
+    /**
+     * /brief Отправляет уведомление пользователю на другие экземпляры.
+     * /param userId Идентификатор пользователя.
+     * /param push Уведомление.
+     * /param collapseKey Ключ схлопывания уведомлений.
+     */
+    void publishPush(int userId, const QJsonObject &push, const QString &collapseKey);
+
+    /**
+     * /brief Рассылает событие набора текста.
+     * /param chatId Идентификатор чата.
+     * /param login Логин пользователя.
+     * /param typing Признак набора.
+     */
+    void publishTyping(int chatId, const QString &login, bool typing);
+
+    /**
+     * /brief Сообщает об изменении состава чата.
+     * /param chatId Идентификатор чата.
+     */
+    void publishChatChanged(int chatId);
+
+    /**
+     * /brief Сообщает об удалении чата.
+     * /param chatId Идентификатор чата.
+     */
+    void publishChatDeleted(int chatId);
+
+    /**
+     * /brief Сообщает об отзыве токенов сессии пользователя.
+     * /param userId Идентификатор пользователя.
+     * /param revokedAt Момент отзыва (секунды с начала эпохи).
+     */
+    void publishTokensRevoked(int userId, qint64 revokedAt);
+
+signals:
+    /**
+     * /brief Сигнал об уведомлении для пользователя этого экземпляра.
+     * /param userId Идентификатор пользователя.
+     * /param push Уведомление.
+     * /param collapseKey Ключ схлопывания уведомлений.
+     */
+    void pushReceived(int userId, const QJsonObject &push, const QString &collapseKey);
+
+    /**
+     * /brief Сигнал об изменении присутствия пользователя на других экземплярах.
+     * /param userId Идентификатор пользователя.
+     * /param login Логин пользователя.
+     * /param online Признак наличия сессий на других экземплярах.
+     */
+    void remotePresenceChanged(int userId, const QString &login, bool online);
+
+    /**
+     * /brief Сигнал о событии набора текста на другом экземпляре.
+     * /param chatId Идентификатор чата.
+     * /param login Логин пользователя.
+     * /param typing Признак набора.
+     */
+    void typingReceived(int chatId, const QString &login, bool typing);
+
+    /**
+     * /brief Сигнал об изменении состава чата на другом экземпляре.
+     * /param chatId Идентификатор чата.
+     */
+    void chatChanged(int chatId);
+
+    /**
+     * /brief Сигнал об удалении чата на другом экземпляре.
+     * /param chatId Идентификатор чата.
+     */
+    void chatDeleted(int chatId);
+
+    /**
+     * /brief Сигнал об отзыве токенов сессии пользователя на другом экземпляре.
+     * /param userId Идентификатор пользователя.
+     * /param revokedAt Момент отзыва (секунды с начала эпохи).
+     */
+    void tokensRevoked(int userId, qint64 revokedAt);
+};
+
+#endif // MESSAGEBUS_H
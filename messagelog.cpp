@@ -0,0 +1,882 @@
+#include "messagelog.h"
+#include "logger.h"
+#include "servermetrics.h"
+
+#include <QDir>
+#include <QMap>
+#include <QSaveFile>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QtEndian>
+#include <QDebug>
+#include <cstring>
+
+namespace
+{
+const char segmentMagic[MessageLog::headerSize] = {'S', 'M', 'S', 'E', 'G', '0', '0', '1'}; ///< Сигнатура сегмента.
+const char indexMagic[MessageLog::headerSize] = {'S', 'M', 'I', 'D', 'X', '0', '0', '1'}; ///< Сигнатура индекса.
+const int recordFixedSize = 22; ///< Размер полей записи фиксированной длины (без поля длины).
+const int indexEntrySize = 16; ///< Размер элемента индекса.
+const int catchUpBatchSize = 1000; ///< Количество сообщений, дописываемых из базы за одну запись.
+
+/**
+ * @brief Кодирует элемент индекса.
+ *
+ * @param entry Элемент индекса.
+ * @return QByteArray Байты элемента.
+ */
+QByteArray encodeIndexEntry(const MessageLog::IndexEntry &entry)
+{
+    QByteArray bytes(indexEntrySize, Qt::Uninitialized);
+    qToLittleEndian<qint64>(entry.seq, bytes.data());
+    qToLittleEndian<qint64>(entry.offset, bytes.data() + 8);
+    return bytes;
+}
+
+/**
+ * @brief Разбирает элемент индекса.
+ *
+ * @param data Начало элемента.
+ * @return MessageLog::IndexEntry Элемент индекса.
+ */
+MessageLog::IndexEntry decodeIndexEntry(const uchar *data)
+{
+    MessageLog::IndexEntry entry;
+    entry.seq = qFromLittleEndian<qint64>(data);
+    entry.offset = qFromLittleEndian<qint64>(data + 8);
+    return entry;
+}
+
+/**
+ * @brief Пишет строку JSON, экранируя только необходимые символы.
+ *
+ * Участки без специальных символов пишутся одним вызовом прямо из отображённого сегмента.
+ *
+ * @param device Устройство для записи.
+ * @param data Строка в UTF-8.
+ * @param size Длина строки.
+ */
+void writeJsonString(QIODevice *device, const char *data, int size)
+{
+    device->putChar('"');
+    int runStart = 0;
+    for (int i = 0; i < size; ++i)
+    {
+        uchar c = uchar(data[i]);
+        if (c >= 0x20 && c != '"' && c != '\\')
+        {
+            continue;
+        }
+        device->write(data + runStart, i - runStart);
+        switch (c)
+        {
+        case '"': device->write("\\\"", 2); break;
+        case '\\': device->write("\\\\", 2); break;
+        case '\n': device->write("\\n", 2); break;
+        case '\r': device->write("\\r", 2); break;
+        case '\t': device->write("\\t", 2); break;
+        case '\b': device->write("\\b", 2); break;
+        case '\f': device->write("\\f", 2); break;
+        default:
+            device->write(QByteArray("\\u00") + QByteArray::number(c, 16).rightJustified(2, '0'));
+            break;
+        }
+        runStart = i + 1;
+    }
+    device->write(data + runStart, size - runStart);
+    device->putChar('"');
+}
+
+/**
+ * @brief Пишет начальный байт элемента CBOR с его аргументом.
+ *
+ * @param device Устройство для записи.
+ * @param majorType Основной тип элемента (0-7).
+ * @param value Аргумент (длина или значение).
+ */
+void writeCborHead(QIODevice *device, quint8 majorType, quint64 value)
+{
+    char head[9];
+    int size = 1;
+    head[0] = char(majorType << 5);
+    if (value < 24)
+    {
+        head[0] = char(head[0] | char(value));
+    }
+    else if (value <= 0xff)
+    {
+        head[0] = char(head[0] | 24);
+        head[1] = char(value);
+        size = 2;
+    }
+    else if (value <= 0xffff)
+    {
+        head[0] = char(head[0] | 25);
+        qToBigEndian<quint16>(quint16(value), head + 1);
+        size = 3;
+    }
+    else if (value <= 0xffffffffULL)
+    {
+        head[0] = char(head[0] | 26);
+        qToBigEndian<quint32>(quint32(value), head + 1);
+        size = 5;
+    }
+    else
+    {
+        head[0] = char(head[0] | 27);
+        qToBigEndian<quint64>(value, head + 1);
+        size = 9;
+    }
+    device->write(head, size);
+}
+
+/**
+ * @brief Пишет целое число CBOR.
+ *
+ * @param device Устройство для записи.
+ * @param value Значение.
+ */
+void writeCborInteger(QIODevice *device, qint64 value)
+{
+    if (value >= 0)
+    {
+        writeCborHead(device, 0, quint64(value));
+    }
+    else
+    {
+        writeCborHead(device, 1, quint64(-1 - value));
+    }
+}
+
+/**
+ * @brief Пишет текстовую строку CBOR.
+ *
+ * @param device Устройство для записи.
+ * @param data Строка в UTF-8.
+ * @param size Длина строки.
+ */
+void writeCborText(QIODevice *device, const char *data, int size)
+{
+    writeCborHead(device, 3, quint64(size));
+    device->write(data, size);
+}
+}
+
+/**
+ * @brief Включает хранение сегментов в указанном каталоге.
+ *
+ * @param database База данных сервера.
+ * @param directory Каталог сегментов.
+ * @return true Если каталог доступен.
+ */
+bool MessageLog::open(const QSqlDatabase &database, const QString &directory)
+{
+    this->database = database;
+    this->directory = directory;
+    chats.clear();
+    logins.clear();
+    enabled = QDir().mkpath(directory);
+    if (!enabled)
+    {
+        qCritical() << "Could not create message segment directory:" << directory;
+    }
+    return enabled;
+}
+
+/**
+ * @brief Выключает хранение сегментов.
+ */
+void MessageLog::close()
+{
+    enabled = false;
+    chats.clear();
+    logins.clear();
+}
+
+/**
+ * @brief Возвращает путь к сегменту чата.
+ *
+ * @param directory Каталог сегментов.
+ * @param chatId Идентификатор чата.
+ * @return QString Путь к файлу сегмента.
+ */
+QString MessageLog::segmentPath(const QString &directory, int chatId)
+{
+    return QDir(directory).filePath(QString("chat-%1.seg").arg(chatId));
+}
+
+/**
+ * @brief Возвращает путь к индексу сегмента чата.
+ *
+ * @param directory Каталог сегментов.
+ * @param chatId Идентификатор чата.
+ * @return QString Путь к файлу индекса.
+ */
+QString MessageLog::indexPath(const QString &directory, int chatId)
+{
+    return QDir(directory).filePath(QString("chat-%1.idx").arg(chatId));
+}
+
+/**
+ * @brief Возвращает идентификаторы чатов, для которых в каталоге есть сегменты.
+ *
+ * @param directory Каталог сегментов.
+ * @return QVector<int> Идентификаторы чатов.
+ */
+QVector<int> MessageLog::chatIds(const QString &directory)
+{
+    QVector<int> ids;
+    const QStringList names = QDir(directory).entryList(QStringList{"chat-*.seg"}, QDir::Files, QDir::Name);
+    for (const QString &name : names)
+    {
+        bool valid = false;
+        int chatId = name.mid(5, name.size() - 9).toInt(&valid);
+        if (valid)
+        {
+            ids.append(chatId);
+        }
+    }
+    return ids;
+}
+
+/**
+ * @brief Кодирует запись сегмента.
+ *
+ * @param record Запись.
+ * @return QByteArray Байты записи.
+ */
+QByteArray MessageLog::encodeRecord(const Record &record)
+{
+    int timestampSize = qMin(record.timestamp.size(), 0xffff);
+    quint32 length = quint32(recordFixedSize + timestampSize + record.text.size());
+    QByteArray bytes(4 + recordFixedSize, Qt::Uninitialized);
+    char *data = bytes.data();
+    qToLittleEndian<quint32>(length, data);
+    qToLittleEndian<qint64>(record.seq, data + 4);
+    qToLittleEndian<qint32>(record.messageId, data + 12);
+    qToLittleEndian<qint32>(record.userId, data + 16);
+    qToLittleEndian<quint16>(quint16(timestampSize), data + 20);
+    qToLittleEndian<quint32>(quint32(record.text.size()), data + 22);
+    bytes.append(record.timestamp.constData(), timestampSize);
+    bytes.append(record.text);
+    return bytes;
+}
+
+/**
+ * @brief Разбирает запись сегмента без копирования.
+ *
+ * @param data Начало записи.
+ * @param available Количество доступных байт.
+ * @param view Разобранная запись (указывает в data).
+ * @param recordSize Полный размер записи.
+ * @return true Если запись целая и её поля согласованы.
+ */
+bool MessageLog::decodeRecord(const uchar *data, qint64 available, RecordView &view, qint64 &recordSize)
+{
+    if (available < 4 + recordFixedSize)
+    {
+        return false;
+    }
+    quint32 length = qFromLittleEndian<quint32>(data);
+    if (length < quint32(recordFixedSize) || qint64(length) > available - 4)
+    {
+        return false;
+    }
+    quint16 timestampSize = qFromLittleEndian<quint16>(data + 20);
+    quint32 textSize = qFromLittleEndian<quint32>(data + 22);
+    if (qint64(recordFixedSize) + timestampSize + textSize != qint64(length))
+    {
+        return false;
+    }
+
+    view.seq = qFromLittleEndian<qint64>(data + 4);
+    view.messageId = qFromLittleEndian<qint32>(data + 12);
+    view.userId = qFromLittleEndian<qint32>(data + 16);
+    view.timestamp = reinterpret_cast<const char*>(data + 4 + recordFixedSize);
+    view.timestampSize = timestampSize;
+    view.text = view.timestamp + timestampSize;
+    view.textSize = int(textSize);
+    recordSize = 4 + qint64(length);
+    return true;
+}
+
+/**
+ * @brief Читает индекс всех целых записей сегмента.
+ *
+ * Чтение останавливается на первой неполной или повреждённой записи: это хвост,
+ * недописанный при сбое.
+ *
+ * @param segmentPath Путь к сегменту.
+ * @param entries Элементы индекса.
+ * @param validSize Размер сегмента до первой повреждённой записи.
+ * @return true Если файл существует и начинается с сигнатуры сегмента.
+ */
+bool MessageLog::scanSegment(const QString &segmentPath, QVector<IndexEntry> &entries, qint64 &validSize)
+{
+    entries.clear();
+    validSize = 0;
+    QFile segment(segmentPath);
+    if (!segment.open(QIODevice::ReadOnly) || segment.size() < headerSize)
+    {
+        return false;
+    }
+    const uchar *data = segment.map(0, segment.size());
+    if (!data || memcmp(data, segmentMagic, headerSize) != 0)
+    {
+        return false;
+    }
+
+    qint64 offset = headerSize;
+    RecordView view;
+    qint64 recordSize = 0;
+    while (decodeRecord(data + offset, segment.size() - offset, view, recordSize))
+    {
+        entries.append(IndexEntry{view.seq, offset});
+        offset += recordSize;
+    }
+    validSize = offset;
+    return true;
+}
+
+/**
+ * @brief Записывает файл индекса целиком.
+ *
+ * Файл заменяется атомарно, поэтому при сбое остаётся прежний индекс.
+ *
+ * @param indexPath Путь к индексу.
+ * @param entries Элементы индекса.
+ * @return true Если индекс записан.
+ */
+bool MessageLog::writeIndex(const QString &indexPath, const QVector<IndexEntry> &entries)
+{
+    QSaveFile index(indexPath);
+    if (!index.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+    QByteArray bytes;
+    bytes.reserve(headerSize + entries.size() * indexEntrySize);
+    bytes.append(indexMagic, headerSize);
+    for (const IndexEntry &entry : entries)
+    {
+        bytes.append(encodeIndexEntry(entry));
+    }
+    return index.write(bytes) == bytes.size() && index.commit();
+}
+
+/**
+ * @brief Открывает существующий сегмент чата.
+ *
+ * Последний элемент индекса должен указывать на последнюю запись сегмента. Иначе индекс
+ * строится заново просмотром сегмента, а недописанный хвост сегмента отрезается.
+ *
+ * @param chatId Идентификатор чата.
+ * @param state Состояние сегмента.
+ * @return true Если сегмент открыт.
+ */
+bool MessageLog::loadChat(int chatId, ChatState &state)
+{
+    QFile segment(segmentPath(directory, chatId));
+    QFile index(indexPath(directory, chatId));
+    if (!segment.open(QIODevice::ReadOnly) || segment.size() < headerSize)
+    {
+        return false;
+    }
+
+    bool consistent = false;
+    if (index.open(QIODevice::ReadOnly) && index.size() >= headerSize && (index.size() - headerSize) % indexEntrySize == 0)
+    {
+        const uchar *indexData = index.map(0, index.size());
+        qint64 count = (index.size() - headerSize) / indexEntrySize;
+        if (indexData && memcmp(indexData, indexMagic, headerSize) == 0)
+        {
+            if (count == 0)
+            {
+                consistent = segment.size() == headerSize;
+                state.lastSeq = 0;
+            }
+            else
+            {
+                IndexEntry last = decodeIndexEntry(indexData + headerSize + (count - 1) * indexEntrySize);
+                const uchar *tail = last.offset >= headerSize && last.offset < segment.size()
+                                    ? segment.map(last.offset, segment.size() - last.offset) : nullptr;
+                RecordView view;
+                qint64 recordSize = 0;
+                consistent = tail && decodeRecord(tail, segment.size() - last.offset, view, recordSize) &&
+                             view.seq == last.seq && last.offset + recordSize == segment.size();
+                state.lastSeq = last.seq;
+            }
+        }
+    }
+    if (consistent)
+    {
+        return true;
+    }
+
+    //Сбой между дозаписью сегмента и индекса: индекс строится заново по сегменту
+    QVector<IndexEntry> entries;
+    qint64 validSize = 0;
+    segment.close();
+    index.close();
+    if (!scanSegment(segment.fileName(), entries, validSize))
+    {
+        return false;
+    }
+    if (validSize < segment.size() && !segment.resize(validSize))
+    {
+        return false;
+    }
+    if (!writeIndex(index.fileName(), entries))
+    {
+        return false;
+    }
+    state.lastSeq = entries.isEmpty() ? 0 : entries.last().seq;
+    ServerMetrics::getInstance()->add("history.segment_repairs");
+    Logger::getInstance()->logToFile(QString("Message segment of chat %1 repaired (%2 records)").arg(chatId).arg(entries.size()));
+    return true;
+}
+
+/**
+ * @brief Проверяет сегмент чата и догоняет его из базы данных.
+ *
+ * Проверка выполняется один раз за время работы процесса; для чата без сегмента
+ * сегмент создаётся из сообщений базы данных.
+ *
+ * @param chatId Идентификатор чата.
+ * @return true Если сегмент полон и пригоден для чтения.
+ */
+bool MessageLog::ensureChat(int chatId)
+{
+    if (chats.contains(chatId))
+    {
+        return true;
+    }
+
+    ChatState state;
+    if (!loadChat(chatId, state))
+    {
+        QSaveFile segment(segmentPath(directory, chatId));
+        if (!segment.open(QIODevice::WriteOnly) || segment.write(segmentMagic, headerSize) != headerSize ||
+            !segment.commit() || !writeIndex(indexPath(directory, chatId), {}))
+        {
+            removeFiles(directory, chatId);
+            return false;
+        }
+        state.lastSeq = 0;
+    }
+    if (!catchUp(chatId, state))
+    {
+        discardChat(chatId);
+        return false;
+    }
+    chats.insert(chatId, state);
+    return true;
+}
+
+/**
+ * @brief Дописывает в сегмент сообщения из базы данных, которых в нём ещё нет.
+ *
+ * @param chatId Идентификатор чата.
+ * @param state Состояние сегмента.
+ * @return true Если сегмент догнал базу данных.
+ */
+bool MessageLog::catchUp(int chatId, ChatState &state)
+{
+    QSqlQuery query(database);
+    query.setForwardOnly(true);
+    query.prepare("SELECT chat_seq, message_id, user_id, timestamp_sent, message_text FROM messages "
+                  "WHERE chat_id = :chatId AND chat_seq > :lastSeq ORDER BY chat_seq");
+    query.bindValue(":chatId", chatId);
+    query.bindValue(":lastSeq", state.lastSeq);
+    if (!query.exec())
+    {
+        qCritical() << "Could not read messages for segment of chat" << chatId << ":" << query.lastError().text();
+        return false;
+    }
+
+    QVector<Record> batch;
+    batch.reserve(catchUpBatchSize);
+    while (query.next())
+    {
+        Record record;
+        record.seq = query.value(0).toLongLong();
+        record.messageId = query.value(1).toInt();
+        record.userId = query.value(2).toInt();
+        record.timestamp = query.value(3).toString().toUtf8();
+        record.text = query.value(4).toString().toUtf8();
+        batch.append(record);
+        if (batch.size() == catchUpBatchSize)
+        {
+            if (!appendRecords(chatId, state, batch))
+            {
+                return false;
+            }
+            batch.clear();
+        }
+    }
+    return batch.isEmpty() || appendRecords(chatId, state, batch);
+}
+
+/**
+ * @brief Дописывает записи в сегмент и индекс.
+ *
+ * Сначала дописывается сегмент, затем индекс: при сбое между ними индекс восстанавливается
+ * по сегменту при следующем открытии.
+ *
+ * @param chatId Идентификатор чата.
+ * @param state Состояние сегмента.
+ * @param records Записи в порядке номеров.
+ * @return true Если записи дописаны.
+ */
+bool MessageLog::appendRecords(int chatId, ChatState &state, const QVector<Record> &records)
+{
+    QFile segment(segmentPath(directory, chatId));
+    QFile index(indexPath(directory, chatId));
+    if (!segment.open(QIODevice::WriteOnly | QIODevice::Append) || !index.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        return false;
+    }
+
+    qint64 offset = segment.size();
+    QByteArray segmentBytes;
+    QByteArray indexBytes;
+    for (const Record &record : records)
+    {
+        indexBytes.append(encodeIndexEntry(IndexEntry{record.seq, offset + segmentBytes.size()}));
+        segmentBytes.append(encodeRecord(record));
+    }
+    if (segment.write(segmentBytes) != segmentBytes.size() || !segment.flush() ||
+        index.write(indexBytes) != indexBytes.size() || !index.flush())
+    {
+        return false;
+    }
+    state.lastSeq = records.last().seq;
+    ServerMetrics::getInstance()->add("history.segment_appends", records.size());
+    return true;
+}
+
+/**
+ * @brief Удаляет сегмент, который не удалось поддержать в согласованном состоянии.
+ *
+ * История чата читается из базы данных, пока сегмент не будет создан заново.
+ *
+ * @param chatId Идентификатор чата.
+ */
+void MessageLog::discardChat(int chatId)
+{
+    chats.remove(chatId);
+    removeFiles(directory, chatId);
+    ServerMetrics::getInstance()->add("history.segment_discards");
+    Logger::getInstance()->logToFile(QString("Message segment of chat %1 discarded").arg(chatId));
+}
+
+/**
+ * @brief Дописывает сохранённое в базе сообщение в сегмент чата.
+ *
+ * Сообщение уже вставлено в базу, поэтому отставший на несколько сообщений сегмент
+ * просто догоняется из неё. Сегмент чата, который ещё не читался в этом процессе, не
+ * загружается: полный импорт истории в потоке событий задержал бы отправку сообщения,
+ * а сегмент догонит базу при первом чтении истории (openHistory).
+ *
+ * @param chatId Идентификатор чата.
+ * @param seq Порядковый номер сообщения в чате.
+ * @param messageId Идентификатор сообщения.
+ * @param userId Идентификатор отправителя.
+ * @param timestamp Время отправки.
+ * @param text Текст сообщения.
+ */
+void MessageLog::append(int chatId, qint64 seq, int messageId, int userId, const QString &timestamp, const QString &text)
+{
+    if (!enabled)
+    {
+        return;
+    }
+    auto it = chats.find(chatId);
+    if (it == chats.end() || seq <= it->lastSeq)
+    {
+        return;
+    }
+
+    bool appended;
+    if (seq != it->lastSeq + 1)
+    {
+        appended = catchUp(chatId, *it);
+    }
+    else
+    {
+        Record record;
+        record.seq = seq;
+        record.messageId = messageId;
+        record.userId = userId;
+        record.timestamp = timestamp.toUtf8();
+        record.text = text.toUtf8();
+        appended = appendRecords(chatId, *it, {record});
+    }
+    if (!appended)
+    {
+        discardChat(chatId);
+    }
+}
+
+/**
+ * @brief Отображает в память записи сегмента после указанного номера.
+ *
+ * Первая запись находится двоичным поиском по индексу.
+ *
+ * @param chatId Идентификатор чата.
+ * @param afterSeq Номер, после которого выдаются сообщения (0 — вся история).
+ * @param history Отображённая часть сегмента.
+ * @return true Если историю можно выдать из сегмента.
+ */
+bool MessageLog::openHistory(int chatId, qint64 afterSeq, MappedHistory &history)
+{
+    if (!enabled || !ensureChat(chatId))
+    {
+        return false;
+    }
+
+    qint64 offset = headerSize;
+    if (afterSeq > 0)
+    {
+        QFile index(indexPath(directory, chatId));
+        if (!index.open(QIODevice::ReadOnly))
+        {
+            return false;
+        }
+        qint64 count = (index.size() - headerSize) / indexEntrySize;
+        const uchar *entries = count > 0 ? index.map(headerSize, count * indexEntrySize) : nullptr;
+        if (count > 0 && !entries)
+        {
+            return false;
+        }
+        qint64 low = 0;
+        qint64 high = count;
+        while (low < high)
+        {
+            qint64 middle = (low + high) / 2;
+            if (decodeIndexEntry(entries + middle * indexEntrySize).seq <= afterSeq)
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+        offset = low < count ? decodeIndexEntry(entries + low * indexEntrySize).offset : -1;
+    }
+
+    history.file.reset(new QFile(segmentPath(directory, chatId)));
+    if (!history.file->open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+    qint64 size = history.file->size();
+    if (offset < 0 || offset >= size)
+    {
+        history.data = nullptr;
+        history.size = 0;
+        return true;
+    }
+    history.data = history.file->map(offset, size - offset);
+    history.size = history.data ? size - offset : 0;
+    return history.data != nullptr;
+}
+
+/**
+ * @brief Пишет записи отображённой части сегмента в ответ get_chat_history.
+ *
+ * Элементы пишутся в кодировке ответа напрямую из отображения: поля элемента те же,
+ * что и при чтении истории из базы данных.
+ *
+ * @param history Отображённая часть сегмента.
+ * @param writer Писатель ответа.
+ * @return int Количество записанных сообщений.
+ */
+int MessageLog::writeHistory(const MappedHistory &history, ListResponseWriter &writer)
+{
+    bool cbor = writer.wireEncoding() == WireEncoding::Cbor;
+    int written = 0;
+    qint64 offset = 0;
+    RecordView view;
+    qint64 recordSize = 0;
+    while (offset < history.size && decodeRecord(history.data + offset, history.size - offset, view, recordSize))
+    {
+        offset += recordSize;
+        QByteArray login = loginOf(view.userId);
+        QIODevice *device = writer.beginRawItem();
+        if (!device)
+        {
+            break;
+        }
+
+        //Ключи в том же порядке, в каком их выдаёт QJsonObject
+        if (cbor)
+        {
+            writeCborHead(device, 5, 5);
+            writeCborText(device, "message_id", 10);
+            writeCborInteger(device, view.messageId);
+            writeCborText(device, "message_text", 12);
+            writeCborText(device, view.text, view.textSize);
+            writeCborText(device, "seq", 3);
+            writeCborInteger(device, view.seq);
+            writeCborText(device, "timestamp", 9);
+            writeCborText(device, view.timestamp, view.timestampSize);
+            writeCborText(device, "user_id", 7);
+            writeCborText(device, login.constData(), login.size());
+        }
+        else
+        {
+            device->write("{\"message_id\":");
+            device->write(QByteArray::number(view.messageId));
+            device->write(",\"message_text\":");
+            writeJsonString(device, view.text, view.textSize);
+            device->write(",\"seq\":");
+            device->write(QByteArray::number(view.seq));
+            device->write(",\"timestamp\":");
+            writeJsonString(device, view.timestamp, view.timestampSize);
+            device->write(",\"user_id\":");
+            writeJsonString(device, login.constData(), login.size());
+            device->putChar('}');
+        }
+        ++written;
+    }
+
+    ServerMetrics *metrics = ServerMetrics::getInstance();
+    metrics->add("history.segment_reads");
+    metrics->add("history.segment_records", written);
+    if (offset < history.size)
+    {
+        metrics->add("history.segment_corrupt_reads");
+    }
+    return written;
+}
+
+/**
+ * @brief Возвращает логин отправителя в UTF-8.
+ *
+ * Логины кэшируются: в истории чата повторяются одни и те же отправители.
+ *
+ * @param userId Идентификатор пользователя.
+ * @return QByteArray Логин (пусто, если пользователь не найден).
+ */
+QByteArray MessageLog::loginOf(int userId)
+{
+    auto it = logins.find(userId);
+    if (it != logins.end())
+    {
+        return *it;
+    }
+    QSqlQuery query(database);
+    query.prepare("SELECT login FROM user_auth WHERE user_id = :userId");
+    query.bindValue(":userId", userId);
+    QByteArray login = (query.exec() && query.next()) ? query.value(0).toString().toUtf8() : QByteArray();
+    logins.insert(userId, login);
+    return login;
+}
+
+/**
+ * @brief Удаляет сегмент чата.
+ *
+ * @param chatId Идентификатор чата.
+ */
+void MessageLog::removeChat(int chatId)
+{
+    chats.remove(chatId);
+    if (enabled)
+    {
+        removeFiles(directory, chatId);
+    }
+}
+
+/**
+ * @brief Забывает логин пользователя.
+ *
+ * @param userId Идентификатор пользователя.
+ */
+void MessageLog::forgetLogin(int userId)
+{
+    logins.remove(userId);
+}
+
+/**
+ * @brief Удаляет файлы сегмента и индекса чата.
+ *
+ * @param directory Каталог сегментов.
+ * @param chatId Идентификатор чата.
+ */
+void MessageLog::removeFiles(const QString &directory, int chatId)
+{
+    QFile::remove(segmentPath(directory, chatId));
+    QFile::remove(indexPath(directory, chatId));
+}
+
+/**
+ * @brief Переписывает сегмент чата без повреждённого хвоста и повторных записей.
+ *
+ * Для каждого номера сохраняется последняя запись, записи упорядочиваются по номеру.
+ * Сегмент и индекс заменяются атомарно; сервер при этом должен быть остановлен или
+ * работать с выключенным хранением сегментов.
+ *
+ * @param directory Каталог сегментов.
+ * @param chatId Идентификатор чата.
+ * @param stats Результат сжатия.
+ * @return true Если сегмент сжат.
+ */
+bool MessageLog::compact(const QString &directory, int chatId, CompactionStats &stats)
+{
+    stats = CompactionStats();
+    QFile source(segmentPath(directory, chatId));
+    if (!source.open(QIODevice::ReadOnly) || source.size() < headerSize)
+    {
+        return false;
+    }
+    stats.bytesBefore = source.size();
+    const uchar *data = source.map(0, source.size());
+    if (!data || memcmp(data, segmentMagic, headerSize) != 0)
+    {
+        return false;
+    }
+
+    //Смещения последних записей по номерам; сами записи копируются из отображения
+    QMap<qint64, qint64> latest;
+    qint64 offset = headerSize;
+    RecordView view;
+    qint64 recordSize = 0;
+    int total = 0;
+    while (decodeRecord(data + offset, source.size() - offset, view, recordSize))
+    {
+        latest.insert(view.seq, offset);
+        offset += recordSize;
+        ++total;
+    }
+    stats.truncatedBytes = source.size() - offset;
+    stats.duplicates = total - latest.size();
+    stats.records = latest.size();
+
+    QSaveFile target(source.fileName());
+    if (!target.open(QIODevice::WriteOnly) || target.write(segmentMagic, headerSize) != headerSize)
+    {
+        return false;
+    }
+    QVector<IndexEntry> entries;
+    entries.reserve(latest.size());
+    qint64 targetOffset = headerSize;
+    for (auto it = latest.constBegin(); it != latest.constEnd(); ++it)
+    {
+        decodeRecord(data + it.value(), source.size() - it.value(), view, recordSize);
+        if (target.write(reinterpret_cast<const char*>(data + it.value()), recordSize) != recordSize)
+        {
+            return false;
+        }
+        entries.append(IndexEntry{it.key(), targetOffset});
+        targetOffset += recordSize;
+    }
+    source.close();
+    if (!target.commit() || !writeIndex(indexPath(directory, chatId), entries))
+    {
+        return false;
+    }
+    stats.bytesAfter = targetOffset;
+    return true;
+}
@@ -0,0 +1,295 @@
+/**
+ * /file messagelog.h
+ * /brief Определение класса MessageLog для хранения истории чатов в файлах сегментов с отображением в память.
+ */
+
+#ifndef MESSAGELOG_H
+#define MESSAGELOG_H
+
+#include "wireprotocol.h"
+
+#include <QSqlDatabase>
+#include <QFile>
+#include <QHash>
+#include <QVector>
+#include <QString>
+#include <memory>
+
+/**
+ * /brief Класс MessageLog.
+ *
+ * Дополнительно к таблице messages дописывает сообщения каждого чата в файл сегмента
+ * (chat-<id>.seg) компактными двоичными записями, а в файл индекса (chat-<id>.idx) —
+ * пары (номер сообщения, смещение записи). Запрос истории отображает сегмент в память
+ * и пишет записи в ответ без декодирования строк в QString и сборки QJsonObject, поэтому
+ * выдача длинной истории упирается в чтение файла, а не в процессор.
+ *
+ * Формат сегмента: 8 байт сигнатуры, затем записи (little-endian): длина записи без этого
+ * поля (4 байта), chat_seq (8), message_id (4), user_id (4), длина времени отправки (2),
+ * длина текста (4), время отправки и текст в UTF-8. Формат индекса: 8 байт сигнатуры,
+ * затем пары chat_seq (8) и смещение записи в сегменте (8).
+ *
+ * Таблица messages остаётся основным хранилищем, а сегменты служат копией для чтения:
+ * сегмент, отставший от базы (например, после сбоя между вставкой и дозаписью), догоняется
+ * из неё, повреждённый хвост отрезается, а сегмент, который не удаётся восстановить,
+ * удаляется и создаётся заново. Сегмент чата загружается и догоняется при первом чтении
+ * истории; до этого новые сообщения в него не дописываются. Сегменты сжимаются
+ * инструментом tools/compact.
+ */
+class MessageLog
+{
+public:
+    /**
+     * /brief Запись сообщения в сегменте.
+     */
+    struct Record
+    {
+        qint64 seq = 0; ///< Порядковый номер сообщения в чате.
+        int messageId = -1; ///< Идентификатор сообщения.
+        int userId = -1; ///< Идентификатор отправителя.
+        QByteArray timestamp; ///< Время отправки в UTF-8.
+        QByteArray text; ///< Текст сообщения в UTF-8.
+    };
+
+    /**
+     * /brief Запись сегмента, прочитанная без копирования.
+     */
+    struct RecordView
+    {
+        qint64 seq = 0; ///< Порядковый номер сообщения в чате.
+        int messageId = -1; ///< Идентификатор сообщения.
+        int userId = -1; ///< Идентификатор отправителя.
+        const char *timestamp = nullptr; ///< Время отправки (в отображённом сегменте).
+        int timestampSize = 0; ///< Длина времени отправки.
+        const char *text = nullptr; ///< Текст сообщения (в отображённом сегменте).
+        int textSize = 0; ///< Длина текста.
+    };
+
+    /**
+     * /brief Элемент индекса сегмента.
+     */
+    struct IndexEntry
+    {
+        qint64 seq = 0; ///< Порядковый номер сообщения в чате.
+        qint64 offset = 0; ///< Смещение записи в сегменте.
+    };
+
+    /**
+     * /brief Часть сегмента, отображённая в память для выдачи истории.
+     */
+    struct MappedHistory
+    {
+        std::unique_ptr<QFile> file; ///< Файл сегмента (отображение снимается при его удалении).
+        const uchar *data = nullptr; ///< Начало первой выдаваемой записи.
+        qint64 size = 0; ///< Размер выдаваемых записей.
+    };
+
+    /**
+     * /brief Результат сжатия сегмента.
+     */
+    struct CompactionStats
+    {
+        int records = 0; ///< Количество записей после сжатия.
+        int duplicates = 0; ///< Количество удалённых повторных записей.
+        qint64 truncatedBytes = 0; ///< Размер отрезанного повреждённого хвоста.
+        qint64 bytesBefore = 0; ///< Размер сегмента до сжатия.
+        qint64 bytesAfter = 0; ///< Размер сегмента после сжатия.
+    };
+
+    static const int headerSize = 8; ///< Размер сигнатуры сегмента и индекса.
+
+private:
+    /**
+     * /brief Состояние сегмента чата, проверенного в текущем процессе.
+     */
+    struct ChatState
+    {
+        qint64 lastSeq = 0; ///< Номер последней записи сегмента.
+    };
+
+    QSqlDatabase database; ///< База данных сервера.
+    QString directory; ///< Каталог сегментов.
+    bool enabled = false; ///< Признак включённого хранения сегментов.
+    QHash<int, ChatState> chats; ///< Проверенные сегменты по чатам.
+    QHash<int, QByteArray> logins; ///< Логины отправителей в UTF-8 по идентификаторам.
+
+    /**
+     * /brief Проверяет сегмент чата и догоняет его из базы данных.
+     * /param chatId Идентификатор чата.
+     * /return Признак того, что сегмент полон и пригоден для чтения.
+     */
+    bool ensureChat(int chatId);
+
+    /**
+     * /brief Открывает существующий сегмент чата, восстанавливая индекс при необходимости.
+     * /param chatId Идентификатор чата.
+     * /param state Состояние сегмента.
+     * /return Признак того, что сегмент открыт.
+     */
+    bool loadChat(int chatId, ChatState &state);
+
+    /**
+     * /brief Дописывает в сегмент сообщения из базы данных, которых в нём ещё нет.
+     * /param chatId Идентификатор чата.
+     * /param state Состояние сегмента.
+     * /return Признак успешной дозаписи.
+     */
+    bool catchUp(int chatId, ChatState &state);
+
+    /**
+     * /brief Дописывает записи в сегмент и индекс.
+     * /param chatId Идентификатор чата.
+     * /param state Состояние сегмента.
+     * /param records Записи в порядке номеров.
+     * /return Признак успешной записи.
+     */
+    bool appendRecords(int chatId, ChatState &state, const QVector<Record> &records);
+
+    /**
+     * /brief Удаляет сегмент, который не удалось поддержать в согласованном состоянии.
+     * /param chatId Идентификатор чата.
+     */
+    void discardChat(int chatId);
+
+    /**
+     * /brief Возвращает логин отправителя в UTF-8.
+     * /param userId Идентификатор пользователя.
+     * /return Логин (пусто, если пользователь не найден).
+     */
+    QByteArray loginOf(int userId);
+
+public:
+    /**
+     * /brief Включает хранение сегментов в указанном каталоге.
+     * /param database База данных сервера.
+     * /param directory Каталог сегментов.
+     * /return Признак того, что каталог доступен.
+     */
+    bool open(const QSqlDatabase &database, const QString &directory);
+
+    /**
+     * /brief Выключает хранение сегментов (история читается из базы данных).
+     */
+    void close();
+
+    /**
+     * /brief Проверяет, включено ли хранение сегментов.
+     * /return Признак включённого хранения.
+     */
+    bool isEnabled() const { return enabled; }
+
+    /**
+     * /brief Дописывает сохранённое в базе сообщение в сегмент чата.
+     * /param chatId Идентификатор чата.
+     * /param seq Порядковый номер сообщения в чате.
+     * /param messageId Идентификатор сообщения.
+     * /param userId Идентификатор отправителя.
+     * /param timestamp Время отправки.
+     * /param text Текст сообщения.
+     */
+    void append(int chatId, qint64 seq, int messageId, int userId, const QString &timestamp, const QString &text);
+
+    /**
+     * /brief Отображает в память записи сегмента после указанного номера.
+     * /param chatId Идентификатор чата.
+     * /param afterSeq Номер, после которого выдаются сообщения (0 — вся история).
+     * /param history Отображённая часть сегмента.
+     * /return Признак того, что историю можно выдать из сегмента.
+     */
+    bool openHistory(int chatId, qint64 afterSeq, MappedHistory &history);
+
+    /**
+     * /brief Пишет записи отображённой части сегмента в ответ get_chat_history.
+     * /param history Отображённая часть сегмента.
+     * /param writer Писатель ответа.
+     * /return Количество записанных сообщений.
+     */
+    int writeHistory(const MappedHistory &history, ListResponseWriter &writer);
+
+    /**
+     * /brief Удаляет сегмент чата (при удалении чата).
+     * /param chatId Идентификатор чата.
+     */
+    void removeChat(int chatId);
+
+    /**
+     * /brief Забывает логин пользователя (при смене логина).
+     * /param userId Идентификатор пользователя.
+     */
+    void forgetLogin(int userId);
+
+    /**
+     * /brief Возвращает путь к сегменту чата.
+     * /param directory Каталог сегментов.
+     * /param chatId Идентификатор чата.
+     * /return Путь к файлу сегмента.
+     */
+    static QString segmentPath(const QString &directory, int chatId);
+
+    /**
+     * /brief Возвращает путь к индексу сегмента чата.
+     * /param directory Каталог сегментов.
+     * /param chatId Идентификатор чата.
+     * /return Путь к файлу индекса.
+     */
+    static QString indexPath(const QString &directory, int chatId);
+
+    /**
+     * /brief Возвращает идентификаторы чатов, для которых в каталоге есть сегменты.
+     * /param directory Каталог сегментов.
+     * /return Идентификаторы чатов.
+     */
+    static QVector<int> chatIds(const QString &directory);
+
+    /**
+     * /brief Кодирует запись сегмента.
+     * /param record Запись.
+     * /return Байты записи.
+     */
+    static QByteArray encodeRecord(const Record &record);
+
+    /**
+     * /brief Разбирает запись сегмента без копирования.
+     * /param data Начало записи.
+     * /param available Количество доступных байт.
+     * /param view Разобранная запись.
+     * /param recordSize Полный размер записи.
+     * /return Признак целой и корректной записи.
+     */
+    static bool decodeRecord(const uchar *data, qint64 available, RecordView &view, qint64 &recordSize);
+
+    /**
+     * /brief Читает индекс всех целых записей сегмента.
+     * /param segmentPath Путь к сегменту.
+     * /param entries Элементы индекса.
+     * /param validSize Размер сегмента до первой повреждённой записи.
+     * /return Признак того, что файл является сегментом.
+     */
+    static bool scanSegment(const QString &segmentPath, QVector<IndexEntry> &entries, qint64 &validSize);
+
+    /**
+     * /brief Записывает файл индекса целиком.
+     * /param indexPath Путь к индексу.
+     * /param entries Элементы индекса.
+     * /return Признак успешной записи.
+     */
+    static bool writeIndex(const QString &indexPath, const QVector<IndexEntry> &entries);
+
+    /**
+     * /brief Переписывает сегмент чата без повреждённого хвоста и повторных записей.
+     * /param directory Каталог сегментов.
+     * /param chatId Идентификатор чата.
+     * /param stats Результат сжатия.
+     * /return Признак успешного сжатия.
+     */
+    static bool compact(const QString &directory, int chatId, CompactionStats &stats);
+
+    /**
+     * /brief Удаляет файлы сегмента и индекса чата.
+     * /param directory Каталог сегментов.
+     * /param chatId Идентификатор чата.
+     */
+    static void removeFiles(const QString &directory, int chatId);
+};
+
+#endif // MESSAGELOG_H
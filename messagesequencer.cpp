@@ -0,0 +1,147 @@
+#include "messagesequencer.h"
+#include "servermetrics.h"
+
+#include <QDebug>
+
+/**
+ * @brief Подключает нумерацию к хранилищу сообщений.
+ *
+ * Схему таблицы messages готовит само хранилище (SqliteChatRepository::open).
+ *
+ * @param repository Хранилище сообщений.
+ * @param dedupWindow Количество идентификаторов клиента, хранимых в памяти.
+ */
+void MessageSequencer::open(ChatRepository *repository, int dedupWindow)
+{
+    this->repository = repository;
+    recentClientIds.clear();
+    recentClientIds.setMaxCost(qMax(1, dedupWindow));
+    lastSeq.clear();
+}
+
+/**
+ * @brief Включает режим базы данных, общей для нескольких экземпляров сервера.
+ *
+ * @param shared Признак общей базы данных.
+ */
+void MessageSequencer::setShared(bool shared)
+{
+    this->shared = shared;
+    lastSeq.clear();
+}
+
+/**
+ * @brief Ищет сообщение по идентификатору клиента в базе данных.
+ *
+ * @param chatId Идентификатор чата.
+ * @param userId Идентификатор отправителя.
+ * @param clientMessageId Идентификатор сообщения клиента.
+ * @param stored Найденное сообщение.
+ * @return true Если сообщение найдено.
+ */
+bool MessageSequencer::findStored(int chatId, int userId, const QString &clientMessageId, StoredMessage &stored)
+{
+    ChatRepository::MessageRecord message;
+    if (!repository->findMessage(chatId, userId, clientMessageId, message))
+    {
+        return false;
+    }
+    stored.messageId = message.messageId;
+    stored.seq = message.seq;
+    stored.duplicate = true;
+    return true;
+}
+
+/**
+ * @brief Возвращает следующий номер сообщения в чате.
+ *
+ * Последний номер чата читается из индекса один раз, дальше он ведётся в памяти.
+ *
+ * @param chatId Идентификатор чата.
+ * @return qint64 Номер сообщения.
+ */
+qint64 MessageSequencer::nextSeq(int chatId)
+{
+    auto it = lastSeq.find(chatId);
+    if (it == lastSeq.end())
+    {
+        it = lastSeq.insert(chatId, repository->lastSeq(chatId));
+    }
+    return *it + 1;
+}
+
+/**
+ * @brief Сохраняет сообщение или возвращает уже сохранённое при повторе.
+ *
+ * Сначала проверяется окно недавних идентификаторов. При промахе сообщение вставляется
+ * сразу; нарушение уникального индекса означает повтор более старого запроса, и тогда
+ * сохранённое сообщение читается из базы.
+ *
+ * @param chatId Идентификатор чата.
+ * @param userId Идентификатор отправителя.
+ * @param clientMessageId Идентификатор сообщения клиента (может быть пустым).
+ * @param messageText Текст сообщения.
+ * @param timestamp Время отправки.
+ * @return StoredMessage Результат сохранения.
+ */
+MessageSequencer::StoredMessage MessageSequencer::store(int chatId, int userId, const QString &clientMessageId,
+                                                        const QString &messageText, const QString &timestamp)
+{
+    StoredMessage stored;
+    //Идентификатор клиента уникален в пределах чата: тот же идентификатор в другом чате — другое сообщение
+    QString cacheKey = QString::number(chatId) + ':' + QString::number(userId) + ':' + clientMessageId;
+    if (!clientMessageId.isEmpty())
+    {
+        if (StoredMessage *recent = recentClientIds.object(cacheKey))
+        {
+            ServerMetrics::getInstance()->add("messages.duplicates");
+            return *recent;
+        }
+    }
+
+    ChatRepository::MessageRecord message;
+    message.chatId = chatId;
+    message.userId = userId;
+    message.clientMessageId = clientMessageId;
+    message.text = messageText;
+    message.timestamp = timestamp;
+    //При общей базе номер присваивает хранилище в самой вставке
+    message.seq = shared ? 0 : nextSeq(chatId);
+
+    if (repository->insertMessage(message))
+    {
+        stored.messageId = message.messageId;
+        stored.seq = message.seq;
+        if (!shared)
+        {
+            lastSeq[chatId] = message.seq;
+        }
+    }
+    else if (clientMessageId.isEmpty() || !findStored(chatId, userId, clientMessageId, stored))
+    {
+        qCritical() << "Could not store message:" << repository->lastError();
+        return stored;
+    }
+    else
+    {
+        ServerMetrics::getInstance()->add("messages.duplicates");
+    }
+
+    if (!clientMessageId.isEmpty())
+    {
+        StoredMessage *entry = new StoredMessage(stored);
+        entry->duplicate = true;
+        recentClientIds.insert(cacheKey, entry);
+    }
+    return stored;
+}
+
+/**
+ * @brief Забывает номер чата.
+ *
+ * @param chatId Идентификатор чата.
+ */
+void MessageSequencer::forgetChat(int chatId)
+{
+    lastSeq.remove(chatId);
+}
@@ -0,0 +1,102 @@
+/**
+ * /file messagesequencer.h
+ * /brief Определение класса MessageSequencer для идемпотентного сохранения сообщений с номерами в чате.
+ */
+
+#ifndef MESSAGESEQUENCER_H
+#define MESSAGESEQUENCER_H
+
+#include "chatrepository.h"
+
+#include <QCache>
+#include <QHash>
+#include <QString>
+
+/**
+ * /brief Класс MessageSequencer.
+ *
+ * Сохраняет сообщения, присваивая каждому порядковый номер в чате (chat_seq). По номерам
+ * клиент обнаруживает пропущенные уведомления без повторной загрузки истории.
+ *
+ * Клиент может передать собственный идентификатор сообщения (client_msg_id); повтор запроса
+ * с тем же идентификатором возвращает уже сохранённое сообщение. Недавние идентификаторы
+ * хранятся в ограниченном окне в памяти, более старые проверяются по уникальному индексу
+ * (chat_id, user_id, client_msg_id), поэтому новые сообщения не требуют лишнего запроса к базе.
+ *
+ * Когда базу используют несколько экземпляров сервера, номер присваивает хранилище
+ * в той же операции вставки, так как последний номер чата в памяти одного процесса
+ * может устареть.
+ */
+class MessageSequencer
+{
+public:
+    /**
+     * /brief Результат сохранения сообщения.
+     */
+    struct StoredMessage
+    {
+        int messageId = -1; ///< Идентификатор сообщения (-1 при ошибке).
+        qint64 seq = 0; ///< Порядковый номер сообщения в чате.
+        bool duplicate = false; ///< Признак повторного запроса уже сохранённого сообщения.
+    };
+
+private:
+    ChatRepository *repository = nullptr; ///< Хранилище сообщений.
+    QCache<QString, StoredMessage> recentClientIds; ///< Окно недавних идентификаторов клиента.
+    QHash<int, qint64> lastSeq; ///< Последний выданный номер по чатам.
+    bool shared = false; ///< Признак базы данных, общей для нескольких экземпляров сервера.
+
+    /**
+     * /brief Ищет сообщение по идентификатору клиента в базе данных.
+     * /param chatId Идентификатор чата.
+     * /param userId Идентификатор отправителя.
+     * /param clientMessageId Идентификатор сообщения клиента.
+     * /param stored Найденное сообщение.
+     * /return Признак того, что сообщение найдено.
+     */
+    bool findStored(int chatId, int userId, const QString &clientMessageId, StoredMessage &stored);
+
+    /**
+     * /brief Возвращает следующий номер сообщения в чате.
+     * /param chatId Идентификатор чата.
+     * /return Номер сообщения.
+     */
+    qint64 nextSeq(int chatId);
+
+public:
+    /**
+     * /brief Подключает нумерацию к хранилищу сообщений.
+     *
+     * Номера чатов и окно идентификаторов, прочитанные из прежнего хранилища, сбрасываются.
+     *
+     * /param repository Хранилище сообщений.
+     * /param dedupWindow Количество идентификаторов клиента, хранимых в памяти.
+     */
+    void open(ChatRepository *repository, int dedupWindow);
+
+    /**
+     * /brief Включает режим базы данных, общей для нескольких экземпляров сервера.
+     * /param shared Признак общей базы данных.
+     */
+    void setShared(bool shared);
+
+    /**
+     * /brief Сохраняет сообщение или возвращает уже сохранённое при повторе.
+     * /param chatId Идентификатор чата.
+     * /param userId Идентификатор отправителя.
+     * /param clientMessageId Идентификатор сообщения клиента (может быть пустым).
+     * /param messageText Текст сообщения.
+     * /param timestamp Время отправки.
+     * /return Результат сохранения.
+     */
+    StoredMessage store(int chatId, int userId, const QString &clientMessageId,
+                        const QString &messageText, const QString &timestamp);
+
+    /**
+     * /brief Забывает номер чата (при удалении чата).
+     * /param chatId Идентификатор чата.
+     */
+    void forgetChat(int chatId);
+};
+
+#endif // MESSAGESEQUENCER_H
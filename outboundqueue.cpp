@@ -0,0 +1,326 @@
+#include "outboundqueue.h"
+#include "logger.h"
+#include "servermetrics.h"
+
+#include <QTimer>
+#include <QSslSocket>
+
+namespace
+{
+/**
+ * @brief Ограничивает внутренний буфер чтения сокета.
+ *
+ * Пока буфер заполнен, Qt не читает данные из ядра, и клиент упирается в окно TCP.
+ * У QSslSocket собственный метод, который ограничивает и буфер расшифрованных данных.
+ *
+ * @param socket Указатель на сокет клиента.
+ * @param size Размер буфера (0 — без ограничения).
+ */
+void setReadLimit(QTcpSocket *socket, qint64 size)
+{
+    if (QSslSocket *sslSocket = qobject_cast<QSslSocket*>(socket))
+    {
+        sslSocket->setReadBufferSize(size);
+        return;
+    }
+    socket->setReadBufferSize(size);
+}
+}
+
+/**
+ * @brief Конструктор класса OutboundQueue.
+ *
+ * @param parent Указатель на родительский объект (по умолчанию nullptr).
+ */
+OutboundQueue::OutboundQueue(QObject *parent) : QObject(parent)
+{
+}
+
+/**
+ * @brief Деструктор класса OutboundQueue.
+ */
+OutboundQueue::~OutboundQueue()
+{
+    qDeleteAll(states);
+}
+
+/**
+ * @brief Задаёт пороги объёма неотправленных данных.
+ *
+ * @param high Верхний порог в байтах.
+ * @param low Нижний порог в байтах.
+ * @param hard Жёсткий предел неотправленных уведомлений в байтах.
+ */
+void OutboundQueue::configure(qint64 high, qint64 low, qint64 hard)
+{
+    highWatermark = qMax<qint64>(1, high);
+    lowWatermark = qBound<qint64>(0, low, highWatermark);
+    hardLimit = qMax(highWatermark, hard);
+}
+
+/**
+ * @brief Возвращает состояние подключения, создавая его при первом обращении.
+ *
+ * При создании состояния подписывается на bytesWritten, чтобы отправить свёрнутые
+ * уведомления, когда клиент снова начнёт читать.
+ *
+ * @param socket Указатель на сокет клиента.
+ * @return ConnectionState* Состояние подключения.
+ */
+OutboundQueue::ConnectionState *OutboundQueue::stateOf(QTcpSocket *socket)
+{
+    ConnectionState *&state = states[socket];
+    if (!state)
+    {
+        state = new ConnectionState;
+        connect(socket, &QTcpSocket::bytesWritten, this, [this, socket]()
+                {
+                    onBytesWritten(socket);
+                });
+    }
+    return state;
+}
+
+/**
+ * @brief Ставит обязательные данные в очередь подключения.
+ *
+ * Данные попадают в буфер сокета, а сам flush откладывается до конца итерации цикла событий.
+ *
+ * @param socket Указатель на сокет клиента.
+ * @param data Данные для отправки.
+ */
+void OutboundQueue::write(QTcpSocket *socket, const QByteArray &data)
+{
+    if (socket->state() != QAbstractSocket::ConnectedState)
+    {
+        return;
+    }
+    socket->write(data);
+    written(socket);
+}
+
+/**
+ * @brief Учитывает данные, записанные в сокет напрямую.
+ *
+ * @param socket Указатель на сокет клиента.
+ */
+void OutboundQueue::written(QTcpSocket *socket)
+{
+    markDirty(socket);
+}
+
+/**
+ * @brief Учитывает необязательное уведомление, переданное подключению.
+ *
+ * Сами данные пишутся в сокет через write(), возможно позже (после сжатия); здесь
+ * учитывается только их объём для проверки жёсткого предела.
+ *
+ * @param socket Указатель на сокет клиента.
+ * @param bytes Размер уведомления в байтах.
+ */
+void OutboundQueue::pushed(QTcpSocket *socket, qint64 bytes)
+{
+    if (socket->state() != QAbstractSocket::ConnectedState)
+    {
+        return;
+    }
+    stateOf(socket)->pushBytes += bytes;
+    enforceHardLimit(socket);
+}
+
+/**
+ * @brief Проверяет, нужно ли свернуть необязательное уведомление.
+ *
+ * @param socket Указатель на сокет клиента.
+ * @return true Если уведомление следует свернуть.
+ * @return false Если его можно отправить сразу.
+ */
+bool OutboundQueue::shouldCollapsePush(QTcpSocket *socket) const
+{
+    ConnectionState *state = states.value(socket);
+    return socket->bytesToWrite() > highWatermark || (state && !state->collapsed.isEmpty());
+}
+
+/**
+ * @brief Приостанавливает чтение запросов подключения, если его буфер выше верхнего порога.
+ *
+ * Уже принятые Qt байты остаются в буфере сокета, новые — в буфере ядра.
+ *
+ * @param socket Указатель на сокет клиента.
+ * @return true Если чтение приостановлено.
+ * @return false Если запросы можно читать.
+ */
+bool OutboundQueue::pauseReadingIfBacklogged(QTcpSocket *socket)
+{
+    ConnectionState *state = states.value(socket);
+    if (state && state->readPaused)
+    {
+        return true;
+    }
+    if (socket->bytesToWrite() <= highWatermark)
+    {
+        return false;
+    }
+    stateOf(socket)->readPaused = true;
+    setReadLimit(socket, qMax<qint64>(1, socket->bytesAvailable()));
+    ServerMetrics::getInstance()->add("outbound.read_pauses");
+    return true;
+}
+
+/**
+ * @brief Сворачивает необязательное уведомление.
+ *
+ * @param socket Указатель на сокет клиента.
+ * @param key Ключ свёртки.
+ * @param push Уведомление.
+ */
+void OutboundQueue::collapsePush(QTcpSocket *socket, const QString &key, const QJsonObject &push)
+{
+    CollapsedPush &collapsed = stateOf(socket)->collapsed[key];
+    collapsed.latest = push;
+    collapsed.missed++;
+    ServerMetrics::getInstance()->add("outbound.collapsed_pushes");
+
+    //Если клиент уже всё прочитал, bytesWritten больше не придёт — проверяем сразу после сброса
+    markDirty(socket);
+}
+
+/**
+ * @brief Проверяет жёсткий предел объёма неотправленных уведомлений.
+ *
+ * Учитываются только уведомления: ответ, который клиент запросил сам, может быть любого
+ * размера и отключения не вызывает. Отключение откладывается до возврата в цикл событий,
+ * так как вызывающий обработчик ещё может обращаться к сокету.
+ *
+ * @param socket Указатель на сокет клиента.
+ * @return true Если клиент превысил предел и будет отключён.
+ * @return false В противном случае.
+ */
+bool OutboundQueue::enforceHardLimit(QTcpSocket *socket)
+{
+    ConnectionState *state = states.value(socket);
+    if (!state || state->pushBytes <= hardLimit)
+    {
+        return false;
+    }
+
+    Logger::getInstance()->logToFile(QString("Client socket %1 exceeded outbound limit (%2 push bytes pending), disconnecting")
+                                         .arg(socket->socketDescriptor()).arg(state->pushBytes));
+    ServerMetrics::getInstance()->add("outbound.slow_consumer_disconnects");
+    dirty.remove(socket);
+    QTimer::singleShot(0, socket, [socket]()
+                       {
+                           socket->abort();
+                       });
+    return true;
+}
+
+/**
+ * @brief Планирует сброс буферов в конце текущей итерации цикла событий.
+ *
+ * @param socket Указатель на сокет клиента.
+ */
+void OutboundQueue::markDirty(QTcpSocket *socket)
+{
+    dirty.insert(socket);
+    if (!flushScheduled)
+    {
+        flushScheduled = true;
+        QMetaObject::invokeMethod(this, "flushDirty", Qt::QueuedConnection);
+    }
+}
+
+/**
+ * @brief Сбрасывает буферы всех подключений, в которые писали за итерацию.
+ */
+void OutboundQueue::flushDirty()
+{
+    flushScheduled = false;
+    QSet<QTcpSocket*> sockets;
+    sockets.swap(dirty);
+    for (QTcpSocket *socket : qAsConst(sockets))
+    {
+        if (socket->state() == QAbstractSocket::ConnectedState)
+        {
+            socket->flush();
+            onBytesWritten(socket);
+        }
+    }
+    ServerMetrics::getInstance()->add("outbound.flushes", sockets.size());
+}
+
+/**
+ * @brief Отправляет свёрнутые уведомления, если буфер подключения опустился ниже нижнего порога.
+ *
+ * Уведомлений в буфере не может быть больше, чем всех неотправленных данных, поэтому их
+ * учтённый объём уменьшается по мере того, как клиент читает. Приостановленное чтение
+ * запросов возобновляется ниже того же порога.
+ *
+ * @param socket Указатель на сокет клиента.
+ */
+void OutboundQueue::onBytesWritten(QTcpSocket *socket)
+{
+    ConnectionState *state = states.value(socket);
+    if (!state)
+    {
+        return;
+    }
+    state->pushBytes = qMin(state->pushBytes, socket->bytesToWrite());
+    if (socket->bytesToWrite() > lowWatermark)
+    {
+        return;
+    }
+    if (state->readPaused)
+    {
+        state->readPaused = false;
+        setReadLimit(socket, 0);
+        emit readingResumed(socket);
+    }
+    if (state->collapsed.isEmpty())
+    {
+        return;
+    }
+
+    QList<QJsonObject> pushes;
+    for (auto it = state->collapsed.begin(); it != state->collapsed.end(); ++it)
+    {
+        QJsonObject push = it->latest;
+        push["collapsed"] = true;
+        push["missed"] = it->missed;
+        pushes.append(push);
+    }
+    state->collapsed.clear();
+    emit collapsedPushesReady(socket, pushes);
+}
+
+/**
+ * @brief Проверяет, что у подключения нет неотправленных и свёрнутых данных.
+ *
+ * @param socket Указатель на сокет клиента.
+ * @return true Если очередь подключения пуста.
+ */
+bool OutboundQueue::isIdle(QTcpSocket *socket) const
+{
+    if (dirty.contains(socket) || socket->bytesToWrite() > 0)
+    {
+        return false;
+    }
+    ConnectionState *state = states.value(socket);
+    return !state || state->collapsed.isEmpty();
+}
+
+/**
+ * @brief Удаляет состояние подключения.
+ *
+ * @param socket Указатель на сокет клиента.
+ */
+void OutboundQueue::remove(QTcpSocket *socket)
+{
+    dirty.remove(socket);
+    ConnectionState *state = states.take(socket);
+    if (state)
+    {
+        disconnect(socket, &QTcpSocket::bytesWritten, this, nullptr);
+        delete state;
+    }
+}
@@ -0,0 +1,194 @@
+/**
+ * /file outboundqueue.h
+ * /brief Определение класса OutboundQueue для объединения записей в сокеты и контроля переполнения.
+ */
+
+#ifndef OUTBOUNDQUEUE_H
+#define OUTBOUNDQUEUE_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QJsonObject>
+#include <QHash>
+#include <QMap>
+#include <QSet>
+
+/**
+ * /brief Класс OutboundQueue.
+ *
+ * Собирает все записи, сделанные в подключения за одну итерацию цикла событий, и выполняет
+ * один flush на подключение в конце итерации вместо системного вызова на каждое сообщение.
+ *
+ * Объём данных, ожидающих отправки, ограничивается порогами:
+ * выше верхнего порога необязательные push-уведомления не пишутся, а сворачиваются
+ * (для каждого ключа сохраняется последнее уведомление и число пропущенных);
+ * после опустошения буфера ниже нижнего порога свёрнутые уведомления отправляются сигналом
+ * collapsedPushesReady. Если в буфере копятся уведомления, которые клиент не читает, и их объём
+ * превышает жёсткий предел, клиент отключается. Ответы на запросы самого клиента в этот объём
+ * не входят: крупный ответ (например, длинная история чата) не приводит к отключению.
+ * Объём ответов ограничивается чтением: пока буфер подключения выше верхнего порога, новые
+ * запросы клиента не читаются (остаются в буфере ядра), а после опустошения буфера ниже
+ * нижнего порога чтение возобновляется сигналом readingResumed.
+ */
+class OutboundQueue : public QObject
+{
+    Q_OBJECT
+
+private:
+    /**
+     * /brief Свёрнутое push-уведомление.
+     */
+    struct CollapsedPush
+    {
+        QJsonObject latest; ///< Последнее уведомление с данным ключом.
+        int missed = 0; ///< Количество уведомлений, не отправленных клиенту.
+    };
+
+    /**
+     * /brief Состояние исходящего потока одного подключения.
+     */
+    struct ConnectionState
+    {
+        QMap<QString, CollapsedPush> collapsed; ///< Свёрнутые уведомления по ключам.
+        qint64 pushBytes = 0; ///< Объём уведомлений, которые ещё могут находиться в буфере сокета.
+        bool readPaused = false; ///< Признак приостановленного чтения запросов.
+    };
+
+    QHash<QTcpSocket*, ConnectionState*> states; ///< Состояния подключений.
+    QSet<QTcpSocket*> dirty; ///< Подключения, в которые писали в текущей итерации цикла событий.
+    bool flushScheduled = false; ///< Признак запланированного сброса буферов.
+    qint64 highWatermark = 256 * 1024; ///< Верхний порог объёма неотправленных данных.
+    qint64 lowWatermark = 64 * 1024; ///< Нижний порог, после которого отправляются свёрнутые уведомления.
+    qint64 hardLimit = 8 * 1024 * 1024; ///< Жёсткий предел неотправленных уведомлений, при превышении которого клиент отключается.
+
+    /**
+     * /brief Возвращает состояние подключения, создавая его при первом обращении.
+     * /param socket Указатель на сокет клиента.
+     * /return Состояние подключения.
+     */
+    ConnectionState *stateOf(QTcpSocket *socket);
+
+    /**
+     * /brief Проверяет жёсткий предел неотправленных уведомлений и отключает клиента при его превышении.
+     * /param socket Указатель на сокет клиента.
+     * /return Признак того, что клиент отключается.
+     */
+    bool enforceHardLimit(QTcpSocket *socket);
+
+    /**
+     * /brief Планирует сброс буферов в конце текущей итерации цикла событий.
+     * /param socket Указатель на сокет клиента.
+     */
+    void markDirty(QTcpSocket *socket);
+
+    /**
+     * /brief Обрабатывает отправку данных подключением.
+     * /param socket Указатель на сокет клиента.
+     */
+    void onBytesWritten(QTcpSocket *socket);
+
+private slots:
+    /**
+     * /brief Сбрасывает буферы всех подключений, в которые писали за итерацию.
+     */
+    void flushDirty();
+
+public:
+    /**
+     * /brief Конструктор класса OutboundQueue.
+     * /param parent Указатель на родительский объект.
+     */
+    explicit OutboundQueue(QObject *parent = nullptr);
+
+    /**
+     * /brief Деструктор, освобождающий состояния подключений.
+     */
+    ~OutboundQueue() override;
+
+    /**
+     * /brief Задаёт пороги объёма неотправленных данных.
+     * /param high Верхний порог в байтах.
+     * /param low Нижний порог в байтах.
+     * /param hard Жёсткий предел неотправленных уведомлений в байтах.
+     */
+    void configure(qint64 high, qint64 low, qint64 hard);
+
+    /**
+     * /brief Ставит обязательные данные (ответ на запрос) в очередь подключения.
+     * /param socket Указатель на сокет клиента.
+     * /param data Данные для отправки.
+     */
+    void write(QTcpSocket *socket, const QByteArray &data);
+
+    /**
+     * /brief Учитывает данные, записанные в сокет напрямую (потоковые ответы).
+     * /param socket Указатель на сокет клиента.
+     */
+    void written(QTcpSocket *socket);
+
+    /**
+     * /brief Учитывает необязательное уведомление, переданное подключению.
+     * /param socket Указатель на сокет клиента.
+     * /param bytes Размер уведомления в байтах.
+     */
+    void pushed(QTcpSocket *socket, qint64 bytes);
+
+    /**
+     * /brief Проверяет, нужно ли свернуть необязательное уведомление вместо отправки.
+     *
+     * Уведомление сворачивается, если буфер выше верхнего порога или у подключения уже есть
+     * свёрнутые уведомления (чтобы не нарушить порядок).
+     *
+     * /param socket Указатель на сокет клиента.
+     * /return Признак необходимости свернуть уведомление.
+     */
+    bool shouldCollapsePush(QTcpSocket *socket) const;
+
+    /**
+     * /brief Приостанавливает чтение запросов подключения, если его буфер выше верхнего порога.
+     *
+     * Клиент, который отправляет запросы, но не читает ответы, не может таким образом
+     * наращивать буфер сервера: его запросы остаются непрочитанными до опустошения буфера.
+     *
+     * /param socket Указатель на сокет клиента.
+     * /return Признак того, что чтение приостановлено и запросы сейчас читать нельзя.
+     */
+    bool pauseReadingIfBacklogged(QTcpSocket *socket);
+
+    /**
+     * /brief Сворачивает необязательное уведомление.
+     * /param socket Указатель на сокет клиента.
+     * /param key Ключ свёртки (например, chat_update:<chat_id>).
+     * /param push Уведомление.
+     */
+    void collapsePush(QTcpSocket *socket, const QString &key, const QJsonObject &push);
+
+    /**
+     * /brief Проверяет, что у подключения нет неотправленных и свёрнутых данных.
+     * /param socket Указатель на сокет клиента.
+     * /return Признак пустой очереди.
+     */
+    bool isIdle(QTcpSocket *socket) const;
+
+    /**
+     * /brief Удаляет состояние подключения (при отключении клиента).
+     * /param socket Указатель на сокет клиента.
+     */
+    void remove(QTcpSocket *socket);
+
+signals:
+    /**
+     * /brief Сигнал о том, что подключение опустошило буфер и может получить свёрнутые уведомления.
+     * /param socket Указатель на сокет клиента.
+     * /param pushes Свёрнутые уведомления с полями collapsed и missed.
+     */
+    void collapsedPushesReady(QTcpSocket *socket, const QList<QJsonObject> &pushes);
+
+    /**
+     * /brief Сигнал о том, что буфер подключения опустел и чтение его запросов возобновлено.
+     * /param socket Указатель на сокет клиента.
+     */
+    void readingResumed(QTcpSocket *socket);
+};
+
+#endif // OUTBOUNDQUEUE_H
@@ -0,0 +1,212 @@
+#include "payloadcompressor.h"
+#include "servermetrics.h"
+
+#include <QtConcurrent>
+#include <QtEndian>
+
+/**
+ * @brief Конструктор класса PayloadCompressor.
+ *
+ * @param parent Указатель на родительский объект (по умолчанию nullptr).
+ */
+PayloadCompressor::PayloadCompressor(QObject *parent) : QObject(parent)
+{
+    pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() / 2));
+}
+
+/**
+ * @brief Деструктор класса PayloadCompressor.
+ *
+ * Дожидается завершения заданий сжатия, чтобы они не обращались к удалённым объектам.
+ */
+PayloadCompressor::~PayloadCompressor()
+{
+    pool.waitForDone();
+    for (QTcpSocket *socket : pipelines.keys())
+    {
+        remove(socket);
+    }
+}
+
+/**
+ * @brief Задаёт параметры сжатия.
+ *
+ * @param threshold Минимальный размер сообщения для сжатия в байтах.
+ * @param level Уровень сжатия zlib.
+ * @param threads Количество потоков сжатия.
+ */
+void PayloadCompressor::configure(int threshold, int level, int threads)
+{
+    this->threshold = qMax(0, threshold);
+    this->level = qBound(-1, level, 9);
+    pool.setMaxThreadCount(qMax(1, threads));
+}
+
+/**
+ * @brief Включает сжатие для подключения.
+ *
+ * @param socket Указатель на сокет клиента.
+ */
+void PayloadCompressor::enable(QTcpSocket *socket)
+{
+    if (!pipelines.contains(socket))
+    {
+        Pipeline *pipeline = new Pipeline;
+        pipeline->socket = socket;
+        pipelines.insert(socket, pipeline);
+    }
+}
+
+/**
+ * @brief Проверяет, включено ли сжатие для подключения.
+ *
+ * @param socket Указатель на сокет клиента.
+ * @return true Если подключение согласовало сжатие.
+ * @return false В противном случае.
+ */
+bool PayloadCompressor::isEnabled(QTcpSocket *socket) const
+{
+    return pipelines.contains(socket);
+}
+
+/**
+ * @brief Проверяет, что у подключения нет кадров, ожидающих сжатия или отправки.
+ *
+ * @param socket Указатель на сокет клиента.
+ * @return true Если очередь подключения пуста.
+ */
+bool PayloadCompressor::isIdle(QTcpSocket *socket) const
+{
+    Pipeline *pipeline = pipelines.value(socket);
+    return !pipeline || pipeline->frames.isEmpty();
+}
+
+/**
+ * @brief Формирует кадр из нагрузки.
+ *
+ * @param payload Полезная нагрузка.
+ * @param compressed Признак сжатой нагрузки.
+ * @return QByteArray Кадр: флаги, длина и нагрузка.
+ */
+QByteArray PayloadCompressor::makeFrame(const QByteArray &payload, bool compressed)
+{
+    QByteArray frame;
+    frame.reserve(payload.size() + 5);
+    frame.append(char(compressed ? 0x01 : 0x00));
+    char length[4];
+    qToBigEndian<quint32>(quint32(payload.size()), length);
+    frame.append(length, sizeof(length));
+    frame.append(payload);
+    return frame;
+}
+
+/**
+ * @brief Отправляет сообщение подключению.
+ *
+ * Сообщения меньше порога не сжимаются: выигрыш на них не окупает затрат. Если перед
+ * сообщением в очереди есть кадры, которые ещё сжимаются, оно ждёт их, чтобы клиент
+ * получил ответы в исходном порядке.
+ *
+ * @param socket Указатель на сокет клиента.
+ * @param payload Закодированное сообщение.
+ */
+void PayloadCompressor::send(QTcpSocket *socket, const QByteArray &payload)
+{
+    Pipeline *pipeline = pipelines.value(socket);
+    if (!pipeline)
+    {
+        emit frameReady(socket, payload);
+        return;
+    }
+
+    PendingFrame pending;
+    pending.originalSize = payload.size();
+    if (payload.size() < threshold)
+    {
+        pending.frame = makeFrame(payload, false);
+    }
+    else
+    {
+        int compressionLevel = level;
+        pending.watcher = new QFutureWatcher<QByteArray>(this);
+        connect(pending.watcher, &QFutureWatcherBase::finished, this, [this, pipeline]()
+                {
+                    drain(pipeline);
+                });
+        pending.watcher->setFuture(QtConcurrent::run(&pool, [payload, compressionLevel]()
+                                                     {
+                                                         return qCompress(payload, compressionLevel);
+                                                     }));
+    }
+    pipeline->frames.enqueue(pending);
+    drain(pipeline);
+}
+
+/**
+ * @brief Отправляет из очереди все готовые кадры, стоящие в её начале.
+ *
+ * @param pipeline Очередь подключения.
+ */
+void PayloadCompressor::drain(Pipeline *pipeline)
+{
+    bool ratioChanged = false;
+    while (!pipeline->frames.isEmpty())
+    {
+        PendingFrame &head = pipeline->frames.head();
+        if (head.watcher)
+        {
+            if (!head.watcher->isFinished())
+            {
+                break;
+            }
+            QByteArray compressed = head.watcher->result();
+            ServerMetrics::getInstance()->add("compression.bytes_in", head.originalSize);
+            ServerMetrics::getInstance()->add("compression.bytes_out", compressed.size());
+            head.frame = makeFrame(compressed, true);
+            head.watcher->deleteLater();
+            head.watcher = nullptr;
+            ratioChanged = true;
+        }
+
+        if (pipeline->socket)
+        {
+            emit frameReady(pipeline->socket, head.frame);
+        }
+        pipeline->frames.dequeue();
+    }
+
+    if (ratioChanged)
+    {
+        double bytesIn = ServerMetrics::getInstance()->value("compression.bytes_in");
+        if (bytesIn > 0)
+        {
+            ServerMetrics::getInstance()->set("compression.ratio",
+                                              bytesIn / qMax(1.0, ServerMetrics::getInstance()->value("compression.bytes_out")));
+        }
+    }
+}
+
+/**
+ * @brief Удаляет очередь подключения.
+ *
+ * Незавершённые задания сжатия доработают в пуле, но их результат будет отброшен.
+ *
+ * @param socket Указатель на сокет клиента.
+ */
+void PayloadCompressor::remove(QTcpSocket *socket)
+{
+    Pipeline *pipeline = pipelines.take(socket);
+    if (!pipeline)
+    {
+        return;
+    }
+    for (PendingFrame &pending : pipeline->frames)
+    {
+        if (pending.watcher)
+        {
+            pending.watcher->disconnect(this);
+            pending.watcher->deleteLater();
+        }
+    }
+    delete pipeline;
+}
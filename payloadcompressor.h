@@ -0,0 +1,132 @@
+/**
+ * /file payloadcompressor.h
+ * /brief Определение класса PayloadCompressor для сжатия крупных ответов сервера.
+ */
+
+#ifndef PAYLOADCOMPRESSOR_H
+#define PAYLOADCOMPRESSOR_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QPointer>
+#include <QQueue>
+#include <QHash>
+#include <QThreadPool>
+#include <QFutureWatcher>
+
+/**
+ * /brief Класс PayloadCompressor.
+ *
+ * Для подключений, согласовавших сжатие в запросе hello, все исходящие сообщения передаются
+ * кадрами: байт флагов, 4 байта длины полезной нагрузки (big-endian) и сама нагрузка.
+ * Бит 0 флагов означает, что нагрузка сжата qCompress (zlib с 4-байтовым префиксом исходной длины).
+ * Сжимаются только сообщения не меньше порога; сжатие выполняется в отдельном пуле потоков,
+ * а порядок кадров в пределах подключения сохраняется. Готовые кадры передаются сигналом
+ * frameReady в исходящую очередь подключения.
+ */
+class PayloadCompressor : public QObject
+{
+    Q_OBJECT
+
+private:
+    /**
+     * /brief Кадр, ожидающий отправки.
+     */
+    struct PendingFrame
+    {
+        QByteArray frame; ///< Готовый кадр (пусто, пока идёт сжатие).
+        QFutureWatcher<QByteArray> *watcher = nullptr; ///< Наблюдатель за сжатием (nullptr для готового кадра).
+        int originalSize = 0; ///< Размер нагрузки до сжатия.
+    };
+
+    /**
+     * /brief Очередь кадров одного подключения.
+     */
+    struct Pipeline
+    {
+        QPointer<QTcpSocket> socket; ///< Сокет подключения.
+        QQueue<PendingFrame> frames; ///< Кадры в порядке отправки.
+    };
+
+    QHash<QTcpSocket*, Pipeline*> pipelines; ///< Очереди подключений, согласовавших сжатие.
+    QThreadPool pool; ///< Пул потоков для сжатия, не занимающий глобальный пул.
+    int threshold = 1024; ///< Минимальный размер сообщения для сжатия в байтах.
+    int level = 6; ///< Уровень сжатия zlib.
+
+    /**
+     * /brief Формирует кадр из нагрузки.
+     * /param payload Полезная нагрузка.
+     * /param compressed Признак сжатой нагрузки.
+     * /return Кадр для отправки.
+     */
+    static QByteArray makeFrame(const QByteArray &payload, bool compressed);
+
+    /**
+     * /brief Отправляет из очереди все готовые кадры, стоящие в её начале.
+     * /param pipeline Очередь подключения.
+     */
+    void drain(Pipeline *pipeline);
+
+public:
+    /**
+     * /brief Конструктор класса PayloadCompressor.
+     * /param parent Указатель на родительский объект.
+     */
+    explicit PayloadCompressor(QObject *parent = nullptr);
+
+    /**
+     * /brief Деструктор, освобождающий очереди подключений.
+     */
+    ~PayloadCompressor() override;
+
+    /**
+     * /brief Задаёт параметры сжатия.
+     * /param threshold Минимальный размер сообщения для сжатия в байтах.
+     * /param level Уровень сжатия zlib (от 0 до 9, -1 — по умолчанию).
+     * /param threads Количество потоков сжатия.
+     */
+    void configure(int threshold, int level, int threads);
+
+    /**
+     * /brief Включает сжатие для подключения.
+     * /param socket Указатель на сокет клиента.
+     */
+    void enable(QTcpSocket *socket);
+
+    /**
+     * /brief Проверяет, включено ли сжатие для подключения.
+     * /param socket Указатель на сокет клиента.
+     * /return Признак включённого сжатия.
+     */
+    bool isEnabled(QTcpSocket *socket) const;
+
+    /**
+     * /brief Отправляет сообщение подключению, сжимая его при превышении порога.
+     * /param socket Указатель на сокет клиента.
+     * /param payload Закодированное сообщение.
+     */
+    void send(QTcpSocket *socket, const QByteArray &payload);
+
+    /**
+     * /brief Проверяет, что у подключения нет кадров, ожидающих сжатия или отправки.
+     * /param socket Указатель на сокет клиента.
+     * /return Признак пустой очереди.
+     */
+    bool isIdle(QTcpSocket *socket) const;
+
+    /**
+     * /brief Удаляет очередь подключения (при отключении клиента).
+     * /param socket Указатель на сокет клиента.
+     */
+    void remove(QTcpSocket *socket);
+
+signals:
+    /**
+     * /brief Сигнал готовности кадра к отправке.
+     * /param socket Указатель на сокет клиента.
+     * /param frame Готовый кадр.
+     */
+    void frameReady(QTcpSocket *socket, const QByteArray &frame);
+};
+
+#endif // PAYLOADCOMPRESSOR_H
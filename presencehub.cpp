@@ -0,0 +1,462 @@
+#include "presencehub.h"
+#include "servermetrics.h"
+
+#include <QJsonArray>
+#include <QDebug>
+
+/**
+ * @brief Конструктор класса PresenceHub.
+ *
+ * @param parent Указатель на родительский объект (по умолчанию nullptr).
+ */
+PresenceHub::PresenceHub(QObject *parent) : QObject(parent)
+{
+    clock.start();
+    connect(&tickTimer, &QTimer::timeout, this, &PresenceHub::flush);
+}
+
+/**
+ * @brief Подключает канал к реестру сессий и хранилищу.
+ *
+ * @param sessions Реестр сессий.
+ * @param repository Хранилище чатов.
+ * @param tickMs Интервал рассылки накопленных изменений.
+ * @param typingIntervalMs Минимальный интервал между событиями набора одного пользователя.
+ */
+void PresenceHub::configure(SessionRegistry *sessions, ChatRepository *repository, int tickMs, qint64 typingIntervalMs)
+{
+    this->sessions = sessions;
+    this->repository = repository;
+    this->typingIntervalMs = qMax<qint64>(0, typingIntervalMs);
+    connect(sessions, &SessionRegistry::userOnline, this, &PresenceHub::onUserOnline);
+    connect(sessions, &SessionRegistry::sessionBound, this, &PresenceHub::onSessionBound);
+    connect(sessions, &SessionRegistry::userOffline, this, &PresenceHub::onUserOffline);
+    tickTimer.start(qMax(50, tickMs));
+}
+
+/**
+ * @brief Загружает чаты пользователя и их участников одним запросом.
+ *
+ * @param userId Идентификатор пользователя.
+ */
+void PresenceHub::loadMemberships(int userId)
+{
+    QHash<int, QVector<int>> members;
+    if (!repository->membershipsOf(userId, members))
+    {
+        qCritical() << "Could not load chat memberships:" << repository->lastError();
+        return;
+    }
+
+    QVector<int> &chats = userChats[userId];
+    chats.clear();
+    for (auto it = members.begin(); it != members.end(); ++it)
+    {
+        chatMembers.insert(it.key(), it.value());
+        chats.append(it.key());
+    }
+    ServerMetrics::getInstance()->set("presence.cached_chats", chatMembers.size());
+}
+
+/**
+ * @brief Удаляет из памяти чаты, в которых не осталось пользователей в сети.
+ *
+ * @param chats Проверяемые чаты.
+ */
+void PresenceHub::releaseChats(const QVector<int> &chats)
+{
+    for (int chatId : chats)
+    {
+        const QVector<int> members = chatMembers.value(chatId);
+        bool anyOnline = false;
+        for (int memberId : members)
+        {
+            if (userChats.contains(memberId))
+            {
+                anyOnline = true;
+                break;
+            }
+        }
+        if (!anyOnline)
+        {
+            chatMembers.remove(chatId);
+        }
+    }
+    ServerMetrics::getInstance()->set("presence.cached_chats", chatMembers.size());
+}
+
+/**
+ * @brief Ставит изменение присутствия в кадры подписчиков.
+ *
+ * Подписчик, состоящий с пользователем в нескольких чатах, получает изменение один раз;
+ * повторное изменение за тот же такт заменяет предыдущее.
+ *
+ * @param userId Идентификатор пользователя.
+ * @param online Признак нахождения в сети.
+ */
+void PresenceHub::publishPresence(int userId, bool online)
+{
+    QString login = logins.value(userId);
+    QSet<int> notified;
+    for (int chatId : userChats.value(userId))
+    {
+        for (int memberId : chatMembers.value(chatId))
+        {
+            if (memberId != userId && logins.contains(memberId) && !notified.contains(memberId))
+            {
+                notified.insert(memberId);
+                pending[memberId].presence.insert(login, online);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Собирает снимок присутствия участников чатов пользователя, находящихся в сети.
+ *
+ * @param userId Идентификатор пользователя.
+ * @return PendingFrame Изменения, в которых все участники в сети отмечены как находящиеся в сети.
+ */
+PresenceHub::PendingFrame PresenceHub::snapshotOf(int userId) const
+{
+    PendingFrame snapshot;
+    for (int chatId : userChats.value(userId))
+    {
+        for (int memberId : chatMembers.value(chatId))
+        {
+            if (memberId != userId && (logins.contains(memberId) || remoteLogins.contains(memberId)))
+            {
+                snapshot.presence.insert(logins.value(memberId, remoteLogins.value(memberId)), true);
+            }
+        }
+    }
+    return snapshot;
+}
+
+/**
+ * @brief Обрабатывает появление пользователя в сети.
+ *
+ * Участники чатов пользователя получают в ближайшем кадре изменение его присутствия.
+ *
+ * @param userId Идентификатор пользователя.
+ */
+void PresenceHub::onUserOnline(int userId)
+{
+    const QVector<ClientSession*> userSessions = sessions->sessionsOf(userId);
+    if (userSessions.isEmpty())
+    {
+        return;
+    }
+    logins.insert(userId, userSessions.first()->login);
+    loadMemberships(userId);
+    if (!remoteLogins.contains(userId))
+    {
+        publishPresence(userId, true);
+    }
+    ServerMetrics::getInstance()->set("presence.online_users", logins.size());
+}
+
+/**
+ * @brief Ставит новую сессию пользователя в очередь на получение снимка присутствия.
+ *
+ * Снимок нужен каждой сессии, включая второе и последующие устройства пользователя:
+ * изменения, разосланные до их входа, они не получали. Снимок собирается при рассылке,
+ * поэтому отражает состояние на момент отправки.
+ *
+ * @param session Сессия.
+ */
+void PresenceHub::onSessionBound(ClientSession *session)
+{
+    snapshotsDue.insert(session->socket, session->userId);
+}
+
+/**
+ * @brief Обрабатывает выход пользователя из сети.
+ *
+ * @param userId Идентификатор пользователя.
+ */
+void PresenceHub::onUserOffline(int userId)
+{
+    if (!remoteLogins.contains(userId))
+    {
+        publishPresence(userId, false);
+    }
+    logins.remove(userId);
+    pending.remove(userId);
+    releaseChats(userChats.take(userId));
+    ServerMetrics::getInstance()->set("presence.online_users", logins.size());
+}
+
+/**
+ * @brief Публикует событие набора текста.
+ *
+ * Событие начала набора пересылается не чаще одного раза за typingIntervalMs для каждой
+ * пары (чат, пользователь); событие окончания набора пересылается всегда.
+ *
+ * @param userId Идентификатор пользователя.
+ * @param chatId Идентификатор чата.
+ * @param typing Признак набора (false — набор прекращён).
+ * @return true Если пользователь состоит в чате.
+ */
+bool PresenceHub::publishTyping(int userId, int chatId, bool typing)
+{
+    if (!userChats.value(userId).contains(chatId))
+    {
+        return false;
+    }
+
+    quint64 key = typingKey(chatId, userId);
+    if (typing)
+    {
+        qint64 now = clock.elapsed();
+        auto it = typingForwardedMs.find(key);
+        if (it != typingForwardedMs.end() && now - *it < typingIntervalMs)
+        {
+            ServerMetrics::getInstance()->add("presence.typing_coalesced");
+            return true;
+        }
+        typingForwardedMs.insert(key, now);
+    }
+    else
+    {
+        typingForwardedMs.remove(key);
+    }
+
+    QString login = logins.value(userId);
+    for (int memberId : chatMembers.value(chatId))
+    {
+        if (memberId != userId && logins.contains(memberId))
+        {
+            pending[memberId].typing[chatId].insert(login, typing);
+        }
+    }
+    ServerMetrics::getInstance()->add("presence.typing_forwarded");
+    emit typingForwarded(chatId, login, typing);
+    return true;
+}
+
+/**
+ * @brief Перечитывает состав чата после его создания или изменения.
+ *
+ * Участники чата в сети получают друг о друге состояние присутствия.
+ *
+ * @param chatId Идентификатор чата.
+ */
+void PresenceHub::reloadChat(int chatId)
+{
+    QVector<int> members;
+    if (!repository->participants(chatId, members))
+    {
+        return;
+    }
+
+    QVector<int> onlineMembers;
+    for (int memberId : qAsConst(members))
+    {
+        if (userChats.contains(memberId))
+        {
+            onlineMembers.append(memberId);
+        }
+    }
+    if (onlineMembers.isEmpty())
+    {
+        return;
+    }
+
+    chatMembers.insert(chatId, members);
+    for (int memberId : onlineMembers)
+    {
+        QVector<int> &chats = userChats[memberId];
+        if (!chats.contains(chatId))
+        {
+            chats.append(chatId);
+        }
+        for (int otherId : onlineMembers)
+        {
+            if (otherId != memberId)
+            {
+                pending[memberId].presence.insert(logins.value(otherId), true);
+            }
+        }
+    }
+    ServerMetrics::getInstance()->set("presence.cached_chats", chatMembers.size());
+}
+
+/**
+ * @brief Удаляет чат из памяти.
+ *
+ * @param chatId Идентификатор чата.
+ */
+void PresenceHub::removeChat(int chatId)
+{
+    const QVector<int> members = chatMembers.take(chatId);
+    for (int memberId : members)
+    {
+        auto it = userChats.find(memberId);
+        if (it != userChats.end())
+        {
+            it->removeOne(chatId);
+        }
+        typingForwardedMs.remove(typingKey(chatId, memberId));
+    }
+    ServerMetrics::getInstance()->set("presence.cached_chats", chatMembers.size());
+}
+
+/**
+ * @brief Учитывает присутствие пользователя на других экземплярах сервера.
+ *
+ * Если пользователь подключён и к этому экземпляру, его состояние уже разослано
+ * локальными событиями. Иначе изменение получают участники его чатов, находящиеся в сети
+ * на этом экземпляре; чаты пользователя читаются из хранилища.
+ *
+ * @param userId Идентификатор пользователя.
+ * @param login Логин пользователя.
+ * @param online Признак наличия сессий на других экземплярах.
+ */
+void PresenceHub::setRemotePresence(int userId, const QString &login, bool online)
+{
+    if (online)
+    {
+        remoteLogins.insert(userId, login);
+    }
+    else
+    {
+        remoteLogins.remove(userId);
+    }
+    if (logins.contains(userId) || chatMembers.isEmpty())
+    {
+        return;
+    }
+
+    QVector<int> chatIds;
+    if (!repository->chatsOf(userId, chatIds))
+    {
+        return;
+    }
+    QSet<int> notified;
+    for (int chatId : qAsConst(chatIds))
+    {
+        for (int memberId : chatMembers.value(chatId))
+        {
+            if (memberId != userId && logins.contains(memberId) && !notified.contains(memberId))
+            {
+                notified.insert(memberId);
+                pending[memberId].presence.insert(login, online);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Публикует событие набора текста, полученное от другого экземпляра.
+ *
+ * Событие уже прошло схлопывание на исходном экземпляре.
+ *
+ * @param chatId Идентификатор чата.
+ * @param login Логин пользователя.
+ * @param typing Признак набора.
+ */
+void PresenceHub::publishRemoteTyping(int chatId, const QString &login, bool typing)
+{
+    for (int memberId : chatMembers.value(chatId))
+    {
+        if (logins.contains(memberId) && logins.value(memberId) != login)
+        {
+            pending[memberId].typing[chatId].insert(login, typing);
+        }
+    }
+}
+
+/**
+ * @brief Кодирует накопленные изменения в кадр presence_update.
+ *
+ * Кадр имеет вид
+ * {"type":"presence_update","presence":[{"user_id","online"}],"typing":[{"chat_id","user_id","typing"}]}.
+ *
+ * @param changes Изменения.
+ * @return QJsonObject Кадр presence_update.
+ */
+QJsonObject PresenceHub::encodeFrame(const PendingFrame &changes)
+{
+    QJsonArray presence;
+    for (auto change = changes.presence.cbegin(); change != changes.presence.cend(); ++change)
+    {
+        presence.append(QJsonObject{{"user_id", change.key()}, {"online", change.value()}});
+    }
+    QJsonArray typing;
+    for (auto chat = changes.typing.cbegin(); chat != changes.typing.cend(); ++chat)
+    {
+        for (auto change = chat->cbegin(); change != chat->cend(); ++change)
+        {
+            typing.append(QJsonObject{{"chat_id", QString::number(chat.key())}, {"user_id", change.key()},
+                                      {"typing", change.value()}});
+        }
+    }
+    return QJsonObject{{"type", "presence_update"}, {"presence", presence}, {"typing", typing}};
+}
+
+/**
+ * @brief Рассылает накопленные изменения.
+ *
+ * Сначала новые сессии получают снимок присутствия, затем каждый подписчик получает
+ * один кадр с изменениями за такт на все свои сессии. Накопленные изменения забираются
+ * до отправки, так как отправка может закрыть переполненное подключение и вызвать выход
+ * пользователя из сети.
+ */
+void PresenceHub::flush()
+{
+    qint64 now = clock.elapsed();
+    for (auto it = typingForwardedMs.begin(); it != typingForwardedMs.end();)
+    {
+        if (now - *it >= typingIntervalMs)
+        {
+            it = typingForwardedMs.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    if (pending.isEmpty() && snapshotsDue.isEmpty())
+    {
+        return;
+    }
+    QHash<int, PendingFrame> frames;
+    frames.swap(pending);
+    QHash<QTcpSocket*, int> snapshots;
+    snapshots.swap(snapshotsDue);
+
+    int sent = 0;
+    for (auto it = snapshots.cbegin(); it != snapshots.cend(); ++it)
+    {
+        //Сокет мог закрыться, а его адрес — достаться другому подключению
+        ClientSession *session = sessions->find(it.key());
+        if (!session || session->userId != it.value())
+        {
+            continue;
+        }
+        emit frameReady(it.key(), encodeFrame(snapshotOf(it.value())));
+        sent++;
+    }
+
+    for (auto it = frames.cbegin(); it != frames.cend(); ++it)
+    {
+        QJsonObject frame = encodeFrame(*it);
+
+        QVector<QTcpSocket*> sockets;
+        for (ClientSession *session : sessions->sessionsOf(it.key()))
+        {
+            sockets.append(session->socket);
+        }
+        for (QTcpSocket *socket : qAsConst(sockets))
+        {
+            if (sessions->find(socket))
+            {
+                emit frameReady(socket, frame);
+                sent++;
+            }
+        }
+    }
+    ServerMetrics::getInstance()->add("presence.frames", sent);
+}
@@ -0,0 +1,204 @@
+/**
+ * /file presencehub.h
+ * /brief Определение класса PresenceHub для рассылки присутствия и индикаторов набора текста.
+ */
+
+#ifndef PRESENCEHUB_H
+#define PRESENCEHUB_H
+
+#include "sessionregistry.h"
+#include "chatrepository.h"
+
+#include <QObject>
+#include <QHash>
+#include <QVector>
+#include <QSet>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QJsonObject>
+
+/**
+ * /brief Класс PresenceHub.
+ *
+ * Канал публикации и подписки для кратковременных событий: вход и выход пользователей
+ * из сети и набор текста в чате. События не записываются в базу данных. Подписчики
+ * события — участники чатов пользователя, находящиеся в сети; состав чатов читается
+ * из базы один раз при входе пользователя и хранится в памяти, пока в чате есть
+ * кто-то в сети.
+ *
+ * События накапливаются и рассылаются по таймеру: каждый подписчик получает за такт
+ * не больше одного кадра presence_update со всеми изменениями. Повторные события
+ * набора текста одного пользователя в чате чаще typingIntervalMs отбрасываются.
+ *
+ * При работе нескольких экземпляров сервера присутствие пользователей других экземпляров
+ * и их события набора передаются через шину (setRemotePresence, publishRemoteTyping).
+ */
+class PresenceHub : public QObject
+{
+    Q_OBJECT
+
+private:
+    /**
+     * /brief Изменения, накопленные для одного подписчика за такт.
+     */
+    struct PendingFrame
+    {
+        QHash<QString, bool> presence; ///< Последнее состояние пользователей по логинам (в сети / не в сети).
+        QHash<int, QHash<QString, bool>> typing; ///< Набор текста: чат -> логин -> признак набора.
+    };
+
+    SessionRegistry *sessions = nullptr; ///< Реестр сессий.
+    ChatRepository *repository = nullptr; ///< Хранилище (только чтение состава чатов).
+    QHash<int, QVector<int>> chatMembers; ///< Участники чатов, в которых есть кто-то в сети.
+    QHash<int, QVector<int>> userChats; ///< Чаты пользователей в сети.
+    QHash<int, QString> logins; ///< Логины пользователей в сети.
+    QHash<int, QString> remoteLogins; ///< Логины пользователей в сети на других экземплярах.
+    QHash<int, PendingFrame> pending; ///< Накопленные изменения по подписчикам.
+    QHash<QTcpSocket*, int> snapshotsDue; ///< Сессии, ожидающие снимка присутствия (сокет -> пользователь).
+    QHash<quint64, qint64> typingForwardedMs; ///< Время последней пересылки набора текста (чат, пользователь).
+    QTimer tickTimer; ///< Таймер рассылки накопленных изменений.
+    QElapsedTimer clock; ///< Монотонные часы.
+    qint64 typingIntervalMs = 3000; ///< Минимальный интервал между событиями набора одного пользователя.
+
+    /**
+     * /brief Загружает чаты пользователя и их участников.
+     * /param userId Идентификатор пользователя.
+     */
+    void loadMemberships(int userId);
+
+    /**
+     * /brief Удаляет из памяти чаты, в которых не осталось пользователей в сети.
+     * /param chats Проверяемые чаты.
+     */
+    void releaseChats(const QVector<int> &chats);
+
+    /**
+     * /brief Ставит изменение присутствия в кадры подписчиков.
+     * /param userId Идентификатор пользователя.
+     * /param online Признак нахождения в сети.
+     */
+    void publishPresence(int userId, bool online);
+
+    /**
+     * /brief Собирает снимок присутствия участников чатов пользователя, находящихся в сети.
+     * /param userId Идентификатор пользователя.
+     * /return Изменения, в которых все участники в сети отмечены как находящиеся в сети.
+     */
+    PendingFrame snapshotOf(int userId) const;
+
+    /**
+     * /brief Кодирует накопленные изменения в кадр presence_update.
+     * /param changes Изменения.
+     * /return Кадр presence_update.
+     */
+    static QJsonObject encodeFrame(const PendingFrame &changes);
+
+    /**
+     * /brief Возвращает ключ пары (чат, пользователь).
+     * /param chatId Идентификатор чата.
+     * /param userId Идентификатор пользователя.
+     * /return Ключ.
+     */
+    static quint64 typingKey(int chatId, int userId) { return (quint64(quint32(chatId)) << 32) | quint32(userId); }
+
+private slots:
+    /**
+     * /brief Обрабатывает появление пользователя в сети.
+     * /param userId Идентификатор пользователя.
+     */
+    void onUserOnline(int userId);
+
+    /**
+     * /brief Ставит новую сессию пользователя в очередь на получение снимка присутствия.
+     * /param session Сессия.
+     */
+    void onSessionBound(ClientSession *session);
+
+    /**
+     * /brief Обрабатывает выход пользователя из сети.
+     * /param userId Идентификатор пользователя.
+     */
+    void onUserOffline(int userId);
+
+    /**
+     * /brief Рассылает накопленные изменения.
+     */
+    void flush();
+
+public:
+    /**
+     * /brief Конструктор класса PresenceHub.
+     * /param parent Указатель на родительский объект.
+     */
+    explicit PresenceHub(QObject *parent = nullptr);
+
+    /**
+     * /brief Подключает канал к реестру сессий и хранилищу.
+     * /param sessions Реестр сессий.
+     * /param repository Хранилище чатов.
+     * /param tickMs Интервал рассылки накопленных изменений.
+     * /param typingIntervalMs Минимальный интервал между событиями набора одного пользователя.
+     */
+    void configure(SessionRegistry *sessions, ChatRepository *repository, int tickMs, qint64 typingIntervalMs);
+
+    /**
+     * /brief Заменяет хранилище, из которого читается состав чатов.
+     * /param repository Хранилище чатов.
+     */
+    void setRepository(ChatRepository *repository) { this->repository = repository; }
+
+    /**
+     * /brief Публикует событие набора текста.
+     * /param userId Идентификатор пользователя.
+     * /param chatId Идентификатор чата.
+     * /param typing Признак набора (false — набор прекращён).
+     * /return Признак того, что пользователь состоит в чате.
+     */
+    bool publishTyping(int userId, int chatId, bool typing);
+
+    /**
+     * /brief Перечитывает состав чата после его создания или изменения.
+     * /param chatId Идентификатор чата.
+     */
+    void reloadChat(int chatId);
+
+    /**
+     * /brief Удаляет чат из памяти (при удалении чата).
+     * /param chatId Идентификатор чата.
+     */
+    void removeChat(int chatId);
+
+    /**
+     * /brief Учитывает присутствие пользователя на других экземплярах сервера.
+     * /param userId Идентификатор пользователя.
+     * /param login Логин пользователя.
+     * /param online Признак наличия сессий на других экземплярах.
+     */
+    void setRemotePresence(int userId, const QString &login, bool online);
+
+    /**
+     * /brief Публикует событие набора текста, полученное от другого экземпляра.
+     * /param chatId Идентификатор чата.
+     * /param login Логин пользователя.
+     * /param typing Признак набора.
+     */
+    void publishRemoteTyping(int chatId, const QString &login, bool typing);
+
+signals:
+    /**
+     * /brief Сигнал о готовом кадре для подключения.
+     * /param socket Сокет подписчика.
+     * /param frame Кадр presence_update.
+     */
+    void frameReady(QTcpSocket *socket, const QJsonObject &frame);
+
+    /**
+     * /brief Сигнал о пересланном событии набора текста (для передачи другим экземплярам).
+     * /param chatId Идентификатор чата.
+     * /param login Логин пользователя.
+     * /param typing Признак набора.
+     */
+    void typingForwarded(int chatId, const QString &login, bool typing);
+};
+
+#endif // PRESENCEHUB_H
@@ -0,0 +1,159 @@
+#include "ratelimiter.h"
+#include "servermetrics.h"
+
+/**
+ * @brief Конструктор класса RateLimiter.
+ *
+ * Задаёт стоимость запросов по умолчанию: поиск пользователей выполняет полный
+ * просмотр таблицы, а история чата читает весь чат и отмечает сообщения прочитанными.
+ *
+ * @param parent Указатель на родительский объект (по умолчанию nullptr).
+ */
+RateLimiter::RateLimiter(QObject *parent) : QObject(parent)
+{
+    costs = {
+        {"ping", 0},
+        {"pong", 0},
+        {"ack", 0},
+        {"ack_pending", 0},
+        {"hello", 0},
+        {"find_users", 5},
+        {"get_chat_history", 5},
+        {"get_chat_list", 2},
+        {"create_chat", 2},
+        {"get_or_create_chat", 2},
+        {"check_chat_exists", 2},
+        {"delete_chat", 2},
+        {"register", 3},
+        {"login", 3},
+        {"update_login", 3},
+        {"update_password", 3},
+        {"send_message", 1}
+    };
+    clock.start();
+    connect(&pruneTimer, &QTimer::timeout, this, &RateLimiter::prune);
+    pruneTimer.start(60000);
+}
+
+/**
+ * @brief Деструктор класса RateLimiter.
+ */
+RateLimiter::~RateLimiter()
+{
+    qDeleteAll(userBuckets);
+}
+
+/**
+ * @brief Задаёт параметры ограничения.
+ *
+ * @param enabled Признак включённого ограничения.
+ * @param connectionLimits Параметры корзин подключений.
+ * @param userLimits Параметры корзин пользователей.
+ * @param costOverrides Стоимость запросов, заменяющая значения по умолчанию.
+ */
+void RateLimiter::configure(bool enabled, const Limits &connectionLimits, const Limits &userLimits,
+                            const QHash<QString, int> &costOverrides)
+{
+    this->enabled = enabled;
+    this->connectionLimits = connectionLimits;
+    this->userLimits = userLimits;
+    for (auto it = costOverrides.begin(); it != costOverrides.end(); ++it)
+    {
+        costs.insert(it.key(), qMax(0, it.value()));
+    }
+}
+
+/**
+ * @brief Списывает стоимость запроса с корзины.
+ *
+ * @param bucket Корзина.
+ * @param cost Стоимость запроса в токенах.
+ * @param limits Параметры корзины.
+ * @param nowUs Текущее время в микросекундах.
+ * @return qint64 0 или время до повторной попытки в микросекундах.
+ */
+qint64 RateLimiter::charge(TokenBucket &bucket, int cost, const Limits &limits, qint64 nowUs)
+{
+    double intervalUs = 1e6 / qMax(0.001, limits.rate);
+    return bucket.tryConsume(qint64(cost * intervalUs), nowUs, qint64(qMax(1.0, limits.burst) * intervalUs));
+}
+
+/**
+ * @brief Возвращает в корзину стоимость запроса, списанную charge().
+ *
+ * @param bucket Корзина.
+ * @param cost Стоимость запроса в токенах.
+ * @param limits Параметры корзины.
+ */
+void RateLimiter::refund(TokenBucket &bucket, int cost, const Limits &limits)
+{
+    double intervalUs = 1e6 / qMax(0.001, limits.rate);
+    bucket.refund(qint64(cost * intervalUs));
+}
+
+/**
+ * @brief Проверяет, можно ли выполнить запрос.
+ *
+ * Сначала проверяется корзина подключения, затем корзина пользователя. Запрос, отклонённый
+ * корзиной пользователя, не расходует и корзину подключения: её списание возвращается.
+ *
+ * @param connectionBucket Корзина подключения.
+ * @param userId Идентификатор пользователя (-1 до входа).
+ * @param type Тип запроса; должен быть известен серверу, так как входит в имя метрики.
+ * @return qint64 0, если запрос допущен, иначе время до повторной попытки в миллисекундах.
+ */
+qint64 RateLimiter::admit(TokenBucket &connectionBucket, int userId, const QString &type)
+{
+    int cost = costs.value(type, defaultCost);
+    if (!enabled || cost == 0)
+    {
+        return 0;
+    }
+
+    qint64 nowUs = clock.nsecsElapsed() / 1000;
+    qint64 retryUs = charge(connectionBucket, cost, connectionLimits, nowUs);
+    if (retryUs == 0 && userId >= 0)
+    {
+        TokenBucket *&userBucket = userBuckets[userId];
+        if (!userBucket)
+        {
+            userBucket = new TokenBucket;
+        }
+        retryUs = charge(*userBucket, cost, userLimits, nowUs);
+        if (retryUs != 0)
+        {
+            refund(connectionBucket, cost, connectionLimits);
+        }
+    }
+
+    if (retryUs == 0)
+    {
+        return 0;
+    }
+    ServerMetrics::getInstance()->add("ratelimit.rejected");
+    ServerMetrics::getInstance()->add("ratelimit.rejected." + type);
+    return qMax<qint64>(1, (retryUs + 999) / 1000);
+}
+
+/**
+ * @brief Удаляет полные корзины пользователей.
+ *
+ * Полная корзина неотличима от новой, поэтому её удаление не меняет поведения.
+ */
+void RateLimiter::prune()
+{
+    qint64 nowUs = clock.nsecsElapsed() / 1000;
+    for (auto it = userBuckets.begin(); it != userBuckets.end();)
+    {
+        if ((*it)->isFull(nowUs))
+        {
+            delete *it;
+            it = userBuckets.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    ServerMetrics::getInstance()->set("ratelimit.user_buckets", userBuckets.size());
+}
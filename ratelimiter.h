@@ -0,0 +1,108 @@
+/**
+ * /file ratelimiter.h
+ * /brief Определение класса RateLimiter для ограничения частоты запросов подключений и пользователей.
+ */
+
+#ifndef RATELIMITER_H
+#define RATELIMITER_H
+
+#include "tokenbucket.h"
+
+#include <QObject>
+#include <QHash>
+#include <QString>
+#include <QTimer>
+#include <QElapsedTimer>
+
+/**
+ * /brief Класс RateLimiter.
+ *
+ * Проверяет запрос по двум корзинам токенов: корзине подключения и корзине пользователя
+ * (после входа), поэтому ни одно подключение и ни один пользователь с несколькими устройствами
+ * не может занять сервер целиком. Стоимость запроса зависит от его типа: тяжёлые запросы
+ * (поиск пользователей, история чата) списывают больше токенов.
+ *
+ * Полные корзины пользователей периодически удаляются, так что память не растёт
+ * с числом когда-либо подключавшихся пользователей.
+ */
+class RateLimiter : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * /brief Параметры корзины.
+     */
+    struct Limits
+    {
+        double rate = 20; ///< Скорость пополнения в токенах в секунду.
+        double burst = 100; ///< Ёмкость корзины в токенах (с запасом на запросы сразу после входа).
+    };
+
+private:
+    bool enabled = false; ///< Признак включённого ограничения.
+    Limits connectionLimits; ///< Параметры корзин подключений.
+    Limits userLimits = {30, 200}; ///< Параметры корзин пользователей.
+    QHash<QString, int> costs; ///< Стоимость запросов по типам.
+    int defaultCost = 1; ///< Стоимость запросов, не указанных в таблице.
+    QHash<int, TokenBucket*> userBuckets; ///< Корзины пользователей.
+    QElapsedTimer clock; ///< Монотонные часы.
+    QTimer pruneTimer; ///< Таймер удаления полных корзин пользователей.
+
+    /**
+     * /brief Списывает стоимость запроса с корзины.
+     * /param bucket Корзина.
+     * /param cost Стоимость запроса в токенах.
+     * /param limits Параметры корзины.
+     * /param nowUs Текущее время в микросекундах.
+     * /return 0 или время до повторной попытки в микросекундах.
+     */
+    static qint64 charge(TokenBucket &bucket, int cost, const Limits &limits, qint64 nowUs);
+
+    /**
+     * /brief Возвращает в корзину стоимость запроса, списанную charge().
+     * /param bucket Корзина.
+     * /param cost Стоимость запроса в токенах.
+     * /param limits Параметры корзины.
+     */
+    static void refund(TokenBucket &bucket, int cost, const Limits &limits);
+
+private slots:
+    /**
+     * /brief Удаляет полные корзины пользователей.
+     */
+    void prune();
+
+public:
+    /**
+     * /brief Конструктор класса RateLimiter.
+     * /param parent Указатель на родительский объект.
+     */
+    explicit RateLimiter(QObject *parent = nullptr);
+
+    /**
+     * /brief Деструктор, освобождающий корзины пользователей.
+     */
+    ~RateLimiter() override;
+
+    /**
+     * /brief Задаёт параметры ограничения.
+     * /param enabled Признак включённого ограничения.
+     * /param connectionLimits Параметры корзин подключений.
+     * /param userLimits Параметры корзин пользователей.
+     * /param costOverrides Стоимость запросов, заменяющая значения по умолчанию.
+     */
+    void configure(bool enabled, const Limits &connectionLimits, const Limits &userLimits,
+                   const QHash<QString, int> &costOverrides);
+
+    /**
+     * /brief Проверяет, можно ли выполнить запрос.
+     * /param connectionBucket Корзина подключения.
+     * /param userId Идентификатор пользователя (-1 до входа).
+     * /param type Тип запроса; должен быть известен серверу, так как входит в имя метрики.
+     * /return 0, если запрос допущен, иначе время в миллисекундах, через которое его можно повторить.
+     */
+    qint64 admit(TokenBucket &connectionBucket, int userId, const QString &type);
+};
+
+#endif // RATELIMITER_H
@@ -0,0 +1,143 @@
+#include "requestarena.h"
+#include "servermetrics.h"
+
+#include <new>
+
+/**
+ * @brief Открывает область обработки запроса.
+ *
+ * @param arena Арена запроса.
+ */
+RequestArena::Scope::Scope(RequestArena &arena)
+    : arena(arena)
+{
+    ++arena.depth;
+}
+
+/**
+ * @brief Закрывает область обработки запроса.
+ */
+RequestArena::Scope::~Scope()
+{
+    if (--arena.depth == 0)
+    {
+        arena.reset();
+    }
+}
+
+/**
+ * @brief Деструктор, освобождающий все блоки.
+ */
+RequestArena::~RequestArena()
+{
+    for (const Block &block : qAsConst(extraBlocks))
+    {
+        ::operator delete(block.data);
+    }
+    ::operator delete(mainBlock.data);
+}
+
+/**
+ * @brief Задаёт размер основного блока.
+ *
+ * Основной блок прежнего размера освобождается, если арена не используется.
+ *
+ * @param bytes Размер в байтах.
+ */
+void RequestArena::configure(int bytes)
+{
+    blockSize = size_t(qMax(1024, bytes));
+    if (depth == 0 && mainBlock.data && mainBlock.size != blockSize)
+    {
+        ::operator delete(mainBlock.data);
+        mainBlock = Block();
+        cursor = nullptr;
+        limit = nullptr;
+    }
+}
+
+/**
+ * @brief Делает текущим новый блок памяти.
+ *
+ * Основной блок создаётся при первом выделении и сохраняется между запросами,
+ * остальные блоки — дополнительные и живут до ближайшего сброса.
+ *
+ * @param minimum Наименьший нужный размер блока.
+ */
+void RequestArena::addBlock(size_t minimum)
+{
+    if (!mainBlock.data)
+    {
+        mainBlock.size = blockSize;
+        mainBlock.data = static_cast<char *>(::operator new(mainBlock.size));
+        cursor = mainBlock.data;
+        limit = mainBlock.data + mainBlock.size;
+        if (minimum <= mainBlock.size)
+        {
+            return;
+        }
+    }
+    Block block;
+    block.size = qMax(blockSize, minimum);
+    block.data = static_cast<char *>(::operator new(block.size));
+    extraBlocks.append(block);
+    ++overflowBlocks;
+    cursor = block.data;
+    limit = block.data + block.size;
+}
+
+/**
+ * @brief Выделяет память до сброса арены.
+ *
+ * @param size Размер в байтах.
+ * @param alignment Выравнивание (степень двойки).
+ * @return void* Указатель на выделенную память.
+ */
+void *RequestArena::allocate(size_t size, size_t alignment)
+{
+    quintptr mask = quintptr(alignment) - 1;
+    quintptr start = (quintptr(cursor) + mask) & ~mask;
+    if (!cursor || start + size > quintptr(limit))
+    {
+        addBlock(size + alignment);
+        start = (quintptr(cursor) + mask) & ~mask;
+    }
+    cursor = reinterpret_cast<char *>(start + size);
+    requestBytes += size;
+    ++allocations;
+    return reinterpret_cast<void *>(start);
+}
+
+/**
+ * @brief Освобождает дополнительные блоки и возвращает арену к началу основного блока.
+ */
+void RequestArena::reset()
+{
+    for (const Block &block : qAsConst(extraBlocks))
+    {
+        ::operator delete(block.data);
+    }
+    extraBlocks.clear();
+    cursor = mainBlock.data;
+    limit = mainBlock.data + mainBlock.size;
+    peakBytes = qMax(peakBytes, requestBytes);
+    requestBytes = 0;
+    ++requests;
+}
+
+/**
+ * @brief Обновляет показатели арены.
+ *
+ * alloc.arena_peak_bytes — наибольший объём, выделенный одному запросу,
+ * alloc.arena_overflow_blocks — количество блоков, добавленных запросам, которым не хватило
+ * основного блока.
+ */
+void RequestArena::publishMetrics() const
+{
+    ServerMetrics *metrics = ServerMetrics::getInstance();
+    metrics->set("alloc.arena_requests", requests);
+    metrics->set("alloc.arena_allocations", allocations);
+    metrics->set("alloc.arena_block_bytes", mainBlock.size);
+    metrics->set("alloc.arena_peak_bytes", peakBytes);
+    metrics->set("alloc.arena_overflow_blocks", overflowBlocks);
+}
@@ -0,0 +1,136 @@
+/**
+ * /file requestarena.h
+ * /brief Определение класса RequestArena — памяти, выделяемой на время обработки одного запроса.
+ */
+
+#ifndef REQUESTARENA_H
+#define REQUESTARENA_H
+
+#include <QVector>
+#include <cstddef>
+
+/**
+ * /brief Класс RequestArena.
+ *
+ * Выделяет память для данных, нужных только до конца обработки запроса (черновые буферы
+ * разбора и т. п.), последовательно из заранее выделенного блока. Освобождать отдельные
+ * выделения не нужно: после обработки запроса вся арена сбрасывается одной операцией,
+ * и следующий запрос снова использует тот же блок. Поэтому обычный запрос не обращается
+ * к общему распределителю памяти.
+ *
+ * Если запросу не хватает основного блока, добавляются дополнительные блоки; они
+ * освобождаются при сбросе, а их количество попадает в показатели, по которым подбирается
+ * размер основного блока (Server/requestArenaBytes).
+ *
+ * Запросы обрабатываются в потоке событий по одному, поэтому одной арены достаточно для
+ * всех подключений и она не защищена блокировкой.
+ */
+class RequestArena
+{
+public:
+    /**
+     * /brief Область обработки запроса: при выходе из внешней области арена сбрасывается.
+     *
+     * Вложенные области (запрос, обработанный во время обработки другого) не сбрасывают
+     * арену, так как её память ещё используется внешней областью.
+     */
+    class Scope
+    {
+    private:
+        RequestArena &arena; ///< Арена запроса.
+
+    public:
+        /**
+         * /brief Открывает область обработки запроса.
+         * /param arena Арена запроса.
+         */
+        explicit Scope(RequestArena &arena);
+
+        /**
+         * /brief Закрывает область и сбрасывает арену, если область внешняя.
+         */
+        ~Scope();
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+    };
+
+private:
+    /**
+     * /brief Блок памяти арены.
+     */
+    struct Block
+    {
+        char *data = nullptr; ///< Начало блока.
+        size_t size = 0; ///< Размер блока в байтах.
+    };
+
+    size_t blockSize = 16 * 1024; ///< Размер основного блока.
+    Block mainBlock; ///< Основной блок, сохраняемый между запросами.
+    QVector<Block> extraBlocks; ///< Дополнительные блоки текущего запроса.
+    char *cursor = nullptr; ///< Начало свободной части текущего блока.
+    char *limit = nullptr; ///< Конец текущего блока.
+    int depth = 0; ///< Количество открытых областей обработки.
+    size_t requestBytes = 0; ///< Объём, выделенный текущему запросу.
+    size_t peakBytes = 0; ///< Наибольший объём, выделенный одному запросу.
+    qint64 requests = 0; ///< Количество обработанных запросов.
+    qint64 allocations = 0; ///< Количество выделений.
+    qint64 overflowBlocks = 0; ///< Количество дополнительных блоков.
+
+    /**
+     * /brief Делает текущим новый блок памяти.
+     * /param minimum Наименьший нужный размер блока.
+     */
+    void addBlock(size_t minimum);
+
+    /**
+     * /brief Освобождает дополнительные блоки и возвращает арену к началу основного блока.
+     */
+    void reset();
+
+public:
+    /**
+     * /brief Конструктор арены без выделенной памяти (основной блок создаётся при первом выделении).
+     */
+    RequestArena() = default;
+
+    /**
+     * /brief Деструктор, освобождающий все блоки.
+     */
+    ~RequestArena();
+
+    RequestArena(const RequestArena &) = delete;
+    RequestArena &operator=(const RequestArena &) = delete;
+
+    /**
+     * /brief Задаёт размер основного блока.
+     * /param bytes Размер в байтах.
+     */
+    void configure(int bytes);
+
+    /**
+     * /brief Выделяет память до сброса арены.
+     * /param size Размер в байтах.
+     * /param alignment Выравнивание (степень двойки).
+     * /return Указатель на выделенную память.
+     */
+    void *allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    /**
+     * /brief Выделяет массив до сброса арены.
+     * /param count Количество элементов.
+     * /return Указатель на первый элемент (элементы не инициализируются).
+     */
+    template<typename T>
+    T *allocateArray(int count)
+    {
+        return static_cast<T *>(allocate(sizeof(T) * size_t(qMax(0, count)), alignof(T)));
+    }
+
+    /**
+     * /brief Обновляет показатели арены в ServerMetrics.
+     */
+    void publishMetrics() const;
+};
+
+#endif // REQUESTARENA_H
@@ -0,0 +1,305 @@
+#include "requestschema.h"
+
+#include <cmath>
+#include <limits>
+
+namespace
+{
+/**
+ * @brief Переводит число JSON (double) в целое.
+ *
+ * @param number Число.
+ * @param result Извлечённое значение.
+ * @return true Если число целое и представимо точно.
+ * @return false Если число дробное или выходит за диапазон точных целых double.
+ */
+bool integralNumber(double number, qint64 &result)
+{
+    //Числа JSON хранятся как double: дробные и выходящие за диапазон значения отвергаются
+    if (std::trunc(number) != number || std::fabs(number) > 9007199254740992.0)
+    {
+        return false;
+    }
+    result = qint64(number);
+    return true;
+}
+
+/**
+ * @brief Разбирает десятичное целое из байтов буфера без создания строки.
+ *
+ * Принимаются только необязательный знак минус и не больше 18 цифр; всё остальное
+ * разбирается общим способом.
+ *
+ * @param data Начало числа.
+ * @param size Размер в байтах.
+ * @param result Извлечённое значение.
+ * @return true Если байты составляют короткое десятичное целое.
+ * @return false В противном случае.
+ */
+bool parseDecimal(const char *data, int size, qint64 &result)
+{
+    bool negative = size > 0 && data[0] == '-';
+    int first = negative ? 1 : 0;
+    if (size <= first || size - first > 18)
+    {
+        return false;
+    }
+    qint64 value = 0;
+    for (int i = first; i < size; ++i)
+    {
+        if (data[i] < '0' || data[i] > '9')
+        {
+            return false;
+        }
+        value = value * 10 + (data[i] - '0');
+    }
+    result = negative ? -value : value;
+    return true;
+}
+
+/**
+ * @brief Преобразует значение целого поля в 64-битное целое.
+ *
+ * Принимается целое число или строка с десятичным целым (клиенты передают
+ * идентификаторы чатов строками).
+ *
+ * @param value Значение из запроса.
+ * @param result Извлечённое значение.
+ * @return true Если значение — целое число.
+ * @return false Если значение другого типа, дробное или строка не является числом.
+ */
+bool toInteger(const QJsonValue &value, qint64 &result)
+{
+    if (value.isString())
+    {
+        bool ok = false;
+        result = value.toString().toLongLong(&ok);
+        return ok;
+    }
+    if (value.isDouble())
+    {
+        return integralNumber(value.toDouble(), result);
+    }
+    return false;
+}
+
+/**
+ * @brief Преобразует значение целого поля запроса, разобранного JsonEnvelope.
+ *
+ * Правила те же, что у toInteger(const QJsonValue &): короткие целые разбираются прямо
+ * в буфере, остальные значения — через QString и double, как при разборе QJsonDocument.
+ *
+ * @param envelope Разобранный запрос.
+ * @param value Поле разобранного запроса.
+ * @param result Извлечённое значение.
+ * @return true Если значение — целое число.
+ * @return false В противном случае.
+ */
+bool toInteger(const JsonEnvelope &envelope, const JsonEnvelope::Field &value, qint64 &result)
+{
+    if (value.kind == JsonEnvelope::Kind::String)
+    {
+        if (!value.escaped && parseDecimal(value.value, value.size, result))
+        {
+            return true;
+        }
+        bool ok = false;
+        result = envelope.toString(value).toLongLong(&ok);
+        return ok;
+    }
+    if (value.kind == JsonEnvelope::Kind::Number)
+    {
+        //Целые до 18 цифр точнее double; больше 2^53 они отвергаются так же, как при разборе QJsonDocument
+        if (parseDecimal(value.value, value.size, result))
+        {
+            return integralNumber(double(result), result);
+        }
+        bool ok = false;
+        double number = QByteArray(value.value, value.size).toDouble(&ok);
+        return ok && integralNumber(number, result);
+    }
+    return false;
+}
+}
+
+/**
+ * @brief Проверяет, что строка не пуста и состоит только из символов множества.
+ *
+ * @param text Строка.
+ * @return true Если все символы строки входят в множество.
+ * @return false Если строка пуста или содержит посторонний символ.
+ */
+bool CharClass::matchesAll(const QString &text) const
+{
+    if (text.isEmpty())
+    {
+        return false;
+    }
+    for (QChar character : text)
+    {
+        if (!contains(character.unicode()))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Проверяет, что в строке есть хотя бы один символ множества.
+ *
+ * @param text Строка.
+ * @return true Если найден символ множества.
+ * @return false Если таких символов нет.
+ */
+bool CharClass::matchesAny(const QString &text) const
+{
+    for (QChar character : text)
+    {
+        if (contains(character.unicode()))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Преобразует значение строкового поля.
+ *
+ * @param value Значение из запроса.
+ * @param result Извлечённая строка.
+ * @return true Если значение — строка.
+ * @return false Если значение другого типа.
+ */
+bool RequestParser::convert(const QJsonValue &value, QString &result)
+{
+    if (!value.isString())
+    {
+        return false;
+    }
+    result = value.toString();
+    return true;
+}
+
+/**
+ * @brief Преобразует значение целого поля.
+ *
+ * @param value Значение из запроса.
+ * @param result Извлечённое число.
+ * @return true Если значение — целое число в диапазоне int.
+ * @return false Если значение не является целым числом или выходит за диапазон.
+ */
+bool RequestParser::convert(const QJsonValue &value, int &result)
+{
+    qint64 number = 0;
+    if (!toInteger(value, number) || number < std::numeric_limits<int>::min() || number > std::numeric_limits<int>::max())
+    {
+        return false;
+    }
+    result = int(number);
+    return true;
+}
+
+/**
+ * @brief Преобразует значение целого поля.
+ *
+ * @param value Значение из запроса.
+ * @param result Извлечённое число.
+ * @return true Если значение — целое число.
+ * @return false Если значение не является целым числом.
+ */
+bool RequestParser::convert(const QJsonValue &value, qint64 &result)
+{
+    return toInteger(value, result);
+}
+
+/**
+ * @brief Преобразует значение логического поля.
+ *
+ * @param value Значение из запроса.
+ * @param result Извлечённое значение.
+ * @return true Если значение — true или false.
+ * @return false Если значение другого типа.
+ */
+bool RequestParser::convert(const QJsonValue &value, bool &result)
+{
+    if (!value.isBool())
+    {
+        return false;
+    }
+    result = value.toBool();
+    return true;
+}
+
+/**
+ * @brief Преобразует значение строкового поля запроса, разобранного JsonEnvelope.
+ *
+ * @param envelope Разобранный запрос.
+ * @param value Поле разобранного запроса.
+ * @param result Извлечённая строка.
+ * @return true Если значение — строка.
+ * @return false Если значение другого типа.
+ */
+bool RequestParser::convert(const JsonEnvelope &envelope, const JsonEnvelope::Field &value, QString &result)
+{
+    if (value.kind != JsonEnvelope::Kind::String)
+    {
+        return false;
+    }
+    result = envelope.toString(value);
+    return true;
+}
+
+/**
+ * @brief Преобразует значение целого поля запроса, разобранного JsonEnvelope.
+ *
+ * @param envelope Разобранный запрос.
+ * @param value Поле разобранного запроса.
+ * @param result Извлечённое число.
+ * @return true Если значение — целое число в диапазоне int.
+ * @return false Если значение не является целым числом или выходит за диапазон.
+ */
+bool RequestParser::convert(const JsonEnvelope &envelope, const JsonEnvelope::Field &value, int &result)
+{
+    qint64 number = 0;
+    if (!toInteger(envelope, value, number) || number < std::numeric_limits<int>::min() || number > std::numeric_limits<int>::max())
+    {
+        return false;
+    }
+    result = int(number);
+    return true;
+}
+
+/**
+ * @brief Преобразует значение целого поля запроса, разобранного JsonEnvelope.
+ *
+ * @param envelope Разобранный запрос.
+ * @param value Поле разобранного запроса.
+ * @param result Извлечённое число.
+ * @return true Если значение — целое число.
+ * @return false Если значение не является целым числом.
+ */
+bool RequestParser::convert(const JsonEnvelope &envelope, const JsonEnvelope::Field &value, qint64 &result)
+{
+    return toInteger(envelope, value, result);
+}
+
+/**
+ * @brief Преобразует значение логического поля запроса, разобранного JsonEnvelope.
+ *
+ * @param envelope Разобранный запрос.
+ * @param value Поле разобранного запроса.
+ * @param result Извлечённое значение.
+ * @return true Если значение — true или false.
+ * @return false Если значение другого типа.
+ */
+bool RequestParser::convert(const JsonEnvelope &, const JsonEnvelope::Field &value, bool &result)
+{
+    if (value.kind != JsonEnvelope::Kind::Bool)
+    {
+        return false;
+    }
+    result = value.value[0] == 't';
+    return true;
+}
@@ -0,0 +1,676 @@
+/**
+ * /file requestschema.h
+ * /brief Схемы запросов клиента: типизированные структуры запросов, описания их полей и разбор.
+ */
+
+#ifndef REQUESTSCHEMA_H
+#define REQUESTSCHEMA_H
+
+#include "jsonenvelope.h"
+
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QLatin1String>
+#include <QString>
+#include <tuple>
+#include <utility>
+
+/**
+ * /brief Класс CharClass.
+ *
+ * Множество символов ASCII в виде битовой таблицы, заданное при компиляции строкой
+ * диапазонов в духе регулярных выражений ("A-Za-z0-9_-"; дефис в конце — сам символ).
+ * Проверка символа — одна операция над таблицей, без QRegularExpression.
+ */
+class CharClass
+{
+private:
+    quint64 low = 0; ///< Символы 0–63.
+    quint64 high = 0; ///< Символы 64–127.
+
+    /**
+     * /brief Добавляет символ в множество.
+     * /param code Код символа (меньше 128).
+     */
+    constexpr void add(int code)
+    {
+        if (code < 64)
+        {
+            low |= quint64(1) << code;
+        }
+        else
+        {
+            high |= quint64(1) << (code - 64);
+        }
+    }
+
+public:
+    /**
+     * /brief Создаёт множество по строке диапазонов.
+     * /param ranges Символы и диапазоны вида "a-z".
+     */
+    constexpr explicit CharClass(const char *ranges)
+    {
+        for (int i = 0; ranges[i] != '\0'; ++i)
+        {
+            int first = ranges[i];
+            int last = first;
+            if (ranges[i + 1] == '-' && ranges[i + 2] != '\0')
+            {
+                last = ranges[i + 2];
+                i += 2;
+            }
+            for (int code = first; code <= last && code < 128; ++code)
+            {
+                add(code);
+            }
+        }
+    }
+
+    /**
+     * /brief Проверяет, входит ли символ в множество.
+     * /param code Код символа UTF-16.
+     * /return Признак вхождения (символы вне ASCII не входят).
+     */
+    constexpr bool contains(ushort code) const
+    {
+        return code < 64 ? ((low >> code) & 1) != 0
+                         : code < 128 ? ((high >> (code - 64)) & 1) != 0 : false;
+    }
+
+    /**
+     * /brief Проверяет, что строка не пуста и состоит только из символов множества.
+     * /param text Строка.
+     * /return Признак соответствия.
+     */
+    bool matchesAll(const QString &text) const;
+
+    /**
+     * /brief Проверяет, что в строке есть хотя бы один символ множества.
+     * /param text Строка.
+     * /return Признак наличия символа.
+     */
+    bool matchesAny(const QString &text) const;
+};
+
+/**
+ * /brief Наборы символов для проверки логинов и паролей.
+ */
+namespace CharClasses
+{
+constexpr CharClass upper("A-Z"); ///< Заглавные латинские буквы.
+constexpr CharClass lower("a-z"); ///< Строчные латинские буквы.
+constexpr CharClass digits("0-9"); ///< Цифры.
+constexpr CharClass special("!@#$%^&*()_+=-"); ///< Специальные символы пароля.
+constexpr CharClass login("A-Za-z0-9_-"); ///< Допустимые символы логина.
+}
+
+/**
+ * /brief Описание поля запроса: ключ, член структуры запроса и обязательность.
+ */
+template<typename Request, typename T>
+struct FieldSpec
+{
+    const char *key; ///< Ключ поля в запросе.
+    T Request::*member; ///< Член структуры, в который извлекается значение.
+    bool required; ///< Признак обязательного поля.
+};
+
+/**
+ * /brief Описывает обязательное поле запроса.
+ * /param key Ключ поля.
+ * /param member Член структуры запроса.
+ * /return Описание поля.
+ */
+template<typename Request, typename T>
+constexpr FieldSpec<Request, T> requiredField(const char *key, T Request::*member)
+{
+    return FieldSpec<Request, T>{key, member, true};
+}
+
+/**
+ * /brief Описывает необязательное поле запроса (при отсутствии остаётся значение по умолчанию).
+ * /param key Ключ поля.
+ * /param member Член структуры запроса.
+ * /return Описание поля.
+ */
+template<typename Request, typename T>
+constexpr FieldSpec<Request, T> optionalField(const char *key, T Request::*member)
+{
+    return FieldSpec<Request, T>{key, member, false};
+}
+
+/**
+ * /brief Схема запроса: специализация задаёт функцию fields() со списком описаний полей.
+ */
+template<typename Request>
+struct RequestSchema;
+
+/**
+ * /brief Ошибка разбора запроса.
+ */
+struct RequestError
+{
+    /**
+     * /brief Причина ошибки.
+     */
+    enum Reason
+    {
+        Missing, ///< Обязательное поле отсутствует.
+        Invalid  ///< Значение поля имеет неверный тип или формат.
+    };
+
+    const char *field = ""; ///< Ключ поля.
+    Reason reason = Missing; ///< Причина.
+};
+
+/**
+ * /brief Класс RequestParser.
+ *
+ * Проверяет запрос по схеме его типа и извлекает поля в структуру запроса за один проход
+ * по списку полей: каждое поле ищется в объекте один раз, проверяется и преобразуется
+ * к типу члена структуры. Разбор останавливается на первом ошибочном поле.
+ *
+ * Строковые поля принимаются только строками. Целые — числами или строками с числом
+ * (идентификаторы чатов клиенты передают строками). Логические — только true/false.
+ * Правила одинаковы для запроса, разобранного в QJsonObject, и для запроса, разобранного
+ * JsonEnvelope без построения дерева.
+ */
+class RequestParser
+{
+private:
+    /**
+     * /brief Преобразует значение строкового поля.
+     * /param value Значение из запроса.
+     * /param result Извлечённое значение.
+     * /return Признак допустимого значения.
+     */
+    static bool convert(const QJsonValue &value, QString &result);
+
+    /**
+     * /brief Преобразует значение целого поля.
+     * /param value Значение из запроса.
+     * /param result Извлечённое значение.
+     * /return Признак допустимого значения.
+     */
+    static bool convert(const QJsonValue &value, int &result);
+
+    /**
+     * /brief Преобразует значение целого поля.
+     * /param value Значение из запроса.
+     * /param result Извлечённое значение.
+     * /return Признак допустимого значения.
+     */
+    static bool convert(const QJsonValue &value, qint64 &result);
+
+    /**
+     * /brief Преобразует значение логического поля.
+     * /param value Значение из запроса.
+     * /param result Извлечённое значение.
+     * /return Признак допустимого значения.
+     */
+    static bool convert(const QJsonValue &value, bool &result);
+
+    /**
+     * /brief Преобразует значение строкового поля.
+     * /param envelope Разобранный запрос.
+     * /param value Поле разобранного запроса.
+     * /param result Извлечённое значение.
+     * /return Признак допустимого значения.
+     */
+    static bool convert(const JsonEnvelope &envelope, const JsonEnvelope::Field &value, QString &result);
+
+    /**
+     * /brief Преобразует значение целого поля.
+     * /param envelope Разобранный запрос.
+     * /param value Поле разобранного запроса.
+     * /param result Извлечённое значение.
+     * /return Признак допустимого значения.
+     */
+    static bool convert(const JsonEnvelope &envelope, const JsonEnvelope::Field &value, int &result);
+
+    /**
+     * /brief Преобразует значение целого поля.
+     * /param envelope Разобранный запрос.
+     * /param value Поле разобранного запроса.
+     * /param result Извлечённое значение.
+     * /return Признак допустимого значения.
+     */
+    static bool convert(const JsonEnvelope &envelope, const JsonEnvelope::Field &value, qint64 &result);
+
+    /**
+     * /brief Преобразует значение логического поля.
+     * /param envelope Разобранный запрос.
+     * /param value Поле разобранного запроса.
+     * /param result Извлечённое значение.
+     * /return Признак допустимого значения.
+     */
+    static bool convert(const JsonEnvelope &envelope, const JsonEnvelope::Field &value, bool &result);
+
+    /**
+     * /brief Извлекает одно поле запроса.
+     * /param json Запрос.
+     * /param request Структура запроса.
+     * /param field Описание поля.
+     * /param error Ошибка разбора.
+     * /return Признак успешного извлечения.
+     */
+    template<typename Request, typename T>
+    static bool readField(const QJsonObject &json, Request &request, const FieldSpec<Request, T> &field, RequestError &error)
+    {
+        QJsonObject::const_iterator it = json.constFind(QLatin1String(field.key));
+        if (it == json.constEnd())
+        {
+            error = RequestError{field.key, RequestError::Missing};
+            return !field.required;
+        }
+        if (!convert(it.value(), request.*field.member))
+        {
+            error = RequestError{field.key, RequestError::Invalid};
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * /brief Извлекает одно поле запроса, разобранного JsonEnvelope.
+     * /param envelope Разобранный запрос.
+     * /param request Структура запроса.
+     * /param field Описание поля.
+     * /param error Ошибка разбора.
+     * /return Признак успешного извлечения.
+     */
+    template<typename Request, typename T>
+    static bool readField(const JsonEnvelope &envelope, Request &request, const FieldSpec<Request, T> &field, RequestError &error)
+    {
+        const JsonEnvelope::Field *value = envelope.find(QLatin1String(field.key));
+        if (!value)
+        {
+            error = RequestError{field.key, RequestError::Missing};
+            return !field.required;
+        }
+        if (!convert(envelope, *value, request.*field.member))
+        {
+            error = RequestError{field.key, RequestError::Invalid};
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * /brief Проходит по полям схемы запроса.
+     * /param source Запрос (QJsonObject или JsonEnvelope).
+     * /param request Структура запроса.
+     * /param error Ошибка разбора.
+     * /return Признак того, что запрос соответствует схеме.
+     */
+    template<typename Source, typename Request>
+    static bool parseFields(const Source &source, Request &request, RequestError &error)
+    {
+        return std::apply([&](const auto &... fields)
+                          {
+                              return (readField(source, request, fields, error) && ...);
+                          }, RequestSchema<Request>::fields());
+    }
+
+public:
+    /**
+     * /brief Проверяет запрос по схеме и извлекает его поля.
+     * /param json Запрос.
+     * /param request Структура запроса.
+     * /param error Ошибка разбора (заполняется при неудаче).
+     * /return Признак того, что запрос соответствует схеме.
+     */
+    template<typename Request>
+    static bool parse(const QJsonObject &json, Request &request, RequestError &error)
+    {
+        return parseFields(json, request, error);
+    }
+
+    /**
+     * /brief Проверяет по схеме запрос, разобранный JsonEnvelope, и извлекает его поля.
+     * /param envelope Разобранный запрос.
+     * /param request Структура запроса.
+     * /param error Ошибка разбора (заполняется при неудаче).
+     * /return Признак того, что запрос соответствует схеме.
+     */
+    template<typename Request>
+    static bool parse(const JsonEnvelope &envelope, Request &request, RequestError &error)
+    {
+        return parseFields(envelope, request, error);
+    }
+};
+
+/**
+ * /brief Запрос без полей (ping, secure_hello).
+ */
+struct EmptyRequest
+{
+};
+
+/**
+ * /brief Запрос hello на согласование кодировки и возможностей подключения.
+ */
+struct HelloRequest
+{
+    QString encoding = "json"; ///< Кодировка ("json" или "cbor").
+    QString compression = "none"; ///< Сжатие ("none" или "zlib").
+    bool heartbeat = false; ///< Признак поддержки ping.
+    bool acks = false; ///< Признак подтверждения уведомлений.
+};
+
+/**
+ * /brief Запрос secure_key с зашифрованным сеансовым ключом.
+ */
+struct SecureKeyRequest
+{
+    QString key; ///< Сеансовый ключ в Base64, зашифрованный открытым ключом RSA.
+};
+
+/**
+ * /brief Запрос resume на восстановление сессии по токену.
+ */
+struct ResumeRequest
+{
+    QString token; ///< Токен сессии.
+};
+
+/**
+ * /brief Индикатор набора текста.
+ */
+struct TypingRequest
+{
+    int chatId = 0; ///< Идентификатор чата.
+    bool typing = true; ///< Признак набора.
+};
+
+/**
+ * /brief Подтверждение получения уведомлений чата.
+ */
+struct AckRequest
+{
+    int chatId = 0; ///< Идентификатор чата.
+    qint64 seq = 0; ///< Номер последнего полученного сообщения.
+};
+
+/**
+ * /brief Запросы register и login.
+ */
+struct CredentialsRequest
+{
+    QString login; ///< Логин.
+    QString password; ///< Хеш пароля, вычисленный клиентом.
+};
+
+/**
+ * /brief Запросы, которым нужен только логин (check_nickname, get_chat_list).
+ */
+struct LoginRequest
+{
+    QString login; ///< Логин.
+};
+
+/**
+ * /brief Запрос update_nickname.
+ */
+struct UpdateNicknameRequest
+{
+    QString login; ///< Логин.
+    QString nickname; ///< Новое отображаемое имя.
+};
+
+/**
+ * /brief Запрос find_users.
+ */
+struct FindUsersRequest
+{
+    QString searchText; ///< Часть отображаемого имени.
+    QString login; ///< Логин пользователя, исключаемого из результатов.
+};
+
+/**
+ * /brief Запрос update_login.
+ */
+struct UpdateLoginRequest
+{
+    QString oldLogin; ///< Прежний логин.
+    QString newLogin; ///< Новый логин.
+    QString password; ///< Хеш пароля, вычисленный клиентом.
+};
+
+/**
+ * /brief Запрос update_password.
+ */
+struct UpdatePasswordRequest
+{
+    QString login; ///< Логин.
+    QString currentPassword; ///< Хеш текущего пароля.
+    QString newPassword; ///< Хеш нового пароля.
+};
+
+/**
+ * /brief Запрос create_chat.
+ */
+struct CreateChatRequest
+{
+    QString user1; ///< Логин первого участника.
+    QString user2; ///< Логин второго участника.
+};
+
+/**
+ * /brief Запрос get_chat_history.
+ */
+struct ChatHistoryRequest
+{
+    int chatId = 0; ///< Идентификатор чата.
+    QString login; ///< Логин читателя.
+    qint64 afterSeq = 0; ///< Номер, после которого выдаются сообщения (0 — вся история).
+};
+
+/**
+ * /brief Запрос send_message.
+ */
+struct SendMessageRequest
+{
+    int chatId = 0; ///< Идентификатор чата.
+    QString userLogin; ///< Логин отправителя (поле user_id).
+    QString messageText; ///< Текст сообщения.
+    QString timestamp; ///< Время отправки.
+    QString clientMessageId; ///< Идентификатор сообщения клиента для повторов (может быть пустым).
+};
+
+/**
+ * /brief Запрос get_or_create_chat.
+ */
+struct GetOrCreateChatRequest
+{
+    QString login1; ///< Логин первого участника.
+    QString login2; ///< Логин второго участника.
+};
+
+/**
+ * /brief Запрос delete_chat.
+ */
+struct DeleteChatRequest
+{
+    int chatId = 0; ///< Идентификатор чата.
+};
+
+/**
+ * /brief Запрос check_chat_exists на создание группового чата с уникальным названием.
+ */
+struct CheckChatExistsRequest
+{
+    QString chatName; ///< Название чата.
+    QString login; ///< Логин создателя.
+};
+
+template<>
+struct RequestSchema<EmptyRequest>
+{
+    static constexpr auto fields() { return std::make_tuple(); }
+};
+
+template<>
+struct RequestSchema<HelloRequest>
+{
+    static constexpr auto fields()
+    {
+        return std::make_tuple(optionalField("encoding", &HelloRequest::encoding),
+                               optionalField("compression", &HelloRequest::compression),
+                               optionalField("heartbeat", &HelloRequest::heartbeat),
+                               optionalField("acks", &HelloRequest::acks));
+    }
+};
+
+template<>
+struct RequestSchema<SecureKeyRequest>
+{
+    static constexpr auto fields() { return std::make_tuple(requiredField("key", &SecureKeyRequest::key)); }
+};
+
+template<>
+struct RequestSchema<ResumeRequest>
+{
+    static constexpr auto fields() { return std::make_tuple(requiredField("token", &ResumeRequest::token)); }
+};
+
+template<>
+struct RequestSchema<TypingRequest>
+{
+    static constexpr auto fields()
+    {
+        return std::make_tuple(requiredField("chat_id", &TypingRequest::chatId),
+                               optionalField("typing", &TypingRequest::typing));
+    }
+};
+
+template<>
+struct RequestSchema<AckRequest>
+{
+    static constexpr auto fields()
+    {
+        return std::make_tuple(requiredField("chat_id", &AckRequest::chatId),
+                               requiredField("seq", &AckRequest::seq));
+    }
+};
+
+template<>
+struct RequestSchema<CredentialsRequest>
+{
+    static constexpr auto fields()
+    {
+        return std::make_tuple(requiredField("login", &CredentialsRequest::login),
+                               requiredField("password", &CredentialsRequest::password));
+    }
+};
+
+template<>
+struct RequestSchema<LoginRequest>
+{
+    static constexpr auto fields() { return std::make_tuple(requiredField("login", &LoginRequest::login)); }
+};
+
+template<>
+struct RequestSchema<UpdateNicknameRequest>
+{
+    static constexpr auto fields()
+    {
+        return std::make_tuple(requiredField("login", &UpdateNicknameRequest::login),
+                               requiredField("nickname", &UpdateNicknameRequest::nickname));
+    }
+};
+
+template<>
+struct RequestSchema<FindUsersRequest>
+{
+    static constexpr auto fields()
+    {
+        return std::make_tuple(requiredField("searchText", &FindUsersRequest::searchText),
+                               requiredField("login", &FindUsersRequest::login));
+    }
+};
+
+template<>
+struct RequestSchema<UpdateLoginRequest>
+{
+    static constexpr auto fields()
+    {
+        return std::make_tuple(requiredField("old_login", &UpdateLoginRequest::oldLogin),
+                               requiredField("new_login", &UpdateLoginRequest::newLogin),
+                               requiredField("password", &UpdateLoginRequest::password));
+    }
+};
+
+template<>
+struct RequestSchema<UpdatePasswordRequest>
+{
+    static constexpr auto fields()
+    {
+        return std::make_tuple(requiredField("login", &UpdatePasswordRequest::login),
+                               requiredField("current_password", &UpdatePasswordRequest::currentPassword),
+                               requiredField("new_password", &UpdatePasswordRequest::newPassword));
+    }
+};
+
+template<>
+struct RequestSchema<CreateChatRequest>
+{
+    static constexpr auto fields()
+    {
+        return std::make_tuple(requiredField("user1", &CreateChatRequest::user1),
+                               requiredField("user2", &CreateChatRequest::user2));
+    }
+};
+
+template<>
+struct RequestSchema<ChatHistoryRequest>
+{
+    static constexpr auto fields()
+    {
+        return std::make_tuple(requiredField("chat_id", &ChatHistoryRequest::chatId),
+                               requiredField("login", &ChatHistoryRequest::login),
+                               optionalField("after_seq", &ChatHistoryRequest::afterSeq));
+    }
+};
+
+template<>
+struct RequestSchema<SendMessageRequest>
+{
+    static constexpr auto fields()
+    {
+        return std::make_tuple(requiredField("chat_id", &SendMessageRequest::chatId),
+                               requiredField("user_id", &SendMessageRequest::userLogin),
+                               requiredField("message_text", &SendMessageRequest::messageText),
+                               optionalField("timestamp", &SendMessageRequest::timestamp),
+                               optionalField("client_msg_id", &SendMessageRequest::clientMessageId));
+    }
+};
+
+template<>
+struct RequestSchema<GetOrCreateChatRequest>
+{
+    static constexpr auto fields()
+    {
+        return std::make_tuple(optionalField("login1", &GetOrCreateChatRequest::login1),
+                               optionalField("login2", &GetOrCreateChatRequest::login2));
+    }
+};
+
+template<>
+struct RequestSchema<DeleteChatRequest>
+{
+    static constexpr auto fields() { return std::make_tuple(requiredField("chat_id", &DeleteChatRequest::chatId)); }
+};
+
+template<>
+struct RequestSchema<CheckChatExistsRequest>
+{
+    static constexpr auto fields()
+    {
+        return std::make_tuple(requiredField("chat_name", &CheckChatExistsRequest::chatName),
+                               optionalField("login", &CheckChatExistsRequest::login));
+    }
+};
+
+#endif // REQUESTSCHEMA_H
@@ -0,0 +1,207 @@
+#include "reuseportlistener.h"
+#include "logger.h"
+#include "servermetrics.h"
+
+#ifdef Q_OS_UNIX
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Конструктор класса ReusePortAcceptor.
+ *
+ * @param targetThread Поток, в котором работает логика сервера.
+ */
+ReusePortAcceptor::ReusePortAcceptor(QThread *targetThread) : QTcpServer(nullptr), targetThread(targetThread)
+{
+}
+
+/**
+ * @brief Создаёт сокет для принятого подключения и передаёт его в поток сервера.
+ *
+ * @param descriptor Дескриптор принятого подключения.
+ */
+void ReusePortAcceptor::incomingConnection(qintptr descriptor)
+{
+    QTcpSocket *socket = new QTcpSocket;
+    if (!socket->setSocketDescriptor(descriptor))
+    {
+        delete socket;
+        return;
+    }
+    socket->moveToThread(targetThread);
+    ServerMetrics::getInstance()->add("accept.reuseport");
+    emit connectionReady(socket);
+}
+
+/**
+ * @brief Конструктор класса ReusePortListener.
+ *
+ * @param parent Указатель на родительский объект (по умолчанию nullptr).
+ */
+ReusePortListener::ReusePortListener(QObject *parent) : QObject(parent)
+{
+}
+
+/**
+ * @brief Деструктор класса ReusePortListener.
+ */
+ReusePortListener::~ReusePortListener()
+{
+    close();
+}
+
+/**
+ * @brief Проверяет, поддерживает ли система SO_REUSEPORT.
+ *
+ * @return true Если параметр доступен.
+ */
+bool ReusePortListener::isSupported()
+{
+#if defined(Q_OS_UNIX) && defined(SO_REUSEPORT)
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Открывает слушающий сокет с SO_REUSEPORT на всех адресах.
+ *
+ * Сокет IPv6 принимает и подключения IPv4 (как QHostAddress::Any); если IPv6 недоступен,
+ * открывается сокет IPv4.
+ *
+ * @param port Порт.
+ * @param backlog Длина очереди ожидающих подключений.
+ * @return qintptr Дескриптор сокета или -1 при ошибке.
+ */
+qintptr ReusePortListener::openSocket(quint16 port, int backlog)
+{
+#if defined(Q_OS_UNIX) && defined(SO_REUSEPORT)
+    int descriptor = ::socket(AF_INET6, SOCK_STREAM, 0);
+    bool ipv6 = descriptor >= 0;
+    if (!ipv6)
+    {
+        descriptor = ::socket(AF_INET, SOCK_STREAM, 0);
+    }
+    if (descriptor < 0)
+    {
+        return -1;
+    }
+
+    int enable = 1;
+    int disable = 0;
+    ::setsockopt(descriptor, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    if (::setsockopt(descriptor, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0)
+    {
+        ::close(descriptor);
+        return -1;
+    }
+
+    int bound;
+    if (ipv6)
+    {
+        ::setsockopt(descriptor, IPPROTO_IPV6, IPV6_V6ONLY, &disable, sizeof(disable));
+        sockaddr_in6 address = {};
+        address.sin6_family = AF_INET6;
+        address.sin6_addr = in6addr_any;
+        address.sin6_port = htons(port);
+        bound = ::bind(descriptor, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    }
+    else
+    {
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(port);
+        bound = ::bind(descriptor, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    }
+    if (bound != 0 || ::listen(descriptor, backlog) != 0)
+    {
+        ::close(descriptor);
+        return -1;
+    }
+    ::fcntl(descriptor, F_SETFL, ::fcntl(descriptor, F_GETFL) | O_NONBLOCK);
+    return descriptor;
+#else
+    Q_UNUSED(port)
+    Q_UNUSED(backlog)
+    return -1;
+#endif
+}
+
+/**
+ * @brief Запускает потоки приёма подключений.
+ *
+ * Слушающий сокет передаётся принимающему серверу в его собственном потоке, так как
+ * уведомления о новых подключениях создаются в потоке владельца.
+ *
+ * @param port Порт.
+ * @param threadCount Количество потоков.
+ * @param backlog Длина очереди ожидающих подключений каждого сокета.
+ * @return int Количество запущенных потоков.
+ */
+int ReusePortListener::listen(quint16 port, int threadCount, int backlog)
+{
+    close();
+    for (int i = 0; i < threadCount; ++i)
+    {
+        qintptr descriptor = openSocket(port, backlog);
+        if (descriptor < 0)
+        {
+            Logger::getInstance()->logToFile(QString("SO_REUSEPORT: cannot open listening socket %1 on port %2").arg(i).arg(port));
+            break;
+        }
+
+        QThread *acceptThread = new QThread;
+        ReusePortAcceptor *acceptor = new ReusePortAcceptor(thread());
+        acceptor->moveToThread(acceptThread);
+        connect(acceptThread, &QThread::finished, acceptor, &QObject::deleteLater);
+        connect(acceptor, &ReusePortAcceptor::connectionReady, this, &ReusePortListener::connectionReady);
+        acceptThread->start();
+
+        bool adopted = false;
+        QMetaObject::invokeMethod(acceptor, [acceptor, descriptor]()
+                                  {
+                                      return acceptor->setSocketDescriptor(descriptor);
+                                  }, Qt::BlockingQueuedConnection, &adopted);
+        if (!adopted)
+        {
+#ifdef Q_OS_UNIX
+            ::close(int(descriptor));
+#endif
+            acceptThread->quit();
+            acceptThread->wait();
+            delete acceptThread;
+            Logger::getInstance()->logToFile(QString("SO_REUSEPORT: acceptor %1 rejected its socket").arg(i));
+            break;
+        }
+        threads.append(acceptThread);
+        acceptors.append(acceptor);
+    }
+    ServerMetrics::getInstance()->set("accept.reuseport_threads", acceptors.size());
+    return acceptors.size();
+}
+
+/**
+ * @brief Закрывает слушающие сокеты и останавливает потоки.
+ */
+void ReusePortListener::close()
+{
+    for (int i = 0; i < acceptors.size(); ++i)
+    {
+        ReusePortAcceptor *acceptor = acceptors[i];
+        QMetaObject::invokeMethod(acceptor, [acceptor]()
+                                  {
+                                      acceptor->close();
+                                  }, Qt::BlockingQueuedConnection);
+        threads[i]->quit();
+        threads[i]->wait();
+        delete threads[i];
+    }
+    threads.clear();
+    acceptors.clear();
+}
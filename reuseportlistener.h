@@ -0,0 +1,116 @@
+/**
+ * /file reuseportlistener.h
+ * /brief Определение класса ReusePortListener для приёма подключений несколькими сокетами с SO_REUSEPORT.
+ */
+
+#ifndef REUSEPORTLISTENER_H
+#define REUSEPORTLISTENER_H
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QThread>
+#include <QVector>
+
+/**
+ * /brief Класс ReusePortAcceptor.
+ *
+ * Принимает подключения на собственном слушающем сокете в отдельном потоке. Принятый
+ * сокет создаётся в этом потоке и передаётся в поток логики сервера.
+ */
+class ReusePortAcceptor : public QTcpServer
+{
+    Q_OBJECT
+
+private:
+    QThread *targetThread; ///< Поток, в котором работает логика сервера.
+
+protected:
+    /**
+     * /brief Создаёт сокет для принятого подключения и передаёт его в поток сервера.
+     * /param descriptor Дескриптор принятого подключения.
+     */
+    void incomingConnection(qintptr descriptor) override;
+
+public:
+    /**
+     * /brief Конструктор класса ReusePortAcceptor.
+     * /param targetThread Поток, в котором работает логика сервера.
+     */
+    explicit ReusePortAcceptor(QThread *targetThread);
+
+signals:
+    /**
+     * /brief Сигнал о принятом подключении.
+     * /param socket Сокет, уже перемещённый в поток сервера.
+     */
+    void connectionReady(QTcpSocket *socket);
+};
+
+/**
+ * /brief Класс ReusePortListener.
+ *
+ * Открывает на одном порту несколько слушающих сокетов с параметром SO_REUSEPORT, по одному
+ * на поток приёма. Ядро распределяет новые подключения между сокетами, поэтому приём
+ * подключений при массовом переподключении клиентов выполняется на нескольких ядрах.
+ * Тем же параметром порт разделяют несколько процессов сервера (см. MessageBus).
+ *
+ * SO_REUSEPORT доступен только в Unix-системах; в остальных isSupported() возвращает false
+ * и сервер слушает порт обычным образом.
+ */
+class ReusePortListener : public QObject
+{
+    Q_OBJECT
+
+private:
+    QVector<QThread*> threads; ///< Потоки приёма подключений.
+    QVector<ReusePortAcceptor*> acceptors; ///< Принимающие серверы (по одному на поток).
+
+public:
+    /**
+     * /brief Конструктор класса ReusePortListener.
+     * /param parent Указатель на родительский объект.
+     */
+    explicit ReusePortListener(QObject *parent = nullptr);
+
+    /**
+     * /brief Деструктор, останавливающий потоки приёма.
+     */
+    ~ReusePortListener() override;
+
+    /**
+     * /brief Проверяет, поддерживает ли система SO_REUSEPORT.
+     * /return Признак поддержки.
+     */
+    static bool isSupported();
+
+    /**
+     * /brief Открывает слушающий сокет с SO_REUSEPORT на всех адресах.
+     * /param port Порт.
+     * /param backlog Длина очереди ожидающих подключений.
+     * /return Дескриптор сокета или -1 при ошибке.
+     */
+    static qintptr openSocket(quint16 port, int backlog);
+
+    /**
+     * /brief Запускает потоки приёма подключений.
+     * /param port Порт.
+     * /param threadCount Количество потоков (и слушающих сокетов).
+     * /param backlog Длина очереди ожидающих подключений каждого сокета.
+     * /return Количество запущенных потоков.
+     */
+    int listen(quint16 port, int threadCount, int backlog);
+
+    /**
+     * /brief Закрывает слушающие сокеты и останавливает потоки.
+     */
+    void close();
+
+signals:
+    /**
+     * /brief Сигнал о принятом подключении.
+     * /param socket Сокет в потоке сервера.
+     */
+    void connectionReady(QTcpSocket *socket);
+};
+
+#endif // REUSEPORTLISTENER_H
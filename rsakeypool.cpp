@@ -0,0 +1,139 @@
+#include "rsakeypool.h"
+#include "servermetrics.h"
+
+#include <QtConcurrent>
+#include <QFutureWatcher>
+#include <QPointer>
+#include <QElapsedTimer>
+
+/**
+ * @brief Конструктор класса RsaKeyPool.
+ *
+ * @param parent Указатель на родительский объект (по умолчанию nullptr).
+ */
+RsaKeyPool::RsaKeyPool(QObject *parent) : QObject(parent)
+{
+    pool.setMaxThreadCount(1);
+    decryptPool.setMaxThreadCount(1);
+}
+
+/**
+ * @brief Деструктор класса RsaKeyPool.
+ */
+RsaKeyPool::~RsaKeyPool()
+{
+    pool.waitForDone();
+    decryptPool.waitForDone();
+}
+
+/**
+ * @brief Задаёт параметры и запускает генерацию ключей.
+ *
+ * @param poolSize Желаемый запас пар ключей.
+ * @param bits Длина ключа RSA в битах.
+ * @param threads Количество потоков генерации.
+ */
+void RsaKeyPool::start(int poolSize, int bits, int threads)
+{
+    targetSize = qMax(1, poolSize);
+    pool.setMaxThreadCount(qMax(1, threads));
+    decryptPool.setMaxThreadCount(qMax(1, threads));
+    switch (bits)
+    {
+    case 1024:
+        rsaType = QRSAEncryption::Rsa::RSA_1024;
+        break;
+    case 4096:
+        rsaType = QRSAEncryption::Rsa::RSA_4096;
+        break;
+    default:
+        rsaType = QRSAEncryption::Rsa::RSA_2048;
+        break;
+    }
+    refill();
+}
+
+/**
+ * @brief Запускает генерацию недостающих пар ключей.
+ */
+void RsaKeyPool::refill()
+{
+    while (keys.size() + generating < targetSize)
+    {
+        generating++;
+        QRSAEncryption::Rsa type = rsaType;
+        QFutureWatcher<KeyPair> *watcher = new QFutureWatcher<KeyPair>(this);
+        connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher]()
+                {
+                    KeyPair pair = watcher->result();
+                    watcher->deleteLater();
+                    generating--;
+                    if (!pair.first.isEmpty())
+                    {
+                        keys.enqueue(pair);
+                    }
+                    ServerMetrics::getInstance()->set("crypto.rsa_pool", keys.size());
+                });
+        watcher->setFuture(QtConcurrent::run(&pool, [type]()
+                                             {
+                                                 QElapsedTimer timer;
+                                                 timer.start();
+                                                 QRSAEncryption rsa(type);
+                                                 KeyPair pair;
+                                                 if (!rsa.generatePairKey(pair.first, pair.second))
+                                                 {
+                                                     return KeyPair();
+                                                 }
+                                                 ServerMetrics::getInstance()->set("crypto.rsa_keygen_ms", timer.elapsed());
+                                                 return pair;
+                                             }));
+    }
+}
+
+/**
+ * @brief Выдаёт пару ключей для подключения.
+ *
+ * Последняя пара остаётся в запасе, чтобы клиенты не ждали генерации при всплеске подключений.
+ *
+ * @return KeyPair Пара ключей или пустая пара, если ключи ещё не сгенерированы.
+ */
+RsaKeyPool::KeyPair RsaKeyPool::take()
+{
+    if (keys.isEmpty())
+    {
+        return KeyPair();
+    }
+    KeyPair pair = keys.size() > 1 ? keys.dequeue() : keys.head();
+    refill();
+    ServerMetrics::getInstance()->set("crypto.rsa_pool", keys.size());
+    return pair;
+}
+
+/**
+ * @brief Расшифровывает данные закрытым ключом в пуле потоков.
+ *
+ * @param context Объект, при удалении которого результат не доставляется.
+ * @param cipherText Зашифрованные данные.
+ * @param privateKey Закрытый ключ.
+ * @param done Обработчик результата.
+ */
+void RsaKeyPool::decrypt(QObject *context, const QByteArray &cipherText, const QByteArray &privateKey, DecryptCallback done)
+{
+    QPointer<QObject> guard(context);
+    QRSAEncryption::Rsa type = rsaType;
+    QFutureWatcher<QByteArray> *watcher = new QFutureWatcher<QByteArray>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [watcher, guard, done]()
+            {
+                QByteArray plain = watcher->result();
+                watcher->deleteLater();
+                if (guard)
+                {
+                    done(plain);
+                }
+            });
+    watcher->setFuture(QtConcurrent::run(&decryptPool, [type, cipherText, privateKey]()
+                                         {
+                                             QRSAEncryption rsa(type);
+                                             return rsa.decode(cipherText, privateKey);
+                                         }));
+}
@@ -0,0 +1,90 @@
+/**
+ * /file rsakeypool.h
+ * /brief Определение класса RsaKeyPool для фоновой генерации ключей RSA и расшифровки сеансовых ключей.
+ */
+
+#ifndef RSAKEYPOOL_H
+#define RSAKEYPOOL_H
+
+#include <QObject>
+#include <QThreadPool>
+#include <QQueue>
+#include <QPair>
+#include <functional>
+#include <qrsaencryption.h>
+
+/**
+ * /brief Класс RsaKeyPool.
+ *
+ * Заранее генерирует пары ключей RSA (Qt-Secret) в отдельном пуле потоков, чтобы
+ * установка зашифрованной сессии не ждала генерации ключа. Каждая выданная пара
+ * используется для одного подключения; если запас исчерпан, повторно выдаётся последняя
+ * пара, пока фоновая генерация не пополнит запас.
+ *
+ * Расшифровка присланного клиентом сеансового ключа также выполняется в пуле,
+ * результат возвращается в поток событий через callback.
+ */
+class RsaKeyPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    using KeyPair = QPair<QByteArray, QByteArray>; ///< Открытый и закрытый ключи.
+    using DecryptCallback = std::function<void(const QByteArray &plain)>; ///< Обработчик расшифрованных данных.
+
+private:
+    QThreadPool pool; ///< Пул потоков для генерации ключей.
+    QThreadPool decryptPool; ///< Пул потоков для расшифровки, не ждущий генерации ключей.
+    QQueue<KeyPair> keys; ///< Готовые пары ключей.
+    int targetSize = 4; ///< Желаемый запас пар ключей.
+    int generating = 0; ///< Количество пар, генерируемых в данный момент.
+    QRSAEncryption::Rsa rsaType = QRSAEncryption::Rsa::RSA_2048; ///< Длина ключа RSA.
+
+    /**
+     * /brief Запускает генерацию недостающих пар ключей.
+     */
+    void refill();
+
+public:
+    /**
+     * /brief Конструктор класса RsaKeyPool.
+     * /param parent Указатель на родительский объект.
+     */
+    explicit RsaKeyPool(QObject *parent = nullptr);
+
+    /**
+     * /brief Деструктор, дожидающийся завершения фоновых операций.
+     */
+    ~RsaKeyPool() override;
+
+    /**
+     * /brief Задаёт параметры и запускает генерацию ключей.
+     * /param poolSize Желаемый запас пар ключей.
+     * /param bits Длина ключа RSA в битах (1024, 2048 или 4096).
+     * /param threads Количество потоков генерации и расшифровки.
+     */
+    void start(int poolSize, int bits, int threads);
+
+    /**
+     * /brief Проверяет, есть ли готовая пара ключей.
+     * /return Признак наличия ключей.
+     */
+    bool isReady() const { return !keys.isEmpty(); }
+
+    /**
+     * /brief Выдаёт пару ключей для подключения.
+     * /return Пара ключей (пустая, если ни одна пара ещё не сгенерирована).
+     */
+    KeyPair take();
+
+    /**
+     * /brief Расшифровывает данные закрытым ключом в пуле потоков.
+     * /param context Объект, при удалении которого результат не доставляется.
+     * /param cipherText Зашифрованные данные.
+     * /param privateKey Закрытый ключ.
+     * /param done Обработчик результата (пустой массив при ошибке).
+     */
+    void decrypt(QObject *context, const QByteArray &cipherText, const QByteArray &privateKey, DecryptCallback done);
+};
+
+#endif // RSAKEYPOOL_H
@@ -0,0 +1,143 @@
+#include "securechannel.h"
+
+#include <QtEndian>
+
+/**
+ * @brief Проверяет, собран ли сервер с поддержкой шифрования.
+ *
+ * @return true Если сервер собран с qca и провайдер поддерживает AES-256-GCM.
+ */
+bool SecureChannel::isAvailable()
+{
+#ifdef SERVER_HAVE_QCA
+    return QCA::isSupported("aes256-gcm-nopadding");
+#else
+    return false;
+#endif
+}
+
+#ifdef SERVER_HAVE_QCA
+
+namespace
+{
+const int nonceSize = 12; ///< Размер nonce в байтах.
+const int tagSize = 16; ///< Размер тега GCM в байтах.
+const quint32 clientDirection = 0; ///< Метка направления кадров клиента.
+const quint32 serverDirection = 1; ///< Метка направления кадров сервера.
+const quint32 maxFrameSize = 64 * 1024 * 1024; ///< Максимальный размер входящего кадра.
+}
+
+/**
+ * @brief Конструктор канала с сеансовым ключом.
+ *
+ * @param sessionKey Сеансовый ключ.
+ */
+SecureChannel::SecureChannel(const QByteArray &sessionKey)
+    : key(sessionKey),
+      encoder("aes256", QCA::Cipher::GCM, QCA::Cipher::NoPadding),
+      decoder("aes256", QCA::Cipher::GCM, QCA::Cipher::NoPadding)
+{
+}
+
+/**
+ * @brief Шифрует исходящий кадр.
+ *
+ * @param plain Открытые данные.
+ * @return QByteArray Зашифрованный кадр.
+ */
+QByteArray SecureChannel::seal(const QByteArray &plain)
+{
+    QByteArray nonce(nonceSize, Qt::Uninitialized);
+    qToBigEndian<quint32>(serverDirection, nonce.data());
+    qToBigEndian<quint64>(++sendCounter, nonce.data() + 4);
+
+    encoder.setup(QCA::Encode, key, QCA::InitializationVector(nonce), QCA::AuthTag(tagSize));
+    QCA::SecureArray cipherText = encoder.update(QCA::MemoryRegion(plain));
+    cipherText.append(encoder.final());
+
+    QByteArray body = nonce + cipherText.toByteArray() + encoder.tag().toByteArray();
+    QByteArray frame(4, Qt::Uninitialized);
+    qToBigEndian<quint32>(quint32(body.size()), frame.data());
+    return frame + body;
+}
+
+/**
+ * @brief Принимает байты из сокета и расшифровывает полностью полученные кадры.
+ *
+ * Неполный кадр остаётся в буфере до следующего вызова.
+ *
+ * @param incoming Принятые байты.
+ * @param frames Расшифрованные кадры.
+ * @return true Если все кадры подлинные.
+ * @return false Если обнаружен подделанный, повторённый или слишком большой кадр.
+ */
+bool SecureChannel::open(const QByteArray &incoming, QList<QByteArray> &frames)
+{
+    if (failed)
+    {
+        return false;
+    }
+    pending.append(incoming);
+
+    int offset = 0;
+    while (pending.size() - offset >= 4)
+    {
+        quint32 length = qFromBigEndian<quint32>(pending.constData() + offset);
+        if (length < quint32(nonceSize + tagSize) || length > maxFrameSize)
+        {
+            failed = true;
+            return false;
+        }
+        if (quint32(pending.size() - offset - 4) < length)
+        {
+            break;
+        }
+
+        const char *body = pending.constData() + offset + 4;
+        quint32 direction = qFromBigEndian<quint32>(body);
+        quint64 counter = qFromBigEndian<quint64>(body + 4);
+        if (direction != clientDirection || counter <= receiveCounter)
+        {
+            failed = true;
+            return false;
+        }
+
+        QByteArray nonce(body, nonceSize);
+        QByteArray cipherText(body + nonceSize, int(length) - nonceSize - tagSize);
+        QByteArray tag(body + length - tagSize, tagSize);
+        decoder.setup(QCA::Decode, key, QCA::InitializationVector(nonce), QCA::AuthTag(tag));
+        QCA::SecureArray plain = decoder.update(QCA::MemoryRegion(cipherText));
+        plain.append(decoder.final());
+        if (!decoder.ok())
+        {
+            failed = true;
+            return false;
+        }
+
+        receiveCounter = counter;
+        frames.append(plain.toByteArray());
+        offset += 4 + int(length);
+    }
+    pending.remove(0, offset);
+    return true;
+}
+
+#else
+
+SecureChannel::SecureChannel(const QByteArray &sessionKey)
+{
+    Q_UNUSED(sessionKey);
+}
+
+QByteArray SecureChannel::seal(const QByteArray &plain)
+{
+    return plain;
+}
+
+bool SecureChannel::open(const QByteArray &incoming, QList<QByteArray> &frames)
+{
+    frames.append(incoming);
+    return true;
+}
+
+#endif
@@ -0,0 +1,75 @@
+/**
+ * /file securechannel.h
+ * /brief Определение класса SecureChannel для симметричного шифрования кадров подключения.
+ */
+
+#ifndef SECURECHANNEL_H
+#define SECURECHANNEL_H
+
+#include <QByteArray>
+#include <QList>
+
+#ifdef SERVER_HAVE_QCA
+#include <QtCrypto>
+#endif
+
+/**
+ * /brief Класс SecureChannel.
+ *
+ * Шифрует и расшифровывает кадры одного подключения алгоритмом AES-256-GCM с сеансовым
+ * ключом, согласованным через RSA. Формат кадра: длина (4 байта, big-endian),
+ * nonce (12 байт: 4 байта направления и 8 байт счётчика кадров), шифртекст и тег (16 байт).
+ * Счётчик входящих кадров должен строго возрастать, что исключает повтор перехваченных кадров.
+ *
+ * Шифры создаются один раз на подключение и перенастраиваются на каждый кадр, поэтому
+ * стоимость шифрования сообщения определяется только объёмом данных.
+ *
+ * Реализация доступна при сборке с библиотекой qca (qmake CONFIG+=secure_sessions);
+ * без неё isAvailable() возвращает false и сервер отклоняет запрос на шифрование.
+ */
+class SecureChannel
+{
+private:
+    QByteArray pending; ///< Принятые, но ещё не собранные в кадр байты.
+    quint64 sendCounter = 0; ///< Счётчик отправленных кадров.
+    quint64 receiveCounter = 0; ///< Счётчик последнего принятого кадра.
+    bool failed = false; ///< Признак ошибки расшифровки (подключение следует закрыть).
+
+#ifdef SERVER_HAVE_QCA
+    QCA::SymmetricKey key; ///< Сеансовый ключ.
+    QCA::Cipher encoder; ///< Шифр для исходящих кадров.
+    QCA::Cipher decoder; ///< Шифр для входящих кадров.
+#endif
+
+public:
+    static const int keySize = 32; ///< Размер сеансового ключа в байтах.
+
+    /**
+     * /brief Проверяет, собран ли сервер с поддержкой шифрования.
+     * /return Признак доступности шифрования.
+     */
+    static bool isAvailable();
+
+    /**
+     * /brief Конструктор канала с сеансовым ключом.
+     * /param sessionKey Сеансовый ключ длиной keySize байт.
+     */
+    explicit SecureChannel(const QByteArray &sessionKey);
+
+    /**
+     * /brief Шифрует исходящий кадр.
+     * /param plain Открытые данные.
+     * /return Зашифрованный кадр для записи в сокет.
+     */
+    QByteArray seal(const QByteArray &plain);
+
+    /**
+     * /brief Принимает байты из сокета и расшифровывает все полностью полученные кадры.
+     * /param incoming Принятые байты.
+     * /param frames Расшифрованные кадры.
+     * /return Признак успешной расшифровки (false, если кадр подделан или повторён).
+     */
+    bool open(const QByteArray &incoming, QList<QByteArray> &frames);
+};
+
+#endif // SECURECHANNEL_H
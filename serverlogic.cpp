@@ -1,18 +1,28 @@
 #include "serverlogic.h"
-#include <qrsaencryption.h>
+#include "wireprotocol.h"
+#include "servermetrics.h"
 #include <QSqlQuery>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonParseError>
 #include <QCryptographicHash>
-#include <QRegularExpression>
 #include <QJsonArray>
 #include <QCryptographicHash>
 #include <QSslSocket>
 #include <QSsl>
 #include <QSslError>
+#include <QSettings>
+#include <QThread>
+#include <QCoreApplication>
+#include <QSysInfo>
+#include <QElapsedTimer>
 #include <string>
 
+namespace
+{
+const char *authBusyMessage = "Too many authentication requests. Try again later."; ///< Ответ при переполнении пула проверки паролей.
+}
+
 /**
  * @brief Конструктор класса ServerLogic.
  *
@@ -22,977 +32,2098 @@
  * @param parent Указатель на родительский объект (по умолчанию nullptr).
  */
 
-ServerLogic::ServerLogic(QObject *parent) : QTcpServer(parent)
+ServerLogic::ServerLogic(QObject *parent) : ServerLogic(QDir::homePath() + "/MESDB.db", parent)
+{
+}
+
+/**
+ * @brief Конструктор класса ServerLogic с указанием файла базы данных.
+ *
+ * Используется инструментами тестирования производительности, которым нужна
+ * отдельная заполненная синтетическими данными база.
+ *
+ * @param databasePath Путь к файлу базы данных SQLite.
+ * @param parent Указатель на родительский объект (по умолчанию nullptr).
+ */
+ServerLogic::ServerLogic(const QString &databasePath, QObject *parent) : QTcpServer(parent)
 {
     connect(this, &ServerLogic::newConnection, this, &ServerLogic::onNewConnection);
+    registerRoutes();
     database = QSqlDatabase::addDatabase("QSQLITE");
-    database.setDatabaseName(QDir::homePath() + "/MESDB.db");
+    database.setDatabaseName(databasePath);
     if (!database.open())
     {
         qCritical() << "Could not connect to database:" << database.lastError().text();
         exit(1);
     }
     Logger::getInstance()->logToFile("Server is running");
+
+    QSettings settings(QDir::homePath() + "/appsettings.ini", QSettings::IniFormat);
+    payloadCompressor.configure(settings.value("Compression/threshold", 1024).toInt(),
+                                settings.value("Compression/level", 6).toInt(),
+                                settings.value("Compression/threads", qMax(1, QThread::idealThreadCount() / 2)).toInt());
+
+    outboundQueue.configure(settings.value("Outbound/highWatermark", 256 * 1024).toLongLong(),
+                            settings.value("Outbound/lowWatermark", 64 * 1024).toLongLong(),
+                            settings.value("Outbound/hardLimit", 8 * 1024 * 1024).toLongLong());
+    connect(&payloadCompressor, &PayloadCompressor::frameReady, this, &ServerLogic::transmit);
+    connect(&outboundQueue, &OutboundQueue::collapsedPushesReady, this, [this](QTcpSocket *socket, const QList<QJsonObject> &pushes)
+            {
+                for (const QJsonObject &push : pushes)
+                {
+                    deliverPush(socket, push);
+                }
+            });
+    connect(&outboundQueue, &OutboundQueue::readingResumed, this, [](QTcpSocket *socket)
+            {
+                //Запросы, пришедшие во время паузы, уже лежат в буфере сокета
+                if (socket->bytesAvailable() > 0)
+                {
+                    emit socket->readyRead();
+                }
+            });
+
+    sessions.configure(settings.value("Sessions/heartbeatIntervalSec", 30).toLongLong() * 1000,
+                       settings.value("Sessions/idleTimeoutSec", 90).toLongLong() * 1000,
+                       settings.value("Sessions/loginTimeoutSec", 30).toLongLong() * 1000);
+    connect(&sessions, &SessionRegistry::heartbeatDue, this, [this](ClientSession *session)
+            {
+                static const ConstantResponse response(QJsonObject{{"type", "ping"}});
+                sendResponse(session->socket, response);
+            });
+
+    loadSessionTokenKey(settings);
+    configureRateLimits(settings);
+    credentialPool.configure(settings.value("Auth/threads", 2).toInt(),
+                             settings.value("Auth/maxPerAddress", 4).toInt(),
+                             settings.value("Auth/maxQueued", 256).toInt(),
+                             settings.value("Auth/pbkdf2Iterations", 100000).toInt());
+    sqliteRepository.open(database);
+    //Таблица отзывов читается после подготовки схемы user_auth
+    sessionTokens.setRepository(repository);
+    deliveryQueue.open(database, settings.value("PendingDelivery/maxChatsPerUser", 200).toInt());
+    messageSequencer.open(repository, settings.value("Messages/dedupWindow", 10000).toInt());
+    if (settings.value("History/segmentLog", false).toBool())
+    {
+        messageLog.open(database, settings.value("History/segmentDir", QDir::homePath() + "/MESDB.segments").toString());
+    }
+    historyCache.configure(settings.value("History/cacheBytes", 32 * 1024 * 1024).toInt(),
+                           settings.value("History/cacheMessagesPerChat", 200).toInt());
+    presenceHub.configure(&sessions, repository,
+                          settings.value("Presence/tickMs", 500).toInt(),
+                          settings.value("Presence/typingIntervalMs", 3000).toLongLong());
+    connect(&presenceHub, &PresenceHub::frameReady, this, &ServerLogic::deliverPush);
+
+    sessions.configureAcks(settings.value("Delivery/ackTimeoutSec", 10).toLongLong() * 1000,
+                           settings.value("Delivery/maxAttempts", 3).toInt());
+    requestArena.configure(settings.value("Server/requestArenaBytes", 16 * 1024).toInt());
+    sessions.configureBuffers(settings.value("Server/connectionBufferBytes", 4096).toInt(),
+                              settings.value("Server/connectionBufferLimitBytes", 64 * 1024).toInt());
+    connect(&sessions, &SessionRegistry::redeliveryDue, this, [this](ClientSession *session, int chatId, const QJsonObject &push)
+            {
+                sendPush(session->socket, push, "chat_update:" + QString::number(chatId));
+            });
+    connect(&sessions, &SessionRegistry::deliveryAbandoned, this, [this](ClientSession *session, int chatId, int messageId)
+            {
+                //Клиент не подтвердил уведомление: сообщение будет выдано при следующем входе
+                if (session->userId >= 0)
+                {
+                    deliveryQueue.enqueue(session->userId, chatId, messageId);
+                }
+            });
+
+    connect(&metricsTimer, &QTimer::timeout, this, [this]()
+            {
+                requestArena.publishMetrics();
+                sessions.publishBufferMetrics();
+                Logger::getInstance()->logToFile("Metrics: " + ServerMetrics::getInstance()->summary());
+            });
+    metricsTimer.start(60000);
 }
 /**
  * @brief Обрабатывает новое соединение от клиента.
- *
- * Устанавливает связь с сокетом клиента и обрабатывает входящие
- * данные, проверяя тип запроса (регистрация, вход, обновление данных и др.).
  */
 void ServerLogic::onNewConnection()
 {
-    QTcpSocket *clientSocket = this->nextPendingConnection();
+    adoptConnection(this->nextPendingConnection());
+}
+
+/**
+ * @brief Начинает обслуживание подключения клиента.
+ *
+ * Устанавливает связь с сокетом клиента и обрабатывает входящие данные. Используется
+ * как для открытых подключений, так и для подключений TLS после рукопожатия.
+ *
+ * @param clientSocket Указатель на сокет клиента.
+ */
+void ServerLogic::adoptConnection(QTcpSocket *clientSocket)
+{
     qintptr socketId = clientSocket->socketDescriptor();
+    quint32 connectionId = nextConnectionId++;
     QString logMessage = QString("New connection. Client socket descriptor: %1").arg(socketId);
     Logger::getInstance()->logToFile(logMessage);
-    connect(clientSocket, &QTcpSocket::readyRead, this, [this, clientSocket]()
+    sessions.add(clientSocket, connectionId);
+    connect(clientSocket, &QTcpSocket::disconnected, this, [this, clientSocket, connectionId]()
             {
-                //Прием данных от клиента
-                QByteArray jsonData = clientSocket->readAll();
-                QJsonParseError parseError;
-                QJsonDocument document = QJsonDocument::fromJson(jsonData, &parseError);
-
-                if (parseError.error != QJsonParseError::NoError)
+                //Освобождение всех ресурсов подключения, сам сокет удаляется через deleteLater
+                Logger::getInstance()->logToFile(QString("Connection %1 closed").arg(connectionId));
+                trafficRecorder.recordClose(connectionId);
+                payloadCompressor.remove(clientSocket);
+                outboundQueue.remove(clientSocket);
+                sessions.remove(clientSocket);
+            });
+    connect(clientSocket, &QTcpSocket::readyRead, this, [this, clientSocket, connectionId]()
+            {
+                //Клиент, не читающий ответы, не может наращивать их буфер новыми запросами
+                if (outboundQueue.pauseReadingIfBacklogged(clientSocket))
                 {
-                    clientSocket->write("{\"status\":\"error\",\"message\":\"Invalid JSON format\"}");
                     return;
                 }
-
-                QJsonObject json = document.object();
-                qDebug() << "Received JSON:" << json;
-
-                //Обработка запроса на регистрацию
-                if (json.contains("type") && json["type"].toString() == "register" &&
-                    json.contains("login") && json.contains("password"))
-                {
-                    QString login = json["login"].toString();
-                    QString hashedPassword = json["password"].toString();
-
-                    //Проверка допустимости логина
-                    if (loginAvailable(login) && loginContainsOnlyAllowedCharacters(login))
-                    {
-
-                        //Добавление пользователя в базу данных
-                        QSqlQuery query(database);
-                        query.prepare("INSERT INTO user_auth (login, password, nickname) "
-                                      "VALUES (:login, :password, :nickname)");
-                        query.bindValue(":login", login);
-                        query.bindValue(":password", hashedPassword); // Сохраняем полученный от клиента хеш пароля
-                        query.bindValue(":nickname", "New user"); // Используем логин в качестве никнейма
-                        if (!query.exec())
-                        {
-                            //Ошибка при добавлении пользователя в БД
-                            clientSocket->write("{\"status\":\"error\",\"message\":\"Failed to register user\"}");
-                        }
-                        else
-                        {
-                            //Пользователь успешно добавлен в БД
-                            clientSocket->write("{\"status\":\"success\",\"message\":\"User registered successfully\"}");
-                            Logger::getInstance()->logToFile(QString("User '%1' was successfully registered.").arg(login));
-                        }
-                    }
-                    else
-                    {
-                        //Информировать клиента о недопустимости логина
-                        clientSocket->write("{\"status\":\"error\",\"message\":\"Login validation failed\"}");
-                    }
-                }
-                else if(json.contains("type") && json["type"].toString() == "register")
+                //Прием данных от клиента в буфер подключения, память которого переиспользуется между запросами
+                ClientSession *session = sessions.find(clientSocket);
+                QByteArray jsonData = session ? sessions.receive(session) : clientSocket->readAll();
+                trafficRecorder.recordFrame(connectionId, jsonData);
+                if (!session)
                 {
-                    clientSocket->write("{\"status\":\"error\",\"message\":\"Missing required fields\"}");
+                    return;
                 }
-
-                else if (json.contains("type") && json["type"].toString() == "login" &&
-                         json.contains("login") && json.contains("password"))
+                sessions.touch(session);
+                if (!session->channel)
                 {
-                    QString login = json["login"].toString();
-                    QString hashedPassword = json["password"].toString();
-
-                    qDebug()<< login;
-                    qDebug() << hashedPassword;
-
-                    QSqlQuery query(database);
-                    query.prepare("SELECT password FROM user_auth WHERE login = :login");
-                    query.bindValue(":login", login);
-                    query.exec();
-
-                    if (query.next())
-                    {
-                        QString storedPassword = query.value(0).toString();
-                        if(storedPassword == hashedPassword)
-                        {
-                            //Пароли совпадают, успешный вход
-                            clientSocket->write("{\"status\":\"success\",\"message\":\"Logged in successfully\"}");
-                            Logger::getInstance()->logToFile(QString("User '%1' logged in successfully.").arg(login));
-                            QSqlQuery userIdQuery(database);
-                            userIdQuery.prepare("SELECT user_id FROM user_auth WHERE login = :login");
-                            userIdQuery.bindValue(":login", login);
-                            if (userIdQuery.exec() && userIdQuery.next())
-                            {
-                                int userId = userIdQuery.value("user_id").toInt();
-                                userSockets.insert(userId, clientSocket);
-                                qDebug() << "user_id = " << userId;
-                                Logger::getInstance()->logToFile(QString("User '%1' with ID '%2' added to userSockets.").arg(login).arg(userId));
-                            }
-                        }
-                        else
-                        {
-                            //Пароли не совпадают
-                            clientSocket->write("{\"status\":\"error\",\"message\":\"Login failed. Incorrect password.\"}");
-                        }
-                    }
-                    else if(json.contains("type") && json["type"].toString() == "login") //???
-                    {
-                        //Логин не найден в базе данных
-                        clientSocket->write("{\"status\":\"error\",\"message\":\"Login failed. User not found.\"}");
-                    }
+                    processRequest(clientSocket, jsonData);
                 }
-                else if (json.contains("type") && json["type"].toString() == "check_nickname" && json.contains("login"))
+                else
                 {
-                    QString login = json["login"].toString();
-                    QSqlQuery query(database);
-                    query.prepare("SELECT nickname FROM user_auth WHERE login = :login");
-                    query.bindValue(":login", login);
-                    if(query.exec() && query.next())
+                    //Зашифрованная сессия: за одно чтение может прийти несколько кадров или часть кадра
+                    QList<QByteArray> frames;
+                    if (!session->channel->open(jsonData, frames))
                     {
-                        QString nickname = query.value(0).toString();
-                        QJsonObject response;
-                        response["type"] = "check_nickname";
-                        response["status"] = "success";
-                        response["nickname"] = nickname;
-                        qDebug() << nickname << "\n";
-                        //Отправить найденный никнейм обратно клиенту
-                        qDebug() << QJsonDocument(response).toJson(QJsonDocument::Compact);
-                        clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
-                        clientSocket->flush();
-                    }
-                }
-                else if (json.contains("type") && json["type"].toString() == "update_nickname" &&
-                         json.contains("login") && json.contains("nickname"))
-                {
-                    QString login = json["login"].toString();
-                    QString nickname = json["nickname"].toString();
-
-                    //Проверка никнейма на допустимость
-                    if (!nickname.isEmpty() && nickname != "New user") {
-                        QSqlQuery query(database);
-                        query.prepare("UPDATE user_auth SET nickname = :nickname WHERE login = :login");
-                        query.bindValue(":nickname", nickname);
-                        query.bindValue(":login", login);
-                        if (!query.exec())
-                        {
-                            QJsonObject response;
-                            response["type"] = "update_nickname";
-                            response["status"] = "error";
-                            response["message"] = "Не удалось обновить имя.";
-                            clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
-                        }
-                        else
-                        {
-                            QJsonObject response;
-                            response["type"] = "update_nickname";
-                            response["status"] = "success";
-                            response["message"] = "Nickname has been changed.";
-                            QString logMessage = QString("User with login '%1' has changed their name to '%2'").arg(login, nickname);
-                            Logger::getInstance()->logToFile(logMessage);
-                            clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
-                        }
+                        Logger::getInstance()->logToFile(QString("Connection %1 sent an invalid encrypted frame, disconnecting").arg(connectionId));
+                        ServerMetrics::getInstance()->add("crypto.invalid_frames");
+                        clientSocket->abort();
+                        return;
                     }
-                    else
+                    for (const QByteArray &frame : qAsConst(frames))
                     {
-                        QJsonObject response;
-                        response["type"] = "update_nickname";
-                        response["status"] = "error";
-                        response["message"] = "Недопустимое имя.";
-                        clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
+                        processRequest(clientSocket, frame);
                     }
-                    clientSocket->flush();
                 }
-                else if (json.contains("type") && json["type"].toString() == "find_users" && json.contains("searchText") && json.contains("login"))
+
+                //Сессия могла закрыться во время обработки запроса
+                session = sessions.find(clientSocket);
+                if (session)
                 {
-                    handleFindUsers(clientSocket, json);
+                    sessions.trimBuffers(session);
                 }
-                else if (json.contains("type") && json["type"].toString() == "update_login" &&
-                         json.contains("old_login") && json.contains("new_login") && json.contains("password"))
-                {
-                    QString oldLogin = json["old_login"].toString();
-                    QString newLogin = json["new_login"].toString();
-                    QString clientPassword = json["password"].toString();
+            });
 
-                    //Проверка допустимости логина и нового логина
-                    if (!loginAvailable(newLogin) || !loginContainsOnlyAllowedCharacters(newLogin))
-                    {
-                        clientSocket->write("{\"type\":\"update_login\", \"status\":\"error\",\"message\":\"Invalid or duplicate new login.\"}");
-                        clientSocket->flush();
-                        return;
-                    }
+    //Данные, пришедшие во время рукопожатия TLS, уже лежат в буфере сокета
+    if (clientSocket->bytesAvailable() > 0)
+    {
+        emit clientSocket->readyRead();
+    }
+}
 
-                    QSqlQuery query(database);
-
-                    //Проверяем существование старого логина и его пароля
-                    query.prepare("SELECT password FROM user_auth WHERE login = :oldLogin");
-                    query.bindValue(":oldLogin", oldLogin);
-                    if (query.exec() && query.next()) {
-                        QString dbHashedPassword = query.value(0).toString();
-
-                        //Если пароли совпадают
-                        if (getSha512Hash(clientPassword, oldLogin) == dbHashedPassword) {
-                            //Зашифровываем пароль с использованием нового логина как соли
-                            QString newHashedPassword = getSha512Hash(clientPassword, newLogin);
-
-                            //Обновляем данные пользователя в БД
-                            query.prepare("UPDATE user_auth SET login = :newLogin, password = :newHashedPassword WHERE login = :oldLogin");
-                            query.bindValue(":newLogin", newLogin);
-                            query.bindValue(":newHashedPassword", newHashedPassword);
-                            query.bindValue(":oldLogin", oldLogin);
-
-                            if (query.exec())
-                            {
-                                clientSocket->write("{\"type\":\"update_login\", \"status\":\"success\",\"message\":\"Login and password updated successfully.\"}");
-                            }
-                            else
-                            {
-                                clientSocket->write("{\"type\":\"update_login\", \"status\":\"error\",\"message\":\"Could not update login and password in the database.\"}");
-                            }
-                        }
-                        else
-                        {
-                            clientSocket->write("{\"type\":\"update_login\", \"status\":\"error\",\"message\":\"Incorrect old password.\"}");
-                        }
-                    }
-                    else
-                    {
-                        clientSocket->write("{\"type\":\"update_login\", \"status\":\"error\",\"message\":\"Old login not found.\"}");
-                    }
-                    clientSocket->flush();
-                }
-                else if (json.contains("type") && json["type"].toString() == "update_password" &&
-                         json.contains("login") && json.contains("current_password") && json.contains("new_password"))
-                {
-                    QString login = json["login"].toString();
-                    QString currentPassword = json["current_password"].toString(); //Предполагается, что пароль хэшируется на клиенте
-                    QString newPassword = json["new_password"].toString(); //Предполагается, что пароль хэшируется на клиенте
-
-                    QSqlQuery query(database);
-                    query.prepare("SELECT password FROM user_auth WHERE login = :login");
-                    query.bindValue(":login", login);
-                    if (query.exec() && query.next()) {
-                        QString storedPassword = query.value(0).toString();
-
-                        if (storedPassword == currentPassword)
-                        {
-
-                            query.prepare("UPDATE user_auth SET password = :newPassword WHERE login = :login");
-                            query.bindValue(":newPassword", newPassword);
-                            query.bindValue(":login", login);
-
-                            if (query.exec())
-                            {
-                                clientSocket->write("{\"type\":\"update_password\", \"status\":\"success\",\"message\":\"Password updated successfully.\"}");
-                            }
-                            else
-                            {
-                                clientSocket->write("{\"type\":\"update_password\", \"status\":\"error\",\"message\":\"Could not update password.\"}");
-                            }
-                        }
-                        else
-                        {
-                            clientSocket->write("{\"type\":\"update_password\", \"status\":\"error\",\"message\":\"Incorrect current password.\"}");
-                        }
-                    }
-                    else
-                    {
-                        clientSocket->write("{\"type\":\"update_password\", \"status\":\"error\",\"message\":\"Login not found.\"}");
-                    }
-                    clientSocket->flush();
-                }
-                else if (json.contains("type") && json["type"].toString() == "create_chat" && json.contains("user1") && json.contains("user2"))
-                {
-                    handleCreateChat(clientSocket, json);
-                }
-                else if (json.contains("type") && json["type"].toString() == "get_chat_list" && json.contains("login"))
-                {
-                    handleGetChatList(clientSocket, json);
-                }
-                else if (json.contains("type")&& json["type"].toString() == "get_chat_history" && json.contains("chat_id"))
-                {
-                    handleGetChatHistory(clientSocket, json);
-                }
-                else if (json.contains("type")&& json["type"].toString() == "send_message" && json.contains("chat_id") &&
-                        json.contains("user_id") && json.contains("message_text"))
-                {
-                    handleSendMessage(clientSocket, json);
-                }
-                else if (json.contains("type")&& json["type"].toString() == "get_or_create_chat")
-                {
-                    handleGetOrCreateChat(clientSocket, json);
-                }
-                else if (json.contains("type") && json["type"].toString() == "delete_chat" && json.contains("chat_id"))
-                {
-                    handleDeleteChat(clientSocket, json);
-                }
-                else if (json.contains("type") && json["type"].toString() == "check_chat_exists" && json.contains("chat_name"))
-                {
-                    QString chatName = json["chat_name"].toString();
-                    QSqlQuery query(database);
-
-                    // Проверяем, существует ли уже такой чат
-                    query.prepare("SELECT chat_id FROM chats WHERE chat_name = :chatName");
-                    query.bindValue(":chatName", chatName);
-                    if (query.exec() && query.next()) {
-                        // Чат существует
-                        QJsonObject response;
-                        response["type"] = "check_chat_exists";
-                        response["status"] = "error";
-                        response["message"] = "Chat name already exists.";
-                        clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
-                        clientSocket->flush();
-                    } else {
-                        // Чат не существует, создаем новый чат
-                        query.prepare("INSERT INTO chats (chat_name, chat_type) VALUES (:chatName, 'group')");
-                        query.bindValue(":chatName", chatName);
-
-                        if (query.exec()) {
-                            // Успешно создан новый чат, возвращаем ID нового чата
-                            int chatId = query.lastInsertId().toInt();
-                            QJsonObject response;
-                            response["type"] = "check_chat_exists";
-                            response["status"] = "success";
-                            response["chat_id"] = chatId; // Отправляем ID новой группы
-                            clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
-
-                            // Добавляем пользователя в только что созданный чат
-                            QString login = json["login"].toString(); // Получаем логин пользователя из запроса
-                            query.prepare("INSERT INTO chat_participants (chat_id, user_id) "
-                                          "SELECT :chatId, user_id FROM user_auth WHERE login = :login");
-                            query.bindValue(":chatId", chatId);
-                            query.bindValue(":login", login);
-
-                            if (!query.exec()) {
-                                // Ошибка при добавлении пользователя в чат
-                                QJsonObject errorResponse;
-                                errorResponse["type"] = "get_or_create_chat";
-                                errorResponse["status"] = "error";
-                                errorResponse["message"] = "Failed to add user to chat.";
-                                qCritical() << "Failed to add user to chat:" << query.lastError().text();
-                                clientSocket->write(QJsonDocument(errorResponse).toJson(QJsonDocument::Compact));
-                                clientSocket->flush();
-                            }
-                        } else {
-                            // Ошибка при создании чата
-                            QJsonObject response;
-                            response["type"] = "check_chat_exists";
-                            response["status"] = "error";
-                            response["message"] = "Failed to create chat.";
-                            clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
-                        }
-                        clientSocket->flush();
-                    }
-                }
+/**
+ * @brief Заполняет таблицу обработчиков запросов.
+ *
+ * Каждый тип запроса связан со структурой запроса, схема которой задаёт обязательные
+ * и необязательные поля. pong обрабатывать не нужно: активность подключения уже
+ * отмечена при чтении кадра.
+ */
+void ServerLogic::registerRoutes()
+{
+    //Согласование кодировки, зашифрованной сессии и восстановление сессии по токену
+    route("hello", &ServerLogic::handleHello);
+    route("secure_hello", &ServerLogic::handleSecureHello);
+    route("secure_key", &ServerLogic::handleSecureKey);
+    route("resume", &ServerLogic::handleResume);
+    route("ping", &ServerLogic::handlePing);
+    route("typing", &ServerLogic::handleTyping);
+    route("ack", &ServerLogic::handleAck);
+    route("ack_pending", &ServerLogic::handleAckPending);
+    //Учётные записи
+    route("register", &ServerLogic::handleRegister);
+    route("login", &ServerLogic::handleLogin);
+    route("check_nickname", &ServerLogic::handleCheckNickname);
+    route("update_nickname", &ServerLogic::handleUpdateNickname);
+    route("find_users", &ServerLogic::handleFindUsers);
+    route("update_login", &ServerLogic::handleUpdateLogin);
+    route("update_password", &ServerLogic::handleUpdatePassword);
+    //Чаты и сообщения
+    route("create_chat", &ServerLogic::handleCreateChat);
+    route("get_chat_list", &ServerLogic::handleGetChatList);
+    route("get_chat_history", &ServerLogic::handleGetChatHistory);
+    route("send_message", &ServerLogic::handleSendMessage);
+    route("get_or_create_chat", &ServerLogic::handleGetOrCreateChat);
+    route("delete_chat", &ServerLogic::handleDeleteChat);
+    route("check_chat_exists", &ServerLogic::handleCheckChatExists);
+}
+
+/**
+ * @brief Отправляет ответ о запросе, не прошедшем проверку по схеме.
+ *
+ * Ответ одинаков для всех типов запросов: в поле field указывается ключ первого
+ * отсутствующего или ошибочного поля.
+ *
+ * @param clientSocket Указатель на сокет клиента.
+ * @param type Тип запроса.
+ * @param error Ошибка разбора.
+ */
+void ServerLogic::sendRequestError(QTcpSocket *clientSocket, const QString &type, const RequestError &error)
+{
+    ResponseWriter response(responseBuffer(clientSocket), encodingOf(clientSocket), 4);
+    response.field("field", QString::fromLatin1(error.field));
+    if (error.reason == RequestError::Missing)
+    {
+        response.field("message", "Missing required fields");
+    }
+    else
+    {
+        response.field("message", "Invalid field value");
+    }
+    response.field("status", "error").field("type", type);
+    sendEncodedResponse(clientSocket, response.finish());
+}
+
+/**
+ * @brief Разбирает и выполняет один запрос клиента.
+ *
+ * Запрос JSON обычного вида разбирается JsonEnvelope одним проходом по принятому буферу,
+ * без построения QJsonDocument. Запросы в CBOR, с вложенными значениями и ошибочные
+ * разбираются через WireProtocol::decode(). Тип запроса извлекается один раз и по нему
+ * выбирается обработчик из таблицы; запросы неизвестных типов игнорируются.
+ *
+ * @param clientSocket Указатель на сокет клиента.
+ * @param jsonData Закодированный запрос.
+ */
+void ServerLogic::processRequest(QTcpSocket *clientSocket, const QByteArray &jsonData)
+{
+    //Черновая память разбора и обработчиков освобождается одной операцией после запроса
+    RequestArena::Scope arenaScope(requestArena);
+    JsonEnvelope envelope(&requestArena);
+    QJsonObject json;
+    QString type;
+    bool scanned = envelope.scan(jsonData);
+    if (scanned)
+    {
+        type = envelope.type();
+    }
+    else
+    {
+        if (!WireProtocol::decode(jsonData, json))
+        {
+            static const ConstantResponse response(QJsonObject{{"status", "error"}, {"message", "Invalid JSON format"}});
+            sendResponse(clientSocket, response);
+            return;
+        }
+        type = json.value(QLatin1String("type")).toString();
+    }
+
+    //Запрос целиком не выводится: для send_message это копия всего текста сообщения
+    qDebug() << "Received request:" << type << jsonData.size() << "bytes";
+
+    //Неизвестные типы не обрабатываются и не учитываются лимитом: тип задаёт клиент,
+    //и каждый новый тип создавал бы новый ключ метрик
+    QHash<QString, RequestRoute>::const_iterator handler = requestRoutes.constFind(type);
+    if (handler == requestRoutes.constEnd())
+    {
+        return;
+    }
+
+    //Ограничение частоты запросов: стоимость зависит от типа запроса
+    ClientSession *session = sessions.find(clientSocket);
+    if (session)
+    {
+        qint64 retryAfterMs = rateLimiter.admit(session->rateBucket, session->userId, type);
+        if (retryAfterMs > 0)
+        {
+            ResponseWriter response(responseBuffer(clientSocket), encodingOf(clientSocket), 4);
+            response.field("message", "Rate limit exceeded").field("retry_after_ms", retryAfterMs)
+                    .field("status", "error").field("type", type);
+            sendEncodedResponse(clientSocket, response.finish());
+            return;
+        }
+    }
+
+    handler.value()(clientSocket, scanned ? &envelope : nullptr, json);
+}
+
+/**
+ * @brief Отвечает на ping клиента.
+ *
+ * @param clientSocket Указатель на сокет клиента.
+ * @param request Запрос (без полей).
+ */
+void ServerLogic::handlePing(QTcpSocket *clientSocket, const EmptyRequest &)
+{
+    static const ConstantResponse response(QJsonObject{{"type", "pong"}});
+    sendResponse(clientSocket, response);
+}
+
+/**
+ * @brief Пересылает индикатор набора текста участникам чата в сети без записи в базу данных.
+ *
+ * @param clientSocket Указатель на сокет клиента.
+ * @param request Запрос.
+ */
+void ServerLogic::handleTyping(QTcpSocket *clientSocket, const TypingRequest &request)
+{
+    ClientSession *session = sessions.find(clientSocket);
+    if (session && session->userId >= 0)
+    {
+        presenceHub.publishTyping(session->userId, request.chatId, request.typing);
+    }
+}
+
+/**
+ * @brief Принимает подтверждение получения уведомлений чата до номера seq включительно.
+ *
+ * @param clientSocket Указатель на сокет клиента.
+ * @param request Запрос.
+ */
+void ServerLogic::handleAck(QTcpSocket *clientSocket, const AckRequest &request)
+{
+    ClientSession *session = sessions.find(clientSocket);
+    if (session)
+    {
+        sessions.acknowledge(session, request.chatId, request.seq);
+    }
+}
+
+/**
+ * @brief Принимает подтверждение получения кадра pending_updates.
+ *
+ * Только после него из очереди удаляются выданные клиенту записи.
+ *
+ * @param clientSocket Указатель на сокет клиента.
+ * @param request Запрос (без полей).
+ */
+void ServerLogic::handleAckPending(QTcpSocket *clientSocket, const EmptyRequest &)
+{
+    ClientSession *session = sessions.find(clientSocket);
+    if (session && session->userId >= 0 && !session->pendingUpdates.isEmpty())
+    {
+        deliveryQueue.acknowledge(session->userId, session->pendingUpdates);
+        session->pendingUpdates = QJsonObject();
+    }
+}
+
+/**
+ * @brief Обрабатывает запрос check_nickname: отправляет клиенту отображаемое имя пользователя.
+ *
+ * @param clientSocket Указатель на сокет клиента.
+ * @param request Запрос.
+ */
+void ServerLogic::handleCheckNickname(QTcpSocket *clientSocket, const LoginRequest &request)
+{
+    ChatRepository::UserRecord user;
+    if (repository->findUser(request.login, user))
+    {
+        QString nickname = user.nickname;
+        qDebug() << nickname << "\n";
+        //Отправить найденный никнейм обратно клиенту
+        ResponseWriter response(responseBuffer(clientSocket), encodingOf(clientSocket), 3);
+        response.field("nickname", nickname).field("status", "success").field("type", "check_nickname");
+        sendEncodedResponse(clientSocket, response.finish());
+    }
+}
+
+/**
+ * @brief Обрабатывает запрос на смену отображаемого имени.
+ *
+ * @param clientSocket Указатель на сокет клиента.
+ * @param request Запрос.
+ */
+void ServerLogic::handleUpdateNickname(QTcpSocket *clientSocket, const UpdateNicknameRequest &request)
+{
+    const QString &login = request.login;
+    const QString &nickname = request.nickname;
+
+    //Проверка никнейма на допустимость
+    if (!nickname.isEmpty() && nickname != "New user") {
+        if (!repository->updateNickname(login, nickname))
+        {
+            static const ConstantResponse response(QJsonObject{{"type", "update_nickname"}, {"status", "error"}, {"message", "Не удалось обновить имя."}});
+            sendResponse(clientSocket, response);
+        }
+        else
+        {
+            static const ConstantResponse response(QJsonObject{{"type", "update_nickname"}, {"status", "success"}, {"message", "Nickname has been changed."}});
+            QString logMessage = QString("User with login '%1' has changed their name to '%2'").arg(login, nickname);
+            Logger::getInstance()->logToFile(logMessage);
+            sendResponse(clientSocket, response);
+        }
+    }
+    else
+    {
+        static const ConstantResponse response(QJsonObject{{"type", "update_nickname"}, {"status", "error"}, {"message", "Недопустимое имя."}});
+        sendResponse(clientSocket, response);
+    }
+}
+
+/**
+ * @brief Обрабатывает запрос check_chat_exists: создаёт групповой чат, если название свободно.
+ *
+ * @param clientSocket Указатель на сокет клиента.
+ * @param request Запрос.
+ */
+void ServerLogic::handleCheckChatExists(QTcpSocket *clientSocket, const CheckChatExistsRequest &request)
+{
+    // Проверяем, существует ли уже такой чат
+    if (repository->chatIdByName({request.chatName}) >= 0) {
+        // Чат существует
+        static const ConstantResponse response(QJsonObject{{"type", "check_chat_exists"}, {"status", "error"}, {"message", "Chat name already exists."}});
+        sendResponse(clientSocket, response);
+    } else {
+        // Чат не существует, создаем новый чат
+        int chatId = repository->createChat(request.chatName, "group");
+        if (chatId >= 0) {
+            // Успешно создан новый чат, возвращаем ID нового чата
+            ResponseWriter response(responseBuffer(clientSocket), encodingOf(clientSocket), 3);
+            response.field("chat_id", chatId) // Отправляем ID новой группы
+                    .field("status", "success").field("type", "check_chat_exists");
+            sendEncodedResponse(clientSocket, response.finish());
+
+            // Добавляем пользователя в только что созданный чат
+            if (repository->addParticipants(chatId, {request.login})) {
+                presenceHub.reloadChat(chatId);
+                messageBus.publishChatChanged(chatId);
+            } else {
+                // Ошибка при добавлении пользователя в чат
+                static const ConstantResponse errorResponse(QJsonObject{{"type", "get_or_create_chat"}, {"status", "error"}, {"message", "Failed to add user to chat."}});
+                qCritical() << "Failed to add user to chat:" << repository->lastError();
+                sendResponse(clientSocket, errorResponse);
+            }
+        } else {
+            // Ошибка при создании чата
+            static const ConstantResponse response(QJsonObject{{"type", "check_chat_exists"}, {"status", "error"}, {"message", "Failed to create chat."}});
+            sendResponse(clientSocket, response);
+        }
+    }
+}
+
+
+/**
+ * @brief Запускает сервер на определенном порте.
+ *
+ * При Server/reusePort=true (только Unix) порт открывается с SO_REUSEPORT: сервер слушает
+ * собственный сокет, а Server/acceptorThreads дополнительных потоков — свои сокеты на том же
+ * порту. Ядро распределяет подключения между сокетами, в том числе между процессами
+ * сервера, запущенными на одном порту.
+ *
+ * При Server/hotRestart=true (только Unix) сервер сначала подключается к Unix-сокету
+ * передачи (Server/handoffPath) и, если на порту уже работает прежний процесс, получает
+ * от него слушающие сокеты и подключения клиентов; затем сам ожидает следующего преемника.
+ * Поэтому новая версия запускается поверх работающей, а прежняя завершается сама.
+ *
+ * @param port Порт, на котором будет запущен сервер.
+ */
+void ServerLogic::startServer(int port)
+{
+    QSettings settings(QDir::homePath() + "/appsettings.ini", QSettings::IniFormat);
+    bool listening = false;
+    bool reusePort = settings.value("Server/reusePort", false).toBool() && ReusePortListener::isSupported();
+    int backlog = settings.value("Server/listenBacklog", 1024).toInt();
+    if (settings.value("Server/hotRestart", false).toBool() && HotRestart::isSupported())
+    {
+        handoffPath = settings.value("Server/handoffPath",
+                                     QDir::temp().filePath(QString("servermessenger-%1.handoff").arg(port))).toString();
+        listening = takeOverFrom(handoffPath);
+    }
+
+    if (!listening && reusePort)
+    {
+        qintptr descriptor = ReusePortListener::openSocket(quint16(port), backlog);
+        listening = descriptor >= 0 && this->setSocketDescriptor(descriptor);
+    }
+    else if (!listening)
+    {
+        listening = this->listen(QHostAddress::Any, port);
+    }
+
+    if (listening && reusePort)
+    {
+        int acceptorThreads = reusePortListener.listen(quint16(port), settings.value("Server/acceptorThreads", 0).toInt(), backlog);
+        connect(&reusePortListener, &ReusePortListener::connectionReady, this, &ServerLogic::adoptConnection, Qt::UniqueConnection);
+        Logger::getInstance()->logToFile(QString("Listening with SO_REUSEPORT on port %1 (%2 extra acceptor threads)")
+                                             .arg(port).arg(acceptorThreads));
+    }
+
+    if (!listening)
+    {
+        qCritical() << "Could not start server";
+    }
+    else
+    {
+        qDebug() << "Server started on port" << port;
+        startTrafficCaptureIfEnabled();
+        startTlsListenerIfEnabled();
+        startMessageBusIfEnabled();
+        generateRSAKeys();
+        if (!handoffPath.isEmpty() && hotRestart.listen(handoffPath))
+        {
+            connect(&hotRestart, &HotRestart::successorConnected, this, &ServerLogic::handOffTo, Qt::UniqueConnection);
+            Logger::getInstance()->logToFile(QString("Hot restart: waiting for successor on %1").arg(handoffPath));
+        }
+    }
+}
+
+/**
+ * @brief Принимает слушающие сокеты и подключения от работающего процесса сервера.
+ *
+ * Кадр listeners содержит основной слушающий сокет и, если был включён, сокет TLS; кадры
+ * connections — подключения клиентов с состоянием их сессий; кадр done завершает передачу.
+ * Если работающего процесса нет, сервер открывает порт обычным образом.
+ *
+ * @param path Путь к Unix-сокету передачи.
+ * @return true Если основной слушающий сокет получен.
+ */
+bool ServerLogic::takeOverFrom(const QString &path)
+{
+    qintptr channel = HotRestart::connectTo(path);
+    if (channel < 0)
+    {
+        return false;
+    }
+
+    bool listening = false;
+    int adopted = 0;
+    QJsonObject message;
+    QVector<qintptr> descriptors;
+    while (HotRestart::receiveFrame(channel, message, descriptors))
+    {
+        QString type = message["type"].toString();
+        if (type == "listeners" && !descriptors.isEmpty())
+        {
+            listening = this->setSocketDescriptor(descriptors[0]);
+            if (!listening)
+            {
+                HotRestart::closeDescriptor(descriptors[0]);
+            }
+            if (descriptors.size() > 1)
+            {
+                inheritedTlsDescriptor = descriptors[1];
+            }
+        }
+        else if (type == "connections")
+        {
+            const QJsonArray states = message["sessions"].toArray();
+            for (int i = 0; i < descriptors.size(); ++i)
+            {
+                adoptHandedOffConnection(descriptors[i], states.at(i).toObject());
+            }
+            adopted += descriptors.size();
+        }
+        else if (type == "done")
+        {
+            break;
+        }
+        else
+        {
+            for (qintptr descriptor : qAsConst(descriptors))
+            {
+                HotRestart::closeDescriptor(descriptor);
+            }
+        }
+    }
+    HotRestart::closeDescriptor(channel);
+
+    ServerMetrics::getInstance()->add("hot_restart.adopted_connections", adopted);
+    Logger::getInstance()->logToFile(QString("Hot restart: took over %1 (listener %2)")
+                                         .arg(adopted).arg(listening ? "received" : "not received"));
+    return listening;
+}
+
+/**
+ * @brief Начинает обслуживание подключения, полученного от предыдущего процесса.
+ *
+ * Сессия сразу получает прежние пользователя и согласованные параметры, поэтому клиенту
+ * не нужно заново выполнять hello и вход.
+ *
+ * @param descriptor Дескриптор подключения.
+ * @param state Состояние сессии.
+ */
+void ServerLogic::adoptHandedOffConnection(qintptr descriptor, const QJsonObject &state)
+{
+    QTcpSocket *clientSocket = new QTcpSocket(this);
+    if (!clientSocket->setSocketDescriptor(descriptor))
+    {
+        HotRestart::closeDescriptor(descriptor);
+        delete clientSocket;
+        return;
+    }
+    adoptConnection(clientSocket);
+    ClientSession *session = sessions.find(clientSocket);
+    if (session)
+    {
+        sessions.importState(session, state);
+    }
+    if (state["compression"].toBool(false))
+    {
+        payloadCompressor.enable(clientSocket);
+    }
+}
+
+/**
+ * @brief Передаёт сокеты новому процессу сервера и завершает работу после их закрытия.
+ *
+ * Первым передаются слушающие сокеты, после чего новые подключения принимает преемник.
+ * Затем передаются подключения, которые можно перенести без потери данных; остальные
+ * (TLS, зашифрованные сессии, подключения с неотправленными данными) закрываются штатно,
+ * и клиенты восстанавливают сессию по токену. Процесс завершается, когда закроются все
+ * оставшиеся подключения или истечёт Server/drainTimeoutSec.
+ *
+ * @param channel Дескриптор канала передачи.
+ */
+void ServerLogic::handOffTo(qintptr channel)
+{
+    QVector<qintptr> listeners{this->socketDescriptor()};
+    if (tlsListener.isListening())
+    {
+        listeners.append(tlsListener.socketDescriptor());
+    }
+    if (!HotRestart::sendFrame(channel, QJsonObject{{"type", "listeners"}}, listeners))
+    {
+        //Преемник не принял сокеты: сервер продолжает работу и ждёт следующего
+        HotRestart::closeDescriptor(channel);
+        Logger::getInstance()->logToFile("Hot restart: could not pass listening sockets, continuing to serve");
+        hotRestart.listen(handoffPath);
+        return;
+    }
+    this->close();
+    reusePortListener.close();
+    tlsListener.close();
+
+    //Процесс уходит, поэтому присутствие перенесённых пользователей больше не публикуется отсюда
+    disconnect(&sessions, nullptr, &presenceHub, nullptr);
+
+    int handedOff = 0;
+    bool channelOpen = true;
+    QVector<qintptr> batch;
+    QList<QTcpSocket*> batchSockets;
+    QJsonArray states;
+    auto sendBatch = [&]()
+    {
+        if (batch.isEmpty())
+        {
+            return;
+        }
+        channelOpen = channelOpen && HotRestart::sendFrame(channel, QJsonObject{{"type", "connections"}, {"sessions", states}}, batch);
+        if (channelOpen)
+        {
+            for (QTcpSocket *clientSocket : qAsConst(batchSockets))
+            {
+                releaseHandedOffConnection(clientSocket);
+            }
+            handedOff += batch.size();
+        }
+        batch.clear();
+        batchSockets.clear();
+        states = QJsonArray();
+    };
+
+    const QList<ClientSession*> activeSessions = sessions.allSessions();
+    for (ClientSession *session : activeSessions)
+    {
+        if (!channelOpen || !canHandOff(session))
+        {
+            continue;
+        }
+        QJsonObject state = sessions.exportState(session);
+        state["compression"] = payloadCompressor.isEnabled(session->socket);
+        batch.append(session->socket->socketDescriptor());
+        batchSockets.append(session->socket);
+        states.append(state);
+        if (batch.size() == HotRestart::maxDescriptorsPerFrame)
+        {
+            sendBatch();
+        }
+    }
+    sendBatch();
+    if (channelOpen)
+    {
+        HotRestart::sendFrame(channel, QJsonObject{{"type", "done"}});
+    }
+    HotRestart::closeDescriptor(channel);
+
+    const QList<ClientSession*> remainingSessions = sessions.allSessions();
+    for (ClientSession *session : remainingSessions)
+    {
+        session->socket->disconnectFromHost();
+    }
+    ServerMetrics::getInstance()->add("hot_restart.handed_off_connections", handedOff);
+    Logger::getInstance()->logToFile(QString("Hot restart: handed off %1 connections, draining %2")
+                                         .arg(handedOff).arg(remainingSessions.size()));
+
+    QSettings settings(QDir::homePath() + "/appsettings.ini", QSettings::IniFormat);
+    QElapsedTimer drainClock;
+    drainClock.start();
+    qint64 drainTimeoutMs = settings.value("Server/drainTimeoutSec", 30).toLongLong() * 1000;
+    connect(&drainTimer, &QTimer::timeout, this, [this, drainClock, drainTimeoutMs]()
+            {
+                if (sessions.connectionCount() > 0 && drainClock.elapsed() < drainTimeoutMs)
+                {
+                    return;
+                }
+                drainTimer.stop();
+                shutdownServer();
+                QCoreApplication::quit();
+            });
+    drainTimer.start(100);
+}
+
+/**
+ * @brief Проверяет, можно ли передать подключение новому процессу без потери данных.
+ *
+ * Передаются только открытые подключения без буферизованных входящих и исходящих данных
+ * и без незавершённых операций: состояние TLS и сеансовые ключи передать нельзя.
+ *
+ * @param session Сессия.
+ * @return true Если подключение можно передать.
+ */
+bool ServerLogic::canHandOff(const ClientSession *session) const
+{
+    QTcpSocket *clientSocket = session->socket;
+    return !qobject_cast<QSslSocket*>(clientSocket) && !session->channel && session->handshakePrivateKey.isEmpty() &&
+           clientSocket->state() == QAbstractSocket::ConnectedState && clientSocket->bytesAvailable() == 0 &&
+           outboundQueue.isIdle(clientSocket) && payloadCompressor.isIdle(clientSocket) &&
+           !credentialPool.isBusy(clientSocket);
+}
+
+/**
+ * @brief Освобождает подключение, переданное новому процессу.
+ *
+ * Обработчики отключаются до закрытия, а сам дескриптор закрывается без завершения
+ * соединения: его копия уже принадлежит новому процессу.
+ *
+ * @param clientSocket Указатель на сокет клиента.
+ */
+void ServerLogic::releaseHandedOffConnection(QTcpSocket *clientSocket)
+{
+    ClientSession *session = sessions.find(clientSocket);
+    clientSocket->disconnect(this);
+    if (session)
+    {
+        trafficRecorder.recordClose(session->connectionId);
+    }
+    payloadCompressor.remove(clientSocket);
+    outboundQueue.remove(clientSocket);
+    sessions.remove(clientSocket);
+    clientSocket->abort();
+}
+
+/**
+ * @brief Включает запись входящего трафика, если она разрешена в настройках.
+ *
+ * Захват управляется ключами Capture/enabled и Capture/path файла appsettings.ini.
+ * Записанный файл воспроизводится инструментом tools/replay на тестовом экземпляре сервера.
+ */
+void ServerLogic::startTrafficCaptureIfEnabled()
+{
+    QSettings settings(QDir::homePath() + "/appsettings.ini", QSettings::IniFormat);
+    if (!settings.value("Capture/enabled", false).toBool())
+    {
+        return;
+    }
+
+    QString capturePath = settings.value("Capture/path", QDir::homePath() + "/traffic.smcap").toString();
+    if (trafficRecorder.open(capturePath))
+    {
+        connect(&captureFlushTimer, &QTimer::timeout, this, [this]()
+                {
+                    trafficRecorder.flush();
+                });
+        captureFlushTimer.start(1000);
+        Logger::getInstance()->logToFile(QString("Traffic capture enabled: %1").arg(capturePath));
+    }
+}
+
+/**
+ * @brief Подключает сервер к шине экземпляров, если это разрешено в настройках.
+ *
+ * Управляется ключами Cluster/enabled и Cluster/busName файла appsettings.ini. Все экземпляры
+ * с одинаковым именем шины должны работать с одной базой данных, поэтому для неё включается
+ * журнал WAL и ожидание блокировки записи. Запуск нескольких экземпляров на одной машине
+ * описан в tools/cluster.
+ */
+void ServerLogic::startMessageBusIfEnabled()
+{
+    QSettings settings(QDir::homePath() + "/appsettings.ini", QSettings::IniFormat);
+    if (!settings.value("Cluster/enabled", false).toBool())
+    {
+        return;
+    }
+
+    QSqlQuery pragmaQuery(database);
+    pragmaQuery.exec("PRAGMA journal_mode=WAL");
+    pragmaQuery.exec(QString("PRAGMA busy_timeout=%1").arg(settings.value("Cluster/busyTimeoutMs", 5000).toInt()));
+    messageSequencer.setShared(true);
+    if (messageLog.isEnabled())
+    {
+        //Сегменты дописываются одним процессом; при общей базе история читается из неё
+        messageLog.close();
+        Logger::getInstance()->logToFile("History segment log disabled in cluster mode");
+    }
+    if (historyCache.isEnabled())
+    {
+        //Сообщения других экземпляров в кэш не попадают
+        historyCache.configure(0, 0);
+        Logger::getInstance()->logToFile("History cache disabled in cluster mode");
+    }
+
+    connect(&sessions, &SessionRegistry::userOnline, this, [this](int userId)
+            {
+                const QVector<ClientSession*> userSessions = sessions.sessionsOf(userId);
+                if (!userSessions.isEmpty())
+                {
+                    messageBus.announceOnline(userId, userSessions.first()->login);
+                }
+            });
+    connect(&sessions, &SessionRegistry::userOffline, &messageBus, &MessageBus::announceOffline);
+    connect(&messageBus, &MessageBus::pushReceived, this, [this](int userId, const QJsonObject &push, const QString &collapseKey)
+            {
+                //Пользователь мог отключиться, пока уведомление шло через шину: тогда сообщение
+                //ставится в очередь доставки здесь, так как отправитель считал его в сети
+                if (!sessions.isOnline(userId))
+                {
+                    deliveryQueue.enqueue(userId, push["chat_id"].toString().toInt(), push["message_id"].toInt());
+                    return;
+                }
+                deliverChatUpdate(userId, push, collapseKey, nullptr);
+            });
+    connect(&messageBus, &MessageBus::remotePresenceChanged, &presenceHub, &PresenceHub::setRemotePresence);
+    connect(&presenceHub, &PresenceHub::typingForwarded, &messageBus, &MessageBus::publishTyping);
+    connect(&messageBus, &MessageBus::typingReceived, &presenceHub, &PresenceHub::publishRemoteTyping);
+    connect(&messageBus, &MessageBus::chatChanged, &presenceHub, &PresenceHub::reloadChat);
+    connect(&messageBus, &MessageBus::tokensRevoked, this, [this](int userId, qint64 revokedAt)
+            {
+                sessionTokens.applyRevocation(userId, revokedAt);
+            });
+    connect(&messageBus, &MessageBus::chatDeleted, this, [this](int chatId)
+            {
+                messageSequencer.forgetChat(chatId);
+                presenceHub.removeChat(chatId);
+            });
+
+    QString instanceId = QString("%1-%2").arg(QSysInfo::machineHostName()).arg(QCoreApplication::applicationPid());
+    messageBus.start(settings.value("Cluster/busName", "servermessenger-bus").toString(), instanceId);
+}
+
+/**
+ * @brief Запускает приём TLS-подключений, если он разрешён в настройках.
+ *
+ * Управляется ключами Tls/enabled, Tls/port, Tls/certificate, Tls/privateKey,
+ * Tls/handshakeThreads и Tls/handshakeTimeoutMs файла appsettings.ini.
+ * Самоподписанный сертификат для проверки на localhost создаётся скриптом tools/tls.
+ */
+void ServerLogic::startTlsListenerIfEnabled()
+{
+    QSettings settings(QDir::homePath() + "/appsettings.ini", QSettings::IniFormat);
+    qintptr inheritedDescriptor = inheritedTlsDescriptor;
+    inheritedTlsDescriptor = -1;
+    if (!settings.value("Tls/enabled", false).toBool() || !QSslSocket::supportsSsl())
+    {
+        if (inheritedDescriptor >= 0)
+        {
+            HotRestart::closeDescriptor(inheritedDescriptor);
+        }
+        if (settings.value("Tls/enabled", false).toBool())
+        {
+            Logger::getInstance()->logToFile("TLS listener disabled: SSL support is not available");
+        }
+        return;
+    }
+
+    int tlsPort = settings.value("Tls/port", 3443).toInt();
+    bool configured = tlsListener.configure(settings.value("Tls/certificate", QDir::homePath() + "/server.crt").toString(),
+                                            settings.value("Tls/privateKey", QDir::homePath() + "/server.key").toString(),
+                                            settings.value("Tls/handshakeThreads", 2).toInt(),
+                                            settings.value("Tls/handshakeTimeoutMs", 10000).toInt());
+    //Слушающий сокет, полученный от предыдущего процесса при перезапуске, используется вместо нового
+    bool listening = configured && (inheritedDescriptor >= 0 ? tlsListener.setSocketDescriptor(inheritedDescriptor)
+                                                              : tlsListener.listen(QHostAddress::Any, tlsPort));
+    if (!listening)
+    {
+        if (inheritedDescriptor >= 0)
+        {
+            HotRestart::closeDescriptor(inheritedDescriptor);
+        }
+        qCritical() << "Could not start TLS listener";
+        return;
+    }
+    connect(&tlsListener, &TlsListener::connectionReady, this, &ServerLogic::adoptConnection, Qt::UniqueConnection);
+    Logger::getInstance()->logToFile(QString("TLS listener started on port %1").arg(tlsPort));
+}
+
+/**
+ * @brief Отключает сервер и всех подключенных клиентов.
+ *
+ * Закрывает соединение с базой данных и очищает список подключенных клиентов.
+ */
+void ServerLogic::shutdownServer()
+{
+    this->close();
+    reusePortListener.close();
+    tlsListener.close();
+    hotRestart.close();
+    drainTimer.stop();
+    Logger::getInstance()->logToFile("Server is turned off");
+    captureFlushTimer.stop();
+    trafficRecorder.close();
+
+    //Отключение всех клиентов; сессии удаляются обработчиками disconnected
+    const QList<ClientSession*> activeSessions = sessions.allSessions();
+    for (ClientSession *session : activeSessions)
+    {
+        session->socket->disconnectFromHost();
+    }
+
+    messageBus.stop();
+
+    //Закрыть соединение с базой данных, если открыто
+    sqliteRepository.close();
+    if (database.isOpen())
+    {
+        database.close();
+    }
+}
+
+/**
+ * @brief Проверяет, содержит ли пароль необходимые символы.
+ *
+ * @param password Пароль для проверки.
+ * @return true Если пароль содержит хотя бы один символ каждого типа.
+ * @return false В противном случае.
+ */
+bool ServerLogic::passwordContainsRequiredCharacters(const QString &password)
+{
+    //Таблицы символов строятся при компиляции, проверка не создаёт регулярных выражений
+    return CharClasses::upper.matchesAny(password) &&
+           CharClasses::lower.matchesAny(password) &&
+           CharClasses::digits.matchesAny(password) &&
+           CharClasses::special.matchesAny(password);
+}
+
+/**
+ * @brief Проверяет, содержит ли логин только допустимые символы.
+ *
+ * @param login Логин для проверки.
+ * @return true Если логин содержит только допустимые символы.
+ * @return false В противном случае.
+ */
+bool ServerLogic::loginContainsOnlyAllowedCharacters(const QString &login)
+{
+    return CharClasses::login.matchesAll(login);
+}
+
+/**
+ * @brief Проверяет доступность логина при регистрации.
+ *
+ * @param login Логин для проверки.
+ * @return true Если логин доступен.
+ * @return false Если логин занят.
+ */
+bool ServerLogic::loginAvailable(const QString& login)
+{
+    return repository->isLoginAvailable(login);
+}
+
+/**
+ * @brief Возвращает кодировку, согласованную с подключением.
+ *
+ * @param socket Указатель на сокет клиента.
+ * @return WireEncoding Кодировка подключения (JSON, если согласование не выполнялось).
+ */
+WireEncoding ServerLogic::encodingOf(QTcpSocket *socket) const
+{
+    ClientSession *session = sessions.find(socket);
+    return session ? session->encoding : WireEncoding::Json;
+}
+
+/**
+ * @brief Кодирует ответ в кодировке подключения и отправляет его клиенту.
+ *
+ * @param socket Указатель на сокет клиента.
+ * @param response Ответ в общей модели сообщений.
+ */
+void ServerLogic::sendResponse(QTcpSocket *socket, const QJsonObject &response)
+{
+    sendEncodedResponse(socket, WireProtocol::encode(response, encodingOf(socket)));
+}
+
+/**
+ * @brief Отправляет клиенту уже закодированный ответ.
+ *
+ * @param socket Указатель на сокет клиента.
+ * @param data Ответ в кодировке подключения.
+ */
+void ServerLogic::sendEncodedResponse(QTcpSocket *socket, const QByteArray &data)
+{
+    if (payloadCompressor.isEnabled(socket))
+    {
+        payloadCompressor.send(socket, data);
+        return;
+    }
+    transmit(socket, data);
+}
+
+/**
+ * @brief Отправляет клиенту постоянный ответ.
+ *
+ * Ответ закодирован заранее, поэтому отправка не кодирует и не копирует его.
+ *
+ * @param socket Указатель на сокет клиента.
+ * @param response Постоянный ответ.
+ */
+void ServerLogic::sendResponse(QTcpSocket *socket, const ConstantResponse &response)
+{
+    sendEncodedResponse(socket, response.encoded(encodingOf(socket)));
+}
+
+/**
+ * @brief Возвращает переиспользуемый буфер ответа подключения.
+ *
+ * Сокет копирует записанные данные в собственный буфер, поэтому после отправки буфер
+ * ответа снова принадлежит только сессии и следующий ответ пишется в ту же память.
+ *
+ * @param socket Указатель на сокет клиента.
+ * @return QByteArray& Буфер ответа.
+ */
+QByteArray &ServerLogic::responseBuffer(QTcpSocket *socket)
+{
+    ClientSession *session = sessions.find(socket);
+    QByteArray &buffer = session ? session->responseBuffer : spareResponseBuffer;
+    if (buffer.capacity() < 256)
+    {
+        //Зарезервированная память не освобождается при сбросе длины буфера
+        buffer.reserve(256);
+    }
+    return buffer;
+}
+
+/**
+ * @brief Передаёт готовые байты в исходящую очередь.
+ *
+ * Для зашифрованных сессий данные предварительно шифруются; сжатие, если оно
+ * согласовано, выполняется до шифрования.
+ *
+ * @param socket Указатель на сокет клиента.
+ * @param data Закодированное сообщение или кадр сжатия.
+ */
+void ServerLogic::transmit(QTcpSocket *socket, const QByteArray &data)
+{
+    ClientSession *session = sessions.find(socket);
+    if (session && session->channel)
+    {
+        outboundQueue.write(socket, session->channel->seal(data));
+        return;
+    }
+    outboundQueue.write(socket, data);
+}
+
+/**
+ * @brief Отправляет необязательное push-уведомление.
+ *
+ * @param socket Указатель на сокет клиента.
+ * @param push Уведомление в общей модели сообщений.
+ * @param collapseKey Ключ свёртки уведомлений.
+ */
+void ServerLogic::sendPush(QTcpSocket *socket, const QJsonObject &push, const QString &collapseKey)
+{
+    if (outboundQueue.shouldCollapsePush(socket))
+    {
+        outboundQueue.collapsePush(socket, collapseKey, push);
+        return;
+    }
+    deliverPush(socket, push);
+}
+
+/**
+ * @brief Отправляет уведомление без свёртки.
+ *
+ * @param socket Указатель на сокет клиента.
+ * @param push Уведомление в общей модели сообщений.
+ */
+void ServerLogic::deliverPush(QTcpSocket *socket, const QJsonObject &push)
+{
+    QByteArray data = WireProtocol::encode(push, encodingOf(socket));
+    sendEncodedResponse(socket, data);
+    outboundQueue.pushed(socket, data.size());
+}
+
+/**
+ * @brief Возвращает устройство, в которое следует писать потоковый ответ.
+ *
+ * @param socket Указатель на сокет клиента.
+ * @return QIODevice* Сокет клиента или промежуточный буфер для сжимаемых подключений.
+ */
+QIODevice *ServerLogic::responseDevice(QTcpSocket *socket)
+{
+    ClientSession *session = sessions.find(socket);
+    if (!payloadCompressor.isEnabled(socket) && !(session && session->channel))
+    {
+        return socket;
+    }
+    stagingBuffer.close();
+    stagingBuffer.setData(QByteArray());
+    stagingBuffer.open(QIODevice::WriteOnly);
+    return &stagingBuffer;
+}
+
+/**
+ * @brief Завершает потоковый ответ.
+ *
+ * Собранный в буфере ответ передаётся в очередь сжатия или шифруется.
+ *
+ * @param socket Указатель на сокет клиента.
+ */
+void ServerLogic::commitResponse(QTcpSocket *socket)
+{
+    if (!stagingBuffer.isOpen())
+    {
+        outboundQueue.written(socket);
+        return;
+    }
+    stagingBuffer.close();
+    if (payloadCompressor.isEnabled(socket))
+    {
+        payloadCompressor.send(socket, stagingBuffer.data());
+    }
+    else
+    {
+        transmit(socket, stagingBuffer.data());
+    }
+    stagingBuffer.setData(QByteArray());
+}
+
+/**
+ * @brief Обрабатывает запрос hello на согласование кодировки и сжатия.
+ *
+ * Ответ отправляется в прежних кодировке и формате, все последующие сообщения — в новых.
+ * Сжатие ("compression": "zlib") после включения не отключается до конца подключения.
+ * Клиент, передавший "heartbeat": true, получает ping при простое и отключается,
+ * если не проявляет активности дольше тайм-аута. Клиент, передавший "acks": true,
+ * подтверждает уведомления запросами ack, а кадр pending_updates — запросом ack_pending.
+ *
+ * @param clientSocket Указатель на сокет клиента.
+ * @param request Запрос.
+ */
+void ServerLogic::handleHello(QTcpSocket *clientSocket, const HelloRequest &request)
+{
+    WireEncoding encoding = WireEncoding::Json;
+    const QString &compression = request.compression;
+    if (!WireProtocol::encodingFromName(request.encoding, encoding))
+    {
+        static const ConstantResponse response(QJsonObject{{"type", "hello"}, {"status", "error"}, {"message", "Unsupported encoding"}});
+        sendResponse(clientSocket, response);
+        return;
+    }
+    if (compression != "none" && compression != "zlib")
+    {
+        static const ConstantResponse response(QJsonObject{{"type", "hello"}, {"status", "error"}, {"message", "Unsupported compression"}});
+        sendResponse(clientSocket, response);
+        return;
+    }
+
+    sendResponse(clientSocket, QJsonObject{{"type", "hello"}, {"status", "success"},
+                                           {"encoding", request.encoding},
+                                           {"compression", compression},
+                                           {"heartbeat", request.heartbeat},
+                                           {"acks", request.acks}});
+    ClientSession *session = sessions.find(clientSocket);
+    if (session)
+    {
+        session->encoding = encoding;
+        session->heartbeat = request.heartbeat;
+        session->acks = request.acks;
+    }
+    if (compression == "zlib")
+    {
+        payloadCompressor.enable(clientSocket);
+    }
+}
+
+/**
+ * @brief Обрабатывает запрос на регистрацию.
+ *
+ * Хеш пароля вычисляется в пуле проверки учётных данных, запись в базу выполняется
+ * в потоке событий после его завершения.
+ *
+ * @param clientSocket Указатель на сокет клиента.
+ * @param request Запрос.
+ */
+void ServerLogic::handleRegister(QTcpSocket *clientSocket, const CredentialsRequest &request)
+{
+    QString login = request.login;
+    QString hashedPassword = request.password; //Хеш пароля, вычисленный клиентом
+
+    //Проверка допустимости логина
+    if (!loginAvailable(login) || !loginContainsOnlyAllowedCharacters(login))
+    {
+        //Информировать клиента о недопустимости логина
+        static const ConstantResponse response(QJsonObject{{"status", "error"}, {"message", "Login validation failed"}});
+        sendResponse(clientSocket, response);
+        return;
+    }
+
+    bool accepted = credentialPool.hash(clientSocket, hashedPassword, [this, clientSocket, login](const CredentialPool::Outcome &outcome)
+    {
+        //Добавление пользователя в базу данных
+        if (repository->createUser(login, outcome.newHash, "New user") < 0)
+        {
+            //Ошибка при добавлении пользователя в БД (в том числе если логин заняли, пока считался хеш)
+            static const ConstantResponse response(QJsonObject{{"status", "error"}, {"message", "Failed to register user"}});
+            sendResponse(clientSocket, response);
+            return;
+        }
+
+        //Пользователь успешно добавлен в БД
+        static const ConstantResponse response(QJsonObject{{"status", "success"}, {"message", "User registered successfully"}});
+        sendResponse(clientSocket, response);
+        Logger::getInstance()->logToFile(QString("User '%1' was successfully registered.").arg(login));
+    });
+    if (!accepted)
+    {
+        static const ConstantResponse response(QJsonObject{{"status", "error"}, {"message", authBusyMessage}});
+        sendResponse(clientSocket, response);
+    }
+}
+
+/**
+ * @brief Обрабатывает запрос на вход.
+ *
+ * Пароль проверяется в пуле проверки учётных данных. Хеш прежнего формата после
+ * успешного входа заменяется хешем PBKDF2.
+ *
+ * @param clientSocket Указатель на сокет клиента.
+ * @param request Запрос.
+ */
+void ServerLogic::handleLogin(QTcpSocket *clientSocket, const CredentialsRequest &request)
+{
+    QString login = request.login;
+    QString hashedPassword = request.password;
 
+    ChatRepository::UserRecord user;
+    if (!repository->findUser(login, user))
+    {
+        //Логин не найден в базе данных
+        static const ConstantResponse response(QJsonObject{{"status", "error"}, {"message", "Login failed. User not found."}});
+        sendResponse(clientSocket, response);
+        return;
+    }
 
-            });
-}
+    int userId = user.userId;
+    QString storedPassword = user.password;
+    bool accepted = credentialPool.verify(clientSocket, hashedPassword, storedPassword,
+                                          [this, clientSocket, login, userId, storedPassword](const CredentialPool::Outcome &outcome)
+    {
+        ClientSession *session = sessions.find(clientSocket);
+        if (!outcome.valid || !session)
+        {
+            //Пароли не совпадают
+            static const ConstantResponse response(QJsonObject{{"status", "error"}, {"message", "Login failed. Incorrect password."}});
+            sendResponse(clientSocket, response);
+            return;
+        }
+
+        if (!outcome.newHash.isEmpty())
+        {
+            //Прозрачное обновление хеша; условие по старому хешу защищает от одновременной смены пароля
+            if (repository->upgradePassword(userId, storedPassword, outcome.newHash))
+            {
+                ServerMetrics::getInstance()->add("auth.hash_upgrades");
+            }
+        }
 
+        //Пароли совпадают, успешный вход
+        sessions.bind(session, userId, login);
+        sendResponse(clientSocket, QJsonObject{{"status", "success"}, {"message", "Logged in successfully"},
+                                               {"token", sessionTokens.issue(userId, login)}});
+        flushPendingDeliveries(clientSocket, userId);
+        Logger::getInstance()->logToFile(QString("User '%1' logged in successfully.").arg(login));
+        Logger::getInstance()->logToFile(QString("User '%1' with ID '%2' bound to connection %3 (%4 active sessions).")
+                                             .arg(login).arg(userId).arg(session->connectionId)
+                                             .arg(sessions.sessionsOf(userId).size()));
+    });
+    if (!accepted)
+    {
+        static const ConstantResponse response(QJsonObject{{"status", "error"}, {"message", authBusyMessage}});
+        sendResponse(clientSocket, response);
+    }
+}
 
 /**
- * @brief Запускает сервер на определенном порте.
+ * @brief Обрабатывает запрос на смену логина.
  *
- * @param port Порт, на котором будет запущен сервер.
+ * Клиент передаёт пароль в открытом виде, поэтому прежний хеш вычисляется с солью
+ * старого логина, а новый — с солью нового. Проверка пароля и вычисление нового
+ * хеша выполняются одной операцией в пуле проверки учётных данных.
+ *
+ * @param clientSocket Указатель на сокет клиента.
+ * @param request Запрос.
  */
-void ServerLogic::startServer(int port)
+void ServerLogic::handleUpdateLogin(QTcpSocket *clientSocket, const UpdateLoginRequest &request)
 {
-    if (!this->listen(QHostAddress::Any, port))
+    QString oldLogin = request.oldLogin;
+    QString newLogin = request.newLogin;
+    QString clientPassword = request.password;
+
+    //Проверка допустимости логина и нового логина
+    if (!loginAvailable(newLogin) || !loginContainsOnlyAllowedCharacters(newLogin))
     {
-        qCritical() << "Could not start server";
+        static const ConstantResponse response(QJsonObject{{"type", "update_login"}, {"status", "error"}, {"message", "Invalid or duplicate new login."}});
+        sendResponse(clientSocket, response);
+        return;
     }
-    else
+
+    //Проверяем существование старого логина и его пароля
+    ChatRepository::UserRecord user;
+    if (!repository->findUser(oldLogin, user))
     {
-        qDebug() << "Server started on port" << port;
+        static const ConstantResponse response(QJsonObject{{"type", "update_login"}, {"status", "error"}, {"message", "Old login not found."}});
+        sendResponse(clientSocket, response);
+        return;
+    }
+
+    int userId = user.userId;
+    //Оба хеша с солью из логина вычисляются в пуле вместе с проверкой пароля
+    bool accepted = credentialPool.verifyLoginChange(clientSocket, clientPassword, oldLogin, newLogin, user.password,
+                                                     [this, clientSocket, oldLogin, newLogin, userId](const CredentialPool::Outcome &outcome)
+    {
+        if (!outcome.valid)
+        {
+            static const ConstantResponse response(QJsonObject{{"type", "update_login"}, {"status", "error"}, {"message", "Incorrect old password."}});
+            sendResponse(clientSocket, response);
+            return;
+        }
+
+        //Обновляем данные пользователя в БД
+        if (!repository->updateLogin(oldLogin, newLogin, outcome.newHash))
+        {
+            static const ConstantResponse response(QJsonObject{{"type", "update_login"}, {"status", "error"}, {"message", "Could not update login and password in the database."}});
+            sendResponse(clientSocket, response);
+            return;
+        }
+
+        //Токены со старым логином больше не действуют
+        messageBus.publishTokensRevoked(userId, sessionTokens.revoke(userId));
+        messageLog.forgetLogin(userId);
+        historyCache.clear();
+        sendResponse(clientSocket, QJsonObject{{"type", "update_login"}, {"status", "success"}, {"message", "Login and password updated successfully."},
+                                               {"token", sessionTokens.issue(userId, newLogin)}});
+    });
+    if (!accepted)
+    {
+        static const ConstantResponse response(QJsonObject{{"type", "update_login"}, {"status", "error"}, {"message", authBusyMessage}});
+        sendResponse(clientSocket, response);
     }
 }
 
 /**
- * @brief Отключает сервер и всех подключенных клиентов.
+ * @brief Обрабатывает запрос на смену пароля.
  *
- * Закрывает соединение с базой данных и очищает список подключенных клиентов.
+ * @param clientSocket Указатель на сокет клиента.
+ * @param request Запрос.
  */
-void ServerLogic::shutdownServer()
+void ServerLogic::handleUpdatePassword(QTcpSocket *clientSocket, const UpdatePasswordRequest &request)
 {
-    this->close();
-    Logger::getInstance()->logToFile("Server is turned off");
+    QString login = request.login;
+    QString currentPassword = request.currentPassword; //Предполагается, что пароль хэшируется на клиенте
+    QString newPassword = request.newPassword; //Предполагается, что пароль хэшируется на клиенте
+
+    ChatRepository::UserRecord user;
+    if (!repository->findUser(login, user))
+    {
+        static const ConstantResponse response(QJsonObject{{"type", "update_password"}, {"status", "error"}, {"message", "Login not found."}});
+        sendResponse(clientSocket, response);
+        return;
+    }
 
-    //Отключение всех клиентов
-    foreach(QTcpSocket *socket, userSockets)
+    int userId = user.userId;
+    bool accepted = credentialPool.verify(clientSocket, currentPassword, user.password,
+                                          [this, clientSocket, login, userId](const CredentialPool::Outcome &outcome)
     {
-        if (socket->state() == QTcpSocket::ConnectedState)
+        if (!outcome.valid)
         {
-            socket->disconnectFromHost();
+            static const ConstantResponse response(QJsonObject{{"type", "update_password"}, {"status", "error"}, {"message", "Incorrect current password."}});
+            sendResponse(clientSocket, response);
+            return;
         }
-        socket->deleteLater();
-    }
-    userSockets.clear();
 
-    //Закрыть соединение с базой данных, если открыто
-    if (database.isOpen())
+        if (!repository->updatePassword(login, outcome.newHash))
+        {
+            static const ConstantResponse response(QJsonObject{{"type", "update_password"}, {"status", "error"}, {"message", "Could not update password."}});
+            sendResponse(clientSocket, response);
+            return;
+        }
+
+        //После смены пароля ранее выданные токены отзываются
+        messageBus.publishTokensRevoked(userId, sessionTokens.revoke(userId));
+        sendResponse(clientSocket, QJsonObject{{"type", "update_password"}, {"status", "success"}, {"message", "Password updated successfully."},
+                                               {"token", sessionTokens.issue(userId, login)}});
+    }, newPassword);
+    if (!accepted)
     {
-        database.close();
+        static const ConstantResponse response(QJsonObject{{"type", "update_password"}, {"status", "error"}, {"message", authBusyMessage}});
+        sendResponse(clientSocket, response);
     }
 }
 
 /**
- * @brief Проверяет, содержит ли пароль необходимые символы.
+ * @brief Задаёт параметры ограничения частоты запросов.
  *
- * @param password Пароль для проверки.
- * @return true Если пароль содержит хотя бы один символ каждого типа.
- * @return false В противном случае.
+ * Ключи RateLimit/enabled, RateLimit/connectionRate, RateLimit/connectionBurst,
+ * RateLimit/userRate и RateLimit/userBurst задают корзины (токены в секунду и ёмкость),
+ * группа RateLimitCosts — стоимость запросов по типам (например, find_users=5).
+ * Ограничение выключено, пока не задано RateLimit/enabled=true; ёмкость корзин по умолчанию
+ * покрывает вход с загрузкой списка чатов и истории нескольких из них.
+ *
+ * @param settings Настройки сервера.
  */
-bool ServerLogic::passwordContainsRequiredCharacters(const QString &password)
+void ServerLogic::configureRateLimits(QSettings &settings)
 {
-    QRegularExpression upperCaseRegExp("[A-Z]"); //Регулярное выражение для заглавных букв
-    QRegularExpression lowerCaseRegExp("[a-z]"); //Регулярное выражение для строчных букв
-    QRegularExpression digitRegExp("\\d");       //Регулярное выражение для цифр
-    QRegularExpression specialRegExp("[!@#$%^&*()_+=-]"); //Регулярное выражение для специальных символов
-
-    return password.contains(upperCaseRegExp) &&
-           password.contains(lowerCaseRegExp) &&
-           password.contains(digitRegExp) &&
-           password.contains(specialRegExp);
+    RateLimiter::Limits connectionLimits;
+    connectionLimits.rate = settings.value("RateLimit/connectionRate", 20).toDouble();
+    connectionLimits.burst = settings.value("RateLimit/connectionBurst", 100).toDouble();
+    RateLimiter::Limits userLimits;
+    userLimits.rate = settings.value("RateLimit/userRate", 30).toDouble();
+    userLimits.burst = settings.value("RateLimit/userBurst", 200).toDouble();
+
+    QHash<QString, int> costs;
+    settings.beginGroup("RateLimitCosts");
+    const QStringList types = settings.childKeys();
+    for (const QString &type : types)
+    {
+        costs.insert(type, settings.value(type).toInt());
+    }
+    settings.endGroup();
+
+    rateLimiter.configure(settings.value("RateLimit/enabled", false).toBool(), connectionLimits, userLimits, costs);
 }
 
 /**
- * @brief Проверяет, содержит ли логин только допустимые символы.
+ * @brief Запускает фоновую генерацию ключей RSA для зашифрованных сессий.
  *
- * @param login Логин для проверки.
- * @return true Если логин содержит только допустимые символы.
- * @return false В противном случае.
+ * Параметры задаются ключами Crypto/rsaPoolSize, Crypto/rsaBits и Crypto/threads.
+ * Без поддержки шифрования в сборке ключи не генерируются.
  */
-bool ServerLogic::loginContainsOnlyAllowedCharacters(const QString &login)
+void ServerLogic::generateRSAKeys()
 {
-    QRegularExpression loginRegExp("^[A-Za-z\\d_-]+$"); //Регулярное выражение для допустимых символов в логине
-    return login.contains(loginRegExp);
+    if (!SecureChannel::isAvailable())
+    {
+        return;
+    }
+    QSettings settings(QDir::homePath() + "/appsettings.ini", QSettings::IniFormat);
+    rsaKeyPool.start(settings.value("Crypto/rsaPoolSize", 4).toInt(),
+                     settings.value("Crypto/rsaBits", 2048).toInt(),
+                     settings.value("Crypto/threads", 1).toInt());
 }
 
 /**
- * @brief Проверяет доступность логина при регистрации.
+ * @brief Обрабатывает запрос secure_hello.
  *
- * @param login Логин для проверки.
- * @return true Если логин доступен.
- * @return false Если логин занят.
+ * Выдаёт клиенту открытый ключ заранее сгенерированной пары RSA. Шифрование должно
+ * согласовываться до включения сжатия, чтобы ответы, уже стоящие в очереди сжатия,
+ * не оказались зашифрованы раньше, чем клиент получит подтверждение.
+ *
+ * @param clientSocket Указатель на сокет клиента.
+ * @param request Запрос (без полей).
  */
-bool ServerLogic::loginAvailable(const QString& login)
+void ServerLogic::handleSecureHello(QTcpSocket *clientSocket, const EmptyRequest &)
 {
-    QSqlQuery query(database);
-    query.prepare("SELECT COUNT(*) FROM user_auth WHERE login = :login");
-    query.bindValue(":login", login);
-    query.exec();
+    ClientSession *session = sessions.find(clientSocket);
+    QString error;
+    if (!SecureChannel::isAvailable())
+    {
+        error = "Encrypted sessions are not supported";
+    }
+    else if (!session || session->channel)
+    {
+        error = "Encrypted session is already established";
+    }
+    else if (payloadCompressor.isEnabled(clientSocket))
+    {
+        error = "Encrypted session must be established before compression";
+    }
+    else if (!rsaKeyPool.isReady())
+    {
+        error = "Encryption keys are not ready. Try again later.";
+    }
+    if (!error.isEmpty())
+    {
+        sendResponse(clientSocket, QJsonObject{{"type", "secure_hello"}, {"status", "error"}, {"message", error}});
+        return;
+    }
+
+    RsaKeyPool::KeyPair keyPair = rsaKeyPool.take();
+    session->handshakePrivateKey = keyPair.second;
+    sendResponse(clientSocket, QJsonObject{{"type", "secure_hello"}, {"status", "success"},
+                                           {"public_key", QString::fromLatin1(keyPair.first.toBase64())}});
+}
 
-    if (query.next() && query.value(0).toInt() == 0)
+/**
+ * @brief Обрабатывает запрос secure_key.
+ *
+ * Сеансовый ключ, зашифрованный открытым ключом RSA, расшифровывается в пуле потоков.
+ * Подтверждение отправляется открытым текстом, все последующие кадры в обоих
+ * направлениях шифруются.
+ *
+ * @param clientSocket Указатель на сокет клиента.
+ * @param request Запрос.
+ */
+void ServerLogic::handleSecureKey(QTcpSocket *clientSocket, const SecureKeyRequest &request)
+{
+    ClientSession *session = sessions.find(clientSocket);
+    if (!session || session->handshakePrivateKey.isEmpty())
     {
-        return true; //Логин свободен
+        static const ConstantResponse response(QJsonObject{{"type", "secure_key"}, {"status", "error"}, {"message", "secure_hello is required first"}});
+        sendResponse(clientSocket, response);
+        return;
     }
-    return false; //Логин занят
+
+    QByteArray privateKey = session->handshakePrivateKey;
+    session->handshakePrivateKey.clear();
+    rsaKeyPool.decrypt(clientSocket, QByteArray::fromBase64(request.key.toLatin1()), privateKey,
+                       [this, clientSocket](const QByteArray &sessionKey)
+    {
+        ClientSession *session = sessions.find(clientSocket);
+        if (!session)
+        {
+            return;
+        }
+        if (sessionKey.size() != SecureChannel::keySize || payloadCompressor.isEnabled(clientSocket))
+        {
+            static const ConstantResponse response(QJsonObject{{"type", "secure_key"}, {"status", "error"}, {"message", "Invalid session key"}});
+            sendResponse(clientSocket, response);
+            return;
+        }
+
+        static const ConstantResponse response(QJsonObject{{"type", "secure_key"}, {"status", "success"}});
+        sendResponse(clientSocket, response);
+        session->channel = QSharedPointer<SecureChannel>::create(sessionKey);
+        ServerMetrics::getInstance()->add("crypto.sessions");
+    });
 }
 
 /**
- * @brief Шифрует строку с использованием SHA-512 и соли.
+ * @brief Обрабатывает запрос resume на восстановление сессии.
+ *
+ * Токен проверяется по подписи, сроку действия и таблице отзывов в памяти, без обращения
+ * к базе данных, после чего подключение привязывается к пользователю так же, как при входе.
+ * В ответе возвращается новый токен, продлевающий срок действия.
  *
- * @param str Строка для шифрования.
- * @param salt Соль для шифрования.
- * @return QString Хешированная строка.
+ * @param clientSocket Указатель на сокет клиента.
+ * @param request Запрос.
  */
-QString ServerLogic::getSha512Hash(const QString &str, const QString &salt)
+void ServerLogic::handleResume(QTcpSocket *clientSocket, const ResumeRequest &request)
 {
-    QByteArray byteArrayPasswordSalt = (str + salt).toUtf8();
-    QByteArray hashedPassword = QCryptographicHash::hash(byteArrayPasswordSalt, QCryptographicHash::Sha512).toHex();
-    return hashedPassword;
+    int userId = -1;
+    QString login;
+    ClientSession *session = sessions.find(clientSocket);
+    if (!session || !sessionTokens.verify(request.token, userId, login))
+    {
+        ServerMetrics::getInstance()->add("auth.resume_failures");
+        static const ConstantResponse response(QJsonObject{{"type", "resume"}, {"status", "error"}, {"message", "Invalid or expired token"}});
+        sendResponse(clientSocket, response);
+        return;
+    }
+
+    sessions.bind(session, userId, login);
+    ServerMetrics *metrics = ServerMetrics::getInstance();
+    metrics->add("auth.resumes");
+    if (qobject_cast<QSslSocket*>(clientSocket))
+    {
+        //Доля TLS-подключений, восстановивших сессию по токену без повторного входа
+        //(не путать с возобновлением сессии TLS, которое здесь не отслеживается)
+        metrics->add("tls.token_resumes");
+        metrics->set("tls.token_resume_rate", metrics->value("tls.token_resumes") / qMax(1.0, metrics->value("tls.handshakes")));
+    }
+    sendResponse(clientSocket, QJsonObject{{"type", "resume"}, {"status", "success"}, {"login", login},
+                                           {"token", sessionTokens.issue(userId, login)}});
+    flushPendingDeliveries(clientSocket, userId);
 }
 
 /**
- * @brief Обрабатывает запрос на поиск пользователей.
+ * @brief Отправляет клиенту накопленные за время отсутствия обновления чатов.
+ *
+ * Все пропущенные сообщения выдаются одним кадром pending_updates, поэтому клиенту
+ * не нужно запрашивать список чатов и историю каждого из них. Клиент, согласовавший
+ * подтверждения, подтверждает кадр запросом ack_pending, и до этого очередь не очищается:
+ * при обрыве подключения кадр будет выдан повторно. У остальных клиентов подтвердить
+ * получение нечем, поэтому выданные записи удаляются сразу после отправки.
  *
  * @param clientSocket Указатель на сокет клиента.
- * @param json JSON-объект с данными запроса.
+ * @param userId Идентификатор пользователя.
  */
-void ServerLogic::handleFindUsers(QTcpSocket* clientSocket, const QJsonObject &json)
+void ServerLogic::flushPendingDeliveries(QTcpSocket *clientSocket, int userId)
 {
-    QString searchText = json["searchText"].toString();
-    QString userLogin = json["login"].toString();
+    QJsonObject pending = deliveryQueue.pending(userId);
+    if (pending.isEmpty())
+    {
+        return;
+    }
+    sendResponse(clientSocket, pending);
 
-    QSqlQuery query(database);
-    query.prepare("SELECT login, nickname FROM user_auth WHERE nickname LIKE :nickname AND login != :login");
-    query.bindValue(":nickname", '%' + searchText + '%');
-    query.bindValue(":login", userLogin); //Исключаем пользователя из результатов
-    if (!query.exec())
+    ClientSession *session = sessions.find(clientSocket);
+    if (session && session->acks)
     {
-        QJsonObject response;
-        response["status"] = "error";
-        response["message"] = "Ошибка при поиске пользователей.";
-        clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
+        session->pendingUpdates = pending;
     }
     else
     {
-        QJsonArray usersArray;
-        while (query.next())
+        deliveryQueue.acknowledge(userId, pending);
+    }
+}
+
+/**
+ * @brief Загружает ключ подписи токенов из настроек.
+ *
+ * Ключ хранится в Security/sessionKey (hex) и создаётся при первом запуске, чтобы токены
+ * оставались действительными после перезапуска сервера. Время жизни токена задаётся
+ * ключом Security/tokenLifetimeHours.
+ *
+ * @param settings Настройки сервера.
+ */
+void ServerLogic::loadSessionTokenKey(QSettings &settings)
+{
+    QByteArray key = QByteArray::fromHex(settings.value("Security/sessionKey").toByteArray());
+    if (key.size() < 32)
+    {
+        key = SessionTokens::generateKey();
+        settings.setValue("Security/sessionKey", QString::fromLatin1(key.toHex()));
+        Logger::getInstance()->logToFile("Generated new session token key");
+    }
+    sessionTokens.configure(key, settings.value("Security/tokenLifetimeHours", 24 * 7).toLongLong() * 3600);
+}
+
+/**
+ * @brief Обрабатывает запрос на поиск пользователей.
+ *
+ * @param clientSocket Указатель на сокет клиента.
+ * @param request Запрос.
+ */
+void ServerLogic::handleFindUsers(QTcpSocket* clientSocket, const FindUsersRequest &request)
+{
+    const QString &searchText = request.searchText;
+    const QString &userLogin = request.login;
+
+    //Результаты пишутся в сокет по мере чтения; ответ начинается с первой найденной строки,
+    //чтобы ошибка поиска не оборвала уже начатый список
+    WireEncoding encoding = encodingOf(clientSocket);
+    QByteArray &itemBuffer = responseBuffer(clientSocket);
+    std::unique_ptr<ListResponseWriter> writer;
+    auto openWriter = [&]()
+    {
+        if (!writer)
         {
-            QString nickname = query.value("nickname").toString();
-            QString login = query.value("login").toString();
-            QJsonObject userObj;
-            userObj["nickname"] = nickname;
-            userObj["login"] = login;
-            usersArray.append(userObj);
+            writer.reset(new ListResponseWriter(responseDevice(clientSocket), encoding, QJsonObject{{"status", "success"}}, "users"));
         }
-        QJsonObject response;
-        response["status"] = "success";
-        response["users"] = usersArray;
-        clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
+    };
+    //Исключаем пользователя из результатов
+    bool found = repository->findUsers(searchText, userLogin, [&](const ChatRepository::UserRecord &user)
+    {
+        openWriter();
+        ResponseWriter userObj(itemBuffer, encoding, 2);
+        userObj.field("login", user.login).field("nickname", user.nickname);
+        writer->appendEncoded(userObj.finish());
+    });
+    if (!found)
+    {
+        static const ConstantResponse response(QJsonObject{{"status", "error"}, {"message", "Ошибка при поиске пользователей."}});
+        sendResponse(clientSocket, response);
+        return;
     }
-    clientSocket->flush();
+    openWriter();
+    writer->finish();
+    commitResponse(clientSocket);
 }
 
 /**
  * @brief Обрабатывает запрос на создание чата.
  *
  * @param clientSocket Указатель на сокет клиента.
- * @param json JSON-объект с данными запроса.
+ * @param request Запрос.
  */
-void ServerLogic::handleCreateChat(QTcpSocket* clientSocket, const QJsonObject &json)
+void ServerLogic::handleCreateChat(QTcpSocket* clientSocket, const CreateChatRequest &request)
 {
-    QString user1 = json["user1"].toString();
-    QString user2 = json["user2"].toString();
+    const QString &user1 = request.user1;
+    const QString &user2 = request.user2;
     QString chatName = user1 + user2;
 
-    QSqlQuery query(database);
-
     //Проверяем, существует ли уже такой чат
-    query.prepare("SELECT chat_id FROM chats WHERE chat_name = :chatName");
-    query.bindValue(":chatName", chatName);
-    if (query.exec() && query.next()) {
+    int chatId = repository->chatIdByName({chatName});
+    if (chatId >= 0) {
         // ат уже существует, возвращаем ID чата
-        int chatId = query.value("chat_id").toInt();
-        QJsonObject response;
-        response["type"] = "create_chat";
-        response["status"] = "success";
-        response["chat_id"] = chatId;
-        clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
-        clientSocket->flush();
+        ResponseWriter response(responseBuffer(clientSocket), encodingOf(clientSocket), 3);
+        response.field("chat_id", chatId).field("status", "success").field("type", "create_chat");
+        sendEncodedResponse(clientSocket, response.finish());
         return;
     }
 
-    //Вставляем новый чат в таблицу chats
-    query.prepare("INSERT INTO chats (chat_name, chat_type) VALUES (:chatName, 'personal')");
-    query.bindValue(":chatName", chatName);
-    if (!query.exec()) {
-        QJsonObject response;
-        response["type"] = "create_chat";
-        response["status"] = "error";
-        response["message"] = "Failed to create chat.";
-        clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
-        clientSocket->flush();
+    //Создаём новый чат
+    chatId = repository->createChat(chatName, "personal");
+    if (chatId < 0) {
+        static const ConstantResponse response(QJsonObject{{"type", "create_chat"}, {"status", "error"}, {"message", "Failed to create chat."}});
+        sendResponse(clientSocket, response);
         return;
     }
 
-    //Получаем ID нового чата
-    int chatId = query.lastInsertId().toInt();
-
-    //Вставляем участников в таблицу chat_participants
-    query.prepare("INSERT INTO chat_participants (chat_id, user_id) "
-                  "SELECT :chatId, user_id FROM user_auth WHERE login = :userLogin");
-    query.bindValue(":chatId", chatId);
-    query.bindValue(":userLogin", user1);
-    if (!query.exec())
+    //Добавляем участников
+    if (!repository->addParticipants(chatId, {user1}))
     {
-        QJsonObject response;
-        response["type"] = "create_chat";
-        response["status"] = "error";
-        response["message"] = "Failed to add user1 to chat.";
-        clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
-        clientSocket->flush();
+        static const ConstantResponse response(QJsonObject{{"type", "create_chat"}, {"status", "error"}, {"message", "Failed to add user1 to chat."}});
+        sendResponse(clientSocket, response);
         return;
     }
-    query.bindValue(":chatId", chatId);
-    query.bindValue(":userLogin", user2);
-    if (!query.exec())
+    if (!repository->addParticipants(chatId, {user2}))
     {
-        QJsonObject response;
-        response["type"] = "create_chat";
-        response["status"] = "error";
-        response["message"] = "Failed to add user2 to chat.";
-        clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
-        clientSocket->flush();
+        static const ConstantResponse response(QJsonObject{{"type", "create_chat"}, {"status", "error"}, {"message", "Failed to add user2 to chat."}});
+        sendResponse(clientSocket, response);
         return;
     }
 
+    presenceHub.reloadChat(chatId);
+    messageBus.publishChatChanged(chatId);
+
     //Возвращаем успешный ответ
-    QJsonObject response;
-    response["type"] = "create_chat";
-    response["status"] = "success";
-    response["chat_id"] = chatId;
     Logger::getInstance()->logToFile(QString("Chat successfully created and users added to chat ID: %1").arg(chatId));
-    clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
-    clientSocket->flush();
+    ResponseWriter response(responseBuffer(clientSocket), encodingOf(clientSocket), 3);
+    response.field("chat_id", chatId).field("status", "success").field("type", "create_chat");
+    sendEncodedResponse(clientSocket, response.finish());
 }
 
 /**
  * @brief Обрабатывает запрос на получение списка чатов.
  *
  * @param clientSocket Указатель на сокет клиента.
- * @param json JSON-объект с данными запроса.
+ * @param request Запрос.
  */
-void ServerLogic::handleGetChatList(QTcpSocket* clientSocket, const QJsonObject &json)
+void ServerLogic::handleGetChatList(QTcpSocket* clientSocket, const LoginRequest &request)
 {
-    QString login = json["login"].toString();
+    const QString &login = request.login;
 
     // Получение персональных чатов
-    QSqlQuery personalQuery(database);
-    personalQuery.prepare(
-        "SELECT c.chat_id, u2.nickname AS other_nickname, c.chat_type "
-        "FROM chats c "
-        "JOIN chat_participants cp1 ON c.chat_id = cp1.chat_id "
-        "JOIN user_auth u1 ON cp1.user_id = u1.user_id "
-        "JOIN chat_participants cp2 ON c.chat_id = cp2.chat_id AND cp2.user_id != cp1.user_id "
-        "JOIN user_auth u2 ON cp2.user_id = u2.user_id "
-        "WHERE u1.login = :login AND c.chat_type = 'personal'"
-        );
-    personalQuery.bindValue(":login", login);
-
-    if (!personalQuery.exec())
-    {
-        qCritical() << "Ошибка выполнения SQL запроса для персональных чатов: " << personalQuery.lastError();
-        QJsonObject response;
-        response["status"] = "error";
-        response["message"] = "Ошибка при получении списка персональных чатов.";
-        clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
-        clientSocket->flush();
-        return;
-    }
-
-    QJsonArray chatsArray;
-
-    // Обработка результатов для персональных чатов
-    while (personalQuery.next())
+    QVector<ChatRepository::ChatSummary> chats;
+    if (!repository->personalChats(login, chats))
     {
-        int chatId = personalQuery.value("chat_id").toInt();
-        QString otherNickname = personalQuery.value("other_nickname").toString();
-        QString chatType = personalQuery.value("chat_type").toString(); // Получаем тип чата
-
-        // Проверяем количество непрочитанных сообщений
-        QSqlQuery unreadQuery(database);
-        unreadQuery.prepare("SELECT COUNT(*) FROM messages m "
-                            "LEFT JOIN message_read_status mrs ON m.message_id = mrs.message_id "
-                            "WHERE m.chat_id = :chatId AND m.user_id != (SELECT user_id FROM user_auth WHERE login = :login) AND mrs.timestamp_read IS NULL");
-        unreadQuery.bindValue(":chatId", chatId);
-        unreadQuery.bindValue(":login", login);
-
-        if (!unreadQuery.exec() || !unreadQuery.next())
-        {
-            qCritical() << "Ошибка выполнения SQL запроса для непрочитанных сообщений: " << unreadQuery.lastError();
-            continue;
-        }
-
-        int unreadCount = unreadQuery.value(0).toInt();
-
-        QJsonObject chatObj;
-        chatObj["chat_id"] = chatId;
-        chatObj["other_nickname"] = otherNickname;
-        chatObj["unread_count"] = unreadCount; // Добавляем информацию о непрочитанных сообщениях
-        chatObj["chat_type"] = chatType; // Добавляем тип чата
-
-        chatsArray.append(chatObj);
+        qCritical() << "Ошибка выполнения SQL запроса для персональных чатов: " << repository->lastError();
+        static const ConstantResponse response(QJsonObject{{"status", "error"}, {"message", "Ошибка при получении списка персональных чатов."}});
+        sendResponse(clientSocket, response);
+        return;
     }
 
-    // Получение групповых чатов
-    QSqlQuery groupQuery(database);
-    groupQuery.prepare(
-        "SELECT c.chat_id, c.chat_name AS other_nickname, c.chat_type "
-        "FROM chats c "
-        "JOIN chat_participants cp ON c.chat_id = cp.chat_id "
-        "JOIN user_auth u ON cp.user_id = u.user_id "
-        "WHERE u.login = :login AND c.chat_type = 'group'"
-        );
-    groupQuery.bindValue(":login", login);
-
-    if (!groupQuery.exec())
+    // Получение групповых чатов (до начала записи ответа, чтобы ошибка не оборвала уже начатый список)
+    if (!repository->groupChats(login, chats))
     {
-        qCritical() << "Ошибка выполнения SQL запроса для групповых чатов: " << groupQuery.lastError();
-        QJsonObject response;
-        response["status"] = "error";
-        response["message"] = "Ошибка при получении списка групповых чатов.";
-        clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
-        clientSocket->flush();
+        qCritical() << "Ошибка выполнения SQL запроса для групповых чатов: " << repository->lastError();
+        static const ConstantResponse response(QJsonObject{{"status", "error"}, {"message", "Ошибка при получении списка групповых чатов."}});
+        sendResponse(clientSocket, response);
         return;
     }
 
-    // Обработка результатов для групповых чатов
-    while (groupQuery.next())
-    {
-        int chatId = groupQuery.value("chat_id").toInt();
-        QString otherNickname = groupQuery.value("other_nickname").toString();
-        QString chatType = groupQuery.value("chat_type").toString(); // Получаем тип чата
-
-        // Проверяем количество непрочитанных сообщений
-        QSqlQuery unreadQuery(database);
-        unreadQuery.prepare("SELECT COUNT(*) FROM messages m "
-                            "LEFT JOIN message_read_status mrs ON m.message_id = mrs.message_id "
-                            "WHERE m.chat_id = :chatId AND m.user_id != (SELECT user_id FROM user_auth WHERE login = :login) AND mrs.timestamp_read IS NULL");
-
-        unreadQuery.bindValue(":chatId", chatId);
-        unreadQuery.bindValue(":login", login);
-
-        if (!unreadQuery.exec() || !unreadQuery.next())
-        {
-            qCritical() << "Ошибка выполнения SQL запроса для непрочитанных сообщений: " << unreadQuery.lastError();
-            continue;
-        }
-
-        int unreadCount = unreadQuery.value(0).toInt();
+    // Количество непрочитанных сообщений читается для всех чатов одним обращением к хранилищу
+    repository->countUnread(login, chats);
 
-        QJsonObject chatObj;
-        chatObj["chat_id"] = chatId;
-        chatObj["other_nickname"] = otherNickname;
-        chatObj["unread_count"] = unreadCount; // Добавляем информацию о непрочитанных сообщениях
-        chatObj["chat_type"] = chatType; // Добавляем тип чата
+    // Формируем ответ с полным списком чатов, записывая элементы в сокет
+    WireEncoding encoding = encodingOf(clientSocket);
+    QByteArray &itemBuffer = responseBuffer(clientSocket);
+    ListResponseWriter writer(responseDevice(clientSocket), encoding, QJsonObject{{"status", "success"}}, "chats");
+    for (const ChatRepository::ChatSummary &chat : qAsConst(chats))
+    {
+        ResponseWriter chatObj(itemBuffer, encoding, 4);
+        chatObj.field("chat_id", chat.chatId)
+               .field("chat_type", chat.chatType) // Добавляем тип чата
+               .field("other_nickname", chat.title)
+               .field("unread_count", chat.unreadCount); // Добавляем информацию о непрочитанных сообщениях
 
-        chatsArray.append(chatObj);
+        writer.appendEncoded(chatObj.finish());
     }
 
-    // Формируем ответ с полным списком чатов
-    QJsonObject response;
-    response["status"] = "success";
-    response["chats"] = chatsArray;
-
-    clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
-    clientSocket->flush();
+    writer.finish();
+    commitResponse(clientSocket);
 }
 
 /**
  * @brief Обрабатывает запрос на отправку сообщения.
  *
  * @param clientSocket Указатель на сокет клиента.
- * @param json JSON-объект с данными сообщения.
+ * @param request Запрос.
  */
-void ServerLogic::handleSendMessage(QTcpSocket* clientSocket, const QJsonObject &json)
+void ServerLogic::handleSendMessage(QTcpSocket* clientSocket, const SendMessageRequest &request)
 {
-    QString chatIdStr = json["chat_id"].toString();
-    QString userLogin = json["user_id"].toString(); //Здесь на самом деле передается login пользователя
-    QString messageText = json["message_text"].toString();
-    QString timestamp = json["timestamp"].toString(); //Получаем временную метку
-
-    int chatId = chatIdStr.toInt();
+    int chatId = request.chatId;
+    const QString &userLogin = request.userLogin; //Здесь на самом деле передается login пользователя
+    const QString &messageText = request.messageText;
+    const QString &timestamp = request.timestamp;
+    const QString &clientMessageId = request.clientMessageId; //Необязательный идентификатор для повторов
+    QString chatIdStr = QString::number(chatId);
 
     //Получаем user_id по логину пользователя
-    QSqlQuery userIdQuery(database);
-    userIdQuery.prepare("SELECT user_id FROM user_auth WHERE login = :login");
-    userIdQuery.bindValue(":login", userLogin);
-
-    if (!userIdQuery.exec() || !userIdQuery.next())
+    int userId = repository->userIdByLogin(userLogin);
+    if (userId < 0)
     {
         qCritical() << "Ошибка получения user_id для логина: " << userLogin;
         return;
     }
 
-    int userId = userIdQuery.value("user_id").toInt();
+    //Вставляем сообщение в базу данных; повтор с тем же client_msg_id возвращает сохранённое сообщение
+    MessageSequencer::StoredMessage stored = messageSequencer.store(chatId, userId, clientMessageId, messageText, timestamp);
+    if (stored.messageId < 0)
+    {
+        qCritical() << "Ошибка добавления сообщения в чат" << chatId;
+        return;
+    }
 
-    //Вставляем сообщение в базу данных
-    QSqlQuery query(database);
-    query.prepare("INSERT INTO messages (chat_id, user_id, message_text, timestamp_sent) "
-                  "VALUES (:chatId, :userId, :messageText, :timestamp)");
-    query.bindValue(":chatId", chatId);
-    query.bindValue(":userId", userId);
-    query.bindValue(":messageText", messageText);
-    query.bindValue(":timestamp", timestamp); //Привязываем временную метку
+    //Подтверждение пишется в буфер подключения без промежуточного QJsonObject
+    bool withClientId = !clientMessageId.isEmpty();
+    ResponseWriter response(responseBuffer(clientSocket), encodingOf(clientSocket), withClientId ? 6 : 4);
+    if (withClientId)
+    {
+        response.field("client_msg_id", clientMessageId).field("duplicate", stored.duplicate);
+    }
+    response.field("message_id", stored.messageId).field("seq", stored.seq).field("status", "success").field("type", "send_message");
+    sendEncodedResponse(clientSocket, response.finish());
 
-    if (!query.exec())
+    if (stored.duplicate)
     {
-        qCritical() << "Ошибка добавления сообщения: " << query.lastError();
+        //Уведомления уже разосланы при первом запросе
         return;
     }
 
-    QJsonObject response;
-    response["type"] = "send_message";
-    response["status"] = "success";
-    clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
-    clientSocket->flush();
-
     Logger::getInstance()->logToFile(QString("Message sent in chat ID: %1 by user: %2 at %3")
         .arg(chatId).arg(userId).arg(timestamp));
+    messageLog.append(chatId, stored.seq, stored.messageId, userId, timestamp, messageText);
+    if (historyCache.isEnabled())
+    {
+        QJsonObject messageObj;
+        messageObj["user_id"] = userLogin;
+        messageObj["message_text"] = messageText;
+        messageObj["timestamp"] = timestamp;
+        messageObj["message_id"] = stored.messageId;
+        messageObj["seq"] = stored.seq;
+        historyCache.append(chatId, stored.seq, timestamp, messageObj);
+    }
 
-    //Находим второго пользователя в чате
-    QSqlQuery participantQuery(database);
-    participantQuery.prepare("SELECT user_id FROM chat_participants WHERE chat_id = :chatId AND user_id != :userId");
-    participantQuery.bindValue(":chatId", chatId);
-    participantQuery.bindValue(":userId", userId);
-
-    if (participantQuery.exec() && participantQuery.next())
-    {
-        int otherUserId = participantQuery.value("user_id").toInt();
-        qDebug() << "Other user id: " << otherUserId;
-        //Вернем уведомление второму пользователю, если он онлайн
-        if (userSockets.contains(otherUserId)) {
-            qDebug() << "Other user socket: " << userSockets[otherUserId];
-            QTcpSocket *otherUserSocket = userSockets[otherUserId];
-            QJsonObject notification;
-            notification["type"] = "chat_update";
-            notification["chat_id"] = chatIdStr;
-            notification["message_text"] = messageText;
-            notification["timestamp"] = timestamp;
-            notification["user_id"] = userLogin; //Добавляем login пользователя, отправившего сообщение
-            //Отправить новое сообщение в чат пользователя
-            otherUserSocket->write(QJsonDocument(notification).toJson(QJsonDocument::Compact));
-            otherUserSocket->flush();
+    QJsonObject notification;
+    notification["type"] = "chat_update";
+    notification["chat_id"] = chatIdStr;
+    notification["message_text"] = messageText;
+    notification["timestamp"] = timestamp;
+    notification["user_id"] = userLogin; //Добавляем login пользователя, отправившего сообщение
+    notification["message_id"] = stored.messageId;
+    notification["seq"] = stored.seq;
+
+    //Рассылаем уведомление всем сессиям участников чата, включая другие устройства отправителя;
+    //участникам не в сети сообщение ставится в очередь доставки
+    QVector<int> participantIds;
+    if (repository->participants(chatId, participantIds))
+    {
+        QString collapseKey = "chat_update:" + chatIdStr;
+        for (int participantId : qAsConst(participantIds))
+        {
+            bool onlineElsewhere = messageBus.isOnlineElsewhere(participantId);
+            if (onlineElsewhere)
+            {
+                //Сессии участника на других экземплярах сервера
+                messageBus.publishPush(participantId, notification, collapseKey);
+            }
+            if (!sessions.isOnline(participantId) && !onlineElsewhere)
+            {
+                deliveryQueue.enqueue(participantId, chatId, stored.messageId);
+                continue;
+            }
+            deliverChatUpdate(participantId, notification, collapseKey, clientSocket);
         }
     }
 }
 
 /**
- * @brief Обрабатывает запрос на получение истории чата.
+ * @brief Отправляет уведомление chat_update всем сессиям пользователя на этом экземпляре.
  *
- * @param clientSocket Указатель на сокет клиента.
- * @param json JSON-объект с данными запроса.
+ * Для клиентов, согласовавших подтверждения, уведомление запоминается до подтверждения.
+ *
+ * @param userId Идентификатор пользователя.
+ * @param notification Уведомление chat_update.
+ * @param collapseKey Ключ схлопывания уведомлений.
+ * @param exceptSocket Сокет, которому уведомление не отправляется (отправитель сообщения).
  */
-void ServerLogic::handleGetChatHistory(QTcpSocket* clientSocket, const QJsonObject &json)
+void ServerLogic::deliverChatUpdate(int userId, const QJsonObject &notification, const QString &collapseKey,
+                                    QTcpSocket *exceptSocket)
 {
-    if (!json.contains("chat_id") || !json.contains("login"))
+    int chatId = notification["chat_id"].toString().toInt();
+    qint64 seq = notification["seq"].toVariant().toLongLong();
+    int messageId = notification["message_id"].toInt();
+
+    const QVector<ClientSession*> userSessions = sessions.sessionsOf(userId);
+    QVector<QTcpSocket*> sockets;
+    for (ClientSession *session : userSessions)
     {
-        qCritical() << "Invalid request: missing chat_id or login";
-        return;
+        if (session->socket == exceptSocket)
+        {
+            continue;
+        }
+        //Отслеживание до отправки: переполненное подключение закрывается внутри sendPush
+        if (session->acks)
+        {
+            sessions.trackPush(session, chatId, seq, messageId, notification);
+        }
+        sockets.append(session->socket);
+    }
+    for (QTcpSocket *socket : qAsConst(sockets))
+    {
+        sendPush(socket, notification, collapseKey);
     }
+}
 
-    QString chatIdStr = json["chat_id"].toString();
-    QString login = json["login"].toString();
-    int chatId = chatIdStr.toInt();
+/**
+ * @brief Обрабатывает запрос на получение истории чата.
+ *
+ * @param clientSocket Указатель на сокет клиента.
+ * @param request Запрос.
+ */
+void ServerLogic::handleGetChatHistory(QTcpSocket* clientSocket, const ChatHistoryRequest &request)
+{
+    int chatId = request.chatId;
+    const QString &login = request.login;
 
     //Получаем user_id по login
-    QSqlQuery userIdQuery(database);
-    userIdQuery.prepare("SELECT user_id FROM user_auth WHERE login = :login");
-    userIdQuery.bindValue(":login", login);
-
-    if (!userIdQuery.exec() || !userIdQuery.next())
+    int userId = repository->userIdByLogin(login);
+    if (userId < 0)
     {
         qCritical() << "Failed to fetch user_id for login:" << login;
         return;
     }
-    int userId = userIdQuery.value("user_id").toInt();
 
     qDebug() << "User ID from handleGetChatHistory: " << userId;
     qDebug() << "Chat ID from handleGetChatHistory: " << chatId;
 
-    QSqlQuery query(database);
-    query.prepare("SELECT ua.login AS user_id, m.message_text, m.timestamp_sent AS timestamp "
-                  "FROM messages m "
-                  "JOIN user_auth ua ON m.user_id = ua.user_id "
-                  "WHERE m.chat_id = :chatId "
-                  "ORDER BY m.timestamp_sent");
-    query.bindValue(":chatId", chatId);
+    //При указании after_seq выдаются только сообщения после него (заполнение пропуска уведомлений)
+    qint64 afterSeq = request.afterSeq;
 
-    if (!query.exec())
+    //Ответ активного чата уже закодирован и отправляется одной записью
+    WireEncoding encoding = encodingOf(clientSocket);
+    QByteArray cached;
+    if (historyCache.lookup(chatId, afterSeq, encoding, cached))
     {
-        qCritical() << "Error fetching chat history:" << query.lastError();
+        sendEncodedResponse(clientSocket, cached);
+        markMessagesAsRead(chatId, userId);
         return;
     }
 
-    QJsonArray messagesArray;
-    while (query.next())
+    //Если включены сегменты истории, записи пишутся в ответ прямо из отображённого файла
+    MessageLog::MappedHistory history;
+    if (messageLog.openHistory(chatId, afterSeq, history))
     {
-        QString messageUserId = query.value("user_id").toString();
-        QString messageText = query.value("message_text").toString();
-        QString timestamp = query.value("timestamp").toString();
+        ListResponseWriter writer(responseDevice(clientSocket), encoding, QJsonObject{{"type", "get_chat_history"}}, "messages");
+        messageLog.writeHistory(history, writer);
+        writer.finish();
+        commitResponse(clientSocket);
+        markMessagesAsRead(chatId, userId);
+        return;
+    }
 
-        QJsonObject messageObj;
-        messageObj["user_id"] = messageUserId;
-        messageObj["message_text"] = messageText;
-        messageObj["timestamp"] = timestamp;
+    //Полная история чата, которого нет в кэше, попутно собирается для него
+    std::unique_ptr<HistoryCache::Collector> collector;
+    if (historyCache.isEnabled() && afterSeq == 0 && !historyCache.contains(chatId, encoding))
+    {
+        collector.reset(new HistoryCache::Collector(historyCache.messagesPerChat()));
+    }
 
-        messagesArray.append(messageObj);
+    //История пишется в сокет по мере чтения; ответ начинается только после успешного запроса
+    QByteArray &itemBuffer = responseBuffer(clientSocket);
+    std::unique_ptr<ListResponseWriter> writer;
+    auto openWriter = [&]()
+    {
+        if (!writer)
+        {
+            writer.reset(new ListResponseWriter(responseDevice(clientSocket), encoding, QJsonObject{{"type", "get_chat_history"}}, "messages"));
+        }
+    };
+    bool read = repository->history(chatId, afterSeq, [&](const ChatRepository::MessageRecord &message)
+    {
+        openWriter();
+        ResponseWriter messageObj(itemBuffer, encoding, 5);
+        messageObj.field("message_id", message.messageId)
+                  .field("message_text", message.text)
+                  .field("seq", message.seq)
+                  .field("timestamp", message.timestamp)
+                  .field("user_id", message.senderLogin);
+        writer->appendEncoded(messageObj.finish());
+        if (collector)
+        {
+            collector->add(message.seq, message.timestamp, itemBuffer);
+        }
+    });
+    if (!read)
+    {
+        qCritical() << "Error fetching chat history:" << repository->lastError();
+        return;
+    }
+    openWriter();
+    writer->finish();
+    commitResponse(clientSocket);
+    if (collector)
+    {
+        historyCache.store(chatId, encoding, *collector);
     }
 
     //Отметить сообщения как прочитанные
     markMessagesAsRead(chatId, userId);
-
-    QJsonObject response;
-    response["type"] = "get_chat_history";
-    response["messages"] = messagesArray;
-    clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
-    clientSocket->flush();
 }
 
 /**
  * @brief Обрабатывает запрос на открытие или создание чата.
  *
  * @param clientSocket Указатель на сокет клиента.
- * @param json JSON-объект с данными запроса.
+ * @param request Запрос.
  */
-void ServerLogic::handleGetOrCreateChat(QTcpSocket* clientSocket, const QJsonObject &json)
+void ServerLogic::handleGetOrCreateChat(QTcpSocket* clientSocket, const GetOrCreateChatRequest &request)
 {
-    QString login1 = json["login1"].toString();
-    QString login2 = json["login2"].toString();
+    const QString &login1 = request.login1;
+    const QString &login2 = request.login2;
     QString chatName1 = login1 + login2;
     QString chatName2 = login2 + login1; //Вариант, когда промежуточный chatName другой
-    QSqlQuery query(database);
 
     //Проверяем, существует ли уже такой чат
-    query.prepare("SELECT chat_id FROM chats WHERE chat_name = :chatName1 OR chat_name = :chatName2");
-    query.bindValue(":chatName1", chatName1);
-    query.bindValue(":chatName2", chatName2);
-
-    if (query.exec() && query.next())
+    int chatId = repository->chatIdByName({chatName1, chatName2});
+    if (chatId >= 0)
     {
-        int chatId = query.value("chat_id").toInt();
-        QJsonObject response;
-        response["type"] = "get_or_create_chat";
-        response["status"] = "success";
-        response["chat_id"] = QString::number(chatId);  //Преобразование в строку для передачи
         qDebug() << "Existing chatId:" << chatId;
-        clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
-        clientSocket->flush();
+        ResponseWriter response(responseBuffer(clientSocket), encodingOf(clientSocket), 3);
+        response.field("chat_id", QString::number(chatId)) //Преобразование в строку для передачи
+                .field("status", "success").field("type", "get_or_create_chat");
+        sendEncodedResponse(clientSocket, response.finish());
         return;
     }
 
-    //Вставляем новый чат в таблицу chats
-    query.prepare("INSERT INTO chats (chat_name, chat_type) VALUES (:chatName1, 'personal')");
-    query.bindValue(":chatName1", chatName1);
-    if (!query.exec())
+    //Создаём новый чат
+    chatId = repository->createChat(chatName1, "personal");
+    if (chatId < 0)
     {
-        QJsonObject response;
-        response["type"] = "get_or_create_chat";
-        response["status"] = "error";
-        response["message"] = "Failed to create chat.";
-        qCritical() << "Failed to create chat:" << query.lastError().text();
-        clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
-        clientSocket->flush();
+        static const ConstantResponse response(QJsonObject{{"type", "get_or_create_chat"}, {"status", "error"}, {"message", "Failed to create chat."}});
+        qCritical() << "Failed to create chat:" << repository->lastError();
+        sendResponse(clientSocket, response);
         return;
     }
-
-    //Получаем ID нового чата
-    int chatId = query.lastInsertId().toInt();
     qDebug() << "New chatId created:" << chatId;
 
-    //Вставляем участников в таблицу chat_participants для обоих логинов
-    query.prepare("INSERT INTO chat_participants (chat_id, user_id) "
-                  "SELECT :chatId, user_id FROM user_auth WHERE login = :login1 OR login = :login2");
-    query.bindValue(":chatId", chatId);
-    query.bindValue(":login1", login1);
-    query.bindValue(":login2", login2);
-    if (!query.exec())
-    {
-        QJsonObject response;
-        response["type"] = "get_or_create_chat";
-        response["status"] = "error";
-        response["message"] = "Failed to add users to chat.";
-        qCritical() << "Failed to add users to chat:" << query.lastError().text();
-        clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
-        clientSocket->flush();
+    //Добавляем в чат обоих пользователей одним запросом
+    if (!repository->addParticipants(chatId, {login1, login2}))
+    {
+        static const ConstantResponse response(QJsonObject{{"type", "get_or_create_chat"}, {"status", "error"}, {"message", "Failed to add users to chat."}});
+        qCritical() << "Failed to add users to chat:" << repository->lastError();
+        sendResponse(clientSocket, response);
         return;
     }
 
+    presenceHub.reloadChat(chatId);
+    messageBus.publishChatChanged(chatId);
+
     //Возвращаем успешный ответ с chat_id
-    QJsonObject response;
-    response["type"] = "get_or_create_chat";
-    response["status"] = "success";
-    response["chat_id"] = QString::number(chatId);
-    clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
-    clientSocket->flush();
+    ResponseWriter response(responseBuffer(clientSocket), encodingOf(clientSocket), 3);
+    response.field("chat_id", QString::number(chatId)).field("status", "success").field("type", "get_or_create_chat");
+    sendEncodedResponse(clientSocket, response.finish());
 }
 
 /**
@@ -1003,107 +2134,74 @@ void ServerLogic::handleGetOrCreateChat(QTcpSocket* clientSocket, const QJsonObj
  */
 void ServerLogic::markMessagesAsRead(int chatId, int userId)
 {
-    QSqlQuery selectQuery(database);
-    selectQuery.prepare("SELECT message_id FROM messages WHERE chat_id = :chatId AND user_id != :userId");
-    selectQuery.bindValue(":chatId", chatId);
-    selectQuery.bindValue(":userId", userId);
-
-    if (!selectQuery.exec())
+    QVector<int> messageIds;
+    if (!repository->markChatRead(chatId, userId, messageIds))
     {
-        qCritical() << "Error fetching message IDs to mark as read:" << selectQuery.lastError().text();
+        qCritical() << "Error fetching message IDs to mark as read:" << repository->lastError();
         return;
     }
 
-    QSqlQuery insertQuery(database);
-    while (selectQuery.next())
+    for (int messageId : qAsConst(messageIds))
     {
-        int messageId = selectQuery.value("message_id").toInt();
-        insertQuery.prepare("INSERT OR IGNORE INTO message_read_status (message_id, user_id, timestamp_read) "
-                            "VALUES (:messageId, :userId, CURRENT_TIMESTAMP)");
-        insertQuery.bindValue(":messageId", messageId);
-        insertQuery.bindValue(":userId", userId);
-
-        if (!insertQuery.exec())
-        {
-            qCritical() << "Error marking message as read:" << insertQuery.lastError().text();
-        }
-        else
-        {
-            Logger::getInstance()->logToFile(QString("Marked message ID: %1 as read in chat ID: %2 for user ID: %3")
-                .arg(messageId).arg(chatId).arg(userId));
-        }
+        Logger::getInstance()->logToFile(QString("Marked message ID: %1 as read in chat ID: %2 for user ID: %3")
+            .arg(messageId).arg(chatId).arg(userId));
     }
 }
 
 /**
- * @brief Обрабатывает запрос на удаление чата.
+ * @brief Переключает обработчики на другое хранилище.
  *
- * @param clientSocket Указатель на сокет клиента.
- * @param json JSON-объект с данными запроса.
+ * Нумерация сообщений и состав чатов для присутствия читаются из нового хранилища.
+ * Сегменты истории дозаписываются из таблицы messages, поэтому с другим хранилищем
+ * они выключаются.
+ *
+ * @param repository Хранилище; nullptr возвращает хранилище SQLite.
  */
-void ServerLogic::handleDeleteChat(QTcpSocket* clientSocket, const QJsonObject &json)
+void ServerLogic::useRepository(ChatRepository *repository)
 {
-    if (!json.contains("chat_id"))
-    {
-        qCritical() << "Invalid delete chat request: missing chat_id";
-        QJsonObject response;
-        response["type"] = "error";
-        response["message"] = "Missing chat_id";
-        clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
-        clientSocket->flush();
-        return;
-    }
-
-    //Извлекаем chat_id как строку
-    QString chatIdStr = json["chat_id"].toString();
-    if (chatIdStr.isEmpty())
+    this->repository = repository ? repository : &sqliteRepository;
+    QSettings settings(QDir::homePath() + "/appsettings.ini", QSettings::IniFormat);
+    messageSequencer.open(this->repository, settings.value("Messages/dedupWindow", 10000).toInt());
+    presenceHub.setRepository(this->repository);
+    sessionTokens.setRepository(this->repository);
+    if (this->repository != &sqliteRepository)
     {
-        qCritical() << "Invalid delete chat request: empty chat_id string";
-        QJsonObject response;
-        response["type"] = "error";
-        response["message"] = "Invalid chat_id";
-        clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
-        clientSocket->flush();
-        return;
+        messageLog.close();
     }
+    historyCache.clear();
+    Logger::getInstance()->logToFile("Storage engine: " + this->repository->engineName());
+}
 
-    //Преобразуем строку в целое число
-    bool ok;
-    int chatId = chatIdStr.toInt(&ok);
-    if (!ok)
-    {
-        qCritical() << "Invalid delete chat request: chat_id is not a valid integer";
-        QJsonObject response;
-        response["type"] = "error";
-        response["message"] = "Invalid chat_id";
-        clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
-        clientSocket->flush();
-        return;
-    }
+/**
+ * @brief Обрабатывает запрос на удаление чата.
+ *
+ * @param clientSocket Указатель на сокет клиента.
+ * @param request Запрос.
+ */
+void ServerLogic::handleDeleteChat(QTcpSocket* clientSocket, const DeleteChatRequest &request)
+{
+    int chatId = request.chatId;
 
     qDebug() << "Deleting chat with ID:" << chatId;
 
     //Удаление чата из базы данных
-    QSqlQuery query(database);
-    query.prepare("DELETE FROM chats WHERE chat_id = :chatId");
-    query.bindValue(":chatId", chatId);
-
-    if (!query.exec())
-    {
-        qCritical() << "Error deleting chat: " << query.lastError();
-        QJsonObject response;
-        response["type"] = "error";
-        response["message"] = "Failed to delete chat";
-        clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
-        clientSocket->flush();
+    if (!repository->deleteChat(chatId))
+    {
+        qCritical() << "Error deleting chat: " << repository->lastError();
+        static const ConstantResponse response(QJsonObject{{"type", "error"}, {"message", "Failed to delete chat"}});
+        sendResponse(clientSocket, response);
         return;
     }
 
-    QJsonObject response;
-    response["type"] = "success";
-    response["message"] = "Chat deleted successfully";
-    clientSocket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
-    clientSocket->flush();
+    deliveryQueue.removeChat(chatId);
+    messageSequencer.forgetChat(chatId);
+    messageLog.removeChat(chatId);
+    historyCache.removeChat(chatId);
+    presenceHub.removeChat(chatId);
+    messageBus.publishChatDeleted(chatId);
+
+    static const ConstantResponse response(QJsonObject{{"type", "success"}, {"message", "Chat deleted successfully"}});
+    sendResponse(clientSocket, response);
 
     Logger::getInstance()->logToFile(QString("Chat ID: %1 deleted successfully").arg(chatId));
 }
@@ -7,12 +7,37 @@
 #define SERVERLOGIC_H
 
 #include "logger.h"
+#include "trafficcapture.h"
+#include "wireprotocol.h"
+#include "payloadcompressor.h"
+#include "outboundqueue.h"
+#include "sessionregistry.h"
+#include "sessiontokens.h"
+#include "credentialpool.h"
+#include "rsakeypool.h"
+#include "tlslistener.h"
+#include "ratelimiter.h"
+#include "sqlitechatrepository.h"
+#include "deliveryqueue.h"
+#include "messagesequencer.h"
+#include "messagelog.h"
+#include "historycache.h"
+#include "presencehub.h"
+#include "messagebus.h"
+#include "reuseportlistener.h"
+#include "hotrestart.h"
+#include "requestschema.h"
+#include "requestarena.h"
 #include <QTcpServer>
 #include <QDir>
 #include <QSqlDatabase>
 #include <QSqlError>
 #include <QTcpSocket>
-#include <qrsaencryption.h>
+#include <QTimer>
+#include <QBuffer>
+#include <QSettings>
+#include <QHash>
+#include <functional>
 
 /**
  * /brief Класс ServerLogic.
@@ -23,24 +48,145 @@
 class ServerLogic : public QTcpServer
 {
     Q_OBJECT
+    friend class HandlerBenchmarks;
 
 private:
-    QHash<int, QTcpSocket*> userSockets; ///< Хранит сокеты пользователей, связанных с их идентификаторами.
+    /**
+     * /brief Обработчик запросов одного типа: проверяет запрос по схеме и выполняет его.
+     *
+     * Запрос передаётся разобранным JsonEnvelope или, если быстрый разбор не удался
+     * (указатель равен nullptr), в виде QJsonObject.
+     */
+    using RequestRoute = std::function<void(QTcpSocket *, const JsonEnvelope *, const QJsonObject &)>;
+
+    SessionRegistry sessions; ///< Сессии подключённых клиентов и их привязка к пользователям.
+    SessionTokens sessionTokens; ///< Выдача и проверка токенов для восстановления сессий.
+    CredentialPool credentialPool; ///< Пул потоков для хеширования и проверки паролей.
+    RsaKeyPool rsaKeyPool; ///< Заранее сгенерированные ключи RSA для зашифрованных сессий.
+    TlsListener tlsListener; ///< Приём TLS-подключений на отдельном порту.
+    RateLimiter rateLimiter; ///< Ограничение частоты запросов подключений и пользователей.
+    SqliteChatRepository sqliteRepository; ///< Хранилище пользователей, чатов и сообщений в базе данных сервера.
+    ChatRepository *repository = &sqliteRepository; ///< Хранилище, через которое работают обработчики.
+    DeliveryQueue deliveryQueue; ///< Очередь обновлений для пользователей не в сети.
+    MessageSequencer messageSequencer; ///< Идемпотентное сохранение сообщений с номерами в чате.
+    MessageLog messageLog; ///< Сегменты истории чатов для чтения через отображение в память.
+    HistoryCache historyCache; ///< Готовые ответы с историей активных чатов.
+    PresenceHub presenceHub; ///< Рассылка присутствия и набора текста без записи в базу данных.
+    MessageBus messageBus; ///< Шина обмена уведомлениями с другими экземплярами сервера.
+    ReusePortListener reusePortListener; ///< Дополнительные потоки приёма подключений на порту с SO_REUSEPORT.
+    HotRestart hotRestart; ///< Передача сокетов новому процессу при перезапуске без разрыва подключений.
+    QString handoffPath; ///< Путь к Unix-сокету передачи (пусто, если перезапуск без разрыва выключен).
+    qintptr inheritedTlsDescriptor = -1; ///< Слушающий сокет TLS, полученный от предыдущего процесса.
+    QTimer drainTimer; ///< Таймер ожидания закрытия подключений после передачи сокетов.
     QSqlDatabase database; ///< Объект базы данных для взаимодействия с SQL-сервером.
+    TrafficRecorder trafficRecorder; ///< Запись входящего трафика для последующего воспроизведения.
+    QTimer captureFlushTimer; ///< Таймер периодического сброса файла захвата на диск.
+    quint32 nextConnectionId = 0; ///< Идентификатор, который получит следующее подключение.
+    PayloadCompressor payloadCompressor; ///< Сжатие ответов для подключений, согласовавших его.
+    OutboundQueue outboundQueue; ///< Исходящие очереди подключений с объединением записей и контролем переполнения.
+    QBuffer stagingBuffer; ///< Буфер для сборки потоковых ответов перед сжатием.
+    QByteArray spareResponseBuffer; ///< Буфер ответов для сокетов без сессии.
+    QTimer metricsTimer; ///< Таймер периодической записи счётчиков в журнал.
+    RequestArena requestArena; ///< Память, выделяемая на время обработки одного запроса.
+    QHash<QString, RequestRoute> requestRoutes; ///< Обработчики запросов по типам.
+
+    /**
+     * /brief Регистрирует обработчик запросов указанного типа.
+     *
+     * Запрос проверяется и разбирается по схеме RequestSchema<Request>; запрос, не
+     * соответствующий схеме, получает ответ об ошибке и до обработчика не доходит.
+     *
+     * /param type Тип запроса.
+     * /param handler Обработчик типизированного запроса.
+     */
+    template<typename Request>
+    void route(const char *type, void (ServerLogic::*handler)(QTcpSocket *, const Request &))
+    {
+        QString typeName = QString::fromLatin1(type);
+        requestRoutes.insert(typeName, [this, typeName, handler](QTcpSocket *clientSocket, const JsonEnvelope *envelope,
+                                                                 const QJsonObject &json)
+                             {
+                                 Request request;
+                                 RequestError error;
+                                 bool parsed = envelope ? RequestParser::parse(*envelope, request, error)
+                                                        : RequestParser::parse(json, request, error);
+                                 if (!parsed)
+                                 {
+                                     sendRequestError(clientSocket, typeName, error);
+                                     return;
+                                 }
+                                 (this->*handler)(clientSocket, request);
+                             });
+    }
+
+    /**
+     * /brief Заполняет таблицу обработчиков запросов.
+     */
+    void registerRoutes();
+
+    /**
+     * /brief Отправляет ответ о запросе, не прошедшем проверку по схеме.
+     * /param clientSocket Указатель на сокет клиента.
+     * /param type Тип запроса.
+     * /param error Ошибка разбора.
+     */
+    void sendRequestError(QTcpSocket *clientSocket, const QString &type, const RequestError &error);
+
+    /**
+     * /brief Включает запись входящего трафика, если она разрешена в настройках.
+     */
+    void startTrafficCaptureIfEnabled();
+
+    /**
+     * /brief Запускает приём TLS-подключений, если он разрешён в настройках.
+     */
+    void startTlsListenerIfEnabled();
+
+    /**
+     * /brief Подключает сервер к шине экземпляров, если это разрешено в настройках.
+     */
+    void startMessageBusIfEnabled();
+
+    /**
+     * /brief Принимает слушающие сокеты и подключения от работающего процесса сервера.
+     * /param path Путь к Unix-сокету передачи.
+     * /return Признак того, что основной слушающий сокет получен.
+     */
+    bool takeOverFrom(const QString &path);
+
+    /**
+     * /brief Начинает обслуживание подключения, полученного от предыдущего процесса.
+     * /param descriptor Дескриптор подключения.
+     * /param state Состояние сессии.
+     */
+    void adoptHandedOffConnection(qintptr descriptor, const QJsonObject &state);
+
+    /**
+     * /brief Проверяет, можно ли передать подключение новому процессу без потери данных.
+     * /param session Сессия.
+     * /return Признак возможности передачи.
+     */
+    bool canHandOff(const ClientSession *session) const;
+
+    /**
+     * /brief Освобождает подключение, переданное новому процессу, не закрывая соединение TCP.
+     * /param clientSocket Указатель на сокет клиента.
+     */
+    void releaseHandedOffConnection(QTcpSocket *clientSocket);
 
     /**
      * /brief Проверяет, содержит ли пароль необходимые символы.
      * /param password Пароль для проверки.
      * /return Признак, соответствует ли пароль требованиям (true, если соответствует).
      */
-    bool passwordContainsRequiredCharacters(const QString &password);
+    static bool passwordContainsRequiredCharacters(const QString &password);
 
     /**
      * /brief Проверяет, содержит ли логин только допустимые символы.
      * /param login Логин для проверки.
      * /return Признак, содержит ли логин только разрешённые символы (true, если содержит).
      */
-    bool loginContainsOnlyAllowedCharacters(const QString &login);
+    static bool loginContainsOnlyAllowedCharacters(const QString &login);
 
     /**
      * /brief Проверяет доступность логина для регистрации.
@@ -50,40 +196,205 @@ private:
     bool loginAvailable(const QString& login);
 
     /**
-     * /brief Получает SHA-512 хеш строки с солью.
-     * /param str Строка для хеширования.
-     * /param salt Соль для хеширования.
-     * /return Хешированная строка.
+     * /brief Возвращает кодировку, согласованную с подключением.
+     * /param socket Указатель на сокет клиента.
+     * /return Кодировка подключения.
+     */
+    WireEncoding encodingOf(QTcpSocket *socket) const;
+
+    /**
+     * /brief Передаёт готовые байты в исходящую очередь, шифруя их для зашифрованных сессий.
+     * /param socket Указатель на сокет клиента.
+     * /param data Закодированное сообщение или кадр сжатия.
+     */
+    void transmit(QTcpSocket *socket, const QByteArray &data);
+
+    /**
+     * /brief Кодирует ответ в кодировке подключения и отправляет его клиенту.
+     * /param socket Указатель на сокет клиента.
+     * /param response Ответ в общей модели сообщений.
      */
-    QString getSha512Hash(const QString &str, const QString &salt);
+    void sendResponse(QTcpSocket *socket, const QJsonObject &response);
+
+    /**
+     * /brief Отправляет клиенту уже закодированный ответ (с учётом сжатия и шифрования).
+     * /param socket Указатель на сокет клиента.
+     * /param data Ответ в кодировке подключения.
+     */
+    void sendEncodedResponse(QTcpSocket *socket, const QByteArray &data);
+
+    /**
+     * /brief Отправляет клиенту постоянный ответ в кодировке подключения.
+     * /param socket Указатель на сокет клиента.
+     * /param response Постоянный ответ.
+     */
+    void sendResponse(QTcpSocket *socket, const ConstantResponse &response);
+
+    /**
+     * /brief Возвращает переиспользуемый буфер ответа подключения для ResponseWriter.
+     * /param socket Указатель на сокет клиента.
+     * /return Буфер ответа (его содержимое перезаписывается следующим ответом).
+     */
+    QByteArray &responseBuffer(QTcpSocket *socket);
+
+    /**
+     * /brief Отправляет необязательное push-уведомление.
+     *
+     * Если клиент не успевает читать, уведомление сворачивается по ключу и будет
+     * отправлено позже с признаком collapsed.
+     *
+     * /param socket Указатель на сокет клиента.
+     * /param push Уведомление в общей модели сообщений.
+     * /param collapseKey Ключ свёртки уведомлений.
+     */
+    void sendPush(QTcpSocket *socket, const QJsonObject &push, const QString &collapseKey);
+
+    /**
+     * /brief Отправляет уведомление без свёртки, учитывая его объём в очереди подключения.
+     *
+     * Объём уведомлений, а не ответов на запросы, проверяется по жёсткому пределу очереди.
+     *
+     * /param socket Указатель на сокет клиента.
+     * /param push Уведомление в общей модели сообщений.
+     */
+    void deliverPush(QTcpSocket *socket, const QJsonObject &push);
+
+    /**
+     * /brief Возвращает устройство, в которое следует писать потоковый ответ.
+     *
+     * Для подключений без сжатия и шифрования это сам сокет, для остальных — промежуточный
+     * буфер, так как кадр сжатого или зашифрованного ответа требует знать его полный размер.
+     *
+     * /param socket Указатель на сокет клиента.
+     * /return Устройство для записи ответа.
+     */
+    QIODevice *responseDevice(QTcpSocket *socket);
+
+    /**
+     * /brief Завершает потоковый ответ, начатый через responseDevice().
+     * /param socket Указатель на сокет клиента.
+     */
+    void commitResponse(QTcpSocket *socket);
+
+    /**
+     * /brief Обрабатывает запрос hello на согласование кодировки.
+     * /param clientSocket Указатель на сокет клиента.
+     * /param request Запрос.
+     */
+    void handleHello(QTcpSocket *clientSocket, const HelloRequest &request);
+
+    /**
+     * /brief Разбирает и выполняет один запрос клиента.
+     * /param clientSocket Указатель на сокет клиента.
+     * /param jsonData Закодированный запрос.
+     */
+    void processRequest(QTcpSocket *clientSocket, const QByteArray &jsonData);
+
+    /**
+     * /brief Обрабатывает запрос secure_hello: выдаёт клиенту открытый ключ RSA.
+     * /param clientSocket Указатель на сокет клиента.
+     * /param request Запрос (без полей).
+     */
+    void handleSecureHello(QTcpSocket *clientSocket, const EmptyRequest &request);
+
+    /**
+     * /brief Обрабатывает запрос secure_key: принимает зашифрованный RSA сеансовый ключ.
+     * /param clientSocket Указатель на сокет клиента.
+     * /param request Запрос.
+     */
+    void handleSecureKey(QTcpSocket *clientSocket, const SecureKeyRequest &request);
+
+    /**
+     * /brief Обрабатывает запрос на регистрацию.
+     * /param clientSocket Указатель на сокет клиента.
+     * /param request Запрос.
+     */
+    void handleRegister(QTcpSocket *clientSocket, const CredentialsRequest &request);
+
+    /**
+     * /brief Обрабатывает запрос на вход.
+     * /param clientSocket Указатель на сокет клиента.
+     * /param request Запрос.
+     */
+    void handleLogin(QTcpSocket *clientSocket, const CredentialsRequest &request);
+
+    /**
+     * /brief Обрабатывает запрос на смену логина.
+     * /param clientSocket Указатель на сокет клиента.
+     * /param request Запрос.
+     */
+    void handleUpdateLogin(QTcpSocket *clientSocket, const UpdateLoginRequest &request);
+
+    /**
+     * /brief Обрабатывает запрос на смену пароля.
+     * /param clientSocket Указатель на сокет клиента.
+     * /param request Запрос.
+     */
+    void handleUpdatePassword(QTcpSocket *clientSocket, const UpdatePasswordRequest &request);
+
+    /**
+     * /brief Обрабатывает запрос resume на восстановление сессии по токену.
+     * /param clientSocket Указатель на сокет клиента.
+     * /param request Запрос.
+     */
+    void handleResume(QTcpSocket *clientSocket, const ResumeRequest &request);
+
+    /**
+     * /brief Отправляет клиенту накопленные за время отсутствия обновления чатов.
+     * /param clientSocket Указатель на сокет клиента.
+     * /param userId Идентификатор пользователя.
+     */
+    void flushPendingDeliveries(QTcpSocket *clientSocket, int userId);
+
+    /**
+     * /brief Отправляет уведомление chat_update всем сессиям пользователя на этом экземпляре.
+     * /param userId Идентификатор пользователя.
+     * /param notification Уведомление chat_update.
+     * /param collapseKey Ключ схлопывания уведомлений.
+     * /param exceptSocket Сокет, которому уведомление не отправляется.
+     */
+    void deliverChatUpdate(int userId, const QJsonObject &notification, const QString &collapseKey,
+                           QTcpSocket *exceptSocket);
+
+    /**
+     * /brief Задаёт параметры ограничения частоты запросов из настроек.
+     * /param settings Настройки сервера.
+     */
+    void configureRateLimits(QSettings &settings);
+
+    /**
+     * /brief Загружает ключ подписи токенов из настроек, создавая его при первом запуске.
+     * /param settings Настройки сервера.
+     */
+    void loadSessionTokenKey(QSettings &settings);
 
     /**
      * /brief Обрабатывает запрос на получение списка чатов.
      * /param clientSocket Указатель на сокет клиента.
-     * /param json Объект JSON с данными запроса.
+     * /param request Запрос.
      */
-    void handleGetChatList(QTcpSocket* clientSocket, const QJsonObject &json);
+    void handleGetChatList(QTcpSocket* clientSocket, const LoginRequest &request);
 
     /**
      * /brief Обрабатывает запрос на отправку сообщения.
      * /param clientSocket Указатель на сокет клиента.
-     * /param json Объект JSON с данными запроса.
+     * /param request Запрос.
      */
-    void handleSendMessage(QTcpSocket* clientSocket, const QJsonObject &json);
+    void handleSendMessage(QTcpSocket* clientSocket, const SendMessageRequest &request);
 
     /**
      * /brief Обрабатывает запрос на получение истории переписки.
      * /param clientSocket Указатель на сокет клиента.
-     * /param json Объект JSON с данными запроса.
+     * /param request Запрос.
      */
-    void handleGetChatHistory(QTcpSocket* clientSocket, const QJsonObject &json);
+    void handleGetChatHistory(QTcpSocket* clientSocket, const ChatHistoryRequest &request);
 
     /**
      * /brief Обрабатывает запрос на получение или создание чата.
      * /param clientSocket Указатель на сокет клиента.
-     * /param json Объект JSON с данными запроса.
+     * /param request Запрос.
      */
-    void handleGetOrCreateChat(QTcpSocket* clientSocket, const QJsonObject &json);
+    void handleGetOrCreateChat(QTcpSocket* clientSocket, const GetOrCreateChatRequest &request);
 
     /**
      * /brief Помечает сообщения как прочитанные.
@@ -92,15 +403,84 @@ private:
      */
     void markMessagesAsRead(int chatId, int userId);
 
+    /**
+     * /brief Переключает обработчики на другое хранилище (используется замерами).
+     * /param repository Хранилище; nullptr возвращает хранилище SQLite.
+     */
+    void useRepository(ChatRepository *repository);
+
     /**
      * /brief Обрабатывает запрос на удаление чата.
      * /param clientSocket Указатель на сокет клиента.
-     * /param json Объект JSON с данными запроса.
+     * /param request Запрос.
+     */
+    void handleDeleteChat(QTcpSocket* clientSocket, const DeleteChatRequest &request);
+
+    /**
+     * /brief Обрабатывает запрос на создание чата.
+     * /param clientSocket Указатель на сокет клиента.
+     * /param request Запрос.
      */
-    void handleDeleteChat(QTcpSocket* clientSocket, const QJsonObject &json);
+    void handleCreateChat(QTcpSocket* clientSocket, const CreateChatRequest &request);
 
     /**
-     * /brief Генерирует RSA ключи для шифрования.
+     * /brief Обрабатывает запрос на поиск пользователей.
+     * /param clientSocket Указатель на сокет клиента.
+     * /param request Запрос.
+     */
+    void handleFindUsers(QTcpSocket* clientSocket, const FindUsersRequest &request);
+
+    /**
+     * /brief Обрабатывает запрос check_nickname: выдаёт отображаемое имя пользователя.
+     * /param clientSocket Указатель на сокет клиента.
+     * /param request Запрос.
+     */
+    void handleCheckNickname(QTcpSocket *clientSocket, const LoginRequest &request);
+
+    /**
+     * /brief Обрабатывает запрос на смену отображаемого имени.
+     * /param clientSocket Указатель на сокет клиента.
+     * /param request Запрос.
+     */
+    void handleUpdateNickname(QTcpSocket *clientSocket, const UpdateNicknameRequest &request);
+
+    /**
+     * /brief Обрабатывает запрос check_chat_exists: создаёт групповой чат с уникальным названием.
+     * /param clientSocket Указатель на сокет клиента.
+     * /param request Запрос.
+     */
+    void handleCheckChatExists(QTcpSocket *clientSocket, const CheckChatExistsRequest &request);
+
+    /**
+     * /brief Отвечает на ping клиента.
+     * /param clientSocket Указатель на сокет клиента.
+     * /param request Запрос (без полей).
+     */
+    void handlePing(QTcpSocket *clientSocket, const EmptyRequest &request);
+
+    /**
+     * /brief Пересылает индикатор набора текста участникам чата в сети.
+     * /param clientSocket Указатель на сокет клиента.
+     * /param request Запрос.
+     */
+    void handleTyping(QTcpSocket *clientSocket, const TypingRequest &request);
+
+    /**
+     * /brief Принимает подтверждение получения уведомлений чата.
+     * /param clientSocket Указатель на сокет клиента.
+     * /param request Запрос.
+     */
+    void handleAck(QTcpSocket *clientSocket, const AckRequest &request);
+
+    /**
+     * /brief Принимает подтверждение получения кадра pending_updates.
+     * /param clientSocket Указатель на сокет клиента.
+     * /param request Запрос (без полей).
+     */
+    void handleAckPending(QTcpSocket *clientSocket, const EmptyRequest &request);
+
+    /**
+     * /brief Запускает фоновую генерацию ключей RSA для зашифрованных сессий.
      */
     void generateRSAKeys();
 
@@ -111,18 +491,16 @@ private slots:
     void onNewConnection();
 
     /**
-     * /brief Обрабатывает запрос на создание чата.
-     * /param clientSocket Указатель на сокет клиента.
-     * /param json Объект JSON с данными запроса.
+     * /brief Передаёт сокеты новому процессу сервера и завершает работу после их закрытия.
+     * /param channel Дескриптор канала передачи.
      */
-    void handleCreateChat(QTcpSocket* clientSocket, const QJsonObject &json);
+    void handOffTo(qintptr channel);
 
     /**
-     * /brief Обрабатывает запрос на поиск пользователей.
+     * /brief Начинает обслуживание подключения клиента (открытого или TLS).
      * /param clientSocket Указатель на сокет клиента.
-     * /param json Объект JSON с данными запроса.
      */
-    void handleFindUsers(QTcpSocket* clientSocket, const QJsonObject &json);
+    void adoptConnection(QTcpSocket *clientSocket);
 
 public:
     /**
@@ -131,6 +509,13 @@ public:
      */
     ServerLogic(QObject *parent = nullptr);
 
+    /**
+     * /brief Конструктор класса ServerLogic с указанием файла базы данных.
+     * /param databasePath Путь к файлу базы данных SQLite.
+     * /param parent Указатель на родительский объект.
+     */
+    ServerLogic(const QString &databasePath, QObject *parent = nullptr);
+
     /**
      * /brief Запускает сервер на указанном порту.
      * /param port Порт, на котором будет слушать сервер.
@@ -0,0 +1,74 @@
+#include "servermetrics.h"
+
+#include <QMutexLocker>
+#include <QStringList>
+
+ServerMetrics* ServerMetrics::instance = nullptr; ///< Указатель на единственный экземпляр ServerMetrics.
+
+/**
+ * @brief Получает указатель на единственный экземпляр класса ServerMetrics.
+ *
+ * Экземпляр создаётся при первом обращении из основного потока, до запуска рабочих потоков.
+ *
+ * @return Указатель на экземпляр ServerMetrics.
+ */
+ServerMetrics* ServerMetrics::getInstance()
+{
+    if (instance == nullptr)
+    {
+        instance = new ServerMetrics();
+    }
+    return instance;
+}
+
+/**
+ * @brief Увеличивает счётчик.
+ *
+ * @param name Имя счётчика.
+ * @param delta Приращение.
+ */
+void ServerMetrics::add(const QString &name, double delta)
+{
+    QMutexLocker locker(&mutex);
+    values[name] += delta;
+}
+
+/**
+ * @brief Устанавливает значение показателя.
+ *
+ * @param name Имя показателя.
+ * @param value Новое значение.
+ */
+void ServerMetrics::set(const QString &name, double value)
+{
+    QMutexLocker locker(&mutex);
+    values[name] = value;
+}
+
+/**
+ * @brief Возвращает значение счётчика.
+ *
+ * @param name Имя счётчика.
+ * @return Значение счётчика или 0, если он не заводился.
+ */
+double ServerMetrics::value(const QString &name) const
+{
+    QMutexLocker locker(&mutex);
+    return values.value(name, 0);
+}
+
+/**
+ * @brief Формирует строку со всеми счётчиками для журнала.
+ *
+ * @return Строка со счётчиками в алфавитном порядке имён.
+ */
+QString ServerMetrics::summary() const
+{
+    QMutexLocker locker(&mutex);
+    QStringList parts;
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it)
+    {
+        parts << QString("%1=%2").arg(it.key()).arg(it.value(), 0, 'g', 6);
+    }
+    return parts.join(' ');
+}
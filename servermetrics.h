@@ -0,0 +1,63 @@
+/**
+ * /file servermetrics.h
+ * /brief Определение класса ServerMetrics для сбора счётчиков работы сервера.
+ */
+
+#ifndef SERVERMETRICS_H
+#define SERVERMETRICS_H
+
+#include <QString>
+#include <QMap>
+#include <QMutex>
+
+/**
+ * /brief Класс ServerMetrics.
+ *
+ * Хранит именованные счётчики и показатели сервера (объём сжатых данных, число рукопожатий
+ * и т. п.). Как и Logger, реализует шаблон Singleton. Методы потокобезопасны, так как
+ * счётчики обновляются и из рабочих потоков.
+ */
+class ServerMetrics
+{
+private:
+    static ServerMetrics* instance; ///< Указатель на единственный экземпляр класса ServerMetrics.
+    mutable QMutex mutex; ///< Мьютекс, защищающий значения счётчиков.
+    QMap<QString, double> values; ///< Значения счётчиков по именам.
+    ServerMetrics() = default; ///< Приватный конструктор для предотвращения создания дополнительных экземпляров.
+
+public:
+    /**
+     * /brief Получает единственный экземпляр класса ServerMetrics.
+     * /return Указатель на экземпляр ServerMetrics.
+     */
+    static ServerMetrics* getInstance();
+
+    /**
+     * /brief Увеличивает счётчик.
+     * /param name Имя счётчика.
+     * /param delta Приращение.
+     */
+    void add(const QString &name, double delta = 1);
+
+    /**
+     * /brief Устанавливает значение показателя.
+     * /param name Имя показателя.
+     * /param value Новое значение.
+     */
+    void set(const QString &name, double value);
+
+    /**
+     * /brief Возвращает значение счётчика.
+     * /param name Имя счётчика.
+     * /return Значение (0, если счётчик не заводился).
+     */
+    double value(const QString &name) const;
+
+    /**
+     * /brief Формирует строку со всеми счётчиками для журнала.
+     * /return Строка вида "name=value name=value ...".
+     */
+    QString summary() const;
+};
+
+#endif // SERVERMETRICS_H
@@ -0,0 +1,494 @@
+#include "sessionregistry.h"
+#include "logger.h"
+#include "servermetrics.h"
+
+#include <QJsonArray>
+#include <limits>
+
+/**
+ * @brief Конструктор класса SessionRegistry.
+ *
+ * @param parent Указатель на родительский объект (по умолчанию nullptr).
+ */
+SessionRegistry::SessionRegistry(QObject *parent) : QObject(parent)
+{
+    clock.start();
+    connect(&sweepTimer, &QTimer::timeout, this, &SessionRegistry::sweep);
+    sweepTimer.start(heartbeatIntervalMs / 2);
+    connect(&redeliveryTimer, &QTimer::timeout, this, &SessionRegistry::redeliver);
+    redeliveryTimer.start(int(ackTimeoutMs / 2));
+}
+
+/**
+ * @brief Деструктор класса SessionRegistry.
+ */
+SessionRegistry::~SessionRegistry()
+{
+    qDeleteAll(bySocket);
+}
+
+/**
+ * @brief Задаёт параметры контроля простоя.
+ *
+ * @param heartbeatIntervalMs Время простоя до отправки ping.
+ * @param idleTimeoutMs Время простоя до отключения.
+ * @param loginTimeoutMs Время после подключения, за которое клиент должен войти.
+ */
+void SessionRegistry::configure(qint64 heartbeatIntervalMs, qint64 idleTimeoutMs, qint64 loginTimeoutMs)
+{
+    this->heartbeatIntervalMs = qMax<qint64>(1000, heartbeatIntervalMs);
+    this->idleTimeoutMs = qMax(this->heartbeatIntervalMs, idleTimeoutMs);
+    this->loginTimeoutMs = qMax<qint64>(1000, loginTimeoutMs);
+    sweepTimer.start(int(this->heartbeatIntervalMs / 2));
+}
+
+/**
+ * @brief Задаёт параметры подтверждения уведомлений.
+ *
+ * @param ackTimeoutMs Время ожидания подтверждения.
+ * @param maxDeliveryAttempts Количество отправок до отказа от доставки.
+ */
+void SessionRegistry::configureAcks(qint64 ackTimeoutMs, int maxDeliveryAttempts)
+{
+    this->ackTimeoutMs = qMax<qint64>(1000, ackTimeoutMs);
+    this->maxDeliveryAttempts = qMax(1, maxDeliveryAttempts);
+    redeliveryTimer.start(int(this->ackTimeoutMs / 2));
+}
+
+/**
+ * @brief Задаёт размеры буферов приёма и ответов подключений.
+ *
+ * @param bufferBytes Начальная ёмкость буфера приёма.
+ * @param bufferLimitBytes Ёмкость, сверх которой буфер освобождается после запроса.
+ */
+void SessionRegistry::configureBuffers(int bufferBytes, int bufferLimitBytes)
+{
+    this->bufferBytes = qMax(256, bufferBytes);
+    this->bufferLimitBytes = qMax(this->bufferBytes, bufferLimitBytes);
+}
+
+/**
+ * @brief Читает все доступные данные сокета в буфер приёма сессии.
+ *
+ * В отличие от readAll(), который выделяет новый QByteArray на каждое чтение, данные
+ * пишутся в зарезервированный буфер сессии: пока запрос помещается в его ёмкость,
+ * память не выделяется. Возвращаемая копия разделяет память с буфером, поэтому данные
+ * остаются действительными, даже если сессия будет удалена во время обработки запроса.
+ *
+ * @param session Сессия.
+ * @return QByteArray Прочитанные данные.
+ */
+QByteArray SessionRegistry::receive(ClientSession *session)
+{
+    QByteArray &buffer = session->receiveBuffer;
+    const char *previous = buffer.constData();
+    int available = int(qMin<qint64>(session->socket->bytesAvailable(), std::numeric_limits<int>::max() - 1));
+    if (buffer.capacity() < qMax(available, bufferBytes))
+    {
+        //Зарезервированная память не освобождается при уменьшении длины буфера
+        buffer.reserve(qMax(available, bufferBytes));
+    }
+    buffer.resize(available);
+    qint64 read = session->socket->read(buffer.data(), available);
+    buffer.resize(int(qMax<qint64>(0, read)));
+    if (buffer.constData() != previous)
+    {
+        ++bufferAllocations;
+    }
+    return buffer;
+}
+
+/**
+ * @brief Освобождает буферы сессии, выросшие сверх допустимой ёмкости.
+ *
+ * Буфер, выросший под крупный запрос или ответ, не удерживается до конца подключения;
+ * при следующем запросе он снова резервируется с начальной ёмкостью.
+ *
+ * @param session Сессия.
+ */
+void SessionRegistry::trimBuffers(ClientSession *session)
+{
+    for (QByteArray *buffer : {&session->receiveBuffer, &session->responseBuffer})
+    {
+        if (buffer->capacity() > bufferLimitBytes)
+        {
+            *buffer = QByteArray();
+            ++bufferTrims;
+        }
+    }
+}
+
+/**
+ * @brief Обновляет показатели буферов подключений.
+ *
+ * alloc.connection_buffer_bytes — суммарная ёмкость буферов приёма и ответов всех
+ * подключений, alloc.connection_buffer_allocations — количество выделений под них.
+ */
+void SessionRegistry::publishBufferMetrics() const
+{
+    qint64 bytes = 0;
+    for (const ClientSession *session : bySocket)
+    {
+        bytes += session->receiveBuffer.capacity() + session->responseBuffer.capacity();
+    }
+    ServerMetrics *metrics = ServerMetrics::getInstance();
+    metrics->set("alloc.connection_buffer_bytes", bytes);
+    metrics->set("alloc.connection_buffer_allocations", bufferAllocations);
+    metrics->set("alloc.connection_buffer_trims", bufferTrims);
+}
+
+/**
+ * @brief Регистрирует новое подключение.
+ *
+ * Включает TCP keepalive, чтобы подключения пропавших клиентов закрывались
+ * даже без поддержки heartbeat на стороне клиента.
+ *
+ * @param socket Сокет подключения.
+ * @param connectionId Идентификатор подключения.
+ * @return ClientSession* Созданная сессия.
+ */
+ClientSession *SessionRegistry::add(QTcpSocket *socket, quint32 connectionId)
+{
+    socket->setSocketOption(QAbstractSocket::KeepAliveOption, 1);
+
+    ClientSession *session = new ClientSession;
+    session->socket = socket;
+    session->connectionId = connectionId;
+    session->lastActivityMs = clock.elapsed();
+    session->connectedAtMs = session->lastActivityMs;
+    bySocket.insert(socket, session);
+    ServerMetrics::getInstance()->set("sessions.connections", bySocket.size());
+    return session;
+}
+
+/**
+ * @brief Находит сессию по сокету.
+ *
+ * @param socket Сокет подключения.
+ * @return ClientSession* Сессия или nullptr.
+ */
+ClientSession *SessionRegistry::find(QTcpSocket *socket) const
+{
+    return bySocket.value(socket, nullptr);
+}
+
+/**
+ * @brief Привязывает сессию к пользователю.
+ *
+ * Повторный вход на том же подключении под другим пользователем переносит сессию.
+ *
+ * @param session Сессия.
+ * @param userId Идентификатор пользователя.
+ * @param login Логин пользователя.
+ */
+void SessionRegistry::bind(ClientSession *session, int userId, const QString &login)
+{
+    if (session->userId == userId)
+    {
+        session->login = login;
+        return;
+    }
+    unbind(session);
+
+    session->userId = userId;
+    session->login = login;
+    QVector<ClientSession*> &sessions = byUser[userId];
+    sessions.append(session);
+    ServerMetrics::getInstance()->set("sessions.online_users", byUser.size());
+    if (sessions.size() == 1)
+    {
+        emit userOnline(userId);
+    }
+    emit sessionBound(session);
+}
+
+/**
+ * @brief Отвязывает сессию от пользователя.
+ *
+ * @param session Сессия.
+ */
+void SessionRegistry::unbind(ClientSession *session)
+{
+    if (session->userId < 0)
+    {
+        return;
+    }
+
+    int userId = session->userId;
+    auto it = byUser.find(userId);
+    if (it != byUser.end())
+    {
+        it->removeOne(session);
+        if (it->isEmpty())
+        {
+            byUser.erase(it);
+            emit userOffline(userId);
+        }
+    }
+    session->userId = -1;
+    session->login.clear();
+    ServerMetrics::getInstance()->set("sessions.online_users", byUser.size());
+}
+
+/**
+ * @brief Возвращает все сессии пользователя.
+ *
+ * @param userId Идентификатор пользователя.
+ * @return QVector<ClientSession*> Сессии пользователя.
+ */
+QVector<ClientSession*> SessionRegistry::sessionsOf(int userId) const
+{
+    return byUser.value(userId);
+}
+
+/**
+ * @brief Проверяет, есть ли у пользователя живые сессии.
+ *
+ * @param userId Идентификатор пользователя.
+ * @return true Если пользователь в сети.
+ * @return false В противном случае.
+ */
+bool SessionRegistry::isOnline(int userId) const
+{
+    return byUser.contains(userId);
+}
+
+/**
+ * @brief Отмечает активность клиента.
+ *
+ * @param session Сессия.
+ */
+void SessionRegistry::touch(ClientSession *session)
+{
+    session->lastActivityMs = clock.elapsed();
+    session->pingSent = false;
+}
+
+/**
+ * @brief Запоминает отправленное уведомление до подтверждения клиентом.
+ *
+ * @param session Сессия.
+ * @param chatId Идентификатор чата.
+ * @param seq Порядковый номер сообщения в чате.
+ * @param messageId Идентификатор сообщения.
+ * @param push Отправленное уведомление.
+ */
+void SessionRegistry::trackPush(ClientSession *session, int chatId, qint64 seq, int messageId, const QJsonObject &push)
+{
+    UnackedPush &pending = session->unacked[chatId];
+    if (seq < pending.seq)
+    {
+        return;
+    }
+    pending.push = push;
+    pending.seq = seq;
+    pending.messageId = messageId;
+    pending.sentAtMs = clock.elapsed();
+    pending.attempts = 1;
+}
+
+/**
+ * @brief Обрабатывает подтверждение клиента.
+ *
+ * Подтверждение номера seq подтверждает и все предыдущие сообщения чата.
+ *
+ * @param session Сессия.
+ * @param chatId Идентификатор чата.
+ * @param seq Номер последнего полученного сообщения чата.
+ */
+void SessionRegistry::acknowledge(ClientSession *session, int chatId, qint64 seq)
+{
+    auto it = session->unacked.find(chatId);
+    if (it != session->unacked.end() && seq >= it->seq)
+    {
+        session->unacked.erase(it);
+        ServerMetrics::getInstance()->add("delivery.acked");
+    }
+}
+
+/**
+ * @brief Удаляет сессию подключения.
+ *
+ * Сокет удаляется через deleteLater, так как удаление может происходить
+ * из обработчика его собственного сигнала.
+ *
+ * @param socket Сокет подключения.
+ */
+void SessionRegistry::remove(QTcpSocket *socket)
+{
+    ClientSession *session = bySocket.take(socket);
+    if (session)
+    {
+        unbind(session);
+        delete session;
+    }
+    socket->deleteLater();
+    ServerMetrics::getInstance()->set("sessions.connections", bySocket.size());
+}
+
+/**
+ * @brief Сохраняет согласованные параметры сессии для передачи другому процессу.
+ *
+ * Сохраняются пользователь, кодировка, heartbeat, подтверждения и неподтверждённые
+ * уведомления; ключи шифрования не передаются.
+ *
+ * @param session Сессия.
+ * @return QJsonObject Состояние сессии.
+ */
+QJsonObject SessionRegistry::exportState(const ClientSession *session) const
+{
+    QJsonArray unacked;
+    for (auto it = session->unacked.constBegin(); it != session->unacked.constEnd(); ++it)
+    {
+        unacked.append(QJsonObject{{"chat_id", it.key()}, {"seq", it->seq}, {"message_id", it->messageId},
+                                   {"attempts", it->attempts}, {"push", it->push}});
+    }
+    return QJsonObject{{"user_id", session->userId}, {"login", session->login},
+                       {"encoding", WireProtocol::encodingName(session->encoding)},
+                       {"heartbeat", session->heartbeat}, {"acks", session->acks},
+                       {"unacked", unacked}};
+}
+
+/**
+ * @brief Восстанавливает параметры сессии, переданной другим процессом.
+ *
+ * Неподтверждённые уведомления ставятся на отслеживание заново, с прежним числом попыток.
+ *
+ * @param session Сессия.
+ * @param state Состояние, полученное от exportState.
+ */
+void SessionRegistry::importState(ClientSession *session, const QJsonObject &state)
+{
+    WireProtocol::encodingFromName(state["encoding"].toString("json"), session->encoding);
+    session->heartbeat = state["heartbeat"].toBool(false);
+    session->acks = state["acks"].toBool(false);
+    int userId = state["user_id"].toInt(-1);
+    if (userId >= 0)
+    {
+        bind(session, userId, state["login"].toString());
+    }
+
+    const QJsonArray unacked = state["unacked"].toArray();
+    for (const QJsonValue &value : unacked)
+    {
+        QJsonObject entry = value.toObject();
+        int chatId = entry["chat_id"].toInt();
+        trackPush(session, chatId, qint64(entry["seq"].toDouble()), entry["message_id"].toInt(), entry["push"].toObject());
+        session->unacked[chatId].attempts = qMax(1, entry["attempts"].toInt(1));
+    }
+}
+
+/**
+ * @brief Возвращает все живые сессии.
+ *
+ * @return QList<ClientSession*> Список сессий.
+ */
+QList<ClientSession*> SessionRegistry::allSessions() const
+{
+    return bySocket.values();
+}
+
+/**
+ * @brief Проверяет срок входа и простой сессий.
+ *
+ * Подключение, не выполнившее вход за loginTimeoutMs, закрывается: иначе клиент без
+ * heartbeat мог бы держать неавторизованное подключение бесконечно. Сессиям, согласовавшим
+ * heartbeat, после heartbeatIntervalMs простоя отправляется ping, после idleTimeoutMs
+ * подключение закрывается; дальнейшая очистка выполняется обработчиком disconnected.
+ */
+void SessionRegistry::sweep()
+{
+    qint64 now = clock.elapsed();
+    const QList<ClientSession*> sessions = bySocket.values();
+    for (ClientSession *session : sessions)
+    {
+        if (session->userId < 0 && now - session->connectedAtMs >= loginTimeoutMs)
+        {
+            Logger::getInstance()->logToFile(QString("Connection %1 did not log in within %2 ms, disconnecting")
+                                                 .arg(session->connectionId).arg(loginTimeoutMs));
+            ServerMetrics::getInstance()->add("sessions.login_timeouts");
+            session->socket->abort();
+            continue;
+        }
+        if (!session->heartbeat)
+        {
+            continue;
+        }
+
+        qint64 idleMs = now - session->lastActivityMs;
+        if (idleMs >= idleTimeoutMs)
+        {
+            Logger::getInstance()->logToFile(QString("Connection %1 idle for %2 ms, disconnecting")
+                                                 .arg(session->connectionId).arg(idleMs));
+            ServerMetrics::getInstance()->add("sessions.idle_disconnects");
+            session->socket->abort();
+        }
+        else if (idleMs >= heartbeatIntervalMs && !session->pingSent)
+        {
+            session->pingSent = true;
+            emit heartbeatDue(session);
+        }
+    }
+}
+
+/**
+ * @brief Повторно отправляет неподтверждённые уведомления.
+ *
+ * Уведомление, не подтверждённое за ackTimeoutMs, отправляется снова; после
+ * maxDeliveryAttempts отправок оно снимается с отслеживания. Сигналы испускаются после
+ * обхода, так как отправка может закрыть переполненное подключение и удалить его сессию.
+ */
+void SessionRegistry::redeliver()
+{
+    struct Due
+    {
+        QTcpSocket *socket;
+        int chatId;
+        QJsonObject push;
+        int abandonedMessageId;
+    };
+    QVector<Due> due;
+
+    qint64 now = clock.elapsed();
+    for (ClientSession *session : qAsConst(bySocket))
+    {
+        for (auto it = session->unacked.begin(); it != session->unacked.end();)
+        {
+            if (now - it->sentAtMs < ackTimeoutMs)
+            {
+                ++it;
+            }
+            else if (it->attempts >= maxDeliveryAttempts)
+            {
+                due.append({session->socket, it.key(), QJsonObject(), it->messageId});
+                it = session->unacked.erase(it);
+            }
+            else
+            {
+                it->attempts++;
+                it->sentAtMs = now;
+                due.append({session->socket, it.key(), it->push, -1});
+                ++it;
+            }
+        }
+    }
+
+    for (const Due &item : qAsConst(due))
+    {
+        ClientSession *session = find(item.socket);
+        if (!session)
+        {
+            continue;
+        }
+        if (item.abandonedMessageId >= 0)
+        {
+            ServerMetrics::getInstance()->add("delivery.abandoned");
+            emit deliveryAbandoned(session, item.chatId, item.abandonedMessageId);
+        }
+        else
+        {
+            ServerMetrics::getInstance()->add("delivery.redelivered");
+            emit redeliveryDue(session, item.chatId, item.push);
+        }
+    }
+}
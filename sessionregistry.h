@@ -0,0 +1,310 @@
+/**
+ * /file sessionregistry.h
+ * /brief Определение класса SessionRegistry для учёта подключений и сессий пользователей.
+ */
+
+#ifndef SESSIONREGISTRY_H
+#define SESSIONREGISTRY_H
+
+#include "wireprotocol.h"
+#include "securechannel.h"
+#include "tokenbucket.h"
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QHash>
+#include <QVector>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QSharedPointer>
+#include <QJsonObject>
+
+/**
+ * /brief Уведомление о сообщении, ещё не подтверждённое клиентом.
+ */
+struct UnackedPush
+{
+    QJsonObject push; ///< Последнее отправленное уведомление чата.
+    qint64 seq = 0; ///< Порядковый номер сообщения в чате.
+    int messageId = -1; ///< Идентификатор сообщения.
+    qint64 sentAtMs = 0; ///< Время последней отправки.
+    int attempts = 0; ///< Количество отправок.
+};
+
+/**
+ * /brief Состояние одного подключения клиента.
+ */
+struct ClientSession
+{
+    QTcpSocket *socket = nullptr; ///< Сокет подключения.
+    quint32 connectionId = 0; ///< Идентификатор подключения (для захвата трафика и журнала).
+    int userId = -1; ///< Идентификатор авторизованного пользователя (-1 до входа).
+    QString login; ///< Логин авторизованного пользователя.
+    WireEncoding encoding = WireEncoding::Json; ///< Кодировка, согласованная с клиентом.
+    bool heartbeat = false; ///< Признак того, что клиент отвечает на ping (согласуется в hello).
+    bool pingSent = false; ///< Признак отправленного и ещё не подтверждённого ping.
+    qint64 lastActivityMs = 0; ///< Время последнего запроса клиента.
+    qint64 connectedAtMs = 0; ///< Время подключения (для срока входа).
+    QByteArray handshakePrivateKey; ///< Закрытый ключ RSA незавершённого согласования шифрования.
+    QSharedPointer<SecureChannel> channel; ///< Шифрование кадров (nullptr для открытых подключений).
+    TokenBucket rateBucket; ///< Корзина токенов подключения для ограничения частоты запросов.
+    bool acks = false; ///< Признак того, что клиент подтверждает уведомления (согласуется в hello).
+    QHash<int, UnackedPush> unacked; ///< Неподтверждённые уведомления по чатам.
+    QJsonObject pendingUpdates; ///< Выданный и ещё не подтверждённый кадр pending_updates.
+    QByteArray responseBuffer; ///< Переиспользуемый буфер для ответов, собираемых ResponseWriter.
+    QByteArray receiveBuffer; ///< Переиспользуемый буфер приёма запросов.
+};
+
+/**
+ * /brief Класс SessionRegistry.
+ *
+ * Ведёт все живые подключения и их привязку к пользователям. У пользователя может быть
+ * несколько сессий (устройств) одновременно; все они доступны за O(1) для рассылки
+ * уведомлений. Сессия удаляется при отключении клиента, а её сокет освобождается через
+ * deleteLater, поэтому память не растёт при длительной работе сервера.
+ *
+ * Клиентам, согласовавшим heartbeat, при простое отправляется ping (сигнал heartbeatDue),
+ * а при отсутствии активности дольше тайм-аута они отключаются. Для остальных клиентов
+ * мёртвые подключения выявляются механизмом TCP keepalive. Подключение, не выполнившее
+ * вход за loginTimeoutMs, закрывается независимо от heartbeat.
+ *
+ * Для клиентов, согласовавших подтверждения, хранится последнее неподтверждённое уведомление
+ * каждого чата. Если подтверждение не пришло за ackTimeoutMs, уведомление отправляется
+ * повторно (сигнал redeliveryDue); после maxDeliveryAttempts попыток оно снимается
+ * с отслеживания (сигнал deliveryAbandoned).
+ */
+class SessionRegistry : public QObject
+{
+    Q_OBJECT
+
+private:
+    QHash<QTcpSocket*, ClientSession*> bySocket; ///< Сессии по сокетам.
+    QHash<int, QVector<ClientSession*>> byUser; ///< Сессии авторизованных пользователей.
+    QTimer sweepTimer; ///< Таймер проверки простоя сессий.
+    QElapsedTimer clock; ///< Монотонные часы для отметок активности.
+    qint64 heartbeatIntervalMs = 30000; ///< Время простоя, после которого отправляется ping.
+    qint64 idleTimeoutMs = 90000; ///< Время простоя, после которого клиент отключается.
+    qint64 loginTimeoutMs = 30000; ///< Время после подключения, за которое клиент должен войти.
+    QTimer redeliveryTimer; ///< Таймер проверки неподтверждённых уведомлений.
+    qint64 ackTimeoutMs = 10000; ///< Время ожидания подтверждения уведомления.
+    int maxDeliveryAttempts = 3; ///< Количество отправок уведомления до отказа от доставки.
+    int bufferBytes = 4096; ///< Начальная ёмкость буфера приёма подключения.
+    int bufferLimitBytes = 64 * 1024; ///< Ёмкость, сверх которой буферы подключения освобождаются после запроса.
+    qint64 bufferAllocations = 0; ///< Количество выделений памяти под буферы подключений.
+    qint64 bufferTrims = 0; ///< Количество освобождённых выросших буферов.
+
+    /**
+     * /brief Отвязывает сессию от пользователя.
+     * /param session Сессия.
+     */
+    void unbind(ClientSession *session);
+
+private slots:
+    /**
+     * /brief Проверяет простой сессий.
+     */
+    void sweep();
+
+    /**
+     * /brief Повторно отправляет неподтверждённые уведомления.
+     */
+    void redeliver();
+
+public:
+    /**
+     * /brief Конструктор класса SessionRegistry.
+     * /param parent Указатель на родительский объект.
+     */
+    explicit SessionRegistry(QObject *parent = nullptr);
+
+    /**
+     * /brief Деструктор, освобождающий сессии.
+     */
+    ~SessionRegistry() override;
+
+    /**
+     * /brief Задаёт параметры контроля простоя.
+     * /param heartbeatIntervalMs Время простоя до отправки ping.
+     * /param idleTimeoutMs Время простоя до отключения.
+     * /param loginTimeoutMs Время после подключения, за которое клиент должен войти.
+     */
+    void configure(qint64 heartbeatIntervalMs, qint64 idleTimeoutMs, qint64 loginTimeoutMs);
+
+    /**
+     * /brief Задаёт параметры подтверждения уведомлений.
+     * /param ackTimeoutMs Время ожидания подтверждения.
+     * /param maxDeliveryAttempts Количество отправок до отказа от доставки.
+     */
+    void configureAcks(qint64 ackTimeoutMs, int maxDeliveryAttempts);
+
+    /**
+     * /brief Задаёт размеры буферов приёма и ответов подключений.
+     * /param bufferBytes Начальная ёмкость буфера приёма.
+     * /param bufferLimitBytes Ёмкость, сверх которой буфер освобождается после запроса.
+     */
+    void configureBuffers(int bufferBytes, int bufferLimitBytes);
+
+    /**
+     * /brief Читает все доступные данные сокета в буфер приёма сессии.
+     * /param session Сессия.
+     * /return Прочитанные данные (разделяют память с буфером приёма).
+     */
+    QByteArray receive(ClientSession *session);
+
+    /**
+     * /brief Освобождает буферы сессии, выросшие сверх допустимой ёмкости.
+     * /param session Сессия.
+     */
+    void trimBuffers(ClientSession *session);
+
+    /**
+     * /brief Обновляет показатели буферов подключений в ServerMetrics.
+     */
+    void publishBufferMetrics() const;
+
+    /**
+     * /brief Регистрирует новое подключение.
+     * /param socket Сокет подключения.
+     * /param connectionId Идентификатор подключения.
+     * /return Созданная сессия.
+     */
+    ClientSession *add(QTcpSocket *socket, quint32 connectionId);
+
+    /**
+     * /brief Находит сессию по сокету.
+     * /param socket Сокет подключения.
+     * /return Сессия или nullptr, если подключение уже удалено.
+     */
+    ClientSession *find(QTcpSocket *socket) const;
+
+    /**
+     * /brief Привязывает сессию к пользователю после успешного входа.
+     * /param session Сессия.
+     * /param userId Идентификатор пользователя.
+     * /param login Логин пользователя.
+     */
+    void bind(ClientSession *session, int userId, const QString &login);
+
+    /**
+     * /brief Возвращает все сессии пользователя.
+     * /param userId Идентификатор пользователя.
+     * /return Сессии пользователя (пусто, если пользователь не в сети).
+     */
+    QVector<ClientSession*> sessionsOf(int userId) const;
+
+    /**
+     * /brief Проверяет, есть ли у пользователя живые сессии.
+     * /param userId Идентификатор пользователя.
+     * /return Признак того, что пользователь в сети.
+     */
+    bool isOnline(int userId) const;
+
+    /**
+     * /brief Отмечает активность клиента.
+     * /param session Сессия.
+     */
+    void touch(ClientSession *session);
+
+    /**
+     * /brief Запоминает отправленное уведомление до подтверждения клиентом.
+     *
+     * Более новое уведомление чата заменяет предыдущее: по его номеру клиент сам
+     * обнаружит пропуск.
+     *
+     * /param session Сессия (должна согласовать подтверждения).
+     * /param chatId Идентификатор чата.
+     * /param seq Порядковый номер сообщения в чате.
+     * /param messageId Идентификатор сообщения.
+     * /param push Отправленное уведомление.
+     */
+    void trackPush(ClientSession *session, int chatId, qint64 seq, int messageId, const QJsonObject &push);
+
+    /**
+     * /brief Обрабатывает подтверждение клиента.
+     * /param session Сессия.
+     * /param chatId Идентификатор чата.
+     * /param seq Номер последнего полученного сообщения чата.
+     */
+    void acknowledge(ClientSession *session, int chatId, qint64 seq);
+
+    /**
+     * /brief Сохраняет согласованные параметры сессии для передачи другому процессу.
+     * /param session Сессия.
+     * /return Состояние сессии.
+     */
+    QJsonObject exportState(const ClientSession *session) const;
+
+    /**
+     * /brief Восстанавливает параметры сессии, переданной другим процессом.
+     * /param session Сессия.
+     * /param state Состояние, полученное от exportState.
+     */
+    void importState(ClientSession *session, const QJsonObject &state);
+
+    /**
+     * /brief Удаляет сессию подключения и планирует освобождение сокета.
+     * /param socket Сокет подключения.
+     */
+    void remove(QTcpSocket *socket);
+
+    /**
+     * /brief Возвращает все живые сессии.
+     * /return Список сессий.
+     */
+    QList<ClientSession*> allSessions() const;
+
+    /**
+     * /brief Возвращает количество живых подключений.
+     * /return Количество подключений.
+     */
+    int connectionCount() const { return bySocket.size(); }
+
+    /**
+     * /brief Возвращает количество пользователей в сети.
+     * /return Количество пользователей.
+     */
+    int onlineUserCount() const { return byUser.size(); }
+
+signals:
+    /**
+     * /brief Сигнал о необходимости отправить клиенту ping.
+     * /param session Сессия.
+     */
+    void heartbeatDue(ClientSession *session);
+
+    /**
+     * /brief Сигнал о первой сессии пользователя (пользователь появился в сети).
+     * /param userId Идентификатор пользователя.
+     */
+    void userOnline(int userId);
+
+    /**
+     * /brief Сигнал о привязке сессии к пользователю (при каждом входе, а не только первом).
+     * /param session Сессия.
+     */
+    void sessionBound(ClientSession *session);
+
+    /**
+     * /brief Сигнал об удалении последней сессии пользователя (пользователь вышел из сети).
+     * /param userId Идентификатор пользователя.
+     */
+    void userOffline(int userId);
+
+    /**
+     * /brief Сигнал о необходимости повторно отправить уведомление.
+     * /param session Сессия.
+     * /param chatId Идентификатор чата.
+     * /param push Уведомление.
+     */
+    void redeliveryDue(ClientSession *session, int chatId, const QJsonObject &push);
+
+    /**
+     * /brief Сигнал об отказе от доставки уведомления после всех попыток.
+     * /param session Сессия.
+     * /param chatId Идентификатор чата.
+     * /param messageId Идентификатор сообщения.
+     */
+    void deliveryAbandoned(ClientSession *session, int chatId, int messageId);
+};
+
+#endif // SESSIONREGISTRY_H
@@ -0,0 +1,172 @@
+#include "sessiontokens.h"
+#include "chatrepository.h"
+#include "credentialpool.h"
+
+#include <QMessageAuthenticationCode>
+#include <QRandomGenerator>
+#include <QDateTime>
+#include <QVector>
+#include <QDebug>
+
+namespace
+{
+const QByteArray::Base64Options tokenBase64 = QByteArray::Base64UrlEncoding | QByteArray::OmitTrailingEquals;
+}
+
+/**
+ * @brief Создаёт случайный ключ подписи.
+ *
+ * @return QByteArray Ключ длиной 32 байта из системного генератора случайных чисел.
+ */
+QByteArray SessionTokens::generateKey()
+{
+    QVector<quint32> words(8);
+    QRandomGenerator::system()->fillRange(words.data(), words.size());
+    return QByteArray(reinterpret_cast<const char*>(words.constData()), words.size() * int(sizeof(quint32)));
+}
+
+/**
+ * @brief Задаёт ключ подписи и время жизни токенов.
+ *
+ * @param key Ключ подписи.
+ * @param lifetimeSec Время жизни токена в секундах.
+ */
+void SessionTokens::configure(const QByteArray &key, qint64 lifetimeSec)
+{
+    this->key = key;
+    this->lifetimeSec = qMax<qint64>(60, lifetimeSec);
+}
+
+/**
+ * @brief Задаёт хранилище, в котором записывается отзыв токенов, и читает из него таблицу отзывов.
+ *
+ * Отзывы, уже известные в памяти, сохраняются: таблица только дополняется.
+ *
+ * @param repository Хранилище пользователей.
+ * @return true Если таблица отзывов прочитана.
+ */
+bool SessionTokens::setRepository(ChatRepository *repository)
+{
+    this->repository = repository;
+    QHash<int, qint64> stored;
+    revocationsLoaded = repository && repository->tokenRevocations(stored);
+    if (!revocationsLoaded)
+    {
+        qCritical() << "Could not load session token revocations, resume is disabled";
+        return false;
+    }
+    for (auto it = stored.constBegin(); it != stored.constEnd(); ++it)
+    {
+        applyRevocation(it.key(), it.value());
+    }
+    return true;
+}
+
+/**
+ * @brief Вычисляет подпись данных токена.
+ *
+ * @param payload Данные токена.
+ * @return QByteArray Подпись HMAC-SHA256.
+ */
+QByteArray SessionTokens::sign(const QByteArray &payload) const
+{
+    return QMessageAuthenticationCode::hash(payload, key, QCryptographicHash::Sha256);
+}
+
+/**
+ * @brief Выдаёт токен для пользователя.
+ *
+ * @param userId Идентификатор пользователя.
+ * @param login Логин пользователя.
+ * @return QString Токен.
+ */
+QString SessionTokens::issue(int userId, const QString &login) const
+{
+    qint64 now = QDateTime::currentSecsSinceEpoch();
+    QByteArray payload = QString("v1|%1|%2|%3|%4").arg(userId).arg(now).arg(now + lifetimeSec).arg(login).toUtf8();
+    return QString::fromLatin1(payload.toBase64(tokenBase64) + '.' + sign(payload).toBase64(tokenBase64));
+}
+
+/**
+ * @brief Проверяет токен.
+ *
+ * @param token Токен.
+ * @param userId Идентификатор пользователя из токена.
+ * @param login Логин пользователя из токена.
+ * @return true Если токен подлинный, не истёк и не отозван.
+ * @return false В противном случае.
+ */
+bool SessionTokens::verify(const QString &token, int &userId, QString &login) const
+{
+    int dot = token.indexOf('.');
+    if (key.isEmpty() || dot <= 0)
+    {
+        return false;
+    }
+
+    QByteArray payload = QByteArray::fromBase64(token.left(dot).toLatin1(), tokenBase64);
+    QByteArray signature = QByteArray::fromBase64(token.mid(dot + 1).toLatin1(), tokenBase64);
+    if (!CredentialPool::constantTimeEquals(sign(payload), signature))
+    {
+        return false;
+    }
+
+    //Логин последний, поэтому поле логина не разбивается
+    QStringList fields = QString::fromUtf8(payload).split('|');
+    if (fields.size() < 5 || fields[0] != "v1")
+    {
+        return false;
+    }
+
+    bool idOk = false;
+    int id = fields[1].toInt(&idOk);
+    qint64 issuedAt = fields[2].toLongLong();
+    qint64 expiresAt = fields[3].toLongLong();
+    if (!idOk || expiresAt < QDateTime::currentSecsSinceEpoch())
+    {
+        return false;
+    }
+    //Без таблицы отзывов нельзя убедиться, что токен не отозван
+    if (!revocationsLoaded || issuedAt < revokedBefore.value(id, 0))
+    {
+        return false;
+    }
+
+    userId = id;
+    login = fields.mid(4).join('|');
+    return true;
+}
+
+/**
+ * @brief Отзывает все ранее выданные токены пользователя.
+ *
+ * Токены, выданные в ту же секунду, что и отзыв, остаются действительными, поэтому
+ * новый токен, выданный сразу после смены учётных данных, не отзывается.
+ *
+ * Отзыв действует в памяти сразу, даже если записать его в хранилище не удалось.
+ *
+ * @param userId Идентификатор пользователя.
+ * @return qint64 Момент отзыва.
+ */
+qint64 SessionTokens::revoke(int userId)
+{
+    qint64 revokedAt = QDateTime::currentSecsSinceEpoch();
+    applyRevocation(userId, revokedAt);
+    if (!repository || !repository->revokeTokens(userId, revokedAt))
+    {
+        qCritical() << "Could not store revocation of session tokens of user" << userId;
+    }
+    return revokedAt;
+}
+
+/**
+ * @brief Учитывает отзыв токенов, выполненный другим экземпляром сервера.
+ *
+ * @param userId Идентификатор пользователя.
+ * @param revokedAt Момент отзыва.
+ */
+void SessionTokens::applyRevocation(int userId, qint64 revokedAt)
+{
+    qint64 &current = revokedBefore[userId];
+    current = qMax(current, revokedAt);
+}
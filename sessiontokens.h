@@ -0,0 +1,99 @@
+/**
+ * /file sessiontokens.h
+ * /brief Определение класса SessionTokens для выдачи и проверки подписанных токенов сессии.
+ */
+
+#ifndef SESSIONTOKENS_H
+#define SESSIONTOKENS_H
+
+#include <QByteArray>
+#include <QString>
+#include <QHash>
+
+class ChatRepository;
+
+/**
+ * /brief Класс SessionTokens.
+ *
+ * Выдаёт после успешного входа токен, позволяющий восстановить сессию запросом resume
+ * без повторной проверки пароля и без обращения к базе данных.
+ * Токен имеет вид base64url(данные).base64url(HMAC-SHA256(данные)), где данные —
+ * строка "v1|user_id|время выдачи|время истечения|login". Подпись вычисляется ключом
+ * сервера, поэтому проверка выполняется только в памяти.
+ *
+ * Отзыв токенов (после смены логина или пароля) отзывает все токены пользователя, выданные
+ * до указанного момента. Моменты отзыва хранятся в памяти и записываются в хранилище
+ * пользователей, из которого таблица отзывов читается один раз при подключении хранилища,
+ * поэтому отзыв переживает перезапуск сервера, а проверка токена по-прежнему не обращается
+ * к базе данных. Пока таблицу отзывов не удалось прочитать, токены не принимаются.
+ */
+class SessionTokens
+{
+private:
+    QByteArray key; ///< Ключ подписи токенов.
+    qint64 lifetimeSec = 7 * 24 * 3600; ///< Время жизни токена в секундах.
+    ChatRepository *repository = nullptr; ///< Хранилище, в котором записан отзыв токенов.
+    QHash<int, qint64> revokedBefore; ///< Время, до которого выданные токены пользователя недействительны.
+    bool revocationsLoaded = false; ///< Признак прочитанной из хранилища таблицы отзывов.
+
+    /**
+     * /brief Вычисляет подпись данных токена.
+     * /param payload Данные токена.
+     * /return Подпись HMAC-SHA256.
+     */
+    QByteArray sign(const QByteArray &payload) const;
+
+public:
+    /**
+     * /brief Создаёт случайный ключ подписи.
+     * /return Ключ длиной 32 байта.
+     */
+    static QByteArray generateKey();
+
+    /**
+     * /brief Задаёт ключ подписи и время жизни токенов.
+     * /param key Ключ подписи.
+     * /param lifetimeSec Время жизни токена в секундах.
+     */
+    void configure(const QByteArray &key, qint64 lifetimeSec);
+
+    /**
+     * /brief Задаёт хранилище, в котором записывается отзыв токенов, и читает из него таблицу отзывов.
+     * /param repository Хранилище пользователей.
+     * /return Признак прочитанной таблицы отзывов.
+     */
+    bool setRepository(ChatRepository *repository);
+
+    /**
+     * /brief Выдаёт токен для пользователя.
+     * /param userId Идентификатор пользователя.
+     * /param login Логин пользователя.
+     * /return Токен.
+     */
+    QString issue(int userId, const QString &login) const;
+
+    /**
+     * /brief Проверяет токен.
+     * /param token Токен.
+     * /param userId Идентификатор пользователя из токена.
+     * /param login Логин пользователя из токена.
+     * /return Признак того, что токен подлинный, не истёк и не отозван.
+     */
+    bool verify(const QString &token, int &userId, QString &login) const;
+
+    /**
+     * /brief Отзывает все ранее выданные токены пользователя.
+     * /param userId Идентификатор пользователя.
+     * /return Момент отзыва (секунды с начала эпохи).
+     */
+    qint64 revoke(int userId);
+
+    /**
+     * /brief Учитывает отзыв токенов, выполненный другим экземпляром сервера.
+     * /param userId Идентификатор пользователя.
+     * /param revokedAt Момент отзыва (секунды с начала эпохи).
+     */
+    void applyRevocation(int userId, qint64 revokedAt);
+};
+
+#endif // SESSIONTOKENS_H
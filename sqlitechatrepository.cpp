@@ -0,0 +1,1028 @@
+#include "sqlitechatrepository.h"
+
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QSet>
+#include <QDebug>
+
+namespace
+{
+const int maxBoundIds = 500; ///< Наибольшее число идентификаторов в одном запросе IN (предел SQLite — 999 параметров).
+
+/**
+ * @brief Возвращает список из count параметров для запроса IN.
+ *
+ * @param count Количество параметров.
+ * @return QString Строка вида "?, ?, ?".
+ */
+QString placeholders(int count)
+{
+    QStringList marks;
+    marks.reserve(count);
+    for (int i = 0; i < count; ++i)
+    {
+        marks.append("?");
+    }
+    return marks.join(", ");
+}
+}
+
+/**
+ * @brief Деструктор класса SqliteChatRepository.
+ */
+SqliteChatRepository::~SqliteChatRepository()
+{
+    close();
+}
+
+/**
+ * @brief Подключает хранилище к базе данных и дополняет схему при необходимости.
+ *
+ * Основное подключение используется в потоке, вызвавшем open(). Повторный вызов
+ * допускается: схема проверяется заново.
+ *
+ * @param database База данных сервера.
+ * @return true Если схема готова к работе.
+ */
+bool SqliteChatRepository::open(const QSqlDatabase &database)
+{
+    close();
+    this->database = database;
+    ownerThread = QThread::currentThread();
+    return prepareUserSchema() && prepareMessageSchema();
+}
+
+/**
+ * @brief Дожидается асинхронных вызовов и закрывает подключения потоков пула.
+ */
+void SqliteChatRepository::close()
+{
+    waitForAsyncCalls();
+    QMutexLocker locker(&connectionMutex);
+    for (const QString &name : qAsConst(connectionNames))
+    {
+        QSqlDatabase::removeDatabase(name);
+    }
+    connectionNames.clear();
+}
+
+/**
+ * @brief Возвращает подключение для текущего потока.
+ *
+ * В потоке событий возвращается основное подключение, в потоке пула — его копия,
+ * открываемая при первом обращении из этого потока.
+ *
+ * @return QSqlDatabase Подключение к базе данных.
+ */
+QSqlDatabase SqliteChatRepository::connection()
+{
+    QThread *current = QThread::currentThread();
+    if (current == ownerThread)
+    {
+        return database;
+    }
+
+    QMutexLocker locker(&connectionMutex);
+    auto it = connectionNames.constFind(current);
+    if (it != connectionNames.constEnd())
+    {
+        return QSqlDatabase::database(*it, false);
+    }
+    QString name = QString("chatrepository-%1-%2").arg(quintptr(this)).arg(quintptr(current));
+    QSqlDatabase copy = QSqlDatabase::cloneDatabase(database, name);
+    if (!copy.open())
+    {
+        qCritical() << "Could not open storage connection for worker thread:" << copy.lastError().text();
+    }
+    connectionNames.insert(current, name);
+    return copy;
+}
+
+/**
+ * @brief Добавляет к таблице user_auth столбец момента отзыва токенов сессии.
+ *
+ * Отзыв хранится в базе данных, поэтому отозванные токены остаются недействительными
+ * и после перезапуска сервера.
+ *
+ * @return true Если схема готова к работе.
+ */
+bool SqliteChatRepository::prepareUserSchema()
+{
+    QSqlQuery query(database);
+    QSet<QString> columns;
+    if (query.exec("PRAGMA table_info(user_auth)"))
+    {
+        while (query.next())
+        {
+            columns.insert(query.value("name").toString());
+        }
+    }
+
+    if (!columns.contains("tokens_revoked_at") &&
+        !query.exec("ALTER TABLE user_auth ADD COLUMN tokens_revoked_at INTEGER NOT NULL DEFAULT 0"))
+    {
+        qCritical() << "Could not add tokens_revoked_at column:" << query.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Добавляет к таблице messages столбцы и индексы для номеров сообщений.
+ *
+ * Столбцы client_msg_id и chat_seq добавляются к существующей таблице messages. Индексы
+ * создаются до заполнения номеров: уникальный индекс (chat_id, chat_seq) не даёт записать
+ * повторяющийся номер ни при заполнении, ни позже.
+ *
+ * @return true Если схема готова к работе.
+ */
+bool SqliteChatRepository::prepareMessageSchema()
+{
+    QSqlQuery query(database);
+    QSet<QString> columns;
+    if (query.exec("PRAGMA table_info(messages)"))
+    {
+        while (query.next())
+        {
+            columns.insert(query.value("name").toString());
+        }
+    }
+
+    if (!columns.contains("client_msg_id") && !query.exec("ALTER TABLE messages ADD COLUMN client_msg_id TEXT"))
+    {
+        qCritical() << "Could not add client_msg_id column:" << query.lastError().text();
+        return false;
+    }
+    if (!columns.contains("chat_seq") && !query.exec("ALTER TABLE messages ADD COLUMN chat_seq INTEGER"))
+    {
+        qCritical() << "Could not add chat_seq column:" << query.lastError().text();
+        return false;
+    }
+
+    //Прежние индексы не учитывали чат в идентификаторе клиента и допускали повтор номера
+    //NULL в client_msg_id и chat_seq не участвует в проверке уникальности, поэтому старые клиенты не затронуты
+    if (!query.exec("DROP INDEX IF EXISTS messages_client_msg_id") ||
+        !query.exec("DROP INDEX IF EXISTS messages_chat_seq") ||
+        !query.exec("CREATE UNIQUE INDEX IF NOT EXISTS messages_chat_client_msg_id ON messages (chat_id, user_id, client_msg_id)") ||
+        !query.exec("CREATE UNIQUE INDEX IF NOT EXISTS messages_chat_seq_unique ON messages (chat_id, chat_seq)"))
+    {
+        qCritical() << "Could not create message indexes:" << query.lastError().text();
+        return false;
+    }
+    return backfillMessageSeqs();
+}
+
+/**
+ * @brief Присваивает номера сообщениям, сохранённым без них.
+ *
+ * Номера получают только сообщения без номера: в каждом чате они нумеруются в порядке
+ * идентификаторов после наибольшего уже присвоенного номера, поэтому номера, известные
+ * клиентам, не меняются. Номера вычисляются за один проход (ROW_NUMBER) во временную
+ * таблицу, затем переносятся в messages. Всё выполняется в одной транзакции: прерванный
+ * запуск не оставляет чат пронумерованным наполовину.
+ *
+ * @return true Если номера присвоены или присваивать нечего.
+ */
+bool SqliteChatRepository::backfillMessageSeqs()
+{
+    QSqlQuery query(database);
+    if (!query.exec("SELECT 1 FROM messages WHERE chat_seq IS NULL LIMIT 1"))
+    {
+        qCritical() << "Could not check message numbers:" << query.lastError().text();
+        return false;
+    }
+    if (!query.next())
+    {
+        return true;
+    }
+    query.finish();
+
+    qInfo() << "Assigning sequence numbers to stored messages";
+    if (!database.transaction())
+    {
+        qCritical() << "Could not start message numbering:" << database.lastError().text();
+        return false;
+    }
+    const QStringList statements = {
+        "CREATE TEMP TABLE message_seq_backfill (message_id INTEGER PRIMARY KEY, chat_seq INTEGER NOT NULL)",
+        "INSERT INTO message_seq_backfill (message_id, chat_seq) "
+        "SELECT m.message_id, ROW_NUMBER() OVER (PARTITION BY m.chat_id ORDER BY m.message_id) + COALESCE(numbered.max_seq, 0) "
+        "FROM messages m "
+        "LEFT JOIN (SELECT chat_id, MAX(chat_seq) AS max_seq FROM messages WHERE chat_seq IS NOT NULL GROUP BY chat_id) numbered "
+        "ON numbered.chat_id = m.chat_id "
+        "WHERE m.chat_seq IS NULL",
+        "UPDATE messages SET chat_seq = (SELECT chat_seq FROM message_seq_backfill "
+        "WHERE message_seq_backfill.message_id = messages.message_id) "
+        "WHERE message_id IN (SELECT message_id FROM message_seq_backfill)",
+        "DROP TABLE message_seq_backfill"
+    };
+    for (const QString &statement : statements)
+    {
+        if (!query.exec(statement))
+        {
+            qCritical() << "Could not assign message numbers:" << query.lastError().text();
+            query.finish();
+            database.rollback();
+            return false;
+        }
+    }
+    if (!database.commit())
+    {
+        qCritical() << "Could not commit message numbers:" << database.lastError().text();
+        database.rollback();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Возвращает имя реализации хранилища.
+ *
+ * @return QString "sqlite".
+ */
+QString SqliteChatRepository::engineName() const
+{
+    return "sqlite";
+}
+
+/**
+ * @brief Проверяет, свободен ли логин.
+ *
+ * @param login Логин.
+ * @return true Если логин свободен.
+ */
+bool SqliteChatRepository::isLoginAvailable(const QString &login)
+{
+    QSqlQuery query(connection());
+    query.prepare("SELECT COUNT(*) FROM user_auth WHERE login = :login");
+    query.bindValue(":login", login);
+    if (!query.exec())
+    {
+        setLastError(query.lastError().text());
+        return false;
+    }
+    return query.next() && query.value(0).toInt() == 0;
+}
+
+/**
+ * @brief Возвращает идентификатор пользователя по логину.
+ *
+ * @param login Логин.
+ * @return int Идентификатор или -1.
+ */
+int SqliteChatRepository::userIdByLogin(const QString &login)
+{
+    QSqlQuery query(connection());
+    query.prepare("SELECT user_id FROM user_auth WHERE login = :login");
+    query.bindValue(":login", login);
+    if (!query.exec())
+    {
+        setLastError(query.lastError().text());
+        return -1;
+    }
+    return query.next() ? query.value(0).toInt() : -1;
+}
+
+/**
+ * @brief Ищет учётную запись по логину.
+ *
+ * @param login Логин.
+ * @param user Найденная учётная запись.
+ * @return true Если пользователь найден.
+ */
+bool SqliteChatRepository::findUser(const QString &login, UserRecord &user)
+{
+    QSqlQuery query(connection());
+    query.prepare("SELECT user_id, password, nickname, tokens_revoked_at FROM user_auth WHERE login = :login");
+    query.bindValue(":login", login);
+    if (!query.exec())
+    {
+        setLastError(query.lastError().text());
+        return false;
+    }
+    if (!query.next())
+    {
+        return false;
+    }
+    user.userId = query.value("user_id").toInt();
+    user.login = login;
+    user.password = query.value("password").toString();
+    user.nickname = query.value("nickname").toString();
+    user.tokensRevokedAt = query.value("tokens_revoked_at").toLongLong();
+    return true;
+}
+
+/**
+ * @brief Создаёт пользователя.
+ *
+ * @param login Логин.
+ * @param password Хеш пароля.
+ * @param nickname Отображаемое имя.
+ * @return int Идентификатор нового пользователя или -1.
+ */
+int SqliteChatRepository::createUser(const QString &login, const QString &password, const QString &nickname)
+{
+    QSqlQuery query(connection());
+    query.prepare("INSERT INTO user_auth (login, password, nickname) "
+                  "VALUES (:login, :password, :nickname)");
+    query.bindValue(":login", login);
+    query.bindValue(":password", password);
+    query.bindValue(":nickname", nickname);
+    if (!query.exec())
+    {
+        setLastError(query.lastError().text());
+        return -1;
+    }
+    return query.lastInsertId().toInt();
+}
+
+/**
+ * @brief Заменяет хеш пароля пользователя.
+ *
+ * @param login Логин.
+ * @param password Новый хеш пароля.
+ * @return true Если запись выполнена.
+ */
+bool SqliteChatRepository::updatePassword(const QString &login, const QString &password)
+{
+    QSqlQuery query(connection());
+    query.prepare("UPDATE user_auth SET password = :newPassword WHERE login = :login");
+    query.bindValue(":newPassword", password);
+    query.bindValue(":login", login);
+    if (!query.exec())
+    {
+        setLastError(query.lastError().text());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Заменяет хеш пароля, только если он не изменился с момента чтения.
+ *
+ * Условие по прежнему хешу защищает от одновременной смены пароля.
+ *
+ * @param userId Идентификатор пользователя.
+ * @param oldPassword Прочитанный хеш пароля.
+ * @param newPassword Новый хеш пароля.
+ * @return true Если хеш заменён.
+ */
+bool SqliteChatRepository::upgradePassword(int userId, const QString &oldPassword, const QString &newPassword)
+{
+    QSqlQuery query(connection());
+    query.prepare("UPDATE user_auth SET password = :newHash WHERE user_id = :userId AND password = :oldHash");
+    query.bindValue(":newHash", newPassword);
+    query.bindValue(":userId", userId);
+    query.bindValue(":oldHash", oldPassword);
+    if (!query.exec())
+    {
+        setLastError(query.lastError().text());
+        return false;
+    }
+    return query.numRowsAffected() > 0;
+}
+
+/**
+ * @brief Меняет логин и хеш пароля пользователя.
+ *
+ * @param oldLogin Прежний логин.
+ * @param newLogin Новый логин.
+ * @param password Новый хеш пароля.
+ * @return true Если запись выполнена.
+ */
+bool SqliteChatRepository::updateLogin(const QString &oldLogin, const QString &newLogin, const QString &password)
+{
+    QSqlQuery query(connection());
+    query.prepare("UPDATE user_auth SET login = :newLogin, password = :newHashedPassword WHERE login = :oldLogin");
+    query.bindValue(":newLogin", newLogin);
+    query.bindValue(":newHashedPassword", password);
+    query.bindValue(":oldLogin", oldLogin);
+    if (!query.exec())
+    {
+        setLastError(query.lastError().text());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Меняет отображаемое имя пользователя.
+ *
+ * @param login Логин.
+ * @param nickname Новое имя.
+ * @return true Если запись выполнена.
+ */
+bool SqliteChatRepository::updateNickname(const QString &login, const QString &nickname)
+{
+    QSqlQuery query(connection());
+    query.prepare("UPDATE user_auth SET nickname = :nickname WHERE login = :login");
+    query.bindValue(":nickname", nickname);
+    query.bindValue(":login", login);
+    if (!query.exec())
+    {
+        setLastError(query.lastError().text());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Отзывает токены сессии пользователя, выданные до указанного момента.
+ *
+ * Более поздний момент отзыва, уже записанный другим экземпляром сервера, не уменьшается.
+ *
+ * @param userId Идентификатор пользователя.
+ * @param revokedAt Момент отзыва (секунды с начала эпохи).
+ * @return true Если запись выполнена.
+ */
+bool SqliteChatRepository::revokeTokens(int userId, qint64 revokedAt)
+{
+    QSqlQuery query(connection());
+    query.prepare("UPDATE user_auth SET tokens_revoked_at = MAX(tokens_revoked_at, :revokedAt) WHERE user_id = :userId");
+    query.bindValue(":revokedAt", revokedAt);
+    query.bindValue(":userId", userId);
+    if (!query.exec())
+    {
+        setLastError(query.lastError().text());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Читает моменты отзыва токенов сессии.
+ *
+ * Строк немного: отзыв записывается только при смене логина или пароля.
+ *
+ * @param revokedAt Моменты отзыва по идентификаторам пользователей.
+ * @return true Если чтение выполнено.
+ */
+bool SqliteChatRepository::tokenRevocations(QHash<int, qint64> &revokedAt)
+{
+    QSqlQuery query(connection());
+    if (!query.exec("SELECT user_id, tokens_revoked_at FROM user_auth WHERE tokens_revoked_at > 0"))
+    {
+        setLastError(query.lastError().text());
+        return false;
+    }
+    revokedAt.clear();
+    while (query.next())
+    {
+        revokedAt.insert(query.value(0).toInt(), query.value(1).toLongLong());
+    }
+    return true;
+}
+
+/**
+ * @brief Ищет пользователей по части отображаемого имени.
+ *
+ * Строки передаются обработчику по мере чтения, без накопления результата.
+ *
+ * @param nicknamePart Часть имени.
+ * @param exceptLogin Логин, исключаемый из результатов.
+ * @param visit Обработчик найденных пользователей.
+ * @return true Если поиск выполнен.
+ */
+bool SqliteChatRepository::findUsers(const QString &nicknamePart, const QString &exceptLogin, const UserVisitor &visit)
+{
+    QSqlQuery query(connection());
+    query.prepare("SELECT login, nickname FROM user_auth WHERE nickname LIKE :nickname AND login != :login");
+    query.bindValue(":nickname", '%' + nicknamePart + '%');
+    query.bindValue(":login", exceptLogin);
+    if (!query.exec())
+    {
+        setLastError(query.lastError().text());
+        return false;
+    }
+
+    UserRecord user;
+    while (query.next())
+    {
+        user.login = query.value("login").toString();
+        user.nickname = query.value("nickname").toString();
+        visit(user);
+    }
+    return true;
+}
+
+/**
+ * @brief Ищет чат по одному из названий.
+ *
+ * @param names Возможные названия чата.
+ * @return int Идентификатор первого найденного чата или -1.
+ */
+int SqliteChatRepository::chatIdByName(const QStringList &names)
+{
+    if (names.isEmpty())
+    {
+        return -1;
+    }
+    QSqlQuery query(connection());
+    query.prepare(QString("SELECT chat_id FROM chats WHERE chat_name IN (%1)").arg(placeholders(names.size())));
+    for (const QString &name : names)
+    {
+        query.addBindValue(name);
+    }
+    if (!query.exec())
+    {
+        setLastError(query.lastError().text());
+        return -1;
+    }
+    return query.next() ? query.value(0).toInt() : -1;
+}
+
+/**
+ * @brief Создаёт чат без участников.
+ *
+ * @param name Название чата.
+ * @param chatType Тип чата.
+ * @return int Идентификатор нового чата или -1.
+ */
+int SqliteChatRepository::createChat(const QString &name, const QString &chatType)
+{
+    QSqlQuery query(connection());
+    query.prepare("INSERT INTO chats (chat_name, chat_type) VALUES (:chatName, :chatType)");
+    query.bindValue(":chatName", name);
+    query.bindValue(":chatType", chatType);
+    if (!query.exec())
+    {
+        setLastError(query.lastError().text());
+        return -1;
+    }
+    return query.lastInsertId().toInt();
+}
+
+/**
+ * @brief Добавляет в чат пользователей с указанными логинами.
+ *
+ * @param chatId Идентификатор чата.
+ * @param logins Логины участников.
+ * @return true Если запись выполнена.
+ */
+bool SqliteChatRepository::addParticipants(int chatId, const QStringList &logins)
+{
+    if (logins.isEmpty())
+    {
+        return true;
+    }
+    QSqlQuery query(connection());
+    query.prepare(QString("INSERT INTO chat_participants (chat_id, user_id) "
+                          "SELECT ?, user_id FROM user_auth WHERE login IN (%1)").arg(placeholders(logins.size())));
+    query.addBindValue(chatId);
+    for (const QString &login : logins)
+    {
+        query.addBindValue(login);
+    }
+    if (!query.exec())
+    {
+        setLastError(query.lastError().text());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Удаляет чат.
+ *
+ * @param chatId Идентификатор чата.
+ * @return true Если запрос выполнен.
+ */
+bool SqliteChatRepository::deleteChat(int chatId)
+{
+    QSqlQuery query(connection());
+    query.prepare("DELETE FROM chats WHERE chat_id = :chatId");
+    query.bindValue(":chatId", chatId);
+    if (!query.exec())
+    {
+        setLastError(query.lastError().text());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Возвращает участников чата.
+ *
+ * @param chatId Идентификатор чата.
+ * @param userIds Идентификаторы участников.
+ * @return true Если чтение выполнено.
+ */
+bool SqliteChatRepository::participants(int chatId, QVector<int> &userIds)
+{
+    QSqlQuery query(connection());
+    query.prepare("SELECT user_id FROM chat_participants WHERE chat_id = :chatId");
+    query.bindValue(":chatId", chatId);
+    if (!query.exec())
+    {
+        setLastError(query.lastError().text());
+        return false;
+    }
+    while (query.next())
+    {
+        userIds.append(query.value(0).toInt());
+    }
+    return true;
+}
+
+/**
+ * @brief Возвращает участников нескольких чатов.
+ *
+ * Идентификаторы передаются частями, чтобы не превысить предел параметров SQLite.
+ *
+ * @param chatIds Идентификаторы чатов.
+ * @param members Участники по чатам.
+ * @return true Если чтение выполнено.
+ */
+bool SqliteChatRepository::participants(const QVector<int> &chatIds, QHash<int, QVector<int>> &members)
+{
+    QSqlQuery query(connection());
+    for (int first = 0; first < chatIds.size(); first += maxBoundIds)
+    {
+        int count = qMin(maxBoundIds, chatIds.size() - first);
+        query.prepare(QString("SELECT chat_id, user_id FROM chat_participants WHERE chat_id IN (%1)").arg(placeholders(count)));
+        for (int i = first; i < first + count; ++i)
+        {
+            query.addBindValue(chatIds[i]);
+        }
+        if (!query.exec())
+        {
+            setLastError(query.lastError().text());
+            return false;
+        }
+        while (query.next())
+        {
+            members[query.value(0).toInt()].append(query.value(1).toInt());
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Возвращает чаты пользователя.
+ *
+ * @param userId Идентификатор пользователя.
+ * @param chatIds Идентификаторы чатов.
+ * @return true Если чтение выполнено.
+ */
+bool SqliteChatRepository::chatsOf(int userId, QVector<int> &chatIds)
+{
+    QSqlQuery query(connection());
+    query.prepare("SELECT chat_id FROM chat_participants WHERE user_id = :userId");
+    query.bindValue(":userId", userId);
+    if (!query.exec())
+    {
+        setLastError(query.lastError().text());
+        return false;
+    }
+    while (query.next())
+    {
+        chatIds.append(query.value(0).toInt());
+    }
+    return true;
+}
+
+/**
+ * @brief Возвращает чаты пользователя вместе с их участниками одним запросом.
+ *
+ * @param userId Идентификатор пользователя.
+ * @param members Участники по чатам.
+ * @return true Если чтение выполнено.
+ */
+bool SqliteChatRepository::membershipsOf(int userId, QHash<int, QVector<int>> &members)
+{
+    QSqlQuery query(connection());
+    query.prepare("SELECT cp2.chat_id, cp2.user_id FROM chat_participants cp1 "
+                  "JOIN chat_participants cp2 ON cp2.chat_id = cp1.chat_id "
+                  "WHERE cp1.user_id = :userId");
+    query.bindValue(":userId", userId);
+    if (!query.exec())
+    {
+        setLastError(query.lastError().text());
+        return false;
+    }
+    while (query.next())
+    {
+        members[query.value(0).toInt()].append(query.value(1).toInt());
+    }
+    return true;
+}
+
+/**
+ * @brief Дописывает личные чаты пользователя в список.
+ *
+ * @param login Логин пользователя.
+ * @param chats Список чатов.
+ * @return true Если чтение выполнено.
+ */
+bool SqliteChatRepository::personalChats(const QString &login, QVector<ChatSummary> &chats)
+{
+    QSqlQuery query(connection());
+    query.prepare(
+        "SELECT c.chat_id, u2.nickname AS other_nickname, c.chat_type "
+        "FROM chats c "
+        "JOIN chat_participants cp1 ON c.chat_id = cp1.chat_id "
+        "JOIN user_auth u1 ON cp1.user_id = u1.user_id "
+        "JOIN chat_participants cp2 ON c.chat_id = cp2.chat_id AND cp2.user_id != cp1.user_id "
+        "JOIN user_auth u2 ON cp2.user_id = u2.user_id "
+        "WHERE u1.login = :login AND c.chat_type = 'personal'"
+        );
+    query.bindValue(":login", login);
+    if (!query.exec())
+    {
+        setLastError(query.lastError().text());
+        return false;
+    }
+    while (query.next())
+    {
+        ChatSummary chat;
+        chat.chatId = query.value("chat_id").toInt();
+        chat.title = query.value("other_nickname").toString();
+        chat.chatType = query.value("chat_type").toString();
+        chats.append(chat);
+    }
+    return true;
+}
+
+/**
+ * @brief Дописывает групповые чаты пользователя в список.
+ *
+ * @param login Логин пользователя.
+ * @param chats Список чатов.
+ * @return true Если чтение выполнено.
+ */
+bool SqliteChatRepository::groupChats(const QString &login, QVector<ChatSummary> &chats)
+{
+    QSqlQuery query(connection());
+    query.prepare(
+        "SELECT c.chat_id, c.chat_name AS other_nickname, c.chat_type "
+        "FROM chats c "
+        "JOIN chat_participants cp ON c.chat_id = cp.chat_id "
+        "JOIN user_auth u ON cp.user_id = u.user_id "
+        "WHERE u.login = :login AND c.chat_type = 'group'"
+        );
+    query.bindValue(":login", login);
+    if (!query.exec())
+    {
+        setLastError(query.lastError().text());
+        return false;
+    }
+    while (query.next())
+    {
+        ChatSummary chat;
+        chat.chatId = query.value("chat_id").toInt();
+        chat.title = query.value("other_nickname").toString();
+        chat.chatType = query.value("chat_type").toString();
+        chats.append(chat);
+    }
+    return true;
+}
+
+/**
+ * @brief Заполняет количество непрочитанных сообщений для всех чатов списка.
+ *
+ * Один подготовленный запрос выполняется для каждого чата.
+ *
+ * @param login Логин пользователя.
+ * @param chats Список чатов.
+ */
+void SqliteChatRepository::countUnread(const QString &login, QVector<ChatSummary> &chats)
+{
+    QSqlQuery query(connection());
+    query.prepare("SELECT COUNT(*) FROM messages m "
+                  "LEFT JOIN message_read_status mrs ON m.message_id = mrs.message_id "
+                  "WHERE m.chat_id = :chatId AND m.user_id != (SELECT user_id FROM user_auth WHERE login = :login) AND mrs.timestamp_read IS NULL");
+
+    int kept = 0;
+    for (int i = 0; i < chats.size(); ++i)
+    {
+        query.bindValue(":chatId", chats[i].chatId);
+        query.bindValue(":login", login);
+        if (!query.exec() || !query.next())
+        {
+            qCritical() << "Ошибка выполнения SQL запроса для непрочитанных сообщений: " << query.lastError();
+            continue;
+        }
+        chats[i].unreadCount = query.value(0).toInt();
+        if (kept != i)
+        {
+            chats[kept] = chats[i];
+        }
+        ++kept;
+    }
+    chats.resize(kept);
+}
+
+/**
+ * @brief Возвращает последний номер сообщения в чате.
+ *
+ * @param chatId Идентификатор чата.
+ * @return qint64 Номер последнего сообщения.
+ */
+qint64 SqliteChatRepository::lastSeq(int chatId)
+{
+    QSqlQuery query(connection());
+    query.prepare("SELECT MAX(chat_seq) FROM messages WHERE chat_id = :chatId");
+    query.bindValue(":chatId", chatId);
+    return (query.exec() && query.next()) ? query.value(0).toLongLong() : 0;
+}
+
+/**
+ * @brief Сохраняет сообщение.
+ *
+ * Без заданного номера номер вычисляется в самом запросе вставки: вставка в SQLite
+ * выполняется под блокировкой записи, поэтому номер уникален и для нескольких процессов.
+ *
+ * @param message Сообщение.
+ * @return true Если сообщение сохранено.
+ */
+bool SqliteChatRepository::insertMessage(MessageRecord &message)
+{
+    QSqlDatabase db = connection();
+    QSqlQuery query(db);
+    bool assignSeq = message.seq <= 0;
+    if (assignSeq)
+    {
+        query.prepare("INSERT INTO messages (chat_id, user_id, message_text, timestamp_sent, client_msg_id, chat_seq) "
+                      "SELECT :chatId, :userId, :messageText, :timestamp, :clientMsgId, COALESCE(MAX(chat_seq), 0) + 1 "
+                      "FROM messages WHERE chat_id = :seqChatId");
+        query.bindValue(":seqChatId", message.chatId);
+    }
+    else
+    {
+        query.prepare("INSERT INTO messages (chat_id, user_id, message_text, timestamp_sent, client_msg_id, chat_seq) "
+                      "VALUES (:chatId, :userId, :messageText, :timestamp, :clientMsgId, :seq)");
+        query.bindValue(":seq", message.seq);
+    }
+    query.bindValue(":chatId", message.chatId);
+    query.bindValue(":userId", message.userId);
+    query.bindValue(":messageText", message.text);
+    query.bindValue(":timestamp", message.timestamp);
+    query.bindValue(":clientMsgId", message.clientMessageId.isEmpty() ? QVariant(QVariant::String) : QVariant(message.clientMessageId));
+    if (!query.exec())
+    {
+        setLastError(query.lastError().text());
+        return false;
+    }
+
+    message.messageId = query.lastInsertId().toInt();
+    if (assignSeq)
+    {
+        QSqlQuery seqQuery(db);
+        seqQuery.prepare("SELECT chat_seq FROM messages WHERE message_id = :messageId");
+        seqQuery.bindValue(":messageId", message.messageId);
+        if (seqQuery.exec() && seqQuery.next())
+        {
+            message.seq = seqQuery.value(0).toLongLong();
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Сохраняет несколько сообщений в одной транзакции.
+ *
+ * При ошибке транзакция откатывается и не сохраняется ни одно сообщение.
+ *
+ * @param messages Сообщения.
+ * @return true Если сохранены все сообщения.
+ */
+bool SqliteChatRepository::insertMessages(QVector<MessageRecord> &messages)
+{
+    QSqlDatabase db = connection();
+    if (!db.transaction())
+    {
+        setLastError(db.lastError().text());
+        return false;
+    }
+    for (MessageRecord &message : messages)
+    {
+        if (!insertMessage(message))
+        {
+            QString error = lastError();
+            db.rollback();
+            setLastError(error);
+            return false;
+        }
+    }
+    if (!db.commit())
+    {
+        setLastError(db.lastError().text());
+        db.rollback();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Ищет сообщение по идентификатору клиента.
+ *
+ * @param chatId Идентификатор чата.
+ * @param userId Идентификатор отправителя.
+ * @param clientMessageId Идентификатор сообщения клиента.
+ * @param message Найденное сообщение.
+ * @return true Если сообщение найдено.
+ */
+bool SqliteChatRepository::findMessage(int chatId, int userId, const QString &clientMessageId, MessageRecord &message)
+{
+    QSqlQuery query(connection());
+    query.prepare("SELECT message_id, chat_seq FROM messages "
+                  "WHERE chat_id = :chatId AND user_id = :userId AND client_msg_id = :clientMsgId");
+    query.bindValue(":chatId", chatId);
+    query.bindValue(":userId", userId);
+    query.bindValue(":clientMsgId", clientMessageId);
+    if (!query.exec() || !query.next())
+    {
+        return false;
+    }
+    message.messageId = query.value(0).toInt();
+    message.seq = query.value(1).toLongLong();
+    return true;
+}
+
+/**
+ * @brief Выдаёт историю чата в порядке номеров сообщений.
+ *
+ * Строки передаются обработчику по мере чтения, без накопления результата. Порядок задаётся
+ * номером, а не временем отправки: время хранится с точностью до секунды, а клиент
+ * подтверждает получение по последнему номеру, поэтому сообщения не должны идти вразнобой.
+ *
+ * @param chatId Идентификатор чата.
+ * @param afterSeq Номер, после которого выдаются сообщения (0 — вся история).
+ * @param visit Обработчик сообщений.
+ * @return true Если чтение выполнено.
+ */
+bool SqliteChatRepository::history(int chatId, qint64 afterSeq, const MessageVisitor &visit)
+{
+    QSqlQuery query(connection());
+    query.prepare(QString("SELECT ua.login AS user_id, m.message_text, m.timestamp_sent AS timestamp, "
+                          "m.message_id, m.chat_seq, m.user_id AS sender_id "
+                          "FROM messages m "
+                          "JOIN user_auth ua ON m.user_id = ua.user_id "
+                          "WHERE m.chat_id = :chatId %1"
+                          "ORDER BY m.chat_seq").arg(afterSeq > 0 ? "AND m.chat_seq > :afterSeq " : ""));
+    query.bindValue(":chatId", chatId);
+    if (afterSeq > 0)
+    {
+        query.bindValue(":afterSeq", afterSeq);
+    }
+    if (!query.exec())
+    {
+        setLastError(query.lastError().text());
+        return false;
+    }
+
+    MessageRecord message;
+    message.chatId = chatId;
+    while (query.next())
+    {
+        message.senderLogin = query.value("user_id").toString();
+        message.text = query.value("message_text").toString();
+        message.timestamp = query.value("timestamp").toString();
+        message.messageId = query.value("message_id").toInt();
+        message.seq = query.value("chat_seq").toLongLong();
+        message.userId = query.value("sender_id").toInt();
+        visit(message);
+    }
+    return true;
+}
+
+/**
+ * @brief Отмечает прочитанными сообщения чата, отправленные другими участниками.
+ *
+ * Уже отмеченные сообщения не изменяются.
+ *
+ * @param chatId Идентификатор чата.
+ * @param userId Идентификатор читателя.
+ * @param messageIds Идентификаторы отмеченных сообщений.
+ * @return true Если сообщения чата прочитаны.
+ */
+bool SqliteChatRepository::markChatRead(int chatId, int userId, QVector<int> &messageIds)
+{
+    QSqlDatabase db = connection();
+    QSqlQuery selectQuery(db);
+    selectQuery.prepare("SELECT message_id FROM messages WHERE chat_id = :chatId AND user_id != :userId");
+    selectQuery.bindValue(":chatId", chatId);
+    selectQuery.bindValue(":userId", userId);
+    if (!selectQuery.exec())
+    {
+        setLastError(selectQuery.lastError().text());
+        return false;
+    }
+
+    QSqlQuery insertQuery(db);
+    insertQuery.prepare("INSERT OR IGNORE INTO message_read_status (message_id, user_id, timestamp_read) "
+                        "VALUES (:messageId, :userId, CURRENT_TIMESTAMP)");
+    while (selectQuery.next())
+    {
+        int messageId = selectQuery.value("message_id").toInt();
+        insertQuery.bindValue(":messageId", messageId);
+        insertQuery.bindValue(":userId", userId);
+        if (!insertQuery.exec())
+        {
+            qCritical() << "Error marking message as read:" << insertQuery.lastError().text();
+            continue;
+        }
+        messageIds.append(messageId);
+    }
+    return true;
+}
@@ -0,0 +1,106 @@
+/**
+ * /file sqlitechatrepository.h
+ * /brief Определение класса SqliteChatRepository — хранилища чатов в базе данных SQLite сервера.
+ */
+
+#ifndef SQLITECHATREPOSITORY_H
+#define SQLITECHATREPOSITORY_H
+
+#include "chatrepository.h"
+
+#include <QSqlDatabase>
+#include <QMutex>
+#include <QThread>
+
+/**
+ * /brief Класс SqliteChatRepository.
+ *
+ * Реализация ChatRepository поверх таблиц user_auth, chats, chat_participants, messages
+ * и message_read_status базы данных сервера. Запросы совпадают с теми, что прежде
+ * выполнялись прямо в обработчиках ServerLogic.
+ *
+ * Подключение QSqlDatabase можно использовать только в создавшем его потоке, поэтому
+ * асинхронные вызовы работают через копии подключения, открываемые по одной на поток пула.
+ */
+class SqliteChatRepository : public ChatRepository
+{
+private:
+    QSqlDatabase database; ///< Подключение потока событий.
+    QThread *ownerThread = nullptr; ///< Поток, которому принадлежит основное подключение.
+    QMutex connectionMutex; ///< Защита списка подключений потоков пула.
+    QHash<QThread*, QString> connectionNames; ///< Имена подключений потоков пула.
+
+    /**
+     * /brief Возвращает подключение для текущего потока.
+     * /return Подключение к базе данных.
+     */
+    QSqlDatabase connection();
+
+    /**
+     * /brief Добавляет к таблице user_auth столбец момента отзыва токенов сессии.
+     * /return Признак успешной подготовки схемы.
+     */
+    bool prepareUserSchema();
+
+    /**
+     * /brief Добавляет к таблице messages столбцы и индексы для номеров сообщений.
+     * /return Признак успешной подготовки схемы.
+     */
+    bool prepareMessageSchema();
+
+    /**
+     * /brief Присваивает номера сообщениям, сохранённым без них.
+     * /return Признак успешного заполнения номеров.
+     */
+    bool backfillMessageSeqs();
+
+public:
+    /**
+     * /brief Деструктор, закрывающий подключения потоков пула.
+     */
+    ~SqliteChatRepository() override;
+
+    /**
+     * /brief Подключает хранилище к базе данных и дополняет схему при необходимости.
+     * /param database База данных сервера.
+     * /return Признак успешной подготовки схемы.
+     */
+    bool open(const QSqlDatabase &database);
+
+    /**
+     * /brief Дожидается асинхронных вызовов и закрывает подключения потоков пула.
+     */
+    void close();
+
+    QString engineName() const override;
+    bool isLoginAvailable(const QString &login) override;
+    int userIdByLogin(const QString &login) override;
+    bool findUser(const QString &login, UserRecord &user) override;
+    int createUser(const QString &login, const QString &password, const QString &nickname) override;
+    bool updatePassword(const QString &login, const QString &password) override;
+    bool upgradePassword(int userId, const QString &oldPassword, const QString &newPassword) override;
+    bool updateLogin(const QString &oldLogin, const QString &newLogin, const QString &password) override;
+    bool updateNickname(const QString &login, const QString &nickname) override;
+    bool revokeTokens(int userId, qint64 revokedAt) override;
+    bool tokenRevocations(QHash<int, qint64> &revokedAt) override;
+    bool findUsers(const QString &nicknamePart, const QString &exceptLogin, const UserVisitor &visit) override;
+    int chatIdByName(const QStringList &names) override;
+    int createChat(const QString &name, const QString &chatType) override;
+    bool addParticipants(int chatId, const QStringList &logins) override;
+    bool deleteChat(int chatId) override;
+    bool participants(int chatId, QVector<int> &userIds) override;
+    bool participants(const QVector<int> &chatIds, QHash<int, QVector<int>> &members) override;
+    bool chatsOf(int userId, QVector<int> &chatIds) override;
+    bool membershipsOf(int userId, QHash<int, QVector<int>> &members) override;
+    bool personalChats(const QString &login, QVector<ChatSummary> &chats) override;
+    bool groupChats(const QString &login, QVector<ChatSummary> &chats) override;
+    void countUnread(const QString &login, QVector<ChatSummary> &chats) override;
+    qint64 lastSeq(int chatId) override;
+    bool insertMessage(MessageRecord &message) override;
+    bool insertMessages(QVector<MessageRecord> &messages) override;
+    bool findMessage(int chatId, int userId, const QString &clientMessageId, MessageRecord &message) override;
+    bool history(int chatId, qint64 afterSeq, const MessageVisitor &visit) override;
+    bool markChatRead(int chatId, int userId, QVector<int> &messageIds) override;
+};
+
+#endif // SQLITECHATREPOSITORY_H
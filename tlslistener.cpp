@@ -0,0 +1,207 @@
+#include "tlslistener.h"
+#include "logger.h"
+#include "servermetrics.h"
+
+#include <QFile>
+#include <QSslKey>
+#include <QTimer>
+#include <QElapsedTimer>
+
+/**
+ * @brief Конструктор класса TlsHandshakeWorker.
+ *
+ * @param configuration Конфигурация TLS.
+ * @param targetThread Поток, в который передаются готовые сокеты.
+ * @param timeoutMs Максимальная длительность рукопожатия в миллисекундах.
+ */
+TlsHandshakeWorker::TlsHandshakeWorker(const QSslConfiguration &configuration, QThread *targetThread, int timeoutMs)
+    : configuration(configuration), targetThread(targetThread), timeoutMs(timeoutMs)
+{
+}
+
+/**
+ * @brief Начинает рукопожатие для принятого подключения.
+ *
+ * Сокет создаётся без родителя, чтобы после рукопожатия его можно было перенести в поток
+ * сервера. Подключения, не завершившие рукопожатие за отведённое время, закрываются.
+ *
+ * @param descriptor Дескриптор сокета.
+ */
+void TlsHandshakeWorker::startHandshake(qintptr descriptor)
+{
+    QSslSocket *socket = new QSslSocket;
+    if (!socket->setSocketDescriptor(descriptor))
+    {
+        Logger::getInstance()->logToFile("TLS: failed to adopt socket descriptor: " + socket->errorString());
+        delete socket;
+        return;
+    }
+    socket->setSslConfiguration(configuration);
+
+    QElapsedTimer clock;
+    clock.start();
+    QTimer *timeout = new QTimer(socket);
+    timeout->setSingleShot(true);
+    connect(timeout, &QTimer::timeout, this, [socket]()
+            {
+                ServerMetrics::getInstance()->add("tls.handshake_timeouts");
+                socket->abort();
+            });
+    timeout->start(timeoutMs);
+
+    connect(socket, &QSslSocket::encrypted, this, [this, socket, timeout, clock]()
+            {
+                //Рукопожатие завершено: сокет больше не нужен этому потоку
+                delete timeout;
+                disconnect(socket, nullptr, this, nullptr);
+
+                ServerMetrics *metrics = ServerMetrics::getInstance();
+                metrics->add("tls.handshakes");
+                metrics->add("tls.handshake_ms_total", clock.elapsed());
+                metrics->set("tls.handshake_ms_avg", metrics->value("tls.handshake_ms_total") / metrics->value("tls.handshakes"));
+
+                socket->moveToThread(targetThread);
+                emit handshakeCompleted(socket);
+            });
+    connect(socket, QOverload<const QList<QSslError>&>::of(&QSslSocket::sslErrors), this, [socket](const QList<QSslError> &errors)
+            {
+                for (const QSslError &error : errors)
+                {
+                    Logger::getInstance()->logToFile(QString("TLS error from %1: %2")
+                                                         .arg(socket->peerAddress().toString(), error.errorString()));
+                }
+            });
+    connect(socket, &QAbstractSocket::disconnected, this, [socket]()
+            {
+                //Клиент ушёл до окончания рукопожатия
+                ServerMetrics::getInstance()->add("tls.handshake_failures");
+                socket->deleteLater();
+            });
+
+    socket->startServerEncryption();
+}
+
+/**
+ * @brief Конструктор класса TlsListener.
+ *
+ * @param parent Указатель на родительский объект (по умолчанию nullptr).
+ */
+TlsListener::TlsListener(QObject *parent) : QTcpServer(parent)
+{
+}
+
+/**
+ * @brief Деструктор класса TlsListener.
+ */
+TlsListener::~TlsListener()
+{
+    stopWorkers();
+}
+
+/**
+ * @brief Останавливает потоки рукопожатий.
+ *
+ * Обработчики, работающие в отдельных потоках, удаляются через deleteLater в своих потоках.
+ */
+void TlsListener::stopWorkers()
+{
+    for (QThread *thread : qAsConst(threads))
+    {
+        thread->quit();
+        thread->wait();
+        delete thread;
+    }
+    if (threads.isEmpty())
+    {
+        qDeleteAll(workers);
+    }
+    threads.clear();
+    workers.clear();
+}
+
+/**
+ * @brief Загружает сертификат и ключ и создаёт обработчики рукопожатий.
+ *
+ * Сессионные билеты TLS и сохранение сессий оставлены включёнными, чтобы клиенты,
+ * поддерживающие их, могли их предъявить.
+ *
+ * @param certificatePath Путь к сертификату в формате PEM.
+ * @param privateKeyPath Путь к закрытому ключу в формате PEM.
+ * @param threadCount Количество потоков рукопожатий.
+ * @param timeoutMs Максимальная длительность рукопожатия в миллисекундах.
+ * @return true Если сертификат и ключ загружены.
+ * @return false В противном случае.
+ */
+bool TlsListener::configure(const QString &certificatePath, const QString &privateKeyPath, int threadCount, int timeoutMs)
+{
+    QFile certificateFile(certificatePath);
+    QFile keyFile(privateKeyPath);
+    if (!certificateFile.open(QIODevice::ReadOnly) || !keyFile.open(QIODevice::ReadOnly))
+    {
+        Logger::getInstance()->logToFile(QString("TLS: cannot read certificate '%1' or key '%2'").arg(certificatePath, privateKeyPath));
+        return false;
+    }
+
+    QList<QSslCertificate> chain = QSslCertificate::fromDevice(&certificateFile, QSsl::Pem);
+    QByteArray keyData = keyFile.readAll();
+    QSslKey key(keyData, QSsl::Rsa, QSsl::Pem);
+    if (key.isNull())
+    {
+        key = QSslKey(keyData, QSsl::Ec, QSsl::Pem);
+    }
+    if (chain.isEmpty() || key.isNull())
+    {
+        Logger::getInstance()->logToFile("TLS: invalid certificate or private key");
+        return false;
+    }
+
+    QSslConfiguration configuration = QSslConfiguration::defaultConfiguration();
+    configuration.setLocalCertificateChain(chain);
+    configuration.setPrivateKey(key);
+    configuration.setProtocol(QSsl::SecureProtocols);
+    configuration.setPeerVerifyMode(QSslSocket::VerifyNone);
+    configuration.setSslOption(QSsl::SslOptionDisableSessionTickets, false);
+    configuration.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+
+    stopWorkers();
+    if (threadCount <= 0)
+    {
+        TlsHandshakeWorker *worker = new TlsHandshakeWorker(configuration, thread(), timeoutMs);
+        connect(worker, &TlsHandshakeWorker::handshakeCompleted, this, &TlsListener::connectionReady);
+        workers.append(worker);
+        return true;
+    }
+
+    for (int i = 0; i < threadCount; ++i)
+    {
+        QThread *workerThread = new QThread;
+        TlsHandshakeWorker *worker = new TlsHandshakeWorker(configuration, thread(), timeoutMs);
+        worker->moveToThread(workerThread);
+        connect(workerThread, &QThread::finished, worker, &QObject::deleteLater);
+        connect(worker, &TlsHandshakeWorker::handshakeCompleted, this, &TlsListener::connectionReady);
+        workerThread->start();
+        threads.append(workerThread);
+        workers.append(worker);
+    }
+    return true;
+}
+
+/**
+ * @brief Передаёт принятый дескриптор обработчику рукопожатий по кругу.
+ *
+ * @param descriptor Дескриптор сокета.
+ */
+void TlsListener::incomingConnection(qintptr descriptor)
+{
+    if (workers.isEmpty())
+    {
+        return;
+    }
+    TlsHandshakeWorker *worker = workers[nextWorker];
+    nextWorker = (nextWorker + 1) % workers.size();
+    ServerMetrics::getInstance()->add("tls.accepted");
+    QMetaObject::invokeMethod(worker, [worker, descriptor]()
+                              {
+                                  worker->startHandshake(descriptor);
+                              }, Qt::QueuedConnection);
+}
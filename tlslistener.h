@@ -0,0 +1,112 @@
+/**
+ * /file tlslistener.h
+ * /brief Определение классов TlsListener и TlsHandshakeWorker для приёма TLS-подключений.
+ */
+
+#ifndef TLSLISTENER_H
+#define TLSLISTENER_H
+
+#include <QTcpServer>
+#include <QSslSocket>
+#include <QSslConfiguration>
+#include <QThread>
+#include <QVector>
+
+/**
+ * /brief Класс TlsHandshakeWorker.
+ *
+ * Выполняет TLS-рукопожатие для принятых дескрипторов в своём потоке. После успешного
+ * рукопожатия сокет переносится в поток сервера и передаётся сигналом handshakeCompleted.
+ */
+class TlsHandshakeWorker : public QObject
+{
+    Q_OBJECT
+
+private:
+    QSslConfiguration configuration; ///< Общая конфигурация TLS с сертификатом и ключом.
+    QThread *targetThread; ///< Поток, в котором работает логика сервера.
+    int timeoutMs; ///< Максимальная длительность рукопожатия.
+
+public:
+    /**
+     * /brief Конструктор класса TlsHandshakeWorker.
+     * /param configuration Конфигурация TLS.
+     * /param targetThread Поток, в который передаются готовые сокеты.
+     * /param timeoutMs Максимальная длительность рукопожатия в миллисекундах.
+     */
+    TlsHandshakeWorker(const QSslConfiguration &configuration, QThread *targetThread, int timeoutMs);
+
+    /**
+     * /brief Начинает рукопожатие для принятого подключения.
+     * /param descriptor Дескриптор сокета.
+     */
+    void startHandshake(qintptr descriptor);
+
+signals:
+    /**
+     * /brief Сигнал об успешном рукопожатии.
+     * /param socket Зашифрованный сокет, уже принадлежащий потоку сервера.
+     */
+    void handshakeCompleted(QSslSocket *socket);
+};
+
+/**
+ * /brief Класс TlsListener.
+ *
+ * Принимает подключения на отдельном порту и выполняет TLS-рукопожатие в пуле рабочих
+ * потоков, не занимая цикл событий сервера. Сертификат и ключ загружаются один раз
+ * и используются всеми подключениями. Готовые сокеты передаются сигналом connectionReady
+ * и дальше обслуживаются так же, как открытые подключения.
+ */
+class TlsListener : public QTcpServer
+{
+    Q_OBJECT
+
+private:
+    QVector<QThread*> threads; ///< Потоки рукопожатий.
+    QVector<TlsHandshakeWorker*> workers; ///< Обработчики рукопожатий (по одному на поток или один в потоке сервера).
+    int nextWorker = 0; ///< Обработчик, который получит следующее подключение.
+
+    /**
+     * /brief Останавливает потоки рукопожатий.
+     */
+    void stopWorkers();
+
+protected:
+    /**
+     * /brief Передаёт принятый дескриптор обработчику рукопожатий.
+     * /param descriptor Дескриптор сокета.
+     */
+    void incomingConnection(qintptr descriptor) override;
+
+public:
+    /**
+     * /brief Конструктор класса TlsListener.
+     * /param parent Указатель на родительский объект.
+     */
+    explicit TlsListener(QObject *parent = nullptr);
+
+    /**
+     * /brief Деструктор, останавливающий потоки рукопожатий.
+     */
+    ~TlsListener() override;
+
+    /**
+     * /brief Загружает сертификат и ключ и создаёт обработчики рукопожатий.
+     * /param certificatePath Путь к сертификату в формате PEM.
+     * /param privateKeyPath Путь к закрытому ключу в формате PEM.
+     * /param threadCount Количество потоков рукопожатий (0 — рукопожатия в потоке сервера).
+     * /param timeoutMs Максимальная длительность рукопожатия в миллисекундах.
+     * /return Признак успешной загрузки сертификата и ключа.
+     */
+    bool configure(const QString &certificatePath, const QString &privateKeyPath, int threadCount, int timeoutMs);
+
+signals:
+    /**
+     * /brief Сигнал о готовом к работе зашифрованном подключении.
+     * /param socket Сокет клиента.
+     */
+    void connectionReady(QTcpSocket *socket);
+};
+
+#endif // TLSLISTENER_H
@@ -0,0 +1,70 @@
+/**
+ * /file tokenbucket.h
+ * /brief Определение класса TokenBucket — неблокирующего ограничителя частоты запросов.
+ */
+
+#ifndef TOKENBUCKET_H
+#define TOKENBUCKET_H
+
+#include <QtGlobal>
+#include <atomic>
+
+/**
+ * /brief Класс TokenBucket.
+ *
+ * Корзина токенов в форме GCRA: всё состояние — одно атомарное «теоретическое время
+ * прибытия» следующего запроса. Запрос стоимостью cost сдвигает это время на
+ * cost * интервал пополнения и допускается, если опережение не превышает ёмкости корзины.
+ * Проверка выполняется одной операцией compare-and-swap без блокировок, поэтому корзину
+ * можно проверять из нескольких потоков.
+ */
+class TokenBucket
+{
+private:
+    std::atomic<qint64> theoreticalArrivalUs{0}; ///< Время, к которому корзина снова будет полной, в микросекундах.
+
+public:
+    /**
+     * /brief Пытается списать токены.
+     * /param costUs Стоимость запроса, выраженная во времени пополнения (микросекунды).
+     * /param nowUs Текущее время в микросекундах (монотонные часы).
+     * /param capacityUs Ёмкость корзины, выраженная во времени пополнения (микросекунды).
+     * /return 0, если запрос допущен, иначе время в микросекундах, через которое его можно повторить.
+     */
+    qint64 tryConsume(qint64 costUs, qint64 nowUs, qint64 capacityUs)
+    {
+        qint64 current = theoreticalArrivalUs.load(std::memory_order_relaxed);
+        qint64 next;
+        do
+        {
+            next = qMax(current, nowUs) + costUs;
+            if (next - nowUs > capacityUs)
+            {
+                return next - nowUs - capacityUs;
+            }
+        }
+        while (!theoreticalArrivalUs.compare_exchange_weak(current, next, std::memory_order_acq_rel, std::memory_order_relaxed));
+        return 0;
+    }
+
+    /**
+     * /brief Возвращает в корзину токены списанного ранее запроса.
+     * /param costUs Стоимость запроса, выраженная во времени пополнения (микросекунды).
+     */
+    void refund(qint64 costUs)
+    {
+        theoreticalArrivalUs.fetch_sub(costUs, std::memory_order_acq_rel);
+    }
+
+    /**
+     * /brief Проверяет, полна ли корзина (её можно удалить без потери состояния).
+     * /param nowUs Текущее время в микросекундах.
+     * /return Признак полной корзины.
+     */
+    bool isFull(qint64 nowUs) const
+    {
+        return theoreticalArrivalUs.load(std::memory_order_relaxed) <= nowUs;
+    }
+};
+
+#endif // TOKENBUCKET_H
@@ -0,0 +1,40 @@
+#!/bin/sh
+# Запускает на одной машине несколько экземпляров сервера, объединённых шиной.
+# Использование: run-local-cluster.sh <путь к Server> [экземпляров, по умолчанию 4] [первый порт, по умолчанию 3000]
+# Перед запуском в appsettings.ini:
+#   [Cluster]
+#   enabled=true
+# Все экземпляры используют общую базу ~/MESDB.db. Экземпляр i слушает порт <первый порт>+i.
+# При SHARED_PORT=1 и [Server] reusePort=true все экземпляры слушают один порт с SO_REUSEPORT,
+# и ядро само распределяет между ними подключения.
+# Проверка масштабирования: по одному генератору нагрузки на каждый порт, например
+#   loadgen --port 3001 --prefix lg1 --clients 1000 --rate 2000
+# и сравнение суммарной пропускной способности с одним экземпляром.
+# Ctrl+C останавливает все экземпляры.
+
+set -e
+SERVER="$1"
+COUNT="${2:-4}"
+BASE_PORT="${3:-3000}"
+
+if [ -z "$SERVER" ] || [ ! -x "$SERVER" ]; then
+    echo "Usage: $0 <server binary> [instances] [base port]" >&2
+    exit 1
+fi
+
+PIDS=""
+trap 'kill $PIDS 2>/dev/null; wait' INT TERM EXIT
+
+i=0
+while [ "$i" -lt "$COUNT" ]; do
+    PORT=$((BASE_PORT + i))
+    if [ "${SHARED_PORT:-0}" = "1" ]; then
+        PORT=$BASE_PORT
+    fi
+    QT_QPA_PLATFORM=offscreen "$SERVER" --port "$PORT" &
+    PIDS="$PIDS $!"
+    echo "Instance $i: port $PORT, pid $!"
+    i=$((i + 1))
+done
+
+wait
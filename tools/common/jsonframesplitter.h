@@ -0,0 +1,112 @@
+/**
+ * /file jsonframesplitter.h
+ * /brief Определение класса JsonFrameSplitter для разбора потока JSON-ответов сервера.
+ */
+
+#ifndef JSONFRAMESPLITTER_H
+#define JSONFRAMESPLITTER_H
+
+#include <QByteArray>
+#include <QList>
+
+/**
+ * /brief Класс JsonFrameSplitter.
+ *
+ * Сервер пишет JSON-объекты в сокет без разделителей, поэтому за одно срабатывание
+ * readyRead клиент может получить несколько склеенных объектов или только часть объекта.
+ * Класс накапливает входящие байты и выделяет из них завершённые объекты верхнего уровня,
+ * учитывая вложенность скобок и строковые литералы.
+ */
+class JsonFrameSplitter
+{
+private:
+    QByteArray buffer; ///< Накопленные, ещё не разобранные байты.
+    int scanPos = 0; ///< Позиция, с которой продолжается сканирование буфера.
+    int depth = 0; ///< Текущая глубина вложенности фигурных и квадратных скобок.
+    int frameStart = -1; ///< Начало текущего объекта в буфере (-1, если объект ещё не начат).
+    bool inString = false; ///< Признак нахождения внутри строкового литерала.
+    bool escaped = false; ///< Признак того, что предыдущий символ строки был обратной косой чертой.
+
+public:
+    /**
+     * /brief Добавляет полученные из сокета байты.
+     * /param data Полученные данные.
+     */
+    void append(const QByteArray &data)
+    {
+        buffer.append(data);
+    }
+
+    /**
+     * /brief Извлекает все завершённые JSON-объекты из буфера.
+     * /return Список завершённых объектов в порядке поступления.
+     */
+    QList<QByteArray> takeFrames()
+    {
+        QList<QByteArray> frames;
+        int consumed = 0;
+        for (; scanPos < buffer.size(); ++scanPos)
+        {
+            const char c = buffer.at(scanPos);
+            if (inString)
+            {
+                if (escaped)
+                {
+                    escaped = false;
+                }
+                else if (c == '\\')
+                {
+                    escaped = true;
+                }
+                else if (c == '"')
+                {
+                    inString = false;
+                }
+                continue;
+            }
+
+            if (c == '"' && frameStart >= 0)
+            {
+                inString = true;
+            }
+            else if (c == '{' || c == '[')
+            {
+                if (depth++ == 0)
+                {
+                    frameStart = scanPos;
+                }
+            }
+            else if ((c == '}' || c == ']') && depth > 0)
+            {
+                if (--depth == 0)
+                {
+                    frames.append(buffer.mid(frameStart, scanPos - frameStart + 1));
+                    frameStart = -1;
+                    consumed = scanPos + 1;
+                }
+            }
+        }
+
+        //Отбрасываем разобранную часть, чтобы буфер не рос бесконечно
+        if (frameStart < 0)
+        {
+            consumed = buffer.size();
+        }
+        else if (frameStart > consumed)
+        {
+            consumed = frameStart;
+        }
+        if (consumed > 0)
+        {
+            buffer.remove(0, consumed);
+            scanPos -= consumed;
+            if (frameStart >= 0)
+            {
+                frameStart -= consumed;
+            }
+        }
+        return frames;
+    }
+};
+
+#endif // JSONFRAMESPLITTER_H
@@ -0,0 +1,23 @@
+QT += core sql
+QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = compact
+
+SERVER_DIR = $$PWD/../..
+INCLUDEPATH += $$SERVER_DIR
+
+SOURCES += \
+    $$SERVER_DIR/logger.cpp \
+    $$SERVER_DIR/messagelog.cpp \
+    $$SERVER_DIR/servermetrics.cpp \
+    $$SERVER_DIR/wireprotocol.cpp \
+    main.cpp
+
+HEADERS += \
+    $$SERVER_DIR/logger.h \
+    $$SERVER_DIR/messagelog.h \
+    $$SERVER_DIR/servermetrics.h \
+    $$SERVER_DIR/wireprotocol.h
@@ -0,0 +1,101 @@
+/**
+ * /file main.cpp
+ * /brief Точка входа инструмента сжатия сегментов истории чатов.
+ */
+
+#include "messagelog.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QSet>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QTextStream>
+
+/**
+ * /brief Главная функция инструмента сжатия.
+ *
+ * Переписывает каждый сегмент каталога (History/segmentDir) без недописанного хвоста
+ * и повторных записей и строит индекс заново. С параметром --database удаляет сегменты
+ * чатов, которых больше нет в базе данных. Запускается при остановленном сервере или
+ * при выключенном хранении сегментов (History/segmentLog=false).
+ *
+ * /param argc Количество аргументов командной строки.
+ * /param argv Массив аргументов командной строки.
+ * /return Код завершения приложения.
+ */
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("compact");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Compacts ServerMessenger chat history segments.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("directory", "Segment directory (History/segmentDir).");
+    QCommandLineOption databaseOption("database", "Server database; segments of deleted chats are removed.", "path");
+    parser.addOption(databaseOption);
+    parser.process(app);
+
+    if (parser.positionalArguments().size() != 1)
+    {
+        parser.showHelp(1);
+    }
+    QString directory = parser.positionalArguments().first();
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    QSet<int> liveChats;
+    bool checkChats = parser.isSet(databaseOption);
+    if (checkChats)
+    {
+        QSqlDatabase database = QSqlDatabase::addDatabase("QSQLITE");
+        database.setDatabaseName(parser.value(databaseOption));
+        QSqlQuery query(database);
+        if (!database.open() || !query.exec("SELECT chat_id FROM chats"))
+        {
+            err << "Could not read chats from " << parser.value(databaseOption) << "\n";
+            return 1;
+        }
+        while (query.next())
+        {
+            liveChats.insert(query.value(0).toInt());
+        }
+    }
+
+    int compacted = 0;
+    int removed = 0;
+    int failed = 0;
+    qint64 bytesBefore = 0;
+    qint64 bytesAfter = 0;
+    const QVector<int> chatIds = MessageLog::chatIds(directory);
+    for (int chatId : chatIds)
+    {
+        if (checkChats && !liveChats.contains(chatId))
+        {
+            MessageLog::removeFiles(directory, chatId);
+            out << "chat " << chatId << ": removed (chat deleted)\n";
+            ++removed;
+            continue;
+        }
+
+        MessageLog::CompactionStats stats;
+        if (!MessageLog::compact(directory, chatId, stats))
+        {
+            //Сегмент будет создан заново из базы данных при следующем чтении
+            err << "chat " << chatId << ": not a valid segment, removing\n";
+            MessageLog::removeFiles(directory, chatId);
+            ++failed;
+            continue;
+        }
+        out << "chat " << chatId << ": " << stats.records << " records, " << stats.duplicates << " duplicates, "
+            << stats.truncatedBytes << " bytes of torn tail, " << stats.bytesBefore << " -> " << stats.bytesAfter << " bytes\n";
+        bytesBefore += stats.bytesBefore;
+        bytesAfter += stats.bytesAfter;
+        ++compacted;
+    }
+
+    out << "Compacted " << compacted << " segments (" << bytesBefore << " -> " << bytesAfter << " bytes), removed "
+        << removed << ", invalid " << failed << "\n";
+    return 0;
+}
@@ -0,0 +1,15 @@
+QT += core network
+QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = loadgen
+
+SOURCES += \
+    loadgenerator.cpp \
+    main.cpp
+
+HEADERS += \
+    ../common/jsonframesplitter.h \
+    loadgenerator.h
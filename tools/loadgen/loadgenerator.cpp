@@ -0,0 +1,542 @@
+#include "loadgenerator.h"
+
+#include <QJsonDocument>
+#include <QDateTime>
+#include <QTextStream>
+#include <algorithm>
+
+namespace
+{
+const QString messageMarkerPrefix = QStringLiteral("lg:"); ///< Префикс метки в тексте синтетического сообщения.
+const QString syntheticPassword = QStringLiteral("loadgen-password"); ///< Пароль всех синтетических пользователей.
+
+/**
+ * @brief Проверяет, что кадр отправлен сервером по своей инициативе, а не в ответ на запрос.
+ *
+ * @param type Тип кадра.
+ * @return true Если кадр является уведомлением сервера.
+ */
+bool isServerPush(const QString &type)
+{
+    return type == QLatin1String("chat_update") || type == QLatin1String("presence_update")
+            || type == QLatin1String("pending_updates") || type == QLatin1String("ping");
+}
+}
+
+/**
+ * @brief Конструктор класса LoadGenerator.
+ *
+ * Создаёт виртуальных клиентов (их число округляется до чётного, чтобы каждый имел собеседника)
+ * и настраивает таймеры разгона, планировщика и отчётов.
+ *
+ * @param config Параметры теста.
+ * @param parent Указатель на родительский объект (по умолчанию nullptr).
+ */
+LoadGenerator::LoadGenerator(const LoadConfig &config, QObject *parent)
+    : QObject(parent), config(config), random(QRandomGenerator::securelySeeded())
+{
+    int clientCount = config.clients + (config.clients % 2);
+    clients.reserve(clientCount);
+    for (int i = 0; i < clientCount; ++i)
+    {
+        VirtualClient *client = new VirtualClient;
+        client->index = i;
+        client->login = QString("%1_%2").arg(config.loginPrefix).arg(i);
+        client->peerLogin = QString("%1_%2").arg(config.loginPrefix).arg(i ^ 1);
+        clients.append(client);
+    }
+
+    for (const auto &entry : config.mix)
+    {
+        totalMixWeight += entry.second;
+        stats.insert(entry.first, TypeStats());
+    }
+
+    connect(&connectTimer, &QTimer::timeout, this, &LoadGenerator::connectNextBatch);
+    connect(&tickTimer, &QTimer::timeout, this, &LoadGenerator::onTick);
+    connect(&reportTimer, &QTimer::timeout, this, [this]()
+            {
+                expireTimedOutRequests();
+                printReport(false);
+            });
+    tickTimer.setTimerType(Qt::PreciseTimer);
+}
+
+/**
+ * @brief Деструктор класса LoadGenerator.
+ *
+ * Закрывает подключения и освобождает виртуальных клиентов.
+ */
+LoadGenerator::~LoadGenerator()
+{
+    for (VirtualClient *client : clients)
+    {
+        if (client->socket)
+        {
+            client->socket->abort();
+        }
+        delete client;
+    }
+}
+
+/**
+ * @brief Запускает подключение клиентов.
+ *
+ * Подключения открываются порциями каждые 10 мс, чтобы не создавать на сервере
+ * искусственный шторм подключений, если это не требуется параметрами теста.
+ */
+void LoadGenerator::start()
+{
+    clock.start();
+    QTextStream(stdout) << "Connecting " << clients.size() << " clients to "
+                        << config.host << ":" << config.port << "\n";
+    connectTimer.start(10);
+}
+
+/**
+ * @brief Открывает очередную порцию подключений.
+ */
+void LoadGenerator::connectNextBatch()
+{
+    int batch = qMax(1, config.connectRate / 100);
+    for (int i = 0; i < batch && nextClientToConnect < clients.size(); ++i)
+    {
+        VirtualClient *client = clients[nextClientToConnect++];
+        client->socket = new QTcpSocket(this);
+        client->socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+        connect(client->socket, &QTcpSocket::connected, this, [this, client]()
+                {
+                    client->state = ClientState::Registering;
+                    QJsonObject request;
+                    request["type"] = "register";
+                    request["login"] = client->login;
+                    request["password"] = syntheticPassword;
+                    sendRequest(client, request);
+                });
+        connect(client->socket, &QTcpSocket::readyRead, this, [this, client]()
+                {
+                    client->splitter.append(client->socket->readAll());
+                    for (const QByteArray &frameData : client->splitter.takeFrames())
+                    {
+                        QJsonDocument document = QJsonDocument::fromJson(frameData);
+                        if (document.isObject())
+                        {
+                            handleFrame(client, document.object());
+                        }
+                    }
+                });
+        connect(client->socket, &QTcpSocket::errorOccurred, this, [this, client](QAbstractSocket::SocketError)
+                {
+                    qWarning() << "Client" << client->login << "failed:" << client->socket->errorString();
+                    if (client->state != ClientState::Ready)
+                    {
+                        failSetup(client);
+                    }
+                    else
+                    {
+                        client->failed = true;
+                        readyClients.removeOne(client);
+                    }
+                });
+
+        client->socket->connectToHost(config.host, config.port);
+    }
+
+    if (nextClientToConnect >= clients.size())
+    {
+        connectTimer.stop();
+    }
+}
+
+/**
+ * @brief Отправляет запрос от имени клиента.
+ *
+ * Сервер не разделяет склеенные запросы, поэтому у каждого клиента одновременно
+ * может быть не более одного ожидающего ответа запроса.
+ *
+ * @param client Виртуальный клиент.
+ * @param request Объект JSON с запросом.
+ */
+void LoadGenerator::sendRequest(VirtualClient *client, const QJsonObject &request)
+{
+    client->pendingType = request["type"].toString();
+    client->pendingSinceNs = clock.nsecsElapsed();
+    client->socket->write(QJsonDocument(request).toJson(QJsonDocument::Compact));
+}
+
+/**
+ * @brief Обрабатывает один полученный клиентом JSON-объект.
+ *
+ * Push-уведомления chat_update учитываются в статистике доставки, остальные уведомления
+ * сервера (присутствие, накопленные обновления, heartbeat) пропускаются, любой другой
+ * объект считается ответом на ожидающий запрос клиента.
+ *
+ * @param client Виртуальный клиент.
+ * @param frame Объект JSON, полученный от сервера.
+ */
+void LoadGenerator::handleFrame(VirtualClient *client, const QJsonObject &frame)
+{
+    qint64 nowNs = clock.nsecsElapsed();
+
+    if (frame["type"].toString() == "chat_update")
+    {
+        QString text = frame["message_text"].toString();
+        if (text.startsWith(messageMarkerPrefix))
+        {
+            quint64 seq = text.mid(messageMarkerPrefix.size()).toULongLong();
+            auto it = pushSentAt.find(seq);
+            if (it != pushSentAt.end())
+            {
+                pushLatenciesUs.append((nowNs - it.value()) / 1000);
+                pushSentAt.erase(it);
+            }
+        }
+        return;
+    }
+    if (isServerPush(frame["type"].toString()))
+    {
+        return;
+    }
+
+    if (client->failed || client->pendingType.isEmpty())
+    {
+        return; //Ответ на запрос, уже признанный потерянным
+    }
+
+    if (client->state != ClientState::Ready)
+    {
+        client->pendingType.clear();
+        advanceSetup(client, frame);
+        return;
+    }
+
+    auto it = stats.find(client->pendingType);
+    if (measureStartNs >= 0 && client->pendingSinceNs >= measureStartNs && it != stats.end())
+    {
+        if (frame["status"].toString() == "error")
+        {
+            it->errors++;
+        }
+        else
+        {
+            it->latenciesUs.append((nowNs - client->pendingSinceNs) / 1000);
+        }
+    }
+    client->pendingType.clear();
+}
+
+/**
+ * @brief Переводит клиента на следующий этап подготовки.
+ *
+ * Ошибка регистрации не считается фатальной: пользователь мог остаться от предыдущего запуска.
+ *
+ * @param client Виртуальный клиент.
+ * @param frame Ответ сервера на предыдущий этап.
+ */
+void LoadGenerator::advanceSetup(VirtualClient *client, const QJsonObject &frame)
+{
+    switch (client->state)
+    {
+    case ClientState::Registering:
+    {
+        client->state = ClientState::LoggingIn;
+        QJsonObject request;
+        request["type"] = "login";
+        request["login"] = client->login;
+        request["password"] = syntheticPassword;
+        sendRequest(client, request);
+        break;
+    }
+    case ClientState::LoggingIn:
+        if (frame["status"].toString() != "success")
+        {
+            qWarning() << "Login failed for" << client->login << ":" << frame["message"].toString();
+            failSetup(client);
+            break;
+        }
+        client->state = ClientState::WaitingForChat;
+        if (++loggedInClients + setupFailures == clients.size())
+        {
+            openChats();
+        }
+        break;
+    case ClientState::OpeningChat:
+    {
+        VirtualClient *peer = clients[client->index ^ 1];
+        if (frame["status"].toString() != "success")
+        {
+            failSetup(client);
+            failSetup(peer);
+            break;
+        }
+        client->chatId = frame["chat_id"].toString();
+        peer->chatId = client->chatId;
+        client->state = ClientState::Ready;
+        peer->state = ClientState::Ready;
+        readyClients.append(client);
+        readyClients.append(peer);
+        startMeasuringIfReady();
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Открывает личные чаты для всех авторизованных пар клиентов.
+ *
+ * Чат создаётся только после регистрации обоих собеседников, иначе сервер добавит
+ * в новый чат лишь одного участника.
+ */
+void LoadGenerator::openChats()
+{
+    QTextStream(stdout) << loggedInClients << " clients logged in, opening chats\n";
+    for (int i = 0; i + 1 < clients.size(); i += 2)
+    {
+        VirtualClient *client = clients[i];
+        VirtualClient *peer = clients[i + 1];
+        if (client->state != ClientState::WaitingForChat || peer->state != ClientState::WaitingForChat)
+        {
+            continue;
+        }
+        client->state = ClientState::OpeningChat;
+        QJsonObject request;
+        request["type"] = "get_or_create_chat";
+        request["login1"] = client->login;
+        request["login2"] = peer->login;
+        sendRequest(client, request);
+    }
+    startMeasuringIfReady();
+}
+
+/**
+ * @brief Помечает клиента как не прошедшего подготовку.
+ *
+ * @param client Виртуальный клиент.
+ */
+void LoadGenerator::failSetup(VirtualClient *client)
+{
+    if (client->state == ClientState::Ready || client->failed)
+    {
+        return;
+    }
+    bool wasLoggedIn = client->state == ClientState::WaitingForChat || client->state == ClientState::OpeningChat;
+    client->failed = true;
+    client->pendingType.clear();
+    setupFailures++;
+    if (wasLoggedIn)
+    {
+        loggedInClients--;
+    }
+    else if (loggedInClients + setupFailures == clients.size() && measureStartNs < 0)
+    {
+        openChats();
+    }
+    startMeasuringIfReady();
+}
+
+/**
+ * @brief Запускает фазу измерения, если подготовка всех клиентов завершена.
+ */
+void LoadGenerator::startMeasuringIfReady()
+{
+    if (measureStartNs >= 0 || readyClients.size() + setupFailures < clients.size())
+    {
+        return;
+    }
+
+    if (readyClients.isEmpty())
+    {
+        QTextStream(stderr) << "No clients completed setup\n";
+        emit finished();
+        return;
+    }
+
+    QTextStream(stdout) << readyClients.size() << " clients ready (" << setupFailures
+                        << " failed), measuring for " << config.durationSec << " s\n";
+    measureStartNs = clock.nsecsElapsed();
+    lastTickNs = measureStartNs;
+    tickTimer.start(10);
+    reportTimer.start(5000);
+    QTimer::singleShot(config.durationSec * 1000, this, [this]()
+                       {
+                           tickTimer.stop();
+                           reportTimer.stop();
+                           expireTimedOutRequests();
+                           printReport(true);
+                           emit finished();
+                       });
+}
+
+/**
+ * @brief Выполняет очередной шаг планировщика запросов.
+ *
+ * Начисляет запросы пропорционально прошедшему времени и раздаёт их случайным
+ * свободным клиентам. Если свободного клиента найти не удалось, запрос пропускается
+ * и учитывается в отчёте, так как это признак насыщения сервера.
+ */
+void LoadGenerator::onTick()
+{
+    qint64 nowNs = clock.nsecsElapsed();
+    requestCredit += config.requestRate * double(nowNs - lastTickNs) / 1e9;
+    lastTickNs = nowNs;
+
+    while (requestCredit >= 1.0 && !readyClients.isEmpty())
+    {
+        requestCredit -= 1.0;
+        VirtualClient *idleClient = nullptr;
+        for (int attempt = 0; attempt < 8 && !idleClient; ++attempt)
+        {
+            VirtualClient *candidate = readyClients[random.bounded(readyClients.size())];
+            if (candidate->pendingType.isEmpty())
+            {
+                idleClient = candidate;
+            }
+        }
+
+        if (!idleClient)
+        {
+            skippedTicks++;
+            continue;
+        }
+        issueRandomRequest(idleClient);
+    }
+}
+
+/**
+ * @brief Отправляет клиенту случайный запрос из смеси нагрузки.
+ *
+ * @param client Виртуальный клиент.
+ */
+void LoadGenerator::issueRandomRequest(VirtualClient *client)
+{
+    int pick = random.bounded(totalMixWeight);
+    QString type;
+    for (const auto &entry : config.mix)
+    {
+        if (pick < entry.second)
+        {
+            type = entry.first;
+            break;
+        }
+        pick -= entry.second;
+    }
+
+    QJsonObject request;
+    request["type"] = type;
+    if (type == "send_message")
+    {
+        quint64 seq = nextMessageSeq++;
+        request["chat_id"] = client->chatId;
+        request["user_id"] = client->login;
+        request["message_text"] = messageMarkerPrefix + QString::number(seq);
+        request["timestamp"] = QDateTime::currentDateTime().toString(Qt::ISODateWithMs);
+        pushSentAt.insert(seq, clock.nsecsElapsed());
+    }
+    else if (type == "get_chat_list")
+    {
+        request["login"] = client->login;
+    }
+    else if (type == "get_chat_history")
+    {
+        request["chat_id"] = client->chatId;
+        request["login"] = client->login;
+    }
+    else if (type == "find_users")
+    {
+        request["searchText"] = config.searchText;
+        request["login"] = client->login;
+    }
+
+    issuedRequests++;
+    sendRequest(client, request);
+}
+
+/**
+ * @brief Помечает просроченные запросы как потерянные.
+ *
+ * Сервер не отвечает на часть ошибочных запросов (например, при сбое вставки сообщения),
+ * поэтому без тайм-аута такой клиент навсегда остался бы занятым.
+ */
+void LoadGenerator::expireTimedOutRequests()
+{
+    qint64 deadlineNs = clock.nsecsElapsed() - qint64(config.requestTimeoutMs) * 1000000;
+    for (VirtualClient *client : qAsConst(readyClients))
+    {
+        if (!client->pendingType.isEmpty() && client->pendingSinceNs < deadlineNs)
+        {
+            auto it = stats.find(client->pendingType);
+            if (it != stats.end())
+            {
+                it->timeouts++;
+            }
+            client->pendingType.clear();
+        }
+    }
+}
+
+/**
+ * @brief Формирует строку с перцентилями набора задержек.
+ *
+ * @param latenciesUs Задержки в микросекундах.
+ * @return Строка вида "p50=... p90=... p99=... p99.9=... max=..." в миллисекундах.
+ */
+QString LoadGenerator::formatPercentiles(QVector<qint64> latenciesUs)
+{
+    if (latenciesUs.isEmpty())
+    {
+        return "no samples";
+    }
+    std::sort(latenciesUs.begin(), latenciesUs.end());
+    auto percentile = [&latenciesUs](double p)
+    {
+        int index = qMin(latenciesUs.size() - 1, int(p * latenciesUs.size()));
+        return QString::number(latenciesUs[index] / 1000.0, 'f', 2);
+    };
+    return QString("p50=%1 p90=%2 p99=%3 p99.9=%4 max=%5 ms")
+        .arg(percentile(0.50), percentile(0.90), percentile(0.99), percentile(0.999),
+             QString::number(latenciesUs.last() / 1000.0, 'f', 2));
+}
+
+/**
+ * @brief Выводит отчёт о пропускной способности и задержках.
+ *
+ * @param isFinal Признак итогового отчёта (включает перцентили и недоставленные push-уведомления).
+ */
+void LoadGenerator::printReport(bool isFinal)
+{
+    double elapsedSec = double(clock.nsecsElapsed() - measureStartNs) / 1e9;
+    QTextStream out(stdout);
+    out << (isFinal ? "=== Final report" : "--- Progress") << " after "
+        << QString::number(elapsedSec, 'f', 1) << " s, issued " << issuedRequests
+        << " requests, skipped (no idle client) " << skippedTicks << "\n";
+
+    qint64 totalCompleted = 0;
+    for (const auto &entry : config.mix)
+    {
+        const TypeStats &typeStats = stats[entry.first];
+        totalCompleted += typeStats.latenciesUs.size();
+        out << QString("  %1: ok=%2 (%3 req/s) errors=%4 timeouts=%5")
+                   .arg(entry.first, -18)
+                   .arg(typeStats.latenciesUs.size())
+                   .arg(typeStats.latenciesUs.size() / elapsedSec, 0, 'f', 1)
+                   .arg(typeStats.errors)
+                   .arg(typeStats.timeouts);
+        if (isFinal)
+        {
+            out << "\n      " << formatPercentiles(typeStats.latenciesUs);
+        }
+        out << "\n";
+    }
+
+    out << QString("  total throughput: %1 req/s\n").arg(totalCompleted / elapsedSec, 0, 'f', 1);
+    out << QString("  chat_update push: delivered=%1").arg(pushLatenciesUs.size());
+    if (isFinal)
+    {
+        out << " undelivered=" << pushSentAt.size() << "\n      " << formatPercentiles(pushLatenciesUs);
+    }
+    out << "\n";
+    out.flush();
+}
@@ -0,0 +1,210 @@
+/**
+ * /file loadgenerator.h
+ * /brief Определение класса LoadGenerator для нагрузочного тестирования сервера.
+ */
+
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include "../common/jsonframesplitter.h"
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QJsonObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QVector>
+#include <QRandomGenerator>
+
+/**
+ * /brief Параметры нагрузочного теста.
+ */
+struct LoadConfig
+{
+    QString host = "127.0.0.1"; ///< Адрес сервера (только локальный).
+    quint16 port = 3000; ///< Порт сервера.
+    int clients = 1000; ///< Количество одновременных подключений.
+    int connectRate = 500; ///< Количество новых подключений в секунду при разгоне.
+    double requestRate = 2000.0; ///< Целевая суммарная частота запросов в секунду.
+    int durationSec = 60; ///< Длительность фазы измерения в секундах.
+    int requestTimeoutMs = 10000; ///< Время ожидания ответа, после которого запрос считается потерянным.
+    QString loginPrefix = "lg"; ///< Префикс логинов синтетических пользователей.
+    QString searchText = "New"; ///< Строка поиска для запросов find_users.
+    QVector<QPair<QString, int>> mix; ///< Веса типов запросов в смеси нагрузки.
+};
+
+/**
+ * /brief Класс LoadGenerator.
+ *
+ * Открывает заданное число TCP-подключений к локальному серверу, регистрирует и авторизует
+ * синтетических пользователей, объединяет их попарно в личные чаты и затем с заданной
+ * частотой выполняет смесь запросов send_message, get_chat_list, get_chat_history и find_users.
+ * По завершении выводит пропускную способность и перцентили задержек, в том числе задержку
+ * доставки push-уведомления chat_update от отправки сообщения до получения его собеседником.
+ */
+class LoadGenerator : public QObject
+{
+    Q_OBJECT
+
+private:
+    /**
+     * /brief Этапы жизненного цикла виртуального клиента.
+     */
+    enum class ClientState
+    {
+        Connecting,
+        Registering,
+        LoggingIn,
+        WaitingForChat,
+        OpeningChat,
+        Ready
+    };
+
+    /**
+     * /brief Состояние одного виртуального клиента.
+     */
+    struct VirtualClient
+    {
+        int index = 0; ///< Порядковый номер клиента.
+        QTcpSocket *socket = nullptr; ///< Сокет подключения к серверу.
+        QString login; ///< Логин синтетического пользователя.
+        QString peerLogin; ///< Логин собеседника по личному чату.
+        QString chatId; ///< Идентификатор личного чата с собеседником.
+        ClientState state = ClientState::Connecting; ///< Текущий этап.
+        QString pendingType; ///< Тип запроса, ожидающего ответа (пусто, если запросов нет).
+        qint64 pendingSinceNs = 0; ///< Время отправки ожидающего запроса.
+        JsonFrameSplitter splitter; ///< Разборщик входящего потока.
+        bool failed = false; ///< Признак клиента, выбывшего из теста.
+    };
+
+    /**
+     * /brief Накопленная статистика по одному типу запросов.
+     */
+    struct TypeStats
+    {
+        QVector<qint64> latenciesUs; ///< Задержки успешных запросов в микросекундах.
+        qint64 errors = 0; ///< Количество ответов со статусом error.
+        qint64 timeouts = 0; ///< Количество запросов без ответа.
+    };
+
+    LoadConfig config; ///< Параметры теста.
+    QVector<VirtualClient*> clients; ///< Все виртуальные клиенты.
+    QElapsedTimer clock; ///< Общие часы для всех измерений.
+    QTimer connectTimer; ///< Таймер постепенного открытия подключений.
+    QTimer tickTimer; ///< Таймер планировщика запросов.
+    QTimer reportTimer; ///< Таймер промежуточных отчётов.
+    QRandomGenerator random; ///< Генератор для выбора клиентов и типов запросов.
+    int nextClientToConnect = 0; ///< Номер следующего клиента для подключения.
+    int loggedInClients = 0; ///< Количество авторизованных клиентов.
+    QVector<VirtualClient*> readyClients; ///< Клиенты, прошедшие подготовку.
+    double requestCredit = 0.0; ///< Накопленная дробная часть запросов для планировщика.
+    qint64 lastTickNs = 0; ///< Время предыдущего срабатывания планировщика.
+    qint64 measureStartNs = -1; ///< Начало фазы измерения (-1, пока фаза не началась).
+    qint64 issuedRequests = 0; ///< Количество отправленных запросов в фазе измерения.
+    qint64 skippedTicks = 0; ///< Количество запросов, пропущенных из-за занятости клиентов.
+    quint64 nextMessageSeq = 0; ///< Счётчик меток отправленных сообщений.
+    int totalMixWeight = 0; ///< Сумма весов смеси запросов.
+    QHash<QString, TypeStats> stats; ///< Статистика по типам запросов.
+    QHash<quint64, qint64> pushSentAt; ///< Время отправки сообщений, ожидающих push-доставки.
+    QVector<qint64> pushLatenciesUs; ///< Задержки доставки push-уведомлений в микросекундах.
+    qint64 setupFailures = 0; ///< Количество клиентов, не прошедших подготовку.
+
+    /**
+     * /brief Открывает очередную порцию подключений.
+     */
+    void connectNextBatch();
+
+    /**
+     * /brief Отправляет запрос от имени клиента и запоминает время отправки.
+     * /param client Виртуальный клиент.
+     * /param request Объект JSON с запросом.
+     */
+    void sendRequest(VirtualClient *client, const QJsonObject &request);
+
+    /**
+     * /brief Обрабатывает один полученный клиентом JSON-объект.
+     * /param client Виртуальный клиент.
+     * /param frame Объект JSON, полученный от сервера.
+     */
+    void handleFrame(VirtualClient *client, const QJsonObject &frame);
+
+    /**
+     * /brief Переводит клиента на следующий этап подготовки.
+     * /param client Виртуальный клиент.
+     * /param frame Ответ сервера на предыдущий этап.
+     */
+    void advanceSetup(VirtualClient *client, const QJsonObject &frame);
+
+    /**
+     * /brief Открывает личные чаты для всех авторизованных пар клиентов.
+     */
+    void openChats();
+
+    /**
+     * /brief Помечает клиента как не прошедшего подготовку.
+     * /param client Виртуальный клиент.
+     */
+    void failSetup(VirtualClient *client);
+
+    /**
+     * /brief Запускает фазу измерения, если подготовка всех клиентов завершена.
+     */
+    void startMeasuringIfReady();
+
+    /**
+     * /brief Отправляет клиенту случайный запрос из смеси нагрузки.
+     * /param client Виртуальный клиент.
+     */
+    void issueRandomRequest(VirtualClient *client);
+
+    /**
+     * /brief Помечает просроченные запросы как потерянные.
+     */
+    void expireTimedOutRequests();
+
+    /**
+     * /brief Выводит итоговый или промежуточный отчёт.
+     * /param isFinal Признак итогового отчёта.
+     */
+    void printReport(bool isFinal);
+
+    /**
+     * /brief Формирует строку с перцентилями набора задержек.
+     * /param latenciesUs Задержки в микросекундах.
+     * /return Строка для отчёта.
+     */
+    static QString formatPercentiles(QVector<qint64> latenciesUs);
+
+private slots:
+    /**
+     * /brief Выполняет очередной шаг планировщика запросов.
+     */
+    void onTick();
+
+public:
+    /**
+     * /brief Конструктор класса LoadGenerator.
+     * /param config Параметры теста.
+     * /param parent Указатель на родительский объект.
+     */
+    explicit LoadGenerator(const LoadConfig &config, QObject *parent = nullptr);
+
+    /**
+     * /brief Деструктор, закрывающий все подключения.
+     */
+    ~LoadGenerator() override;
+
+    /**
+     * /brief Запускает подключение клиентов и нагрузку.
+     */
+    void start();
+
+signals:
+    /**
+     * /brief Сигнал завершения теста.
+     */
+    void finished();
+};
+
+#endif // LOADGENERATOR_H
@@ -0,0 +1,102 @@
+/**
+ * /file main.cpp
+ * /brief Точка входа консольного генератора нагрузки для сервера.
+ */
+
+#include "loadgenerator.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QHostAddress>
+#include <QTextStream>
+
+/**
+ * /brief Разбирает описание смеси запросов вида "send_message=50,get_chat_list=20".
+ * /param text Строка с описанием смеси.
+ * /param mix Результат разбора.
+ * /return Признак успешного разбора.
+ */
+static bool parseMix(const QString &text, QVector<QPair<QString, int>> &mix)
+{
+    static const QStringList supportedTypes = {"send_message", "get_chat_list", "get_chat_history", "find_users"};
+    mix.clear();
+    for (const QString &part : text.split(',', Qt::SkipEmptyParts))
+    {
+        QStringList pair = part.split('=');
+        bool ok = false;
+        int weight = pair.size() == 2 ? pair[1].toInt(&ok) : 0;
+        if (!ok || weight < 0 || !supportedTypes.contains(pair[0].trimmed()))
+        {
+            return false;
+        }
+        if (weight > 0)
+        {
+            mix.append(qMakePair(pair[0].trimmed(), weight));
+        }
+    }
+    return !mix.isEmpty();
+}
+
+/**
+ * /brief Главная функция генератора нагрузки.
+ *
+ * Разбирает параметры командной строки, проверяет, что целевой адрес локальный,
+ * и запускает тест. Для тысяч подключений может потребоваться увеличить лимит
+ * открытых файлов (ulimit -n).
+ *
+ * /param argc Количество аргументов командной строки.
+ * /param argv Массив аргументов командной строки.
+ * /return Код завершения приложения.
+ */
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("loadgen");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Multi-client load generator for ServerMessenger (localhost only).");
+    parser.addHelpOption();
+    QCommandLineOption hostOption("host", "Server address (loopback only).", "host", "127.0.0.1");
+    QCommandLineOption portOption("port", "Server port.", "port", "3000");
+    QCommandLineOption clientsOption("clients", "Number of concurrent connections.", "count", "1000");
+    QCommandLineOption connectRateOption("connect-rate", "New connections per second during ramp-up.", "rate", "500");
+    QCommandLineOption rateOption("rate", "Target total request rate per second.", "rate", "2000");
+    QCommandLineOption durationOption("duration", "Measurement duration in seconds.", "seconds", "60");
+    QCommandLineOption timeoutOption("timeout", "Request timeout in milliseconds.", "ms", "10000");
+    QCommandLineOption prefixOption("prefix", "Login prefix for synthetic users.", "prefix", "lg");
+    QCommandLineOption searchOption("search-text", "Search text for find_users requests.", "text", "New");
+    QCommandLineOption mixOption("mix", "Request mix as type=weight pairs.", "mix",
+                                 "send_message=50,get_chat_list=20,get_chat_history=20,find_users=10");
+    parser.addOptions({hostOption, portOption, clientsOption, connectRateOption, rateOption,
+                       durationOption, timeoutOption, prefixOption, searchOption, mixOption});
+    parser.process(app);
+
+    LoadConfig config;
+    config.host = parser.value(hostOption);
+    config.port = parser.value(portOption).toUShort();
+    config.clients = qMax(2, parser.value(clientsOption).toInt());
+    config.connectRate = qMax(1, parser.value(connectRateOption).toInt());
+    config.requestRate = qMax(0.0, parser.value(rateOption).toDouble());
+    config.durationSec = qMax(1, parser.value(durationOption).toInt());
+    config.requestTimeoutMs = qMax(100, parser.value(timeoutOption).toInt());
+    config.loginPrefix = parser.value(prefixOption);
+    config.searchText = parser.value(searchOption);
+
+    QTextStream err(stderr);
+    if (config.host != "localhost" && !QHostAddress(config.host).isLoopback())
+    {
+        err << "Refusing to load a non-local host: " << config.host << "\n";
+        return 1;
+    }
+    if (!parseMix(parser.value(mixOption), config.mix))
+    {
+        err << "Invalid request mix: " << parser.value(mixOption) << "\n";
+        return 1;
+    }
+
+    LoadGenerator generator(config);
+    QObject::connect(&generator, &LoadGenerator::finished, &app, &QCoreApplication::quit);
+    generator.start();
+
+    return app.exec();
+}
@@ -0,0 +1,63 @@
+/**
+ * /file main.cpp
+ * /brief Точка входа инструмента воспроизведения записанного трафика.
+ */
+
+#include "trafficreplayer.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+
+/**
+ * /brief Главная функция инструмента воспроизведения.
+ *
+ * Тестовый экземпляр сервера должен работать на копии базы данных, снятой одновременно
+ * с началом захвата, иначе запросы входа и отправки сообщений будут получать ошибки.
+ *
+ * /param argc Количество аргументов командной строки.
+ * /param argv Массив аргументов командной строки.
+ * /return Код завершения приложения.
+ */
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("replay");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Replays a ServerMessenger traffic capture against a test instance.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("capture", "Capture file written by the server (Capture/path).");
+    QCommandLineOption hostOption("host", "Test server address.", "host", "127.0.0.1");
+    QCommandLineOption portOption("port", "Test server port.", "port", "3000");
+    QCommandLineOption speedOption("speed", "Pace multiplier: 1 = original pace, N = N times faster.", "factor", "1");
+    QCommandLineOption fastOption("fast", "Replay as fast as possible, ignoring original timing.");
+    QCommandLineOption timeoutOption("timeout", "Response timeout in milliseconds.", "ms", "5000");
+    parser.addOptions({hostOption, portOption, speedOption, fastOption, timeoutOption});
+    parser.process(app);
+
+    if (parser.positionalArguments().size() != 1)
+    {
+        parser.showHelp(1);
+    }
+
+    ReplayConfig config;
+    config.capturePath = parser.positionalArguments().first();
+    config.host = parser.value(hostOption);
+    config.port = parser.value(portOption).toUShort();
+    config.speed = parser.isSet(fastOption) ? 0.0 : parser.value(speedOption).toDouble();
+    config.responseTimeoutMs = qMax(1, parser.value(timeoutOption).toInt());
+    if (!parser.isSet(fastOption) && config.speed <= 0)
+    {
+        QTextStream(stderr) << "Speed must be positive, use --fast for unpaced replay\n";
+        return 1;
+    }
+
+    TrafficReplayer replayer(config);
+    QObject::connect(&replayer, &TrafficReplayer::finished, &app, &QCoreApplication::quit);
+    if (!replayer.start())
+    {
+        return 1;
+    }
+    return app.exec();
+}
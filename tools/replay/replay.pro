@@ -0,0 +1,17 @@
+QT += core network
+QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = replay
+
+SOURCES += \
+    ../../trafficcapture.cpp \
+    main.cpp \
+    trafficreplayer.cpp
+
+HEADERS += \
+    ../../trafficcapture.h \
+    ../common/jsonframesplitter.h \
+    trafficreplayer.h
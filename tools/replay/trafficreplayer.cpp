@@ -0,0 +1,319 @@
+#include "trafficreplayer.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <algorithm>
+
+namespace
+{
+/**
+ * @brief Проверяет, что кадр отправлен сервером по своей инициативе, а не в ответ на запрос.
+ *
+ * @param type Тип кадра.
+ * @return true Если кадр является уведомлением сервера.
+ */
+bool isServerPush(const QString &type)
+{
+    return type == QLatin1String("chat_update") || type == QLatin1String("presence_update")
+            || type == QLatin1String("pending_updates") || type == QLatin1String("ping");
+}
+}
+
+/**
+ * @brief Конструктор класса TrafficReplayer.
+ *
+ * @param config Параметры воспроизведения.
+ * @param parent Указатель на родительский объект (по умолчанию nullptr).
+ */
+TrafficReplayer::TrafficReplayer(const ReplayConfig &config, QObject *parent)
+    : QObject(parent), config(config)
+{
+    schedulerTimer.setTimerType(Qt::PreciseTimer);
+    connect(&schedulerTimer, &QTimer::timeout, this, &TrafficReplayer::onSchedulerTick);
+}
+
+/**
+ * @brief Деструктор класса TrafficReplayer.
+ */
+TrafficReplayer::~TrafficReplayer()
+{
+    qDeleteAll(connections);
+}
+
+/**
+ * @brief Загружает файл захвата и запускает воспроизведение.
+ *
+ * @return true Если захват загружен.
+ * @return false Если файл захвата не удалось прочитать.
+ */
+bool TrafficReplayer::start()
+{
+    TrafficCaptureReader reader;
+    if (!reader.open(config.capturePath))
+    {
+        return false;
+    }
+
+    CapturedFrame frame;
+    while (reader.next(frame))
+    {
+        ReplayConnection *&connection = connections[frame.connectionId];
+        if (!connection)
+        {
+            connection = new ReplayConnection;
+            connection->id = frame.connectionId;
+            active.append(connection);
+        }
+        connection->frames.enqueue(frame);
+        if (!frame.closed)
+        {
+            totalFrames++;
+        }
+    }
+
+    QTextStream(stdout) << "Replaying " << totalFrames << " frames over " << connections.size()
+                        << " connections at " << (config.speed > 0 ? QString("%1x").arg(config.speed) : QString("max"))
+                        << " speed\n";
+    clock.start();
+    schedulerTimer.start(1);
+    return true;
+}
+
+/**
+ * @brief Возвращает время отправки кадра по расписанию.
+ *
+ * @param frame Кадр захвата.
+ * @return Время в наносекундах от начала воспроизведения (0 в режиме максимальной скорости).
+ */
+qint64 TrafficReplayer::dueTimeNs(const CapturedFrame &frame) const
+{
+    if (config.speed <= 0)
+    {
+        return 0;
+    }
+    return qint64(double(frame.timestampUs) * 1000.0 / config.speed);
+}
+
+/**
+ * @brief Отправляет кадры, время которых наступило, и завершает воспроизведение,
+ * когда у всех подключений не осталось кадров.
+ */
+void TrafficReplayer::onSchedulerTick()
+{
+    for (int i = 0; i < active.size();)
+    {
+        if (pump(active[i]))
+        {
+            ++i;
+        }
+        else
+        {
+            active.removeAt(i);
+        }
+    }
+
+    if (active.isEmpty())
+    {
+        schedulerTimer.stop();
+        printReport();
+        emit finished();
+    }
+}
+
+/**
+ * @brief Отправляет очередной кадр подключения.
+ *
+ * @param connection Подключение.
+ * @return true Если у подключения остались кадры или ожидающий ответ.
+ * @return false Если воспроизведение подключения завершено.
+ */
+bool TrafficReplayer::pump(ReplayConnection *connection)
+{
+    if (connection->failed)
+    {
+        return false;
+    }
+    qint64 nowNs = clock.nsecsElapsed();
+
+    if (!connection->pendingType.isEmpty())
+    {
+        if (nowNs - connection->pendingSinceNs < qint64(config.responseTimeoutMs) * 1000000)
+        {
+            return true;
+        }
+        stats[connection->pendingType].unanswered++;
+        connection->pendingType.clear();
+    }
+
+    while (!connection->frames.isEmpty())
+    {
+        const CapturedFrame &head = connection->frames.head();
+        qint64 dueNs = dueTimeNs(head);
+        if (nowNs < dueNs)
+        {
+            return true;
+        }
+
+        if (head.closed)
+        {
+            connection->frames.dequeue();
+            continue;
+        }
+
+        if (!connection->socket)
+        {
+            connection->socket = new QTcpSocket(this);
+            connection->socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+            connect(connection->socket, &QTcpSocket::connected, this, [this, connection]()
+                    {
+                        connection->connected = true;
+                        pump(connection);
+                    });
+            connect(connection->socket, &QTcpSocket::readyRead, this, [this, connection]()
+                    {
+                        onResponse(connection);
+                    });
+            connect(connection->socket, &QTcpSocket::errorOccurred, this, [this, connection](QAbstractSocket::SocketError error)
+                    {
+                        onSocketError(connection, error);
+                    });
+            connection->socket->connectToHost(config.host, config.port);
+            return true;
+        }
+        if (!connection->connected)
+        {
+            return true;
+        }
+
+        CapturedFrame frame = connection->frames.dequeue();
+        QJsonDocument document = QJsonDocument::fromJson(frame.data);
+        connection->pendingType = document.isObject() ? document.object()["type"].toString() : QString();
+        if (connection->pendingType.isEmpty())
+        {
+            connection->pendingType = "invalid";
+        }
+        connection->pendingSinceNs = nowNs;
+        if (dueNs > 0)
+        {
+            scheduleSlipUs.append((nowNs - dueNs) / 1000);
+        }
+        connection->socket->write(frame.data);
+        sentFrames++;
+        return true;
+    }
+
+    if (connection->socket)
+    {
+        connection->socket->disconnectFromHost();
+    }
+    return false;
+}
+
+/**
+ * @brief Обрабатывает данные, полученные подключением.
+ *
+ * Уведомления сервера (chat_update, presence_update, pending_updates, ping) не считаются
+ * ответом на запрос. В режиме максимальной
+ * скорости следующий кадр отправляется сразу, не дожидаясь таймера.
+ *
+ * @param connection Подключение.
+ */
+void TrafficReplayer::onResponse(ReplayConnection *connection)
+{
+    connection->splitter.append(connection->socket->readAll());
+    for (const QByteArray &frameData : connection->splitter.takeFrames())
+    {
+        QJsonObject response = QJsonDocument::fromJson(frameData).object();
+        if (isServerPush(response["type"].toString()) || connection->pendingType.isEmpty())
+        {
+            continue;
+        }
+        stats[connection->pendingType].latenciesUs.append((clock.nsecsElapsed() - connection->pendingSinceNs) / 1000);
+        connection->pendingType.clear();
+    }
+
+    if (config.speed <= 0 && connection->pendingType.isEmpty())
+    {
+        pump(connection);
+    }
+}
+
+/**
+ * @brief Обрабатывает ошибку сокета подключения.
+ *
+ * Подключение, которому отказал сервер или которое разорвалось до отправки всех кадров,
+ * завершается: ожидающий запрос считается оставшимся без ответа, оставшиеся кадры не
+ * отправляются, и планировщик при следующем срабатывании исключает подключение.
+ * Закрытие сервером уже завершённого подключения ошибкой не считается.
+ *
+ * @param connection Подключение.
+ * @param error Ошибка сокета.
+ */
+void TrafficReplayer::onSocketError(ReplayConnection *connection, QAbstractSocket::SocketError error)
+{
+    if (connection->failed || (connection->frames.isEmpty() && connection->pendingType.isEmpty()))
+    {
+        return;
+    }
+
+    QTextStream(stderr) << "Connection " << connection->id << " failed: " << connection->socket->errorString()
+                        << " (error " << int(error) << ")\n";
+    connection->failed = true;
+    failedConnections++;
+    if (!connection->pendingType.isEmpty())
+    {
+        stats[connection->pendingType].unanswered++;
+        connection->pendingType.clear();
+    }
+    connection->frames.clear();
+    connection->socket->abort();
+}
+
+/**
+ * @brief Выводит задержки по типам запросов и отставание от расписания.
+ */
+void TrafficReplayer::printReport()
+{
+    auto percentiles = [](QVector<qint64> values)
+    {
+        if (values.isEmpty())
+        {
+            return QString("no samples");
+        }
+        std::sort(values.begin(), values.end());
+        auto at = [&values](double p)
+        {
+            return QString::number(values[qMin(values.size() - 1, int(p * values.size()))] / 1000.0, 'f', 2);
+        };
+        return QString("p50=%1 p90=%2 p99=%3 max=%4 ms").arg(at(0.5), at(0.9), at(0.99),
+                                                             QString::number(values.last() / 1000.0, 'f', 2));
+    };
+
+    double elapsedSec = clock.nsecsElapsed() / 1e9;
+    QTextStream out(stdout);
+    out << "=== Replay finished in " << QString::number(elapsedSec, 'f', 2) << " s, sent "
+        << sentFrames << "/" << totalFrames << " frames ("
+        << QString::number(sentFrames / elapsedSec, 'f', 1) << " req/s)\n";
+    if (failedConnections > 0)
+    {
+        out << "  failed connections: " << failedConnections << "/" << connections.size() << "\n";
+    }
+
+    QStringList types = stats.keys();
+    types.sort();
+    for (const QString &type : types)
+    {
+        const TypeStats &typeStats = stats[type];
+        out << QString("  %1: answered=%2 unanswered=%3\n      %4\n")
+                   .arg(type, -18)
+                   .arg(typeStats.latenciesUs.size())
+                   .arg(typeStats.unanswered)
+                   .arg(percentiles(typeStats.latenciesUs));
+    }
+    if (config.speed > 0)
+    {
+        out << "  schedule slip: " << percentiles(scheduleSlipUs) << "\n";
+    }
+    out.flush();
+}
@@ -0,0 +1,145 @@
+/**
+ * /file trafficreplayer.h
+ * /brief Определение класса TrafficReplayer для воспроизведения записанного трафика.
+ */
+
+#ifndef TRAFFICREPLAYER_H
+#define TRAFFICREPLAYER_H
+
+#include "../../trafficcapture.h"
+#include "../common/jsonframesplitter.h"
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QQueue>
+#include <QHash>
+#include <QVector>
+
+/**
+ * /brief Параметры воспроизведения.
+ */
+struct ReplayConfig
+{
+    QString capturePath; ///< Путь к файлу захвата.
+    QString host = "127.0.0.1"; ///< Адрес тестового экземпляра сервера.
+    quint16 port = 3000; ///< Порт тестового экземпляра сервера.
+    double speed = 1.0; ///< Множитель скорости (0 — максимально быстро).
+    int responseTimeoutMs = 5000; ///< Время ожидания ответа, после которого запрос считается оставшимся без ответа.
+};
+
+/**
+ * /brief Класс TrafficReplayer.
+ *
+ * Повторно отправляет записанные кадры на тестовый экземпляр сервера, сохраняя разбиение
+ * по подключениям и порядок кадров внутри подключения. Кадры отправляются в исходном темпе,
+ * ускоренно в N раз или без пауз. Так как сервер разбирает каждое чтение сокета как один
+ * JSON-документ, следующий кадр подключения отправляется только после ответа на предыдущий
+ * (или по истечении тайм-аута). По завершении выводятся задержки по типам запросов.
+ */
+class TrafficReplayer : public QObject
+{
+    Q_OBJECT
+
+private:
+    /**
+     * /brief Состояние одного воспроизводимого подключения.
+     */
+    struct ReplayConnection
+    {
+        quint32 id = 0; ///< Идентификатор подключения из файла захвата.
+        QTcpSocket *socket = nullptr; ///< Сокет подключения к тестовому серверу.
+        bool connected = false; ///< Признак установленного подключения.
+        bool failed = false; ///< Признак отказа в подключении или его разрыва до окончания воспроизведения.
+        QQueue<CapturedFrame> frames; ///< Кадры, ожидающие отправки.
+        QString pendingType; ///< Тип запроса, ожидающего ответа.
+        qint64 pendingSinceNs = 0; ///< Время отправки ожидающего запроса.
+        JsonFrameSplitter splitter; ///< Разборщик ответов сервера.
+    };
+
+    /**
+     * /brief Статистика по одному типу запросов.
+     */
+    struct TypeStats
+    {
+        QVector<qint64> latenciesUs; ///< Задержки ответов в микросекундах.
+        qint64 unanswered = 0; ///< Количество запросов без ответа.
+    };
+
+    ReplayConfig config; ///< Параметры воспроизведения.
+    QHash<quint32, ReplayConnection*> connections; ///< Подключения по идентификатору из захвата.
+    QVector<ReplayConnection*> active; ///< Подключения, у которых остались кадры или ожидающий ответ.
+    QTimer schedulerTimer; ///< Таймер планировщика отправки.
+    QElapsedTimer clock; ///< Часы воспроизведения.
+    QHash<QString, TypeStats> stats; ///< Статистика по типам запросов.
+    QVector<qint64> scheduleSlipUs; ///< Отставание фактической отправки от расписания.
+    qint64 totalFrames = 0; ///< Общее количество кадров в захвате.
+    qint64 sentFrames = 0; ///< Количество отправленных кадров.
+    qint64 failedConnections = 0; ///< Количество подключений, прерванных ошибкой сокета.
+
+    /**
+     * /brief Возвращает время отправки кадра по расписанию с учётом множителя скорости.
+     * /param frame Кадр захвата.
+     * /return Время в наносекундах от начала воспроизведения.
+     */
+    qint64 dueTimeNs(const CapturedFrame &frame) const;
+
+    /**
+     * /brief Отправляет очередной кадр подключения, если его время наступило и ответ на предыдущий получен.
+     * /param connection Подключение.
+     * /return Признак того, что у подключения ещё остались кадры или ожидающий ответ.
+     */
+    bool pump(ReplayConnection *connection);
+
+    /**
+     * /brief Обрабатывает ответ сервера, полученный подключением.
+     * /param connection Подключение.
+     */
+    void onResponse(ReplayConnection *connection);
+
+    /**
+     * /brief Обрабатывает ошибку сокета подключения.
+     * /param connection Подключение.
+     * /param error Ошибка сокета.
+     */
+    void onSocketError(ReplayConnection *connection, QAbstractSocket::SocketError error);
+
+    /**
+     * /brief Выводит итоговый отчёт.
+     */
+    void printReport();
+
+private slots:
+    /**
+     * /brief Отправляет кадры, время которых наступило.
+     */
+    void onSchedulerTick();
+
+public:
+    /**
+     * /brief Конструктор класса TrafficReplayer.
+     * /param config Параметры воспроизведения.
+     * /param parent Указатель на родительский объект.
+     */
+    explicit TrafficReplayer(const ReplayConfig &config, QObject *parent = nullptr);
+
+    /**
+     * /brief Деструктор, закрывающий подключения.
+     */
+    ~TrafficReplayer() override;
+
+    /**
+     * /brief Загружает файл захвата и запускает воспроизведение.
+     * /return Признак успешной загрузки захвата.
+     */
+    bool start();
+
+signals:
+    /**
+     * /brief Сигнал завершения воспроизведения.
+     */
+    void finished();
+};
+
+#endif // TRAFFICREPLAYER_H
@@ -0,0 +1,18 @@
+#!/bin/sh
+# Создаёт самоподписанный сертификат для проверки TLS-подключений на localhost.
+# Использование: make-self-signed-cert.sh [каталог]  (по умолчанию — домашний каталог)
+# Затем в appsettings.ini:
+#   [Tls]
+#   enabled=true
+#   certificate=<каталог>/server.crt
+#   privateKey=<каталог>/server.key
+# Проверка: openssl s_client -connect 127.0.0.1:3443 -reconnect
+
+set -e
+DIR="${1:-$HOME}"
+openssl req -x509 -newkey rsa:2048 -nodes -days 365 \
+    -keyout "$DIR/server.key" -out "$DIR/server.crt" \
+    -subj "/CN=localhost" \
+    -addext "subjectAltName=DNS:localhost,IP:127.0.0.1"
+echo "Certificate: $DIR/server.crt"
+echo "Private key: $DIR/server.key"
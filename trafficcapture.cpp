@@ -0,0 +1,222 @@
+#include "trafficcapture.h"
+
+#include <QDateTime>
+#include <QtEndian>
+#include <QDebug>
+
+namespace
+{
+const QByteArray captureMagic("SMCAP"); ///< Сигнатура файла захвата.
+const char captureVersion = 1; ///< Версия формата файла захвата.
+const int flushThreshold = 64 * 1024; ///< Размер буфера, при котором записи передаются в файл.
+}
+
+/**
+ * @brief Открывает файл захвата и записывает заголовок.
+ *
+ * @param path Путь к файлу захвата.
+ * @return true Если файл открыт.
+ * @return false Если файл открыть не удалось.
+ */
+bool TrafficRecorder::open(const QString &path)
+{
+    close();
+    file.setFileName(path);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate))
+    {
+        qWarning() << "Failed to open capture file:" << path;
+        return false;
+    }
+
+    QByteArray header = captureMagic;
+    header.append(captureVersion);
+    char epoch[8];
+    qToBigEndian<qint64>(QDateTime::currentMSecsSinceEpoch(), epoch);
+    header.append(epoch, sizeof(epoch));
+    file.write(header);
+
+    clock.start();
+    lastTimestampUs = 0;
+    return true;
+}
+
+/**
+ * @brief Записывает принятый от клиента кадр.
+ *
+ * @param connectionId Идентификатор подключения.
+ * @param data Принятые байты.
+ */
+void TrafficRecorder::recordFrame(quint32 connectionId, const QByteArray &data)
+{
+    appendRecord(connectionId, false, data);
+}
+
+/**
+ * @brief Записывает событие закрытия подключения.
+ *
+ * @param connectionId Идентификатор подключения.
+ */
+void TrafficRecorder::recordClose(quint32 connectionId)
+{
+    appendRecord(connectionId, true, QByteArray());
+}
+
+/**
+ * @brief Добавляет запись в буфер и при его заполнении передаёт данные в файл.
+ *
+ * @param connectionId Идентификатор подключения.
+ * @param closed Признак события закрытия подключения.
+ * @param data Данные кадра.
+ */
+void TrafficRecorder::appendRecord(quint32 connectionId, bool closed, const QByteArray &data)
+{
+    if (!file.isOpen())
+    {
+        return;
+    }
+
+    qint64 nowUs = clock.nsecsElapsed() / 1000;
+    writeVarint(pending, (quint64(connectionId) << 1) | (closed ? 1 : 0));
+    writeVarint(pending, quint64(nowUs - lastTimestampUs));
+    lastTimestampUs = nowUs;
+    if (!closed)
+    {
+        writeVarint(pending, quint64(data.size()));
+        pending.append(data);
+    }
+
+    if (pending.size() >= flushThreshold)
+    {
+        flush();
+    }
+}
+
+/**
+ * @brief Передаёт накопленные записи в файл.
+ */
+void TrafficRecorder::flush()
+{
+    if (file.isOpen() && !pending.isEmpty())
+    {
+        file.write(pending);
+        file.flush();
+        pending.clear();
+    }
+}
+
+/**
+ * @brief Завершает захват и закрывает файл.
+ */
+void TrafficRecorder::close()
+{
+    flush();
+    if (file.isOpen())
+    {
+        file.close();
+    }
+}
+
+/**
+ * @brief Добавляет число в буфер в формате varint (по 7 бит в байте, младшие байты первыми).
+ *
+ * @param out Буфер.
+ * @param value Число.
+ */
+void TrafficRecorder::writeVarint(QByteArray &out, quint64 value)
+{
+    while (value >= 0x80)
+    {
+        out.append(char((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+/**
+ * @brief Читает число в формате varint.
+ *
+ * @param data Буфер.
+ * @param pos Позиция чтения, сдвигается за прочитанное число.
+ * @param value Прочитанное число.
+ * @return true Если число прочитано.
+ * @return false Если данные закончились или число повреждено.
+ */
+bool TrafficRecorder::readVarint(const QByteArray &data, int &pos, quint64 &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64 && pos < data.size(); shift += 7)
+    {
+        quint8 byte = quint8(data.at(pos++));
+        value |= quint64(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Открывает файл захвата и проверяет заголовок.
+ *
+ * @param path Путь к файлу захвата.
+ * @return true Если файл прочитан и заголовок корректен.
+ * @return false В противном случае.
+ */
+bool TrafficCaptureReader::open(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QFile::ReadOnly))
+    {
+        qWarning() << "Failed to open capture file:" << path;
+        return false;
+    }
+    content = file.readAll();
+
+    const int headerSize = captureMagic.size() + 1 + 8;
+    if (content.size() < headerSize || !content.startsWith(captureMagic) ||
+        content.at(captureMagic.size()) != captureVersion)
+    {
+        qWarning() << "Unsupported capture file format:" << path;
+        return false;
+    }
+    startEpochMs = qFromBigEndian<qint64>(content.constData() + captureMagic.size() + 1);
+    pos = headerSize;
+    timestampUs = 0;
+    return true;
+}
+
+/**
+ * @brief Читает следующую запись.
+ *
+ * @param frame Прочитанная запись.
+ * @return true Если запись прочитана.
+ * @return false В конце файла или при повреждённой записи.
+ */
+bool TrafficCaptureReader::next(CapturedFrame &frame)
+{
+    quint64 key = 0;
+    quint64 deltaUs = 0;
+    if (!TrafficRecorder::readVarint(content, pos, key) || !TrafficRecorder::readVarint(content, pos, deltaUs))
+    {
+        return false;
+    }
+
+    timestampUs += qint64(deltaUs);
+    frame.connectionId = quint32(key >> 1);
+    frame.closed = key & 1;
+    frame.timestampUs = timestampUs;
+    frame.data.clear();
+
+    if (!frame.closed)
+    {
+        quint64 length = 0;
+        if (!TrafficRecorder::readVarint(content, pos, length) || length > quint64(content.size() - pos))
+        {
+            return false;
+        }
+        frame.data = content.mid(pos, int(length));
+        pos += int(length);
+    }
+    return true;
+}
@@ -0,0 +1,138 @@
+/**
+ * /file trafficcapture.h
+ * /brief Определение классов TrafficRecorder и TrafficCaptureReader для записи и чтения входящего трафика.
+ */
+
+#ifndef TRAFFICCAPTURE_H
+#define TRAFFICCAPTURE_H
+
+#include <QFile>
+#include <QByteArray>
+#include <QElapsedTimer>
+
+/**
+ * /brief Одна запись файла захвата.
+ */
+struct CapturedFrame
+{
+    quint32 connectionId = 0; ///< Идентификатор подключения, присвоенный сервером.
+    qint64 timestampUs = 0; ///< Время получения относительно начала захвата в микросекундах.
+    bool closed = false; ///< Признак события закрытия подключения (кадр без данных).
+    QByteArray data; ///< Принятые от клиента байты.
+};
+
+/**
+ * /brief Класс TrafficRecorder.
+ *
+ * Записывает каждый входящий кадр запроса вместе с идентификатором подключения и временем
+ * получения в компактный двоичный файл. Формат файла:
+ * заголовок "SMCAP", байт версии, 8 байт времени начала (мс с эпохи, big-endian);
+ * далее записи из трёх varint-полей: (connectionId << 1 | признак закрытия),
+ * приращение времени в микросекундах, длина данных (только для кадров с данными), и сами данные.
+ */
+class TrafficRecorder
+{
+private:
+    QFile file; ///< Файл захвата.
+    QElapsedTimer clock; ///< Часы для отметок времени.
+    qint64 lastTimestampUs = 0; ///< Время предыдущей записи в микросекундах.
+    QByteArray pending; ///< Буфер записей, ещё не переданных в файл.
+
+    /**
+     * /brief Добавляет запись в буфер.
+     * /param connectionId Идентификатор подключения.
+     * /param closed Признак события закрытия подключения.
+     * /param data Данные кадра.
+     */
+    void appendRecord(quint32 connectionId, bool closed, const QByteArray &data);
+
+public:
+    /**
+     * /brief Открывает файл захвата и записывает заголовок.
+     * /param path Путь к файлу захвата.
+     * /return Признак успешного открытия файла.
+     */
+    bool open(const QString &path);
+
+    /**
+     * /brief Записывает принятый от клиента кадр.
+     * /param connectionId Идентификатор подключения.
+     * /param data Принятые байты.
+     */
+    void recordFrame(quint32 connectionId, const QByteArray &data);
+
+    /**
+     * /brief Записывает событие закрытия подключения.
+     * /param connectionId Идентификатор подключения.
+     */
+    void recordClose(quint32 connectionId);
+
+    /**
+     * /brief Передаёт накопленные записи в файл.
+     */
+    void flush();
+
+    /**
+     * /brief Завершает захват и закрывает файл.
+     */
+    void close();
+
+    /**
+     * /brief Проверяет, ведётся ли захват.
+     * /return Признак открытого файла захвата.
+     */
+    bool isOpen() const { return file.isOpen(); }
+
+    /**
+     * /brief Добавляет число в буфер в формате varint.
+     * /param out Буфер.
+     * /param value Число.
+     */
+    static void writeVarint(QByteArray &out, quint64 value);
+
+    /**
+     * /brief Читает число в формате varint.
+     * /param data Буфер.
+     * /param pos Позиция чтения, сдвигается за прочитанное число.
+     * /param value Прочитанное число.
+     * /return Признак успешного чтения.
+     */
+    static bool readVarint(const QByteArray &data, int &pos, quint64 &value);
+};
+
+/**
+ * /brief Класс TrafficCaptureReader.
+ *
+ * Читает файл, записанный TrafficRecorder, и восстанавливает абсолютные отметки времени кадров.
+ */
+class TrafficCaptureReader
+{
+private:
+    QByteArray content; ///< Содержимое файла захвата.
+    int pos = 0; ///< Позиция чтения.
+    qint64 timestampUs = 0; ///< Время последней прочитанной записи.
+    qint64 startEpochMs = 0; ///< Время начала захвата (мс с эпохи).
+
+public:
+    /**
+     * /brief Открывает файл захвата и проверяет заголовок.
+     * /param path Путь к файлу захвата.
+     * /return Признак успешного открытия.
+     */
+    bool open(const QString &path);
+
+    /**
+     * /brief Читает следующую запись.
+     * /param frame Прочитанная запись.
+     * /return Признак успешного чтения (false в конце файла или при повреждении).
+     */
+    bool next(CapturedFrame &frame);
+
+    /**
+     * /brief Возвращает время начала захвата.
+     * /return Миллисекунды с эпохи.
+     */
+    qint64 captureStartEpochMs() const { return startEpochMs; }
+};
+
+#endif // TRAFFICCAPTURE_H
@@ -0,0 +1,558 @@
+#include "wireprotocol.h"
+
+#include <QJsonDocument>
+#include <QJsonParseError>
+#include <QCborValue>
+#include <QCborMap>
+#include <QtEndian>
+
+namespace
+{
+/**
+ * @brief Дописывает заголовок элемента CBOR (старший тип и значение/длину).
+ *
+ * @param buffer Буфер.
+ * @param majorType Старший тип (0–7).
+ * @param value Значение или длина.
+ */
+void appendCborHead(QByteArray &buffer, quint8 majorType, quint64 value)
+{
+    char head[9];
+    int size = 1;
+    char major = char(majorType << 5);
+    if (value < 24)
+    {
+        head[0] = char(major | char(value));
+    }
+    else if (value <= 0xFF)
+    {
+        head[0] = char(major | 24);
+        head[1] = char(value);
+        size = 2;
+    }
+    else if (value <= 0xFFFF)
+    {
+        head[0] = char(major | 25);
+        qToBigEndian<quint16>(quint16(value), head + 1);
+        size = 3;
+    }
+    else if (value <= 0xFFFFFFFFull)
+    {
+        head[0] = char(major | 26);
+        qToBigEndian<quint32>(quint32(value), head + 1);
+        size = 5;
+    }
+    else
+    {
+        head[0] = char(major | 27);
+        qToBigEndian<quint64>(value, head + 1);
+        size = 9;
+    }
+    buffer.append(head, size);
+}
+
+/**
+ * @brief Дописывает управляющий символ или кавычку в виде escape-последовательности JSON.
+ *
+ * @param buffer Буфер.
+ * @param symbol Символ (меньше 0x20, кавычка или обратная косая черта).
+ */
+void appendJsonEscape(QByteArray &buffer, char symbol)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    buffer.append('\\');
+    switch (symbol)
+    {
+    case '"': buffer.append('"'); break;
+    case '\\': buffer.append('\\'); break;
+    case '\b': buffer.append('b'); break;
+    case '\f': buffer.append('f'); break;
+    case '\n': buffer.append('n'); break;
+    case '\r': buffer.append('r'); break;
+    case '\t': buffer.append('t'); break;
+    default:
+        buffer.append("u00", 3);
+        buffer.append(hexDigits[(symbol >> 4) & 0xF]);
+        buffer.append(hexDigits[symbol & 0xF]);
+        break;
+    }
+}
+
+/**
+ * @brief Возвращает очередной символ Unicode строки.
+ *
+ * Одиночные суррогаты заменяются символом U+FFFD.
+ *
+ * @param data Символы UTF-16.
+ * @param size Длина строки.
+ * @param index Позиция символа; сдвигается за суррогатную пару.
+ * @return uint Код символа.
+ */
+uint codePointAt(const QChar *data, int size, int &index)
+{
+    uint code = data[index].unicode();
+    if (QChar::isHighSurrogate(code) && index + 1 < size && data[index + 1].isLowSurrogate())
+    {
+        return QChar::surrogateToUcs4(ushort(code), data[++index].unicode());
+    }
+    return QChar::isSurrogate(code) ? 0xFFFD : code;
+}
+
+/**
+ * @brief Возвращает длину строки в UTF-8 без её преобразования.
+ *
+ * @param text Строка.
+ * @return int Длина в байтах.
+ */
+int utf8Size(const QString &text)
+{
+    const QChar *data = text.constData();
+    int size = text.size();
+    int bytes = 0;
+    for (int i = 0; i < size; ++i)
+    {
+        uint code = codePointAt(data, size, i);
+        bytes += code < 0x80 ? 1 : code < 0x800 ? 2 : code < 0x10000 ? 3 : 4;
+    }
+    return bytes;
+}
+
+/**
+ * @brief Дописывает строку в UTF-8, при необходимости экранируя её для JSON.
+ *
+ * @param buffer Буфер.
+ * @param text Строка.
+ * @param escapeJson Признак экранирования для JSON.
+ */
+void appendUtf8(QByteArray &buffer, const QString &text, bool escapeJson)
+{
+    const QChar *data = text.constData();
+    int size = text.size();
+    for (int i = 0; i < size; ++i)
+    {
+        uint code = codePointAt(data, size, i);
+        if (code < 0x80)
+        {
+            if (escapeJson && (code < 0x20 || code == '"' || code == '\\'))
+            {
+                appendJsonEscape(buffer, char(code));
+            }
+            else
+            {
+                buffer.append(char(code));
+            }
+        }
+        else if (code < 0x800)
+        {
+            buffer.append(char(0xC0 | (code >> 6)));
+            buffer.append(char(0x80 | (code & 0x3F)));
+        }
+        else if (code < 0x10000)
+        {
+            buffer.append(char(0xE0 | (code >> 12)));
+            buffer.append(char(0x80 | ((code >> 6) & 0x3F)));
+            buffer.append(char(0x80 | (code & 0x3F)));
+        }
+        else
+        {
+            buffer.append(char(0xF0 | (code >> 18)));
+            buffer.append(char(0x80 | ((code >> 12) & 0x3F)));
+            buffer.append(char(0x80 | ((code >> 6) & 0x3F)));
+            buffer.append(char(0x80 | (code & 0x3F)));
+        }
+    }
+}
+}
+
+/**
+ * @brief Кодирует сообщение в выбранной кодировке.
+ *
+ * @param message Сообщение в общей модели.
+ * @param encoding Кодировка.
+ * @return QByteArray Байтовое представление сообщения.
+ */
+QByteArray WireProtocol::encode(const QJsonObject &message, WireEncoding encoding)
+{
+    if (encoding == WireEncoding::Cbor)
+    {
+        return QCborMap::fromJsonObject(message).toCborValue().toCbor();
+    }
+    return QJsonDocument(message).toJson(QJsonDocument::Compact);
+}
+
+/**
+ * @brief Декодирует входящее сообщение.
+ *
+ * JSON-объект всегда начинается с '{', а CBOR-словарь — с байта старшего типа 5 (0xA0–0xBF),
+ * поэтому кодировка определяется однозначно по первому байту.
+ *
+ * @param data Принятые байты.
+ * @param message Декодированное сообщение.
+ * @return true Если данные содержат объект.
+ * @return false Если данные повреждены или не являются объектом.
+ */
+bool WireProtocol::decode(const QByteArray &data, QJsonObject &message)
+{
+    if (!data.isEmpty() && (quint8(data.at(0)) & 0xE0) == 0xA0)
+    {
+        QCborParserError cborError;
+        QCborValue value = QCborValue::fromCbor(data, &cborError);
+        if (cborError.error != QCborError::NoError || !value.isMap())
+        {
+            return false;
+        }
+        message = value.toMap().toJsonObject();
+        return true;
+    }
+
+    QJsonParseError parseError;
+    QJsonDocument document = QJsonDocument::fromJson(data, &parseError);
+    if (parseError.error != QJsonParseError::NoError || !document.isObject())
+    {
+        return false;
+    }
+    message = document.object();
+    return true;
+}
+
+/**
+ * @brief Определяет кодировку по имени.
+ *
+ * @param name Имя кодировки.
+ * @param encoding Найденная кодировка.
+ * @return true Если кодировка поддерживается.
+ * @return false В противном случае.
+ */
+bool WireProtocol::encodingFromName(const QString &name, WireEncoding &encoding)
+{
+    if (name == "json")
+    {
+        encoding = WireEncoding::Json;
+        return true;
+    }
+    if (name == "cbor")
+    {
+        encoding = WireEncoding::Cbor;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Возвращает имя кодировки.
+ *
+ * @param encoding Кодировка.
+ * @return QString Имя кодировки ("json" или "cbor").
+ */
+QString WireProtocol::encodingName(WireEncoding encoding)
+{
+    return encoding == WireEncoding::Cbor ? "cbor" : "json";
+}
+
+/**
+ * @brief Начинает потоковый ответ со списком.
+ *
+ * @param device Устройство для записи.
+ * @param encoding Кодировка ответа.
+ * @param header Скалярные поля ответа.
+ * @param arrayKey Имя поля со списком элементов.
+ */
+ListResponseWriter::ListResponseWriter(QIODevice *device, WireEncoding encoding, const QJsonObject &header, const QString &arrayKey)
+    : device(device), encoding(encoding)
+{
+    if (encoding == WireEncoding::Cbor)
+    {
+        cborWriter.reset(new QCborStreamWriter(device));
+        cborWriter->startMap(header.size() + 1);
+        for (auto it = header.constBegin(); it != header.constEnd(); ++it)
+        {
+            cborWriter->append(it.key());
+            QCborValue::fromJsonValue(it.value()).toCbor(*cborWriter);
+        }
+        cborWriter->append(arrayKey);
+        cborWriter->startArray();
+    }
+    else
+    {
+        //Заголовок без закрывающей скобки, к которому дописывается массив
+        QByteArray prefix = QJsonDocument(header).toJson(QJsonDocument::Compact);
+        prefix.chop(1);
+        if (!header.isEmpty())
+        {
+            prefix.append(',');
+        }
+        prefix.append('"').append(arrayKey.toUtf8()).append("\":[");
+        device->write(prefix);
+    }
+}
+
+/**
+ * @brief Деструктор, завершающий незакрытый ответ.
+ */
+ListResponseWriter::~ListResponseWriter()
+{
+    finish();
+}
+
+/**
+ * @brief Записывает очередной элемент списка.
+ *
+ * @param item Элемент списка.
+ */
+void ListResponseWriter::append(const QJsonObject &item)
+{
+    if (!device)
+    {
+        return;
+    }
+    if (cborWriter)
+    {
+        QCborMap::fromJsonObject(item).toCborValue().toCbor(*cborWriter);
+        return;
+    }
+    if (!firstItem)
+    {
+        device->putChar(',');
+    }
+    firstItem = false;
+    device->write(QJsonDocument(item).toJson(QJsonDocument::Compact));
+}
+
+/**
+ * @brief Начинает элемент, который вызывающий запишет в устройство сам.
+ *
+ * Для JSON дописывается разделитель элементов; для CBOR ничего не пишется.
+ *
+ * @return QIODevice* Устройство для записи элемента или nullptr, если ответ завершён.
+ */
+QIODevice *ListResponseWriter::beginRawItem()
+{
+    if (!device)
+    {
+        return nullptr;
+    }
+    if (!cborWriter)
+    {
+        if (!firstItem)
+        {
+            device->putChar(',');
+        }
+        firstItem = false;
+    }
+    return device;
+}
+
+/**
+ * @brief Закрывает массив и объект ответа.
+ */
+void ListResponseWriter::finish()
+{
+    if (!device)
+    {
+        return;
+    }
+    if (cborWriter)
+    {
+        cborWriter->endArray();
+        cborWriter->endMap();
+        cborWriter.reset();
+    }
+    else
+    {
+        device->write("]}");
+    }
+    device = nullptr;
+}
+
+/**
+ * @brief Записывает элемент, уже закодированный в кодировке ответа.
+ *
+ * @param item Закодированный элемент.
+ */
+void ListResponseWriter::appendEncoded(const QByteArray &item)
+{
+    QIODevice *itemDevice = beginRawItem();
+    if (itemDevice)
+    {
+        itemDevice->write(item);
+    }
+}
+
+/**
+ * @brief Очищает буфер и начинает объект ответа.
+ *
+ * Длина буфера сбрасывается без освобождения памяти, если для него вызывался reserve().
+ *
+ * @param buffer Буфер ответа.
+ * @param encoding Кодировка ответа.
+ * @param fieldCount Количество полей объекта.
+ */
+ResponseWriter::ResponseWriter(QByteArray &buffer, WireEncoding encoding, int fieldCount)
+    : buffer(buffer), encoding(encoding), remainingFields(fieldCount)
+{
+    buffer.resize(0);
+    if (encoding == WireEncoding::Cbor)
+    {
+        appendCborHead(buffer, 5, quint64(fieldCount));
+    }
+    else
+    {
+        buffer.append('{');
+    }
+}
+
+/**
+ * @brief Записывает ключ поля.
+ *
+ * @param key Ключ в UTF-8 (литерал, не требующий экранирования).
+ * @param size Длина ключа.
+ */
+void ResponseWriter::writeKey(const char *key, int size)
+{
+    Q_ASSERT(remainingFields > 0);
+    --remainingFields;
+    if (encoding == WireEncoding::Cbor)
+    {
+        appendCborHead(buffer, 3, quint64(size));
+        buffer.append(key, size);
+        return;
+    }
+    if (!firstField)
+    {
+        buffer.append(',');
+    }
+    firstField = false;
+    buffer.append('"');
+    buffer.append(key, size);
+    buffer.append("\":", 2);
+}
+
+/**
+ * @brief Записывает строковое значение, заданное в UTF-8.
+ *
+ * @param text Строка.
+ * @param size Длина строки.
+ */
+void ResponseWriter::writeText(const char *text, int size)
+{
+    if (encoding == WireEncoding::Cbor)
+    {
+        appendCborHead(buffer, 3, quint64(size));
+        buffer.append(text, size);
+        return;
+    }
+    buffer.append('"');
+    for (int i = 0; i < size; ++i)
+    {
+        uchar symbol = uchar(text[i]);
+        if (symbol < 0x20 || symbol == '"' || symbol == '\\')
+        {
+            appendJsonEscape(buffer, char(symbol));
+        }
+        else
+        {
+            buffer.append(char(symbol));
+        }
+    }
+    buffer.append('"');
+}
+
+/**
+ * @brief Записывает строковое значение.
+ *
+ * Строка перекодируется в UTF-8 прямо в буфер, без промежуточного QByteArray.
+ *
+ * @param text Строка.
+ */
+void ResponseWriter::writeString(const QString &text)
+{
+    if (encoding == WireEncoding::Cbor)
+    {
+        appendCborHead(buffer, 3, quint64(utf8Size(text)));
+        appendUtf8(buffer, text, false);
+        return;
+    }
+    buffer.append('"');
+    appendUtf8(buffer, text, true);
+    buffer.append('"');
+}
+
+/**
+ * @brief Записывает целое значение.
+ *
+ * @param value Значение.
+ */
+void ResponseWriter::writeInteger(qint64 value)
+{
+    quint64 magnitude = value < 0 ? quint64(-(value + 1)) + 1 : quint64(value);
+    if (encoding == WireEncoding::Cbor)
+    {
+        //Отрицательное число n кодируется старшим типом 1 со значением -1 - n
+        appendCborHead(buffer, value < 0 ? 1 : 0, value < 0 ? magnitude - 1 : magnitude);
+        return;
+    }
+    char digits[20];
+    int count = 0;
+    do
+    {
+        digits[count++] = char('0' + magnitude % 10);
+        magnitude /= 10;
+    }
+    while (magnitude > 0);
+    if (value < 0)
+    {
+        buffer.append('-');
+    }
+    while (count > 0)
+    {
+        buffer.append(digits[--count]);
+    }
+}
+
+/**
+ * @brief Записывает логическое значение.
+ *
+ * @param value Значение.
+ */
+void ResponseWriter::writeBool(bool value)
+{
+    if (encoding == WireEncoding::Cbor)
+    {
+        buffer.append(char(value ? 0xF5 : 0xF4));
+        return;
+    }
+    if (value)
+    {
+        buffer.append("true", 4);
+    }
+    else
+    {
+        buffer.append("false", 5);
+    }
+}
+
+/**
+ * @brief Закрывает объект.
+ *
+ * @return const QByteArray& Буфер с закодированным ответом.
+ */
+const QByteArray &ResponseWriter::finish()
+{
+    Q_ASSERT(remainingFields == 0);
+    if (encoding == WireEncoding::Json)
+    {
+        buffer.append('}');
+    }
+    return buffer;
+}
+
+/**
+ * @brief Кодирует постоянный ответ в обеих кодировках.
+ *
+ * @param response Ответ в общей модели сообщений.
+ */
+ConstantResponse::ConstantResponse(const QJsonObject &response)
+    : json(WireProtocol::encode(response, WireEncoding::Json)),
+      cbor(WireProtocol::encode(response, WireEncoding::Cbor))
+{
+}
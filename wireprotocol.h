@@ -0,0 +1,300 @@
+/**
+ * /file wireprotocol.h
+ * /brief Определение классов WireProtocol и ListResponseWriter для кодирования сообщений протокола.
+ */
+
+#ifndef WIREPROTOCOL_H
+#define WIREPROTOCOL_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QIODevice>
+#include <QCborStreamWriter>
+#include <memory>
+#include <type_traits>
+
+/**
+ * /brief Кодировка сообщений, согласованная с клиентом.
+ */
+enum class WireEncoding
+{
+    Json, ///< Текстовый JSON (по умолчанию).
+    Cbor  ///< Двоичный CBOR (RFC 7049).
+};
+
+/**
+ * /brief Класс WireProtocol.
+ *
+ * Переводит сообщения протокола между общей моделью (QJsonObject), с которой работают
+ * обработчики, и байтовым представлением в выбранной кодировке. Кодировка входящего
+ * сообщения определяется по первому байту, поэтому клиент может перейти на CBOR сразу
+ * после запроса hello, не дожидаясь ответа.
+ */
+class WireProtocol
+{
+public:
+    /**
+     * /brief Кодирует сообщение.
+     * /param message Сообщение в общей модели.
+     * /param encoding Кодировка.
+     * /return Байтовое представление сообщения.
+     */
+    static QByteArray encode(const QJsonObject &message, WireEncoding encoding);
+
+    /**
+     * /brief Декодирует входящее сообщение в общую модель.
+     * /param data Принятые байты.
+     * /param message Декодированное сообщение.
+     * /return Признак успешного декодирования объекта.
+     */
+    static bool decode(const QByteArray &data, QJsonObject &message);
+
+    /**
+     * /brief Определяет кодировку по имени из запроса hello.
+     * /param name Имя кодировки ("json" или "cbor").
+     * /param encoding Найденная кодировка.
+     * /return Признак того, что кодировка поддерживается.
+     */
+    static bool encodingFromName(const QString &name, WireEncoding &encoding);
+
+    /**
+     * /brief Возвращает имя кодировки для запроса hello.
+     * /param encoding Кодировка.
+     * /return Имя кодировки.
+     */
+    static QString encodingName(WireEncoding encoding);
+};
+
+/**
+ * /brief Класс ListResponseWriter.
+ *
+ * Записывает ответ со списком элементов (история чата, список чатов, результаты поиска)
+ * непосредственно в буфер сокета по мере чтения строк из базы данных, не собирая
+ * промежуточный QJsonArray и итоговый документ целиком.
+ */
+class ListResponseWriter
+{
+private:
+    QIODevice *device; ///< Устройство (сокет), в которое пишется ответ.
+    WireEncoding encoding; ///< Кодировка ответа.
+    std::unique_ptr<QCborStreamWriter> cborWriter; ///< Потоковый писатель CBOR (только для Cbor).
+    bool firstItem = true; ///< Признак того, что элементы ещё не записывались (для JSON-разделителей).
+
+public:
+    /**
+     * /brief Начинает ответ: записывает поля заголовка и открывает массив.
+     * /param device Устройство для записи.
+     * /param encoding Кодировка ответа.
+     * /param header Скалярные поля ответа (type, status и т. п.).
+     * /param arrayKey Имя поля со списком элементов.
+     */
+    ListResponseWriter(QIODevice *device, WireEncoding encoding, const QJsonObject &header, const QString &arrayKey);
+
+    /**
+     * /brief Деструктор, завершающий ответ, если finish() не был вызван.
+     */
+    ~ListResponseWriter();
+
+    /**
+     * /brief Записывает очередной элемент списка.
+     * /param item Элемент списка.
+     */
+    void append(const QJsonObject &item);
+
+    /**
+     * /brief Записывает элемент, уже закодированный в кодировке ответа (например, ResponseWriter).
+     * /param item Закодированный элемент.
+     */
+    void appendEncoded(const QByteArray &item);
+
+    /**
+     * /brief Начинает элемент, который вызывающий запишет в устройство сам.
+     *
+     * Элемент должен быть записан целиком в кодировке ответа до следующего вызова.
+     * Массив CBOR открыт с неопределённой длиной, поэтому готовые элементы можно
+     * дописывать в устройство напрямую.
+     *
+     * /return Устройство для записи элемента или nullptr, если ответ уже завершён.
+     */
+    QIODevice *beginRawItem();
+
+    /**
+     * /brief Возвращает кодировку ответа.
+     * /return Кодировка.
+     */
+    WireEncoding wireEncoding() const { return encoding; }
+
+    /**
+     * /brief Закрывает массив и объект ответа.
+     */
+    void finish();
+};
+
+/**
+ * /brief Класс ResponseWriter.
+ *
+ * Записывает объект ответа с заранее известным набором полей (подтверждения, элементы
+ * списков) прямо в переданный буфер, минуя QJsonObject, QJsonDocument и промежуточные
+ * QString. Ключи — строковые литералы, их длина известна при компиляции. Буфер
+ * переиспользуется между ответами (см. ServerLogic::responseBuffer()), поэтому после
+ * того как он однажды вырос до нужного размера, запись ответа не выделяет память.
+ *
+ * Поля следует писать в алфавитном порядке ключей: так же их располагает QJsonObject,
+ * и ответ совпадает побайтно с ответом, собранным через WireProtocol::encode().
+ */
+class ResponseWriter
+{
+private:
+    QByteArray &buffer; ///< Буфер ответа.
+    WireEncoding encoding; ///< Кодировка ответа.
+    int remainingFields; ///< Количество ещё не записанных полей.
+    bool firstField = true; ///< Признак того, что поля ещё не записывались (для JSON-разделителей).
+
+    /**
+     * /brief Записывает ключ поля.
+     * /param key Ключ в UTF-8.
+     * /param size Длина ключа.
+     */
+    void writeKey(const char *key, int size);
+
+    /**
+     * /brief Записывает строковое значение, заданное в UTF-8.
+     * /param text Строка.
+     * /param size Длина строки.
+     */
+    void writeText(const char *text, int size);
+
+    /**
+     * /brief Записывает строковое значение.
+     * /param text Строка.
+     */
+    void writeString(const QString &text);
+
+    /**
+     * /brief Записывает целое значение.
+     * /param value Значение.
+     */
+    void writeInteger(qint64 value);
+
+    /**
+     * /brief Записывает логическое значение.
+     * /param value Значение.
+     */
+    void writeBool(bool value);
+
+public:
+    /**
+     * /brief Очищает буфер (сохраняя выделенную память) и начинает объект.
+     * /param buffer Буфер ответа.
+     * /param encoding Кодировка ответа.
+     * /param fieldCount Количество полей объекта (нужно заголовку словаря CBOR).
+     */
+    ResponseWriter(QByteArray &buffer, WireEncoding encoding, int fieldCount);
+
+    /**
+     * /brief Записывает строковое поле.
+     * /param key Ключ.
+     * /param value Значение.
+     * /return Ссылка на писатель.
+     */
+    template<int N>
+    ResponseWriter &field(const char (&key)[N], const QString &value)
+    {
+        writeKey(key, N - 1);
+        writeString(value);
+        return *this;
+    }
+
+    /**
+     * /brief Записывает поле с постоянной строкой.
+     * /param key Ключ.
+     * /param value Строковый литерал в UTF-8.
+     * /return Ссылка на писатель.
+     */
+    template<int N, int M>
+    ResponseWriter &field(const char (&key)[N], const char (&value)[M])
+    {
+        writeKey(key, N - 1);
+        writeText(value, M - 1);
+        return *this;
+    }
+
+    /**
+     * /brief Записывает целое поле.
+     * /param key Ключ.
+     * /param value Значение.
+     * /return Ссылка на писатель.
+     */
+    template<int N>
+    ResponseWriter &field(const char (&key)[N], qint64 value)
+    {
+        writeKey(key, N - 1);
+        writeInteger(value);
+        return *this;
+    }
+
+    /**
+     * /brief Записывает целое поле.
+     * /param key Ключ.
+     * /param value Значение.
+     * /return Ссылка на писатель.
+     */
+    template<int N>
+    ResponseWriter &field(const char (&key)[N], int value)
+    {
+        return field(key, qint64(value));
+    }
+
+    /**
+     * /brief Записывает логическое поле.
+     *
+     * Перегрузка принимает только bool, чтобы указатели и целые не приводились к нему неявно.
+     *
+     * /param key Ключ.
+     * /param value Значение.
+     * /return Ссылка на писатель.
+     */
+    template<int N, typename T>
+    typename std::enable_if<std::is_same<T, bool>::value, ResponseWriter&>::type field(const char (&key)[N], T value)
+    {
+        writeKey(key, N - 1);
+        writeBool(value);
+        return *this;
+    }
+
+    /**
+     * /brief Закрывает объект.
+     * /return Буфер с закодированным ответом.
+     */
+    const QByteArray &finish();
+};
+
+/**
+ * /brief Класс ConstantResponse.
+ *
+ * Ответ, который не зависит от запроса (pong, подтверждения и ошибки с постоянным
+ * текстом). Кодируется один раз в обеих кодировках; отправка лишь увеличивает счётчик
+ * ссылок готового QByteArray. Объявляется как static const внутри обработчика.
+ */
+class ConstantResponse
+{
+private:
+    QByteArray json; ///< Ответ в JSON.
+    QByteArray cbor; ///< Ответ в CBOR.
+
+public:
+    /**
+     * /brief Кодирует ответ в обеих кодировках.
+     * /param response Ответ в общей модели сообщений.
+     */
+    explicit ConstantResponse(const QJsonObject &response);
+
+    /**
+     * /brief Возвращает ответ в указанной кодировке.
+     * /param encoding Кодировка.
+     * /return Закодированный ответ.
+     */
+    const QByteArray &encoded(WireEncoding encoding) const { return encoding == WireEncoding::Cbor ? cbor : json; }
+};
+
+#endif // WIREPROTOCOL_H